@@ -0,0 +1,319 @@
+#include "capture_governor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "capture_profile.h"
+#include "depth_quant.h"
+#include "frame_sidecar.h"
+
+using json = nlohmann::json;
+
+namespace {
+const size_t kMaxAdjustments = 1000;
+const int kMaxDivisor = 15;   // fits GCVF_GOV_DIVISOR
+
+std::string fmt_ms(double ms) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.1f ms", ms);
+  return buf;
+}
+}
+
+static const char* const kStepNames[(int)GovernorStep::Count] = { "depth_compression", "depth_precision", "rate" };
+
+const char* governor_step_name(GovernorStep s) {
+  const int i = (int)s;
+  return (i >= 0 && i < (int)GovernorStep::Count) ? kStepNames[i] : "?";
+}
+
+void CaptureGovernor::reset(const GovernorParams& p) {
+  *this = CaptureGovernor();
+  p_ = p;
+}
+
+CaptureGovernor::PathState CaptureGovernor::judge(const GovernorPath& cur, const GovernorPath& prev) const {
+  PathState st;
+  const uint64_t dropped = cur.drops > prev.drops ? cur.drops - prev.drops : 0;
+  const uint64_t calls = cur.lat_count > prev.lat_count ? cur.lat_count - prev.lat_count : 0;
+  const double mean_ms = calls ? (cur.lat_sum_ms - prev.lat_sum_ms) / (double)calls : 0.0;
+  const bool slow = cur.budget_ms > 0.0 && calls && mean_ms > cur.budget_ms;
+  if (dropped) st.why = std::to_string(dropped) + " dropped";
+  else if (cur.fill >= p_.raise_fill) st.why = "queue " + std::to_string((int)std::lround(cur.fill * 100.0)) + "% full";
+  else if (slow) st.why = "stages " + fmt_ms(mean_ms) + " > " + fmt_ms(cur.budget_ms);
+  st.hot = !st.why.empty();
+  // well below every threshold, so restoring a step does not bring the pressure straight back
+  st.calm = !dropped && cur.fill <= p_.lower_fill && !(cur.budget_ms > 0.0 && calls && mean_ms > 0.5 * cur.budget_ms);
+  return st;
+}
+
+bool CaptureGovernor::can_take(GovernorStep s) const {
+  switch (s) {
+    case GovernorStep::DepthCompression: return p_.fast_depth_compression && !fast_depth_;
+    case GovernorStep::DepthPrecision:   return p_.min_depth_bits < 23 && depth_bits_ >= 23;
+    case GovernorStep::Rate:             return rate_divisor_ < std::min(p_.max_rate_divisor, kMaxDivisor);
+    default: return false;
+  }
+}
+
+void CaptureGovernor::apply(GovernorStep s, bool lower) {
+  switch (s) {
+    case GovernorStep::DepthCompression: fast_depth_ = lower; break;
+    case GovernorStep::DepthPrecision:   depth_bits_ = lower ? std::max(1, p_.min_depth_bits) : 23; break;
+    case GovernorStep::Rate:
+      rate_divisor_ = std::max(1, rate_divisor_ + (lower ? 1 : -1));
+      due_count_[0] = due_count_[1] = 0;   // the next due frame is kept
+      break;
+    default: return;
+  }
+  if (lower) applied_.push_back(s);
+  else if (!applied_.empty()) applied_.pop_back();
+}
+
+void CaptureGovernor::record(int64_t now_us, uint64_t frame_idx, GovernorStep s, bool lowered, const std::string& why) {
+  last_change_us_ = now_us;
+  ++(lowered ? steps_down_ : steps_up_);
+  max_level_ = std::max(max_level_, level());
+  if (level() > 0 && degraded_since_us_ < 0) degraded_since_us_ = now_us;
+  if (level() == 0 && degraded_since_us_ >= 0) {
+    degraded_us_ += now_us - degraded_since_us_;
+    degraded_since_us_ = -1;
+  }
+  if (adjustments_.size() >= kMaxAdjustments) return;
+  GovernorAdjustment a;
+  a.time_us = now_us;
+  a.frame_idx = frame_idx;
+  a.step = s;
+  a.lowered = lowered;
+  a.level = level();
+  a.reason = why;
+  adjustments_.push_back(a);
+}
+
+bool CaptureGovernor::update(int64_t now_us, uint64_t frame_idx, const GovernorSample& s) {
+  if (!p_.enabled) return false;
+  last_seen_us_ = now_us;
+  if (!have_prev_) {
+    // counters start here; nothing is judged on a single reading
+    prev_ = s;
+    have_prev_ = true;
+    last_change_us_ = now_us;
+    return false;
+  }
+  const PathState c = judge(s.color, prev_.color);
+  const PathState d = judge(s.depth, prev_.depth);
+  prev_ = s;
+
+  if (c.hot || d.hot) {
+    calm_since_us_ = -1;
+    if ((double)(now_us - last_change_us_) < p_.step_interval_s * 1e6) return false;
+    GovernorStep step = GovernorStep::Count;
+    // only the depth writers behind: their own steps first, they leave color untouched
+    if (d.hot && !c.hot) {
+      if (can_take(GovernorStep::DepthCompression)) step = GovernorStep::DepthCompression;
+      else if (can_take(GovernorStep::DepthPrecision)) step = GovernorStep::DepthPrecision;
+    }
+    if (step == GovernorStep::Count && can_take(GovernorStep::Rate)) step = GovernorStep::Rate;
+    if (step == GovernorStep::Count) {
+      ++saturated_;   // at the bounds; the writers drop what they cannot take
+      last_change_us_ = now_us;
+      return false;
+    }
+    apply(step, true);
+    record(now_us, frame_idx, step, true, c.hot ? "color: " + c.why : "depth: " + d.why);
+    return true;
+  }
+  if (!(c.calm && d.calm)) {
+    calm_since_us_ = -1;
+    return false;
+  }
+  if (calm_since_us_ < 0) calm_since_us_ = now_us;
+  const double hold_us = p_.hold_s * 1e6;
+  if (applied_.empty() || (double)(now_us - calm_since_us_) < hold_us || (double)(now_us - last_change_us_) < hold_us) return false;
+  const GovernorStep step = applied_.back();
+  apply(step, false);
+  char why[64];
+  std::snprintf(why, sizeof(why), "calm for %.1f s", (double)(now_us - calm_since_us_) * 1e-6);
+  record(now_us, frame_idx, step, false, why);
+  calm_since_us_ = now_us;   // each further step back waits for another hold
+  return true;
+}
+
+uint32_t CaptureGovernor::filter_due(uint32_t due) {
+  if (rate_divisor_ <= 1) return due;
+  const CaptureStream streams[2] = { CaptureStream::Color, CaptureStream::Depth };
+  for (int i = 0; i < 2; ++i) {
+    const uint32_t bit = capture_stream_bit(streams[i]);
+    if ((due & bit) && (due_count_[i]++ % (uint64_t)rate_divisor_) != 0) due &= ~bit;
+  }
+  return due;
+}
+
+uint32_t CaptureGovernor::frame_flags() const {
+  if (applied_.empty()) return 0;
+  uint32_t f = (uint32_t)std::min(level(), 15) << kGcvfGovLevelShift;
+  if (rate_divisor_ > 1) f |= GCVF_GOV_RATE | ((uint32_t)std::min(rate_divisor_, kMaxDivisor) << kGcvfGovDivisorShift);
+  if (depth_bits_ < 23) f |= GCVF_GOV_DEPTH_BITS;
+  if (fast_depth_) f |= GCVF_GOV_DEPTH_FAST;
+  return f;
+}
+
+json CaptureGovernor::stats_json() const {
+  json j;
+  j["max_rate_divisor"] = p_.max_rate_divisor;
+  j["min_depth_bits"] = p_.min_depth_bits;
+  j["fast_depth_compression"] = p_.fast_depth_compression;
+  j["raise_fill"] = p_.raise_fill;
+  j["lower_fill"] = p_.lower_fill;
+  j["step_interval_s"] = p_.step_interval_s;
+  j["hold_s"] = p_.hold_s;
+  j["steps_down"] = steps_down_;
+  j["steps_up"] = steps_up_;
+  j["at_bounds"] = saturated_;   // readings with pressure and no step left
+  j["max_level"] = max_level_;
+  j["level_at_end"] = level();
+  const int64_t open_us = degraded_since_us_ >= 0 ? last_seen_us_ - degraded_since_us_ : 0;   // still degraded
+  j["degraded_s"] = (double)(degraded_us_ + open_us) * 1e-6;
+  json ja = json::array();
+  for (const GovernorAdjustment& a : adjustments_) {
+    json e;
+    e["time_us"] = a.time_us;
+    e["frame_idx"] = a.frame_idx;
+    e["step"] = governor_step_name(a.step);
+    e["action"] = a.lowered ? "lowered" : "restored";
+    e["level"] = a.level;
+    e["reason"] = a.reason;
+    ja.push_back(e);
+  }
+  j["adjustments"] = ja;
+  if (steps_down_ + steps_up_ > adjustments_.size()) j["adjustments_truncated"] = true;
+  return j;
+}
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+std::string run_capture_governor_tests() {
+  const int64_t s = 1000000;
+  GovernorParams p;
+  p.enabled = true;
+  p.max_rate_divisor = 3;
+  p.min_depth_bits = 12;
+  GovernorSample hot_color, hot_depth, calm, middle;
+  hot_color.color.fill = 0.9;
+  hot_depth.depth.fill = 0.8;
+  middle.color.fill = 0.3;   // between lower_fill and raise_fill
+
+  {
+    CaptureGovernor g;
+    g.reset(GovernorParams());
+    for (int i = 0; i < 10; ++i)
+      if (g.update(i * s, i, hot_color)) RETURNFAILST("governor: a disabled governor changed the quality");
+    if (g.frame_flags() != 0 || g.filter_due(0xFF) != 0xFF) RETURNFAILST("governor: a disabled governor degrades frames");
+  }
+
+  // the color side behind: the rate goes down, a step per step_interval, up to the bound
+  CaptureGovernor g;
+  g.reset(p);
+  int64_t t = 0;
+  uint64_t idx = 0;
+  g.update(t, idx, hot_color);
+  t += s / 2;
+  if (g.update(t, ++idx, hot_color)) RETURNFAILST("governor: stepped within step_interval");
+  t += s / 2;
+  if (!g.update(t, ++idx, hot_color) || g.rate_divisor() != 2 || g.level() != 1) RETURNFAILST("governor: color pressure did not lower the rate");
+  if (g.fast_depth_compression() || g.depth_bits() != 23) RETURNFAILST("governor: color pressure took a depth step");
+  const uint32_t f = g.frame_flags();
+  if (!(f & GCVF_GOV_RATE) || ((f & GCVF_GOV_DIVISOR) >> kGcvfGovDivisorShift) != 2 || ((f & GCVF_GOV_LEVEL) >> kGcvfGovLevelShift) != 1)
+    RETURNFAILST("governor: frame flags " + std::to_string(f));
+  {
+    const uint32_t cd = capture_stream_bit(CaptureStream::Color) | capture_stream_bit(CaptureStream::Depth);
+    const uint32_t pose = capture_stream_bit(CaptureStream::Pose);
+    int kept = 0;
+    for (int i = 0; i < 10; ++i) {
+      const uint32_t due = g.filter_due(cd | pose);
+      if (!(due & pose)) RETURNFAILST("governor: the rate step dropped pose");
+      kept += (due & cd) == cd;
+    }
+    if (kept != 5) RETURNFAILST("governor: divisor 2 kept " + std::to_string(kept) + " of 10 frames");
+  }
+  t += s;
+  g.update(t, ++idx, hot_color);
+  t += s;
+  if (g.update(t, ++idx, hot_color) || g.rate_divisor() != 3) RETURNFAILST("governor: went past max_rate_divisor");
+
+  // in between the thresholds: nothing changes either way
+  for (int i = 0; i < 20; ++i) {
+    t += s;
+    if (g.update(t, ++idx, middle)) RETURNFAILST("governor: moved without pressure or calm");
+  }
+  // calm: the steps come back one hold apart, last in first out
+  int restored = 0;
+  for (int i = 0; i < 20 && g.level() > 0; ++i) {
+    t += s;
+    restored += g.update(t, ++idx, calm);
+  }
+  if (restored != 2 || g.level() != 0 || g.rate_divisor() != 1 || g.frame_flags() != 0)
+    RETURNFAILST("governor: calm restored " + std::to_string(restored) + " steps, level " + std::to_string(g.level()));
+  const std::vector<GovernorAdjustment>& adj = g.adjustments();
+  if (adj.size() != 4 || !adj[0].lowered || adj[3].lowered || adj[3].level != 0 || adj[2].time_us - adj[1].time_us < (int64_t)(p.hold_s * s))
+    RETURNFAILST("governor: adjustments not recorded as made");
+
+  // only depth behind: compression, then precision, then the rate
+  g.reset(p);
+  t = 0;
+  g.update(t, 0, hot_depth);
+  const GovernorStep want[3] = { GovernorStep::DepthCompression, GovernorStep::DepthPrecision, GovernorStep::Rate };
+  for (int i = 0; i < 3; ++i) {
+    t += s;
+    if (!g.update(t, i + 1, hot_depth) || g.adjustments().back().step != want[i])
+      RETURNFAILST(std::string("governor: depth pressure did not take ") + governor_step_name(want[i]));
+  }
+  if (!g.fast_depth_compression() || g.depth_bits() != 12 || !(g.frame_flags() & GCVF_GOV_DEPTH_BITS) || !(g.frame_flags() & GCVF_GOV_DEPTH_FAST))
+    RETURNFAILST("governor: depth steps not in effect");
+
+  // drops and slow stages are pressure too
+  {
+    CaptureGovernor gd;
+    gd.reset(p);
+    GovernorSample r;
+    gd.update(0, 0, r);
+    r.color.drops = 3;
+    if (!gd.update(2 * s, 1, r) || gd.adjustments().back().reason.find("3 dropped") == std::string::npos)
+      RETURNFAILST("governor: drops were not pressure");
+    GovernorSample l = r;
+    l.color.budget_ms = 40.0;
+    gd.update(3 * s, 2, l);
+    l.color.lat_count += 10;
+    l.color.lat_sum_ms += 10 * 55.0;
+    if (!gd.update(5 * s, 3, l) || gd.rate_divisor() != 3) RETURNFAILST("governor: slow stages were not pressure");
+  }
+
+  // bounds from a profile, kept through to_json (what meta.json and the saved profiles hold)
+  {
+    std::vector<CaptureProfile> ps;
+    std::string err;
+    const char* text = "{\"profiles\": [{\"name\": \"g\", \"streams\": {\"color\": {\"rate\": 30}},"
+                       " \"governor\": {\"max_rate_divisor\": 2, \"min_depth_bits\": 16, \"hold\": 5}}]}";
+    if (!parse_capture_profiles(text, ps, err)) RETURNFAILST("governor profile: " + err);
+    const GovernorParams& gp = ps[0].governor;
+    if (!gp.enabled || gp.max_rate_divisor != 2 || gp.min_depth_bits != 16 || gp.hold_s != 5.0) RETURNFAILST("governor profile: bounds not parsed");
+    std::vector<CaptureProfile> again;
+    const nlohmann::json wrapped = { { "profiles", nlohmann::json::array({ ps[0].to_json() }) } };
+    if (!parse_capture_profiles(wrapped.dump(), again, err) || again[0].governor.min_depth_bits != 16) RETURNFAILST("governor profile: lost in to_json");
+    if (parse_capture_profiles("{\"profiles\": [{\"name\": \"b\", \"streams\": {\"color\": {}}, \"governor\": {\"min_depth_bits\": 30}}]}", again, err))
+      RETURNFAILST("governor profile: min_depth_bits 30 accepted");
+  }
+
+  {
+    float v[4] = { 1.2345678f, 1000.123f, NAN, INFINITY };
+    const float orig[2] = { v[0], v[1] };
+    truncate_depth_mantissa(v, 4, 12);
+    for (int i = 0; i < 2; ++i)
+      if (std::fabs(v[i] - orig[i]) > std::fabs(orig[i]) * std::ldexp(1.0f, -13)) RETURNFAILST("depth mantissa: error past half a kept bit");
+    if (!std::isnan(v[2]) || !std::isinf(v[3])) RETURNFAILST("depth mantissa: non-finite values changed");
+    float w = 0.1f;
+    truncate_depth_mantissa(&w, 1, 23);
+    if (w != 0.1f) RETURNFAILST("depth mantissa: 23 bits changed the value");
+  }
+  return "ok";
+}
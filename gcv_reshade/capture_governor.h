@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Capture-quality governor: when the writers fall behind (queues filling up, frames dropped, stages
+// slower than the frame interval), it lowers what a recording costs one step at a time, within
+// the profile's bounds, and takes the steps back once the pressure has been gone for a while.
+// Part of a capture profile ("governor" in capture_profiles.json, see capture_profile.h):
+//   "governor": { "mode": "auto", "max_rate_divisor": 4, "min_depth_bits": 12,
+//                 "fast_depth_compression": true, "raise_fill": 0.5, "lower_fill": 0.2,
+//                 "step_interval": 1, "hold": 3 }
+// Steps, cheapest first:
+//   depth compression  depth.gcvd frames LZ4 only, no delta coding (lossless; less CPU, more disk)
+//   depth precision    raw depth keeps min_depth_bits of its 23 mantissa bits (truncate_depth_mantissa)
+//   rate               color and depth captured at every 2nd, 3rd ... due frame, up to max_rate_divisor
+// Depth steps are taken first only when the depth writers alone are behind; when the color side is,
+// the rate goes down. Resolution is left alone: the encoders' frame size is fixed when they start.
+// Every recorded frame carries the governor's state in frames.bin (GCVF_GOV_*, frame_sidecar.h),
+// and meta.json lists the adjustments.
+
+struct GovernorParams {
+  bool enabled = false;
+  int max_rate_divisor = 4;            // 1: the rate is never lowered
+  int min_depth_bits = 12;             // mantissa bits kept (1..23); 23: depth precision is never lowered
+  bool fast_depth_compression = true;
+  double raise_fill = 0.5;             // a queue this full (0..1) is pressure
+  double lower_fill = 0.2;             // every queue below this (and no drops) is calm
+  double step_interval_s = 1.0;        // at least this long between two steps down, so a step can show
+  double hold_s = 3.0;                 // calm for this long before a step back up
+};
+
+// One pressure reading of a side of the capture path; counters are running totals
+struct GovernorPath {
+  double fill = 0.0;                   // fullest queue on the path, 0..1
+  uint64_t drops = 0;                  // frames lost so far
+  uint64_t lat_count = 0;              // timed calls of the path's stages so far
+  double lat_sum_ms = 0.0;             // and their total time
+  double budget_ms = 0.0;              // a mean call time above this is pressure (0: not checked)
+};
+
+struct GovernorSample {
+  GovernorPath color;                  // readback pipeline, conversion, color encoder
+  GovernorPath depth;                  // depth.gcvd writer, depth encoders
+};
+
+enum class GovernorStep : uint8_t { DepthCompression = 0, DepthPrecision, Rate, Count };
+const char* governor_step_name(GovernorStep s);
+
+struct GovernorAdjustment {
+  int64_t time_us = 0;
+  uint64_t frame_idx = 0;              // first frame recorded with the new state
+  GovernorStep step = GovernorStep::Rate;
+  bool lowered = false;                // false: restored
+  int level = 0;                       // steps in effect afterwards
+  std::string reason;
+};
+
+class CaptureGovernor {
+public:
+  void reset(const GovernorParams& p);
+  const GovernorParams& params() const { return p_; }
+  bool enabled() const { return p_.enabled; }
+
+  // One reading of the writers' state; true if the quality changed (applies from frame_idx on)
+  bool update(int64_t now_us, uint64_t frame_idx, const GovernorSample& s);
+  // Clears the color and depth bits of the presents the rate step skips (one call per present)
+  uint32_t filter_due(uint32_t due);
+
+  int level() const { return (int)applied_.size(); }
+  int rate_divisor() const { return rate_divisor_; }
+  int depth_bits() const { return depth_bits_; }        // 23: full precision
+  bool fast_depth_compression() const { return fast_depth_; }
+  // GCVF_GOV_* of the current state, for every frame recorded under it
+  uint32_t frame_flags() const;
+  const std::vector<GovernorAdjustment>& adjustments() const { return adjustments_; }
+  nlohmann::json stats_json() const;
+
+private:
+  struct PathState {
+    bool hot = false, calm = false;
+    std::string why;
+  };
+  PathState judge(const GovernorPath& cur, const GovernorPath& prev) const;
+  bool can_take(GovernorStep s) const;
+  void apply(GovernorStep s, bool lower);
+  void record(int64_t now_us, uint64_t frame_idx, GovernorStep s, bool lowered, const std::string& why);
+
+  GovernorParams p_;
+  bool have_prev_ = false;
+  GovernorSample prev_;
+  int64_t last_change_us_ = 0;
+  int64_t last_seen_us_ = 0;           // time of the last reading
+  int64_t calm_since_us_ = -1;         // -1: not calm
+  std::vector<GovernorStep> applied_;  // taken back last in, first out
+  int rate_divisor_ = 1;
+  int depth_bits_ = 23;
+  bool fast_depth_ = false;
+  uint64_t due_count_[2] = {};         // color, depth presents seen at the current divisor
+
+  std::vector<GovernorAdjustment> adjustments_;   // the first kMaxAdjustments
+  uint64_t steps_down_ = 0, steps_up_ = 0, saturated_ = 0;
+  int max_level_ = 0;
+  int64_t degraded_since_us_ = -1;
+  int64_t degraded_us_ = 0;            // time spent below full quality
+};
+
+// Self-test on synthetic pressure readings; "ok" or what failed (like run_utils_tests)
+std::string run_capture_governor_tests();
@@ -0,0 +1,176 @@
+#include "capture_pipeline.h"
+#include "readback_ring.h"
+
+const char* capture_stage_name(CaptureStage s) {
+  switch (s) {
+  case CaptureStage::Readback: return "readback";
+  case CaptureStage::Convert: return "convert";
+  case CaptureStage::Annotate: return "annotate";
+  case CaptureStage::Sink: return "sink";
+  default: return "?";
+  }
+}
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+namespace {
+struct TestToken {
+  uint64_t frame = 0;
+  uint64_t tex[2] = { 0, 0 };   // 0: the ring had no room for the copy
+  int copies = 0;
+  int got = 0;
+  ReadbackKey key[2];
+  std::vector<uint8_t> bytes[2];
+  uint32_t sum = 0;
+  bool annotated = false;
+  std::thread::id readback_thread;
+  std::string err;
+};
+
+struct TestRun {
+  int frames = 100;
+  CapturePipelineConfig cfg;
+  int convert_sleep_us = 0, sink_sleep_us = 0;
+  int gpu_every = 1;           // the "GPU" finishes one fence value every this many frames
+  bool off_thread = true;
+  // out
+  std::vector<uint64_t> sunk;
+  uint64_t refused = 0;
+  std::vector<CaptureStageStats> st;
+  ReadbackRingStats ring;
+  bool readback_on_render_thread = true;
+};
+}
+
+// The render thread of a recording against the mock device: per frame two texture copies behind
+// one commit and a token, or neither when the pipeline has no room; then stop() drains it all.
+static std::string run_pipe(TestRun& r) {
+  ReadbackRing ring;
+  ring.configure(2, 2 + (int)r.cfg.capacity[0] + 1);
+  auto* mock = new MockReadbackBackend();
+  mock->off_thread = r.off_thread;
+  ring.set_backend(std::unique_ptr<ReadbackBackend>(mock));
+  r.cfg.readback_on_caller = !mock->maps_off_thread();
+
+  const std::thread::id render_thread = std::this_thread::get_id();
+  bool off_render_thread = false;   // written by the readback stage, read after stop()
+  std::string err;
+  uint64_t last = 0;
+  bool any = false;
+
+  StagePipeline<TestToken> pipe;
+  pipe.start(r.cfg,
+    [&](TestToken& t, bool wait) {
+      const int n = ring.take_frame(t.frame, [&t](const ReadbackTag& tag, const ReadbackKey& key, const ReadbackMapped& m) {
+        if (tag.frame_idx != t.frame || tag.aux >= 2 || !m.data) { t.err = "readback of the wrong frame"; return; }
+        t.key[tag.aux] = key;
+        t.bytes[tag.aux].assign(m.data, m.data + (size_t)key.width * key.height * 4);
+        ++t.got;
+      }, wait);
+      if (n < 0) return false;
+      t.readback_thread = std::this_thread::get_id();
+      if (t.readback_thread != render_thread) off_render_thread = true;
+      return true;
+    },
+    [&](TestToken& t) {
+      for (int i = 0; i < 2; ++i) {
+        if (!t.tex[i]) continue;
+        if (t.key[i] != MockReadbackBackend::key_of(t.tex[i])) { t.err = "layout mix-up"; return; }
+        for (size_t j = 0; j < t.bytes[i].size(); ++j) {
+          if (t.bytes[i][j] != MockReadbackBackend::texel_of(t.tex[i], j)) { t.err = "frame " + std::to_string(t.frame) + " read before its copy finished"; return; }
+          t.sum += t.bytes[i][j];
+        }
+      }
+      if (r.convert_sleep_us) std::this_thread::sleep_for(std::chrono::microseconds(r.convert_sleep_us));
+    },
+    [](TestToken& t) { t.annotated = true; },
+    [&](TestToken& t) {
+      if (r.sink_sleep_us) std::this_thread::sleep_for(std::chrono::microseconds(r.sink_sleep_us));
+      if (!err.empty()) return;
+      if (!t.err.empty()) { err = t.err; return; }
+      if (any && t.frame <= last) { err = "tokens out of order"; return; }
+      if (t.got != t.copies || !t.annotated) { err = "frame " + std::to_string(t.frame) + " skipped a stage"; return; }
+      any = true;
+      last = t.frame;
+      r.sunk.push_back(t.frame);
+    });
+
+  for (int i = 0; i < r.frames; ++i) {
+    ring.next_frame();
+    pipe.pump();
+    if (!pipe.has_room()) {
+      ++r.refused;
+    } else {
+      std::unique_ptr<TestToken> t(new TestToken());
+      t->frame = (uint64_t)i;
+      for (uint32_t k = 0; k < 2; ++k) {
+        const uint64_t tex = ((uint64_t)(k + 1) << 32) | ((uint64_t)k << 24) | (uint64_t)(0x100 + i);
+        ReadbackTag tag;
+        tag.frame_idx = t->frame;
+        tag.aux = k;
+        if (!ring.submit(tex, tag)) continue;
+        t->tex[k] = tex;
+        ++t->copies;
+      }
+      ring.commit();   // before the token: the readback stage may wait on the fence right away
+      if (!pipe.submit(std::move(t))) return "submit refused with room";
+    }
+    if (r.gpu_every > 0 && (i % r.gpu_every) == 0) mock->tick();
+  }
+  pipe.stop();
+  r.st = pipe.stats();
+  r.ring = ring.stats();
+  r.readback_on_render_thread = !off_render_thread;
+  if (ring.in_flight() != 0) return "copies left in the ring";
+  if (mock->mapped() != 0) return "left a texture mapped";
+  return err;
+}
+
+std::string run_capture_pipeline_tests() {
+  {
+    // D3D12/Vulkan-like device: readback on a worker, every frame through every stage in order
+    TestRun r;
+    r.frames = 120;
+    const std::string err = run_pipe(r);
+    if (!err.empty()) RETURNFAILST("capture pipeline: " + err);
+    if (r.readback_on_render_thread) RETURNFAILST("capture pipeline: readback ran on the render thread");
+    if (r.sunk.size() + r.refused != (size_t)r.frames) RETURNFAILST("capture pipeline: lost frames");
+    for (const CaptureStageStats& s : r.st)
+      if (s.processed != r.sunk.size() || s.max_queued > s.capacity || s.queued != 0 || s.on_caller)
+        RETURNFAILST(std::string("capture pipeline: stage ") + s.name + " processed " + std::to_string(s.processed));
+  }
+  {
+    // slow conversion and sink: the queues fill up to their bound and the render thread is
+    // refused (frames dropped) instead of blocking
+    TestRun r;
+    r.frames = 200;
+    r.cfg.capacity[0] = 2;
+    r.cfg.capacity[1] = 1;
+    r.cfg.capacity[2] = 1;
+    r.cfg.capacity[3] = 2;
+    r.convert_sleep_us = 300;
+    r.sink_sleep_us = 1000;
+    const std::string err = run_pipe(r);
+    if (!err.empty()) RETURNFAILST("capture pipeline (slow sink): " + err);
+    if (r.refused == 0 || r.st[0].refused != r.refused) RETURNFAILST("capture pipeline (slow sink): nothing refused");
+    if (r.sunk.size() + r.refused != (size_t)r.frames) RETURNFAILST("capture pipeline (slow sink): lost frames");
+    for (const CaptureStageStats& s : r.st)
+      if (s.max_queued > s.capacity) RETURNFAILST(std::string("capture pipeline (slow sink): ") + s.name + " queue over its bound");
+    if (r.st[(int)CaptureStage::Sink].busy_mean_ms < 0.5) RETURNFAILST("capture pipeline (slow sink): sink timing off");
+  }
+  {
+    // D3D11/OpenGL-like device: the readback stage is pumped on the render thread and only takes
+    // frames whose copies are 'latency' frames old; a late GPU holds them back, never the game
+    TestRun r;
+    r.frames = 150;
+    r.off_thread = false;
+    r.gpu_every = 2;
+    const std::string err = run_pipe(r);
+    if (!err.empty()) RETURNFAILST("capture pipeline (pumped): " + err);
+    if (!r.readback_on_render_thread || !r.st[0].on_caller) RETURNFAILST("capture pipeline (pumped): readback left the render thread");
+    if (r.sunk.size() + r.refused != (size_t)r.frames) RETURNFAILST("capture pipeline (pumped): lost frames");
+    if (r.ring.latency_max_frames < 2) RETURNFAILST("capture pipeline (pumped): mapped before 'latency' frames");
+    if (r.ring.late == 0) RETURNFAILST("capture pipeline (pumped): a late GPU went unnoticed");
+  }
+  return "ok";
+}
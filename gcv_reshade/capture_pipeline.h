@@ -0,0 +1,295 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What happens to a recorded frame after the render thread issued its GPU copies, as a chain of
+// stages on worker threads: readback (wait for the copies, map, unpack) -> convert (color/depth
+// conversion into pool slots) -> annotate (frame record: sizes, flags) -> sink (recorder pushes and
+// logs). The render thread only hands over a token per frame. Every stage has a bounded queue in
+// front of it and one thread, so tokens reach the sink in the order they were submitted; a full
+// stage holds up the one before it, and a full readback queue refuses new tokens (the caller
+// counts the frame as dropped) instead of blocking the game.
+//
+// Where mapping a staging texture has to stay on the render thread (D3D11's immediate context,
+// OpenGL), the readback stage runs there instead: pump() once per present.
+
+enum class CaptureStage : uint8_t { Readback = 0, Convert, Annotate, Sink, Count };
+static const int kCaptureStages = (int)CaptureStage::Count;
+const char* capture_stage_name(CaptureStage s);
+
+struct CaptureStageStats {
+  const char* name = "";
+  size_t capacity = 0;
+  size_t queued = 0;           // right now
+  size_t max_queued = 0;
+  uint64_t processed = 0;
+  uint64_t refused = 0;        // readback only: frames turned away with the queue full
+  double busy_mean_ms = 0.0;   // time in the stage function per token
+  double busy_max_ms = 0.0;
+  double wait_mean_ms = 0.0;   // time queued in front of the stage
+  double wait_max_ms = 0.0;
+  bool on_caller = false;      // runs on the render thread (pump)
+};
+
+struct CapturePipelineConfig {
+  size_t capacity[kCaptureStages] = { 6, 4, 4, 8 };   // tokens queued in front of each stage
+  bool readback_on_caller = false;
+};
+
+template<class Token>
+class StagePipeline {
+public:
+  using Ptr = std::unique_ptr<Token>;
+  // true once the token's readbacks are in; wait=false (pump) may answer "not yet" with false
+  using ReadbackFn = std::function<bool(Token& t, bool wait)>;
+  using StageFn = std::function<void(Token& t)>;
+
+  StagePipeline() = default;
+  ~StagePipeline() { stop(); }
+  StagePipeline(const StagePipeline&) = delete;
+  StagePipeline& operator=(const StagePipeline&) = delete;
+
+  void start(const CapturePipelineConfig& cfg, ReadbackFn readback, StageFn convert, StageFn annotate, StageFn sink) {
+    stop();
+    cfg_ = cfg;
+    readback_ = std::move(readback);
+    fns_[(int)CaptureStage::Convert] = std::move(convert);
+    fns_[(int)CaptureStage::Annotate] = std::move(annotate);
+    fns_[(int)CaptureStage::Sink] = std::move(sink);
+    for (int i = 0; i < kCaptureStages; ++i) {
+      Lane& l = lanes_[i];
+      std::lock_guard<std::mutex> lk(l.mtx);
+      l.q.clear();
+      l.closed = false;
+      l.cap = cfg_.capacity[i] ? cfg_.capacity[i] : 1;
+      l.st = Counters();
+    }
+    {
+      std::lock_guard<std::mutex> lk(done_mtx_);
+      submitted_ = done_ = 0;
+    }
+    running_ = true;
+    for (int i = cfg_.readback_on_caller ? 1 : 0; i < kCaptureStages; ++i) lanes_[i].th = std::thread([this, i] { run(i); });
+  }
+  bool running() const { return running_; }
+  bool readback_on_caller() const { return cfg_.readback_on_caller; }
+
+  // Caller (single producer), before issuing a frame's copies: whether submit() will take its
+  // token; false counts the frame as refused
+  bool has_room() {
+    Lane& l = lanes_[0];
+    std::lock_guard<std::mutex> lk(l.mtx);
+    if (running_ && !l.closed && l.q.size() < l.cap) return true;
+    ++l.st.refused;
+    return false;
+  }
+  // Caller: queues the token for readback; false (token dropped) if the queue is full
+  bool submit(Ptr t) {
+    Lane& l = lanes_[0];
+    {
+      std::lock_guard<std::mutex> lk(l.mtx);
+      if (!running_ || l.closed || l.q.size() >= l.cap) {
+        ++l.st.refused;
+        return false;
+      }
+      l.q.push_back(Item{ std::move(t), now_us() });
+      l.st.max_queued = std::max(l.st.max_queued, l.q.size());
+    }
+    {
+      std::lock_guard<std::mutex> lk(done_mtx_);
+      ++submitted_;
+    }
+    l.cv.notify_all();
+    return true;
+  }
+  // Caller, readback_on_caller only: runs the readback stage for the tokens whose copies are in
+  // (oldest first) while the convert stage has room; returns how many went on
+  size_t pump() {
+    if (!running_ || !cfg_.readback_on_caller) return 0;
+    size_t n = 0;
+    while (take_on_caller(false)) ++n;
+    return n;
+  }
+  // Caller: blocks until every token submitted so far went through the sink
+  void drain() {
+    if (!running_) return;
+    if (cfg_.readback_on_caller) {
+      while (take_on_caller(true)) {}
+    }
+    std::unique_lock<std::mutex> lk(done_mtx_);
+    done_cv_.wait(lk, [this] { return done_ == submitted_; });
+  }
+  // Drains, then joins the stage threads
+  void stop() {
+    if (!running_) return;
+    drain();
+    for (int i = 0; i < kCaptureStages; ++i) {
+      Lane& l = lanes_[i];
+      {
+        std::lock_guard<std::mutex> lk(l.mtx);
+        l.closed = true;
+      }
+      l.cv.notify_all();
+    }
+    for (int i = 0; i < kCaptureStages; ++i)
+      if (lanes_[i].th.joinable()) lanes_[i].th.join();
+    running_ = false;
+  }
+
+  std::vector<CaptureStageStats> stats() {
+    std::vector<CaptureStageStats> out;
+    for (int i = 0; i < kCaptureStages; ++i) {
+      Lane& l = lanes_[i];
+      std::lock_guard<std::mutex> lk(l.mtx);
+      CaptureStageStats s;
+      s.name = capture_stage_name((CaptureStage)i);
+      s.capacity = l.cap;
+      s.queued = l.q.size();
+      s.max_queued = l.st.max_queued;
+      s.processed = l.st.processed;
+      s.refused = l.st.refused;
+      s.busy_mean_ms = l.st.processed ? (double)l.st.busy_us_sum / (double)l.st.processed / 1000.0 : 0.0;
+      s.busy_max_ms = (double)l.st.busy_us_max / 1000.0;
+      s.wait_mean_ms = l.st.processed ? (double)l.st.wait_us_sum / (double)l.st.processed / 1000.0 : 0.0;
+      s.wait_max_ms = (double)l.st.wait_us_max / 1000.0;
+      s.on_caller = i == 0 && cfg_.readback_on_caller;
+      out.push_back(s);
+    }
+    return out;
+  }
+
+private:
+  struct Item {
+    Ptr t;
+    int64_t queued_us = 0;
+  };
+  struct Counters {
+    size_t max_queued = 0;
+    uint64_t processed = 0, refused = 0;
+    uint64_t busy_us_sum = 0, busy_us_max = 0, wait_us_sum = 0, wait_us_max = 0;
+  };
+  struct Lane {
+    std::mutex mtx;
+    std::condition_variable cv;   // items arrived / room freed / closed
+    std::deque<Item> q;
+    size_t cap = 1;
+    bool closed = false;
+    Counters st;
+    std::thread th;
+  };
+
+  static int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void account(Lane& l, int64_t queued_us, int64_t start_us, int64_t end_us) {
+    std::lock_guard<std::mutex> lk(l.mtx);
+    const uint64_t wait = (uint64_t)std::max<int64_t>(0, start_us - queued_us), busy = (uint64_t)std::max<int64_t>(0, end_us - start_us);
+    ++l.st.processed;
+    l.st.wait_us_sum += wait;
+    l.st.wait_us_max = std::max(l.st.wait_us_max, wait);
+    l.st.busy_us_sum += busy;
+    l.st.busy_us_max = std::max(l.st.busy_us_max, busy);
+  }
+
+  // into the next stage's queue, waiting for room (that stage drains even while closing)
+  void pass_on(int next, Item&& it) {
+    if (next >= kCaptureStages) {
+      it.t.reset();
+      {
+        std::lock_guard<std::mutex> lk(done_mtx_);
+        ++done_;
+      }
+      done_cv_.notify_all();
+      return;
+    }
+    Lane& l = lanes_[next];
+    {
+      std::unique_lock<std::mutex> lk(l.mtx);
+      l.cv.wait(lk, [&] { return l.q.size() < l.cap; });
+      it.queued_us = now_us();
+      l.q.push_back(std::move(it));
+      l.st.max_queued = std::max(l.st.max_queued, l.q.size());
+    }
+    l.cv.notify_all();
+  }
+
+  bool run_stage(int i, Token& t, bool wait) {
+    if (i == 0) return !readback_ || readback_(t, wait);
+    if (fns_[i]) fns_[i](t);
+    return true;
+  }
+
+  void run(int i) {
+    Lane& l = lanes_[i];
+    for (;;) {
+      Item it;
+      {
+        std::unique_lock<std::mutex> lk(l.mtx);
+        l.cv.wait(lk, [&] { return !l.q.empty() || l.closed; });
+        if (l.q.empty()) return;   // closed and drained
+        it = std::move(l.q.front());
+        l.q.pop_front();
+      }
+      l.cv.notify_all();   // room for the stage before
+      const int64_t t0 = now_us();
+      run_stage(i, *it.t, true);
+      account(l, it.queued_us, t0, now_us());
+      pass_on(i + 1, std::move(it));
+    }
+  }
+
+  // the readback stage on the caller's thread: the oldest token, if it is ready (or wait) and the
+  // convert stage has room
+  bool take_on_caller(bool wait) {
+    Lane& l = lanes_[0];
+    {
+      Lane& next = lanes_[1];
+      std::lock_guard<std::mutex> lk(next.mtx);
+      if (!wait && next.q.size() >= next.cap) return false;
+    }
+    Token* t = nullptr;
+    int64_t queued_us = 0;
+    {
+      std::lock_guard<std::mutex> lk(l.mtx);
+      if (l.q.empty()) return false;
+      t = l.q.front().t.get();
+      queued_us = l.q.front().queued_us;
+    }
+    // only the caller takes from this queue and submit() appends: the front stays where it is
+    const int64_t t0 = now_us();
+    if (!run_stage(0, *t, wait)) return false;
+    const int64_t t1 = now_us();
+    Item it;
+    {
+      std::lock_guard<std::mutex> lk(l.mtx);
+      it = std::move(l.q.front());
+      l.q.pop_front();
+    }
+    account(l, queued_us, t0, t1);
+    pass_on(1, std::move(it));
+    return true;
+  }
+
+  CapturePipelineConfig cfg_;
+  ReadbackFn readback_;
+  StageFn fns_[kCaptureStages];
+  Lane lanes_[kCaptureStages];
+  bool running_ = false;
+  std::mutex done_mtx_;
+  std::condition_variable done_cv_;
+  uint64_t submitted_ = 0, done_ = 0;
+};
+
+// Pipeline self-test: a mock device (readback_ring.h) behind the readback stage, slow stages, a
+// full pipeline refusing tokens, and the pumped readback; "ok" or what failed
+std::string run_capture_pipeline_tests();
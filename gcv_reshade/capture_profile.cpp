@@ -0,0 +1,406 @@
+#include "capture_profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using json = nlohmann::json;
+
+static const char* const kStreamNames[kCaptureStreams] = { "color", "depth", "pose", "actions", "segmentation" };
+
+const char* capture_stream_name(CaptureStream s) {
+  const int i = (int)s;
+  return (i >= 0 && i < kCaptureStreams) ? kStreamNames[i] : "?";
+}
+
+int CaptureProfile::fps(CaptureStream s) const {
+  return std::max(1, (int)std::lround(stream(s).rate_hz));
+}
+
+bool CaptureProfile::depth_per_frame_files() const {
+  const std::string& sink = stream(CaptureStream::Depth).sink;
+  return has(CaptureStream::Depth) && (sink == "files" || sink == "npy" || sink == "gcvz");
+}
+
+json CaptureProfile::to_json() const {
+  json j;
+  j["name"] = name;
+  j["hotkey"] = capture_hotkey_name(hotkey_vk);
+  json js = json::object();
+  for (int i = 0; i < kCaptureStreams; ++i) {
+    const StreamProfile& s = streams[i];
+    if (!s.enabled) continue;
+    json e;
+    e["rate"] = s.rate_hz;
+    if (s.scale != 1) e["scale"] = s.scale;
+    if (!s.format.empty()) e["format"] = s.format;
+    e["sink"] = s.sink;
+    js[kStreamNames[i]] = e;
+  }
+  j["streams"] = js;
+  if (trigger.enabled) {
+    json t;
+    t["mode"] = "motion";
+    t["translation"] = trigger.translation;
+    t["rotation_deg"] = trigger.rotation_deg;
+    t["fov_deg"] = trigger.fov_deg;
+    t["min_interval"] = trigger.min_interval_s;
+    t["max_interval"] = trigger.max_interval_s;
+    json ts = json::array();
+    for (int i = 0; i < kCaptureStreams; ++i)
+      if (trigger.streams & (1u << i)) ts.push_back(kStreamNames[i]);
+    t["streams"] = ts;
+    j["trigger"] = t;
+  }
+  if (governor.enabled) {
+    json g;
+    g["mode"] = "auto";
+    g["max_rate_divisor"] = governor.max_rate_divisor;
+    g["min_depth_bits"] = governor.min_depth_bits;
+    g["fast_depth_compression"] = governor.fast_depth_compression;
+    g["raise_fill"] = governor.raise_fill;
+    g["lower_fill"] = governor.lower_fill;
+    g["step_interval"] = governor.step_interval_s;
+    g["hold"] = governor.hold_s;
+    j["governor"] = g;
+  }
+  return j;
+}
+
+static StreamProfile make_stream(double rate, const char* sink, const char* format = "") {
+  StreamProfile s;
+  s.enabled = true;
+  s.rate_hz = rate;
+  s.sink = sink;
+  s.format = format;
+  return s;
+}
+
+std::vector<CaptureProfile> builtin_capture_profiles() {
+  std::vector<CaptureProfile> out(2);
+  CaptureProfile& f9 = out[0];
+  f9.name = "F9";
+  f9.hotkey_vk = capture_hotkey_from_name("F9");
+  f9.streams[(int)CaptureStream::Color] = make_stream(1.0, "video");
+  f9.streams[(int)CaptureStream::Depth] = make_stream(1.0, "files", "f32");
+  f9.streams[(int)CaptureStream::Pose]  = make_stream(1.0, "jsonl");
+  CaptureProfile& f7 = out[1];
+  f7.name = "F7";
+  f7.hotkey_vk = capture_hotkey_from_name("F7");
+  f7.streams[(int)CaptureStream::Color]   = make_stream(24.0, "video");
+  f7.streams[(int)CaptureStream::Depth]   = make_stream(24.0, "gcvd", "f32");
+  f7.streams[(int)CaptureStream::Pose]    = make_stream(24.0, "jsonl");
+  f7.streams[(int)CaptureStream::Actions] = make_stream(24.0, "csv");
+  // F9 with frames taken by camera motion instead of once a second
+  CaptureProfile f6 = f9;
+  f6.name = "F6 motion";
+  f6.hotkey_vk = capture_hotkey_from_name("F6");
+  f6.trigger.enabled = true;
+  f6.trigger.streams = capture_stream_bit(CaptureStream::Color) | capture_stream_bit(CaptureStream::Depth) |
+                       capture_stream_bit(CaptureStream::Pose);
+  out.push_back(f6);
+  return out;
+}
+
+int capture_hotkey_from_name(const std::string& name) {
+  if (name.size() == 1) {
+    const char c = (char)std::toupper((unsigned char)name[0]);
+    if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) return (int)c;   // VK codes of letters/digits are their ASCII codes
+    return 0;
+  }
+  if (name.size() >= 2 && (name[0] == 'F' || name[0] == 'f')) {
+    int n = 0;
+    for (size_t i = 1; i < name.size(); ++i) {
+      if (name[i] < '0' || name[i] > '9') return 0;
+      n = n * 10 + (name[i] - '0');
+    }
+    if (n >= 1 && n <= 24) return 0x70 + n - 1;   // VK_F1..VK_F24
+  }
+  return 0;
+}
+
+std::string capture_hotkey_name(int vk) {
+  if ((vk >= 'A' && vk <= 'Z') || (vk >= '0' && vk <= '9')) return std::string(1, (char)vk);
+  if (vk >= 0x70 && vk <= 0x87) return "F" + std::to_string(vk - 0x70 + 1);
+  return "";
+}
+
+static bool one_of(const std::string& v, std::initializer_list<const char*> allowed) {
+  for (const char* a : allowed) if (v == a) return true;
+  return false;
+}
+
+// fills s from e (stream 'i' of a profile); false with err set if something is not supported
+static bool parse_stream(int i, const json& e, double default_rate, StreamProfile& s, std::string& err) {
+  const std::string what = std::string("stream '") + kStreamNames[i] + "': ";
+  if (!e.is_object()) { err = what + "expected an object"; return false; }
+  s = StreamProfile();
+  s.enabled = e.value("enabled", true);
+  s.rate_hz = e.value("rate", default_rate);
+  s.scale = e.value("scale", 1);
+  s.format = e.value("format", std::string());
+  s.sink = e.value("sink", std::string());
+  if (!(s.rate_hz > 0.0 && s.rate_hz <= 1000.0)) { err = what + "rate must be in (0, 1000]"; return false; }
+  if (s.scale != 1 && s.scale != 2 && s.scale != 4) { err = what + "scale must be 1, 2 or 4"; return false; }
+  switch ((CaptureStream)i) {
+    case CaptureStream::Color:
+      if (s.sink.empty()) s.sink = "video";
+      if (!one_of(s.sink, { "video" })) { err = what + "sink must be \"video\""; return false; }
+      if (!one_of(s.format, { "", "i420", "nv12", "bgra" })) { err = what + "format must be i420, nv12 or bgra"; return false; }
+      break;
+    case CaptureStream::Depth:
+      if (s.sink.empty()) s.sink = "gcvd";
+      if (!one_of(s.sink, { "gcvd", "video", "files", "npy", "gcvz" })) { err = what + "sink must be gcvd, video, files, npy or gcvz"; return false; }
+      if (s.format.empty()) s.format = s.sink == "video" ? "gray8" : "f32";
+      if (s.format != (s.sink == "video" ? "gray8" : "f32")) { err = what + "format must be gray8 for the video sink, f32 otherwise"; return false; }
+      if (s.scale != 1 && !one_of(s.sink, { "gcvd", "video" })) { err = what + "scale is only supported by the gcvd and video sinks"; return false; }
+      break;
+    case CaptureStream::Pose:
+      if (s.sink.empty()) s.sink = "jsonl";
+      if (!one_of(s.sink, { "jsonl", "json_files" })) { err = what + "sink must be jsonl or json_files"; return false; }
+      break;
+    case CaptureStream::Actions:
+      if (s.sink.empty()) s.sink = "csv";
+      if (!one_of(s.sink, { "csv" })) { err = what + "sink must be \"csv\""; return false; }
+      break;
+    case CaptureStream::Segmentation:
+      if (s.sink.empty()) s.sink = "snapshot";
+      if (!one_of(s.sink, { "snapshot" })) { err = what + "sink must be \"snapshot\""; return false; }
+      break;
+    default:
+      break;
+  }
+  return true;
+}
+
+static bool parse_trigger(const json& e, const CaptureProfile& p, MotionTriggerParams& t, std::string& err) {
+  if (!e.is_object()) { err = "trigger: expected an object"; return false; }
+  t = MotionTriggerParams();
+  const std::string mode = e.value("mode", std::string("motion"));
+  if (mode == "off") return true;
+  if (mode != "motion") { err = "trigger: mode must be \"motion\" or \"off\""; return false; }
+  t.enabled = true;
+  t.translation = e.value("translation", t.translation);
+  t.rotation_deg = e.value("rotation_deg", t.rotation_deg);
+  t.fov_deg = e.value("fov_deg", t.fov_deg);
+  t.min_interval_s = e.value("min_interval", t.min_interval_s);
+  t.max_interval_s = e.value("max_interval", t.max_interval_s);
+  if (t.translation <= 0.0 && t.rotation_deg <= 0.0 && t.fov_deg <= 0.0) { err = "trigger: needs a translation, rotation_deg or fov_deg threshold"; return false; }
+  if (!(t.min_interval_s >= 0.0)) { err = "trigger: min_interval must be >= 0"; return false; }
+  if (t.max_interval_s > 0.0 && t.max_interval_s < t.min_interval_s) { err = "trigger: max_interval is below min_interval"; return false; }
+  if (e.contains("streams")) {
+    const json& ts = e["streams"];
+    if (!ts.is_array()) { err = "trigger: \"streams\" must be a list of stream names"; return false; }
+    for (const json& n : ts) {
+      const std::string name = n.is_string() ? n.get<std::string>() : std::string();
+      const int i = (int)(std::find(kStreamNames, kStreamNames + kCaptureStreams, name) - kStreamNames);
+      if (i == kCaptureStreams) { err = "trigger: unknown stream '" + name + "'"; return false; }
+      t.streams |= 1u << i;
+    }
+  } else {
+    // key presses are about the player, not the view; they keep their own rate
+    for (int i = 0; i < kCaptureStreams; ++i)
+      if (i != (int)CaptureStream::Actions && p.streams[i].enabled) t.streams |= 1u << i;
+  }
+  bool any = false;
+  for (int i = 0; i < kCaptureStreams; ++i) any |= ((t.streams >> i) & 1u) && p.streams[i].enabled;
+  if (!any) { err = "trigger: none of its streams are enabled"; return false; }
+  return true;
+}
+
+static bool parse_governor(const json& e, GovernorParams& g, std::string& err) {
+  if (!e.is_object()) { err = "governor: expected an object"; return false; }
+  g = GovernorParams();
+  const std::string mode = e.value("mode", std::string("auto"));
+  if (mode == "off") return true;
+  if (mode != "auto") { err = "governor: mode must be \"auto\" or \"off\""; return false; }
+  g.enabled = true;
+  g.max_rate_divisor = e.value("max_rate_divisor", g.max_rate_divisor);
+  g.min_depth_bits = e.value("min_depth_bits", g.min_depth_bits);
+  g.fast_depth_compression = e.value("fast_depth_compression", g.fast_depth_compression);
+  g.raise_fill = e.value("raise_fill", g.raise_fill);
+  g.lower_fill = e.value("lower_fill", g.lower_fill);
+  g.step_interval_s = e.value("step_interval", g.step_interval_s);
+  g.hold_s = e.value("hold", g.hold_s);
+  if (g.max_rate_divisor < 1 || g.max_rate_divisor > 15) { err = "governor: max_rate_divisor must be 1..15"; return false; }
+  if (g.min_depth_bits < 1 || g.min_depth_bits > 23) { err = "governor: min_depth_bits must be 1..23"; return false; }
+  if (!(g.lower_fill >= 0.0 && g.lower_fill < g.raise_fill && g.raise_fill <= 1.0)) { err = "governor: needs 0 <= lower_fill < raise_fill <= 1"; return false; }
+  if (!(g.step_interval_s >= 0.0) || !(g.hold_s >= 0.0)) { err = "governor: step_interval and hold must be >= 0"; return false; }
+  return true;
+}
+
+bool parse_capture_profiles(const std::string& json_text, std::vector<CaptureProfile>& out, std::string& err) {
+  json root;
+  try {
+    root = json::parse(json_text);
+  } catch (const std::exception& e) {
+    err = std::string("capture profiles: ") + e.what();
+    return false;
+  }
+  const json& list = root.is_object() ? root.value("profiles", json()) : root;
+  if (!list.is_array()) {
+    err = "capture profiles: expected {\"profiles\": [...]}";
+    return false;
+  }
+  std::vector<CaptureProfile> parsed;
+  for (const json& jp : list) {
+    CaptureProfile p;
+    if (!jp.is_object()) { err = "capture profiles: each profile must be an object"; return false; }
+    p.name = jp.value("name", std::string());
+    const std::string ctx = "capture profile '" + p.name + "': ";
+    if (p.name.empty()) { err = "capture profiles: a profile has no name"; return false; }
+    const std::string hotkey = jp.value("hotkey", std::string());
+    p.hotkey_vk = capture_hotkey_from_name(hotkey);
+    if (!hotkey.empty() && !p.hotkey_vk) { err = ctx + "unknown hotkey \"" + hotkey + "\" (F1..F24, A..Z, 0..9)"; return false; }
+    // Ctrl+F8/F10 stop a recording, F11 takes a snapshot
+    if (p.hotkey_vk == 0x77 || p.hotkey_vk == 0x79 || p.hotkey_vk == 0x7A) { err = ctx + "F8, F10 and F11 are taken"; return false; }
+    const double default_rate = jp.value("rate", 1.0);
+    const json streams = jp.value("streams", json::object());
+    if (!streams.is_object()) { err = ctx + "\"streams\" must be an object"; return false; }
+    for (auto it = streams.begin(); it != streams.end(); ++it) {
+      const int i = (int)(std::find(kStreamNames, kStreamNames + kCaptureStreams, it.key()) - kStreamNames);
+      if (i == kCaptureStreams) { err = ctx + "unknown stream '" + it.key() + "'"; return false; }
+      if (!parse_stream(i, it.value(), default_rate, p.streams[i], err)) { err = ctx + err; return false; }
+    }
+    bool any = false;
+    for (const StreamProfile& s : p.streams) any |= s.enabled;
+    if (!any) { err = ctx + "no streams"; return false; }
+    if (jp.contains("trigger") && !parse_trigger(jp["trigger"], p, p.trigger, err)) { err = ctx + err; return false; }
+    if (jp.contains("governor") && !parse_governor(jp["governor"], p.governor, err)) { err = ctx + err; return false; }
+    for (const CaptureProfile& q : parsed) {
+      if (q.name == p.name) { err = ctx + "duplicate name"; return false; }
+      if (p.hotkey_vk && q.hotkey_vk == p.hotkey_vk) { err = ctx + "hotkey already used by '" + q.name + "'"; return false; }
+    }
+    parsed.push_back(p);
+  }
+  out.insert(out.end(), parsed.begin(), parsed.end());
+  return true;
+}
+
+bool load_capture_profiles(const std::string& path, std::vector<CaptureProfile>& out, std::string& err) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    err = "capture profiles: cannot open " + path;
+    return false;
+  }
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  return parse_capture_profiles(ss.str(), out, err);
+}
+
+bool save_capture_profiles(const std::string& path, const std::vector<CaptureProfile>& profiles) {
+  json list = json::array();
+  for (const CaptureProfile& p : profiles) list.push_back(p.to_json());
+  json root;
+  root["profiles"] = list;
+  std::ofstream ofs(path, std::ios::binary);
+  ofs << root.dump(2) << "\n";
+  return (bool)ofs;
+}
+
+//=================================================================================================
+// scheduler
+
+void CaptureScheduler::reset(const CaptureProfile& p, int64_t t0_us) {
+  t0_us_ = t0_us;
+  last_present_us_ = 0;
+  frame_interval_us_ = 0.0;
+  for (int i = 0; i < kCaptureStreams; ++i) {
+    Lane& l = lanes_[i];
+    l = Lane();
+    l.on = p.streams[i].enabled && p.streams[i].rate_hz > 0.0 && !p.triggered((CaptureStream)i);
+    l.period_us = l.on ? 1e6 / p.streams[i].rate_hz : 0.0;
+  }
+}
+
+uint32_t CaptureScheduler::tick(int64_t now_us) {
+  if (last_present_us_) {
+    const double dt = (double)(now_us - last_present_us_);
+    // a pause (loading screen, debugger) would throw the average off for many frames
+    if (dt > 0.0 && dt < 1e6) frame_interval_us_ = frame_interval_us_ > 0.0 ? frame_interval_us_ + (dt - frame_interval_us_) / 8.0 : dt;
+  }
+  last_present_us_ = now_us;
+  // due times up to half a frame from now are closer to this present than to the next one
+  const double horizon = (double)(now_us - t0_us_) + 0.5 * frame_interval_us_;
+  uint32_t mask = 0;
+  for (int i = 0; i < kCaptureStreams; ++i) {
+    Lane& l = lanes_[i];
+    if (!l.on || horizon < (double)l.slot * l.period_us) continue;
+    // the newest slot within reach; older ones that are also due were missed
+    const uint64_t latest = std::max(l.slot, (uint64_t)std::floor(horizon / l.period_us));
+    const double err = std::fabs((double)(now_us - t0_us_) - (double)latest * l.period_us);
+    l.st.missed += latest - l.slot;
+    l.slot = latest + 1;
+    ++l.st.fired;
+    l.err_sum_us += err;
+    l.st.mean_abs_err_us = l.err_sum_us / (double)l.st.fired;
+    l.st.max_abs_err_us = std::max(l.st.max_abs_err_us, err);
+    mask |= 1u << i;
+  }
+  return mask;
+}
+
+json CaptureScheduler::stats_json() const {
+  json j = json::object();
+  for (int i = 0; i < kCaptureStreams; ++i) {
+    const Lane& l = lanes_[i];
+    if (!l.on) continue;
+    json s;
+    s["fired"] = l.st.fired;
+    s["missed"] = l.st.missed;
+    s["mean_abs_err_us"] = l.st.mean_abs_err_us;
+    s["max_abs_err_us"] = l.st.max_abs_err_us;
+    j[kStreamNames[i]] = s;
+  }
+  j["frame_interval_us"] = frame_interval_us_;
+  return j;
+}
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+std::string run_capture_scheduler_tests() {
+  CaptureProfile p;
+  p.streams[(int)CaptureStream::Color] = make_stream(24.0, "video");
+  p.streams[(int)CaptureStream::Depth] = make_stream(8.0, "gcvd", "f32");
+  p.streams[(int)CaptureStream::Actions] = make_stream(60.0, "csv");
+  p.streams[(int)CaptureStream::Segmentation] = make_stream(0.5, "snapshot");
+
+  // 10 s of presents at ~144 Hz with +-1 ms of jitter
+  CaptureScheduler s;
+  const int64_t t0 = 5000000;
+  s.reset(p, t0);
+  uint32_t seed = 12345u;
+  int64_t t = t0;
+  const int64_t frame_us = 6944;
+  uint64_t color_naive_err = 0;
+  int64_t naive_due = t0;
+  while (t <= t0 + 10000000) {
+    s.tick(t);
+    // what "first present at or after the due time" would do
+    if (t >= naive_due) { color_naive_err += (uint64_t)(t - naive_due); naive_due += 1000000 / 24; }
+    seed = seed * 1664525u + 1013904223u;
+    t += frame_us + (int64_t)(seed >> 21) % 2001 - 1000;
+  }
+  const struct { CaptureStream s; uint64_t expect; } counts[] = {
+    { CaptureStream::Color, 241 }, { CaptureStream::Depth, 81 }, { CaptureStream::Actions, 601 }, { CaptureStream::Segmentation, 6 } };
+  for (const auto& c : counts) {
+    const CaptureScheduler::StreamStats& st = s.stats(c.s);
+    const int64_t diff = (int64_t)st.fired - (int64_t)c.expect;
+    if (diff < -1 || diff > 1) RETURNFAILST(std::string("scheduler: ") + capture_stream_name(c.s) + " fired " + std::to_string(st.fired) + " times, expected " + std::to_string(c.expect));
+    if (st.missed) RETURNFAILST(std::string("scheduler: ") + capture_stream_name(c.s) + " missed slots at 144 Hz");
+    if (st.max_abs_err_us > 0.5 * frame_us + 2100.0) RETURNFAILST(std::string("scheduler: ") + capture_stream_name(c.s) + " max error " + std::to_string(st.max_abs_err_us) + " us");
+  }
+  const double naive_mean = (double)color_naive_err / 241.0;
+  if (!(s.stats(CaptureStream::Color).mean_abs_err_us < naive_mean)) RETURNFAILST("scheduler: not more accurate than firing at the first present after the due time");
+
+  // 20 fps presents: a 30 Hz stream fires on every present and counts what it could not take
+  CaptureProfile fast = p;
+  fast.streams[(int)CaptureStream::Color].rate_hz = 30.0;
+  s.reset(fast, 0);
+  for (int k = 0; k <= 100; ++k) s.tick((int64_t)k * 50000);
+  const CaptureScheduler::StreamStats& st = s.stats(CaptureStream::Color);
+  if (st.fired != 101) RETURNFAILST("scheduler: 30 Hz stream at 20 fps should fire on every present, fired " + std::to_string(st.fired));
+  if (st.missed < 45 || st.missed > 55) RETURNFAILST("scheduler: 30 Hz stream at 20 fps missed " + std::to_string(st.missed) + " slots, expected ~50");
+  return std::string("ok");
+}
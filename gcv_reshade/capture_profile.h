@@ -0,0 +1,112 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "capture_governor.h"
+#include "motion_trigger.h"
+
+// Capture profiles: what a recording captures, per stream, at which rate. Loaded from
+// capture_profiles.json in the output directory (the built-in F9/F7 profiles otherwise):
+//   { "profiles": [ { "name": "F7", "hotkey": "F7", "streams": {
+//       "color":   { "rate": 24, "format": "i420", "sink": "video", "scale": 1 },
+//       "depth":   { "rate": 8,  "format": "f32",  "sink": "gcvd" },
+//       "pose":    { "rate": 24, "sink": "jsonl" },
+//       "actions": { "rate": 60, "sink": "csv" } } } ] }
+// A stream that is left out is not captured. Per stream:
+//   rate   captures per second (default: the profile's "rate", else 1)
+//   scale  resolution divisor, 1 (native), 2 or 4; color and the gcvd/video depth sinks
+//   format color: "i420", "nv12", "bgra" ("" = the overlay setting); depth: "f32" (raw float) or "gray8"
+//   sink   color: "video" (capture.mp4, or segments)
+//          depth: "gcvd" (depth.gcvd + depth16.mkv), "video" (gray8 depth.mp4),
+//                 "files" (per-frame .npy or .gcvz, as set in the overlay), "npy", "gcvz"
+//          pose: "jsonl" (cam.jsonl), "json_files" (also frame_XXXXXX_camera.json)
+//          actions: "csv" (actions.csv)
+//          segmentation: "snapshot" (semantic segmentation snapshot files in the recording directory)
+// Pose and keys of every captured frame also go to frames.bin; streams that were not due at a
+// frame are flagged there (GCVF_NO_COLOR, ...).
+// A profile can drive streams by camera motion instead of their rate with a "trigger" block
+// (motion_trigger.h); "streams" in it defaults to every stream but actions.
+// A "governor" block lets it lower its rate and depth precision while the writers fall behind
+// (capture_governor.h).
+
+enum class CaptureStream : int { Color = 0, Depth, Pose, Actions, Segmentation, Count };
+static const int kCaptureStreams = (int)CaptureStream::Count;
+const char* capture_stream_name(CaptureStream s);
+inline uint32_t capture_stream_bit(CaptureStream s) { return 1u << (int)s; }
+
+struct StreamProfile {
+  bool enabled = false;
+  double rate_hz = 1.0;
+  int scale = 1;
+  std::string format;
+  std::string sink;
+};
+
+struct CaptureProfile {
+  std::string name;
+  int hotkey_vk = 0;           // virtual key, pressed together with Ctrl; 0: no hotkey
+  StreamProfile streams[kCaptureStreams];
+  MotionTriggerParams trigger;
+  GovernorParams governor;
+
+  const StreamProfile& stream(CaptureStream s) const { return streams[(int)s]; }
+  bool has(CaptureStream s) const { return streams[(int)s].enabled; }
+  // Captured when the motion trigger fires rather than at its rate
+  bool triggered(CaptureStream s) const { return trigger.enabled && (trigger.streams & (1u << (int)s)) && has(s); }
+  // Rate of a stream as an encoder frame rate (at least 1)
+  int fps(CaptureStream s) const;
+  // Depth written as per-frame files (the old F9 mode) rather than as a sequence
+  bool depth_per_frame_files() const;
+  nlohmann::json to_json() const;
+};
+
+// F9: 1 fps color video, per-frame depth files, pose. F7: 24 fps color, depth.gcvd, pose, keys.
+// F6: F9's streams, captured by the motion trigger.
+std::vector<CaptureProfile> builtin_capture_profiles();
+// Appends the profiles in json_text to out; false (and why in err) if any of them is invalid
+bool parse_capture_profiles(const std::string& json_text, std::vector<CaptureProfile>& out, std::string& err);
+bool load_capture_profiles(const std::string& path, std::vector<CaptureProfile>& out, std::string& err);
+bool save_capture_profiles(const std::string& path, const std::vector<CaptureProfile>& profiles);
+// "F1".."F24", "A".."Z", "0".."9" -> virtual key code (0 if unknown), and back
+int capture_hotkey_from_name(const std::string& name);
+std::string capture_hotkey_name(int vk);
+
+// Decides at each present which streams are due. Stream s is due at t0 + k / rate_s; it fires at
+// the present closest to that time (a present is expected one average frame interval after the
+// last one), so the error stays within half a frame instead of up to a whole one. Due times are
+// computed from t0, so they do not drift; a stream that falls more than a period behind skips the
+// slots it missed instead of firing on every present to catch up.
+class CaptureScheduler {
+public:
+  struct StreamStats {
+    uint64_t fired = 0;
+    uint64_t missed = 0;       // slots skipped because the frame rate was below the stream's rate
+    double mean_abs_err_us = 0.0;
+    double max_abs_err_us = 0.0;
+  };
+
+  // Streams driven by the profile's motion trigger are left out
+  void reset(const CaptureProfile& p, int64_t t0_us);
+  // Bitmask of capture_stream_bit() of the streams due at this present
+  uint32_t tick(int64_t now_us);
+  const StreamStats& stats(CaptureStream s) const { return lanes_[(int)s].st; }
+  double frame_interval_us() const { return frame_interval_us_; }
+  nlohmann::json stats_json() const;
+
+private:
+  struct Lane {
+    bool on = false;
+    double period_us = 0.0;
+    uint64_t slot = 0;         // next due slot
+    double err_sum_us = 0.0;
+    StreamStats st;
+  };
+  Lane lanes_[kCaptureStreams];
+  int64_t t0_us_ = 0;
+  int64_t last_present_us_ = 0;
+  double frame_interval_us_ = 0.0;   // running average of the present interval
+};
+
+// Self-test of the scheduler on synthetic present timings; "ok" or what failed (like run_utils_tests)
+std::string run_capture_scheduler_tests();
@@ -0,0 +1,548 @@
+#include "capture_replay.h"
+#include "capture_profile.h"
+#include "depth_quant.h"
+#include "frame_bus.h"
+#include "readback_ring.h"
+#include "gcv_utils/yuv_convert.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <thread>
+
+namespace {
+
+// reshade::api::format values (the DXGI ones) the replay converts; others are read back only
+bool format_is_bgra8(uint32_t f) { return f == 87 || f == 88 || (f >= 90 && f <= 93); }
+bool format_is_rgba8(uint32_t f) { return f >= 27 && f <= 32; }
+bool format_is_float32(uint32_t f) { return f == 40 || f == 41; }   // d32_float, r32_float
+
+// The traced textures on a "GPU" that finishes every fence gpu_us after its signal. Texture
+// handles are (position in the trace << 20) | (texture index + 1). Staging rows are 256-byte
+// aligned like D3D12 readback buffers, so the readback side has to honour row_pitch.
+class TraceReadbackBackend : public ReadbackBackend {
+public:
+  TraceReadbackBackend(const CaptureTrace& t, int gpu_us, bool off_thread) : t_(t), gpu_(std::chrono::microseconds(gpu_us)), off_thread_(off_thread) {}
+
+  static uint64_t handle(size_t frame_pos, size_t tex) { return ((uint64_t)frame_pos << 20) | (uint64_t)(tex + 1); }
+
+  bool describe(uint64_t tex, ReadbackKey& key) override {
+    const CaptureTraceTexture* src = texture(tex);
+    if (!src) return false;
+    key = src->key;
+    return true;
+  }
+  bool create_staging(const ReadbackKey& key, uint64_t& staging) override {
+    std::lock_guard<std::mutex> lk(mtx_);
+    Staging s;
+    s.key = key;
+    staging_.push_back(std::move(s));
+    staging = staging_.size();
+    return true;
+  }
+  void destroy_staging(uint64_t staging) override {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (staging && staging <= staging_.size()) staging_[staging - 1] = Staging();
+  }
+  bool copy(uint64_t tex, uint64_t staging) override {
+    if (!texture(tex)) return false;
+    std::lock_guard<std::mutex> lk(mtx_);
+    unsignalled_.emplace_back(staging, tex);
+    return true;
+  }
+  bool create_fence() override { return true; }
+  void destroy_fence() override {}
+  bool signal(uint64_t value) override {
+    std::lock_guard<std::mutex> lk(mtx_);
+    Fence f;
+    f.value = value;
+    f.due = std::chrono::steady_clock::now() + gpu_;
+    f.copies.swap(unsignalled_);
+    fences_.push_back(std::move(f));
+    return true;
+  }
+  uint64_t completed() const override {
+    std::lock_guard<std::mutex> lk(mtx_);
+    land_locked(std::chrono::steady_clock::now());
+    return done_;
+  }
+  bool wait(uint64_t value, uint64_t timeout_ms) override {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (;;) {
+      std::chrono::steady_clock::time_point next;
+      {
+        std::lock_guard<std::mutex> lk(mtx_);
+        const auto now = std::chrono::steady_clock::now();
+        land_locked(now);
+        if (done_ >= value) return true;
+        if (fences_.empty() || now >= deadline) return false;
+        next = std::min(fences_.front().due, deadline);
+      }
+      std::this_thread::sleep_until(next);
+    }
+  }
+  bool map(uint64_t staging, ReadbackMapped& out) override {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (staging == 0 || staging > staging_.size() || staging_[staging - 1].bytes.empty()) return false;
+    out.data = staging_[staging - 1].bytes.data();
+    out.row_pitch = staging_[staging - 1].pitch;
+    return true;
+  }
+  void unmap(uint64_t) override {}
+  bool maps_off_thread() const override { return off_thread_; }
+
+  const CaptureTraceTexture* texture(uint64_t tex) const {
+    const size_t pos = (size_t)(tex >> 20), i = (size_t)(tex & 0xFFFFF);
+    if (pos >= t_.frames.size() || i == 0 || i > t_.frames[pos].textures.size()) return nullptr;
+    return &t_.frames[pos].textures[i - 1];
+  }
+
+private:
+  struct Staging {
+    ReadbackKey key;
+    std::vector<uint8_t> bytes;
+    uint32_t pitch = 0;
+  };
+  struct Fence {
+    uint64_t value = 0;
+    std::chrono::steady_clock::time_point due;
+    std::vector<std::pair<uint64_t, uint64_t>> copies;   // staging, texture
+  };
+  // the fences due by now are done: their copies land in the staging textures
+  void land_locked(std::chrono::steady_clock::time_point now) const {
+    while (!fences_.empty() && fences_.front().due <= now) {
+      for (const auto& c : fences_.front().copies) {
+        const CaptureTraceTexture* src = texture(c.second);
+        if (!src || c.first == 0 || c.first > staging_.size()) continue;
+        Staging& s = staging_[c.first - 1];
+        s.pitch = (src->row_bytes + 255u) & ~255u;
+        s.bytes.resize((size_t)s.pitch * src->key.height);
+        for (uint32_t y = 0; y < src->key.height; ++y)
+          std::memcpy(s.bytes.data() + (size_t)y * s.pitch, src->bytes.data() + (size_t)y * src->row_bytes, src->row_bytes);
+      }
+      done_ = fences_.front().value;
+      fences_.pop_front();
+    }
+  }
+
+  const CaptureTrace& t_;
+  const std::chrono::steady_clock::duration gpu_;
+  const bool off_thread_;
+  mutable std::mutex mtx_;
+  mutable std::vector<Staging> staging_;
+  mutable std::deque<Fence> fences_;
+  mutable uint64_t done_ = 0;
+  std::vector<std::pair<uint64_t, uint64_t>> unsignalled_;
+};
+
+// The recorder as far as the stages see it: its frame pool and histograms, a FrameBus whose
+// stand-in encoders consume color, depth video and depth16 the way the Recorder publishes them,
+// and frames.bin reduced to counters. Sink stage only (and the caller's thread after stop()).
+class ReplayOutput : public CaptureOutput {
+public:
+  ReplayOutput(const CaptureTrace& t, const CaptureReplayConfig& cfg, CaptureLatency& lat, uint64_t frames)
+    : t_(t), pool_(std::max<size_t>(cfg.pool_slots, 2)), lat_(lat), submit_ns_(frames, 0) {
+    bus_.set_latency(&lat[LatencyStage::QueueWait], &lat[LatencyStage::EncodeWrite]);
+    color_ = new MockFrameSink("color", cfg.encoder_us);
+    ids_[0] = bus_.add_sink(BusTopic::Color, std::unique_ptr<FrameSink>(color_), cfg.encoder_capacity, cfg.encoder_policy);
+    ids_[1] = bus_.add_sink(BusTopic::Depth, std::unique_ptr<FrameSink>(new MockFrameSink("depth", cfg.encoder_us)), cfg.encoder_capacity, cfg.encoder_policy);
+    ids_[2] = bus_.add_sink(BusTopic::Depth16, std::unique_ptr<FrameSink>(new MockFrameSink("depth16", cfg.encoder_us)), cfg.encoder_capacity, cfg.encoder_policy);
+  }
+
+  FramePool& frame_pool() override { return pool_; }
+  CaptureLatency& latency() override { return lat_; }
+  bool push_color(FrameRef&& frame) override { return frame && bus_.publish(BusTopic::Color, frame); }
+  void refuse_color() override {}   // counted by the replay loop
+  uint32_t color_repeat_run() const override { return 0; }
+  void push_depth(FrameRef&& frame) override {
+    if (frame && bus_.publish(BusTopic::Depth, frame)) depth_idx_ = frame.frame_idx() + 1;
+  }
+  // like Recorder::push_depth16; depth.gcvd is not written
+  void push_raw_depth(const float* data, int w, int h, uint64_t frame_idx, int64_t timestamp_us) override {
+    depth_idx_ = frame_idx + 1;
+    FrameRef f = pool_.acquire((size_t)w * (size_t)h * sizeof(uint16_t));
+    if (!f) return;
+    f.set_geometry(w, h, (size_t)w * sizeof(uint16_t), FrameFormat::Gray16);
+    f.set_stamp(frame_idx, timestamp_us);
+    quantize_depth16(data, (size_t)w * (size_t)h, depth16_, reinterpret_cast<uint16_t*>(f.data()));
+    bus_.publish(BusTopic::Depth16, f);
+  }
+  uint32_t depth_repeat_run() const override { return 0; }
+  void log_camera(uint64_t, int64_t, const CamMatrixData*, const std::string&, int, int) override {}
+  void log_frame(const GcvFrameRecord& r) override {
+    const CaptureTraceFrame& src = t_.frames[(size_t)(r.frame_idx % t_.frames.size())];
+    bool has_depth = false;
+    for (const CaptureTraceTexture& tex : src.textures) has_depth |= tex.stream == (uint32_t)CaptureStream::Depth;
+    const bool color_dropped = (r.flags & GCVF_COLOR_DROPPED) != 0;
+    const bool depth_missing = has_depth && depth_idx_ != r.frame_idx + 1;
+    color_dropped_ += color_dropped;
+    depth_missing_ += depth_missing;
+    depth_dropped_ += depth_missing && (r.flags & GCVF_DEPTH_DROPPED);
+    degraded_ += color_dropped || depth_missing;
+    ++logged_;
+    if (r.frame_idx < submit_ns_.size() && submit_ns_[r.frame_idx]) end_to_end_.record_since(submit_ns_[r.frame_idx]);
+  }
+
+  // render thread, before the frame's token is submitted
+  void submitted(uint64_t frame_idx) { if (frame_idx < submit_ns_.size()) submit_ns_[frame_idx] = LatencyHistogram::now(); }
+  // after the pipeline has stopped
+  void finish(CaptureReplayResult& r) {
+    bus_.close();
+    for (int id : ids_) {
+      const FrameBusSinkStats s = bus_.stats(id);
+      r.published += s.published;
+      r.encoded += s.consumed;
+      r.encoder_dropped += s.dropped;
+    }
+    r.color_checksum = color_->checksum;
+    r.color_dropped = color_dropped_;
+    r.depth_missing = depth_missing_;
+    r.depth_dropped = depth_dropped_;
+    r.drop_rate = r.frames ? (double)degraded_ / (double)r.frames : 0.0;
+    if (logged_ != r.frames) r.err = std::to_string(r.frames - logged_) + " frames never reached frames.bin";
+  }
+  const LatencyHistogram& end_to_end() const { return end_to_end_; }
+
+private:
+  const CaptureTrace& t_;
+  FramePool pool_;
+  CaptureLatency& lat_;
+  FrameBus bus_;
+  MockFrameSink* color_ = nullptr;
+  int ids_[3] = {};
+  Depth16Params depth16_;
+  uint64_t depth_idx_ = 0;       // 1 + frame of the last depth pushed
+  uint64_t logged_ = 0, degraded_ = 0, color_dropped_ = 0, depth_missing_ = 0, depth_dropped_ = 0;
+  std::vector<uint64_t> submit_ns_;
+  LatencyHistogram end_to_end_;
+};
+
+} // namespace
+
+bool unpack_traced_readback(simple_packed_buf& dst, const ReadbackKey& key, const ReadbackMapped& mapped, uint32_t aux) {
+  const TextureInterpretation interp = (TextureInterpretation)(aux & 0xFF);
+  if (!mapped.data) return false;
+  dst.width = key.width;
+  dst.height = key.height;
+  if (format_is_bgra8(key.format) || format_is_rgba8(key.format)) {
+    if (!dst.set_pixfmt_and_alloc_bytes(BUF_PIX_FMT_RGBA)) return false;
+    const bool swap = format_is_bgra8(key.format);
+    for (uint32_t y = 0; y < key.height; ++y) {
+      const uint8_t* src = mapped.data + (size_t)y * mapped.row_pitch;
+      uint8_t* out = dst.rowptr<uint8_t>(y);
+      for (uint32_t x = 0; x < key.width; ++x, src += 4, out += 4) {
+        out[0] = swap ? src[2] : src[0];
+        out[1] = src[1];
+        out[2] = swap ? src[0] : src[2];
+        out[3] = interp == TexInterp_RGB ? 255 : src[3];
+      }
+    }
+    return true;
+  }
+  if (format_is_float32(key.format)) {
+    // linear depth is copied as is; a depth buffer without a game to interpret it is kept as its
+    // bit patterns (GRAYU32), like depth_gray_bytesLE_to_f32 does
+    if (!dst.set_pixfmt_and_alloc_bytes(interp == TexInterp_LinearDepthF32 ? BUF_PIX_FMT_GRAYF32 : BUF_PIX_FMT_GRAYU32)) return false;
+    for (uint32_t y = 0; y < key.height; ++y)
+      std::memcpy(dst.rowptr<uint8_t>(y), mapped.data + (size_t)y * mapped.row_pitch, (size_t)key.width * 4);
+    return true;
+  }
+  return false;
+}
+
+CaptureReplayResult replay_capture_trace(const CaptureTrace& trace, const CaptureReplayConfig& cfg) {
+  CaptureReplayResult r;
+  if (trace.frames.empty()) { r.err = "empty trace"; return r; }
+  const int loops = std::max(1, cfg.loops);
+
+  CaptureLatency lat;
+  ReplayOutput out(trace, cfg, lat, (uint64_t)trace.frames.size() * (uint64_t)loops);
+  ReadbackRing ring;
+  ring.configure(cfg.readback_latency, cfg.readback_depth);
+  ring.set_backend(std::unique_ptr<ReadbackBackend>(new TraceReadbackBackend(trace, cfg.gpu_us, cfg.maps_off_thread)));
+  ring.set_latency(&lat[LatencyStage::ReadbackWait], &lat[LatencyStage::Map]);
+
+  std::atomic<uint64_t> not_unpacked{0};
+  const ReadbackUnpack unpack = cfg.unpack ? cfg.unpack : ReadbackUnpack(unpack_traced_readback);
+  CaptureStages stages;
+  stages.ring = &ring;
+  stages.out = &out;
+  stages.unpack = [&unpack, &not_unpacked](simple_packed_buf& dst, const ReadbackKey& key, const ReadbackMapped& m, uint32_t aux) {
+    const bool ok = unpack(dst, key, m, aux);
+    if (!ok) not_unpacked.fetch_add(1, std::memory_order_relaxed);
+    return ok;
+  };
+
+  CapturePipelineConfig pcfg = cfg.pipeline;
+  pcfg.readback_on_caller = !ring.maps_off_thread();
+  StagePipeline<CaptureFrame> pipe;
+  pipe.start(pcfg,
+    [&stages](CaptureFrame& cf, bool wait) { return capture_readback_stage(stages, cf, wait); },
+    [&stages](CaptureFrame& cf) { capture_convert_stage(stages, cf); },
+    capture_annotate_stage,
+    [&stages](CaptureFrame& cf) { capture_sink_stage(stages, cf); });
+
+  // the render thread: presents at the traced times, each frame's copies behind one fence; like
+  // the addon, a frame the pipeline has no room for waits to be logged with the next token
+  const int64_t first_us = trace.frames.front().time_us;
+  const int64_t span_us = trace.frames.size() > 1
+    ? (trace.frames.back().time_us - first_us) * (int64_t)trace.frames.size() / (int64_t)(trace.frames.size() - 1)
+    : 0;
+  std::vector<PendingFrame> refused;
+  const auto t0 = std::chrono::steady_clock::now();
+  uint64_t idx = 0;
+  for (int loop = 0; loop < loops; ++loop) {
+    for (size_t pos = 0; pos < trace.frames.size(); ++pos, ++idx) {
+      const CaptureTraceFrame& src = trace.frames[pos];
+      const int64_t t_us = (int64_t)loop * span_us + (src.time_us - first_us);
+      if (cfg.speed > 0.0)
+        std::this_thread::sleep_until(t0 + std::chrono::microseconds((int64_t)((double)t_us / cfg.speed)));
+      ring.next_frame();
+      pipe.pump();
+      ++r.frames;
+      PendingFrame pf;
+      pf.frec.frame_idx = idx;
+      pf.frec.time_us = t_us;
+      bool has_color = false;
+      for (const CaptureTraceTexture& t : src.textures) {
+        has_color |= t.stream == (uint32_t)CaptureStream::Color;
+        pf.depth_readback |= t.stream == (uint32_t)CaptureStream::Depth;
+      }
+      if (!has_color) pf.frec.flags |= GCVF_NO_COLOR;
+      out.submitted(idx);
+      if (!pipe.has_room()) {
+        ++r.refused;
+        refused.push_back(std::move(pf));
+        continue;
+      }
+      std::unique_ptr<CaptureFrame> cf(new CaptureFrame());
+      cf->pf = std::move(pf);
+      cf->refused.swap(refused);
+      cf->color_fmt = cfg.color_format;
+      for (size_t k = 0; k < src.textures.size(); ++k) {
+        ReadbackTag tag;
+        tag.frame_idx = idx;
+        tag.time_us = t_us;
+        tag.stream = src.textures[k].stream;
+        tag.aux = src.textures[k].aux;
+        const bool ok = ring.submit(TraceReadbackBackend::handle(pos, k), tag);
+        if (ok) ++r.textures;
+        if (ok && tag.stream == (uint32_t)CaptureStream::Color) cf->color_submitted = true;
+      }
+      ring.commit();
+      pipe.submit(std::move(cf));
+    }
+  }
+  pipe.stop();
+  for (PendingFrame& pf : refused) log_refused_frame(stages, pf);
+  r.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  r.stages = pipe.stats();
+  r.ring = ring.stats();
+  ring.release();
+  r.no_slot = r.ring.no_slot;
+  r.not_converted = not_unpacked.load();
+  out.finish(r);
+  const uint64_t sunk = r.stages.empty() ? 0 : r.stages.back().processed;
+  r.fps = r.wall_s > 0.0 ? (double)sunk / r.wall_s : 0.0;
+  for (int i = 0; i < kLatencyStages; ++i) {
+    const LatencySummary s = lat.stage[i].summary();
+    if (s.count) r.latency.emplace_back(latency_stage_name((LatencyStage)i), s);
+  }
+  r.latency.emplace_back("end_to_end", out.end_to_end().summary());
+  return r;
+}
+
+std::string CaptureReplayResult::summary() const {
+  if (!err.empty()) return "replay failed: " + err;
+  char buf[512];
+  double e2e_p50 = 0.0, e2e_p99 = 0.0;
+  if (!latency.empty()) { e2e_p50 = latency.back().second.p50_ms; e2e_p99 = latency.back().second.p99_ms; }
+  snprintf(buf, sizeof(buf),
+           "replay: %llu frames in %.2f s (%.1f fps), %.2f%% dropped (color %llu, depth %llu; refused %llu, no slot %llu, not converted %llu, "
+           "encoder %llu), end to end p50 %.2f ms p99 %.2f ms",
+           (unsigned long long)frames, wall_s, fps, drop_rate * 100.0, (unsigned long long)color_dropped, (unsigned long long)depth_missing,
+           (unsigned long long)refused, (unsigned long long)no_slot, (unsigned long long)not_converted, (unsigned long long)encoder_dropped,
+           e2e_p50, e2e_p99);
+  return buf;
+}
+
+nlohmann::json CaptureReplayResult::to_json() const {
+  nlohmann::json j = nlohmann::json::object();
+  if (!err.empty()) j["error"] = err;
+  j["frames"] = frames;
+  j["textures"] = textures;
+  j["refused"] = refused;
+  j["no_slot"] = no_slot;
+  j["not_converted"] = not_converted;
+  j["color_dropped"] = color_dropped;
+  j["depth_missing"] = depth_missing;
+  j["depth_dropped"] = depth_dropped;
+  j["published"] = published;
+  j["encoded"] = encoded;
+  j["encoder_dropped"] = encoder_dropped;
+  j["wall_s"] = wall_s;
+  j["fps"] = fps;
+  j["drop_rate"] = drop_rate;
+  nlohmann::json jl = nlohmann::json::object();
+  for (const auto& l : latency) {
+    nlohmann::json s = nlohmann::json::object();
+    s["count"] = l.second.count;
+    s["mean_ms"] = l.second.mean_ms;
+    s["p50_ms"] = l.second.p50_ms;
+    s["p95_ms"] = l.second.p95_ms;
+    s["p99_ms"] = l.second.p99_ms;
+    s["max_ms"] = l.second.max_ms;
+    jl[l.first] = s;
+  }
+  j["latency"] = jl;
+  nlohmann::json js = nlohmann::json::object();
+  for (const CaptureStageStats& s : stages) {
+    nlohmann::json st = nlohmann::json::object();
+    st["processed"] = s.processed;
+    st["max_queued"] = s.max_queued;
+    st["busy_mean_ms"] = s.busy_mean_ms;
+    st["wait_mean_ms"] = s.wait_mean_ms;
+    js[s.name] = st;
+  }
+  j["stages"] = js;
+  return j;
+}
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+namespace {
+const int kTestFrames = 30;
+const uint32_t kTestColorW = 64, kTestColorH = 36, kTestDepthW = 32, kTestDepthH = 18;
+
+uint8_t test_gray(uint64_t i) { return (uint8_t)(i * 5 + 3); }
+
+// 40 frames of 64x36 BGRA color (rows padded to 320 bytes, gray level per frame) and 32x18 float
+// raw depth, with uniforms, a camera buffer, an event and a frames.bin record each; 30 of them traced
+std::string write_test_trace(const std::string& path) {
+  CaptureTraceWriter w;
+  if (!w.open(path, kTestFrames)) return "cannot write " + path;
+  std::vector<uint8_t> color(320 * kTestColorH);
+  std::vector<float> depth(kTestDepthW * kTestDepthH);
+  for (uint64_t i = 0; i < 40; ++i) {
+    const float fov = 60.0f + (float)i;
+    const double buffer[17] = { 1.0, (double)i };
+    w.add_uniform("IGCS_cameraFoV", &fov, 1);
+    w.add_buffer("camera_data_buffer", buffer, 17);
+    const int64_t t_us = (int64_t)i * 2000;
+    w.begin_frame(i, t_us, capture_stream_bit(CaptureStream::Color) | capture_stream_bit(CaptureStream::Depth));
+    w.add_event(i, "pose_fetch", t_us + 10, 25);
+
+    ReadbackTag tag;
+    tag.frame_idx = i;
+    tag.time_us = t_us;
+    tag.stream = (uint32_t)CaptureStream::Color;
+    ReadbackKey key;
+    key.format = 87;   // b8g8r8a8_unorm
+    key.width = kTestColorW;
+    key.height = kTestColorH;
+    std::fill(color.begin(), color.end(), test_gray(i));
+    ReadbackMapped m;
+    m.data = color.data();
+    m.row_pitch = 320;
+    w.add_texture(tag, key, m, kTestColorW * 4);
+
+    tag.stream = (uint32_t)CaptureStream::Depth;
+    tag.aux = TexInterp_LinearDepthF32;   // raw depth from DepthCapture.fx
+    key.format = 41;   // r32_float
+    key.width = kTestDepthW;
+    key.height = kTestDepthH;
+    std::fill(depth.begin(), depth.end(), 1.0f + (float)i);
+    m.data = reinterpret_cast<const uint8_t*>(depth.data());
+    m.row_pitch = kTestDepthW * 4;
+    w.add_texture(tag, key, m, kTestDepthW * 4);
+
+    GcvFrameRecord rec{};
+    rec.frame_idx = i;
+    rec.time_us = t_us;
+    rec.letters_mask = (uint32_t)i;
+    w.add_record(rec);
+  }
+  w.close();
+  const CaptureTraceStats st = w.stats();
+  if (st.failed || st.frames != kTestFrames || st.textures != 2 * kTestFrames || st.skipped == 0)
+    return "writer counted " + std::to_string(st.frames) + " frames, " + std::to_string(st.textures) + " textures";
+  return std::string();
+}
+}
+
+std::string run_capture_replay_tests() {
+  std::error_code ec;
+  const std::string path = (std::filesystem::temp_directory_path(ec) / "gcv_capture_replay_test.gcvt").string();
+  const std::string werr = write_test_trace(path);
+  if (!werr.empty()) RETURNFAILST("capture trace: " + werr);
+  CaptureTrace trace;
+  std::string err;
+  const bool loaded = load_capture_trace(path, trace, err);
+  std::filesystem::remove(path, ec);
+  if (!loaded) RETURNFAILST("capture trace: " + err);
+  if (trace.frames.size() != (size_t)kTestFrames) RETURNFAILST("capture trace: read " + std::to_string(trace.frames.size()) + " frames");
+  for (const CaptureTraceFrame& f : trace.frames) {
+    const uint64_t i = f.frame_idx;
+    if (f.time_us != (int64_t)i * 2000 || f.textures.size() != 2 || !f.have_record || f.record.letters_mask != (uint32_t)i ||
+        f.uniforms.size() != 1 || f.uniforms[0].values.size() != 1 || f.uniforms[0].values[0] != 60.0 + (double)i ||
+        f.buffers.size() != 1 || f.buffers[0].values.size() != 17 || f.buffers[0].values[1] != (double)i ||
+        f.events.size() != 1 || f.events[0].name != "pose_fetch" || f.events[0].dur_us != 25)
+      RETURNFAILST("capture trace: frame " + std::to_string(i) + " read back wrong");
+    const CaptureTraceTexture& c = f.textures[0];
+    if (c.row_bytes != kTestColorW * 4 || c.bytes.size() != (size_t)c.row_bytes * kTestColorH ||
+        std::count(c.bytes.begin(), c.bytes.end(), test_gray(i)) != (long)c.bytes.size())
+      RETURNFAILST("capture trace: frame " + std::to_string(i) + " color padding kept or bytes wrong");
+  }
+
+  uint64_t want_checksum = 0;   // first Y byte of every frame
+  for (const CaptureTraceFrame& f : trace.frames) {
+    std::vector<uint8_t> yuv(yuv420_frame_bytes(kTestColorW, kTestColorH));
+    rgb_to_yuv420(f.textures[0].bytes.data(), f.textures[0].row_bytes, YuvSrcOrder::BGRA, kTestColorW, kTestColorH, YuvLayout::I420, yuv.data());
+    want_checksum += yuv[0];
+  }
+  {
+    // paced, fast device: every frame through every stage, output as converted by hand; color to
+    // the color encoder, raw depth to depth16
+    CaptureReplayConfig cfg;
+    cfg.gpu_us = 300;
+    const CaptureReplayResult r = replay_capture_trace(trace, cfg);
+    if (!r.err.empty()) RETURNFAILST("capture replay: " + r.err);
+    if (r.frames != (uint64_t)kTestFrames || r.refused || r.no_slot || r.not_converted || r.color_dropped || r.depth_missing ||
+        r.drop_rate != 0.0 || r.encoded != 2 * (uint64_t)kTestFrames || r.encoder_dropped)
+      RETURNFAILST("capture replay: " + r.summary());
+    if (r.color_checksum != want_checksum) RETURNFAILST("capture replay: converted color differs");
+    if (r.latency.empty() || r.latency.back().first != "end_to_end" || r.latency.back().second.count != (uint64_t)kTestFrames)
+      RETURNFAILST("capture replay: end-to-end latency not measured");
+  }
+  {
+    // unpaced into slow encoders with no room: drops are counted, nothing is lost track of
+    CaptureReplayConfig cfg;
+    cfg.speed = 0.0;
+    cfg.loops = 3;
+    cfg.encoder_us = 2000;
+    cfg.encoder_capacity = 1;
+    const CaptureReplayResult r = replay_capture_trace(trace, cfg);
+    if (!r.err.empty()) RETURNFAILST("capture replay (slow): " + r.err);
+    const uint64_t sunk = r.stages[(int)CaptureStage::Sink].processed;
+    if (r.frames != 3 * (uint64_t)kTestFrames || sunk + r.refused != r.frames || r.encoded + r.encoder_dropped != r.published ||
+        r.encoder_dropped + r.refused == 0 || r.drop_rate < 0.0 || r.drop_rate > 1.0)
+      RETURNFAILST("capture replay (slow): " + r.summary());
+    if (r.depth_dropped != r.refused) RETURNFAILST("capture replay (slow): refused frames not flagged as depth dropped");
+  }
+  {
+    // D3D11/OpenGL-like: readback pumped on the replaying thread, same output
+    CaptureReplayConfig cfg;
+    cfg.maps_off_thread = false;
+    cfg.gpu_us = 300;
+    cfg.color_format = FrameFormat::I420;
+    const CaptureReplayResult r = replay_capture_trace(trace, cfg);
+    if (!r.err.empty() || r.stages.empty() || !r.stages[0].on_caller) RETURNFAILST("capture replay (pumped): " + r.summary());
+    if (r.stages[(int)CaptureStage::Sink].processed + r.refused != r.frames || r.not_converted)
+      RETURNFAILST("capture replay (pumped): " + r.summary());
+  }
+  return "ok";
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "capture_pipeline.h"
+#include "capture_stages.h"
+#include "capture_trace.h"
+#include "frame_pool.h"
+#include "frame_queue.h"
+#include "latency_histogram.h"
+
+// Replays a capture trace (capture_trace.h) through the capture path without a game or a GPU, so
+// its throughput, drops and latency can be measured the same way on any machine. The device is a
+// ReadbackBackend whose "GPU" finishes each fence gpu_us after it was signalled and whose textures
+// are the traced ones; from there the frames take the recording's way, through the recording's
+// code: ReadbackRing -> StagePipeline running the stages of capture_stages.h (readback, conversion
+// into pool slots, stamps, recorder pushes) -> a CaptureOutput whose FrameBus feeds sinks that
+// stand in for the encoders (a fixed time per frame, nothing written). The render thread's part
+// runs on the caller's thread, paced by the traced present times. tools/gcv_replay runs it from
+// the command line.
+
+struct CaptureReplayConfig {
+  double speed = 1.0;               // 1: the traced frame times; 2: twice as fast; 0: as fast as possible
+  int loops = 1;                    // the trace is played this many times in a row
+  int readback_latency = 2, readback_depth = 3;   // ReadbackRing::configure
+  CapturePipelineConfig pipeline;
+  bool maps_off_thread = true;      // D3D12/Vulkan-like; false: readback pumped on the caller (D3D11/OpenGL)
+  int gpu_us = 2000;                // signal -> fence done
+  FrameFormat color_format = FrameFormat::I420;   // I420, NV12 or BGRA (as copied)
+  size_t pool_slots = 24;
+  int encoder_us = 0;               // per frame, in each stand-in encoder
+  size_t encoder_capacity = 8;      // frames queued in front of an encoder
+  QueuePolicy encoder_policy = QueuePolicy::DropNewest;
+  ReadbackUnpack unpack;            // empty: unpack_traced_readback (the addon passes its own, for every format)
+};
+
+struct CaptureReplayResult {
+  std::string err;                  // empty: replayed
+  uint64_t frames = 0;              // presents that recorded a frame
+  uint64_t textures = 0;            // copies submitted
+  uint64_t refused = 0;             // pipeline full: the frame was dropped before any copy
+  uint64_t no_slot = 0;             // ring full: a texture of the frame was not copied
+  uint64_t not_converted = 0;       // read back but not unpacked (format not replayable)
+  uint64_t color_dropped = 0;       // frames recorded without color (GCVF_COLOR_DROPPED)
+  uint64_t depth_missing = 0;       // frames with traced depth that reached the recorder without it
+  uint64_t depth_dropped = 0;       // of those, flagged GCVF_DEPTH_DROPPED (refused by the pipeline)
+  uint64_t published = 0;           // frames handed to the stand-in encoders (color, depth, depth16)
+  uint64_t encoded = 0;             // frames the stand-in encoders consumed (repeats included)
+  uint64_t encoder_dropped = 0;     // by their queue policy
+  double wall_s = 0.0;
+  double fps = 0.0;                 // frames that reached the sink stage per second
+  double drop_rate = 0.0;           // frames recorded without their color or depth / frames
+  uint64_t color_checksum = 0;      // sum of the first byte of every color frame encoded: equal replays, equal sums
+  std::vector<std::pair<std::string, LatencySummary>> latency;   // per LatencyStage, then "end_to_end"
+  std::vector<CaptureStageStats> stages;
+  ReadbackRingStats ring;
+
+  std::string summary() const;      // one log line
+  nlohmann::json to_json() const;
+};
+
+CaptureReplayResult replay_capture_trace(const CaptureTrace& trace, const CaptureReplayConfig& cfg);
+
+// copy_readback_into_packedbuf for the formats a recording usually has, without ReShade: 8-bit
+// RGBA/BGRA color and 32-bit float depth; false for anything else
+bool unpack_traced_readback(simple_packed_buf& dst, const ReadbackKey& key, const ReadbackMapped& mapped, uint32_t aux);
+
+// A synthetic trace written and read back (capture.gcvt round trip), then replayed: every frame
+// through every stage on a fast device, counted drops on a slow one; "ok" or what failed (like
+// run_utils_tests)
+std::string run_capture_replay_tests();
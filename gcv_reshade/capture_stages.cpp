@@ -0,0 +1,108 @@
+#include "capture_stages.h"
+#include "capture_profile.h"
+#include "depth_quant.h"
+
+#include <algorithm>
+
+void deliver_color(const CaptureStages& s, PendingFrame& pf, bool grabbed, FrameRef& frame, int w, int h) {
+  bool color_ok = false;
+  if (grabbed) {
+    frame.set_stamp(pf.frec.frame_idx, pf.frec.time_us);
+    color_ok = s.out->push_color(std::move(frame));
+  } else if (w > 0 && h > 0) {
+    // texture was read back but every pool slot is still queued: count it as dropped
+    s.out->push_color(FrameRef());
+  }
+  pf.frec.img_w = (uint32_t)std::max(0, w);
+  pf.frec.img_h = (uint32_t)std::max(0, h);
+  if (!color_ok) pf.frec.flags |= GCVF_COLOR_DROPPED;
+  else if (const uint32_t run = s.out->color_repeat_run()) {
+    pf.frec.flags |= GCVF_COLOR_REPEAT;
+    pf.frec.color_run = (uint16_t)std::min<uint32_t>(run, 0xFFFF);
+  }
+}
+
+void deliver_raw_depth(const CaptureStages& s, PendingFrame& pf, std::vector<float>& raw_depth, int dw, int dh) {
+  if (pf.frec.flags & GCVF_GOV_DEPTH_BITS)
+    truncate_depth_mantissa(raw_depth.data(), raw_depth.size(), pf.depth_bits);
+  s.out->push_raw_depth(raw_depth.data(), dw, dh, pf.frec.frame_idx, pf.frec.time_us);
+  if (s.on_raw_depth) s.on_raw_depth(raw_depth, dw, dh);
+  if (const uint32_t run = s.out->depth_repeat_run()) {
+    pf.frec.flags |= GCVF_DEPTH_REPEAT;
+    pf.frec.depth_run = (uint16_t)std::min<uint32_t>(run, 0xFFFF);
+  }
+}
+
+void log_pending_frame(const CaptureStages& s, const PendingFrame& pf) {
+  if (pf.log_pose) {
+    s.out->log_camera(/*idx=*/pf.frec.frame_idx,
+                      /*time_us=*/pf.frec.time_us,
+                      /*cam=*/pf.cam_ok ? &pf.cam : nullptr, pf.cam_err,
+                      /*img_w=*/(int)pf.frec.img_w, /*img_h=*/(int)pf.frec.img_h);
+  }
+  s.out->log_frame(pf.frec);
+  if (s.trace && s.trace->is_open()) s.trace->add_record(pf.frec);
+}
+
+void log_refused_frame(const CaptureStages& s, PendingFrame& pf) {
+  if (!(pf.frec.flags & GCVF_NO_COLOR)) {
+    s.out->refuse_color();
+    pf.frec.flags |= GCVF_COLOR_DROPPED;
+  }
+  if (pf.depth_readback) pf.frec.flags |= GCVF_DEPTH_DROPPED;
+  log_pending_frame(s, pf);
+}
+
+bool capture_readback_stage(const CaptureStages& s, CaptureFrame& cf, bool wait) {
+  const int n = s.ring->take_frame(cf.pf.frec.frame_idx, [&s, &cf](const ReadbackTag& tag, const ReadbackKey& key, const ReadbackMapped& data) {
+    if (tag.frame_idx != cf.pf.frec.frame_idx) return;   // left behind by an older frame
+    if (s.trace && s.trace->is_open()) s.trace->add_texture(tag, key, data, s.row_bytes ? s.row_bytes(key) : data.row_pitch);
+    cf.readbacks.emplace_back();
+    CaptureFrame::Readback& rb = cf.readbacks.back();
+    rb.tag = tag;
+    rb.ok = data.data && s.unpack(rb.pbuf, key, data, tag.aux);
+  }, wait);
+  return n >= 0;
+}
+
+void capture_convert_stage(const CaptureStages& s, CaptureFrame& cf) {
+  LatencyScope timed(&s.out->latency()[LatencyStage::Convert]);
+  FramePool& pool = s.out->frame_pool();
+  for (CaptureFrame::Readback& rb : cf.readbacks) {
+    if (!rb.ok) continue;
+    if (rb.tag.stream == (uint32_t)CaptureStream::Color) {
+      cf.color_grabbed = (cf.color_fmt == FrameFormat::BGRA)
+        ? bgra_frame_from_packedbuf(rb.pbuf, pool, cf.color, cf.w, cf.h, cf.color_scale)
+        : yuv420_frame_from_packedbuf(rb.pbuf, pool, cf.color, cf.w, cf.h, cf.color_fmt, cf.color_scale);
+    } else if (rb.tag.stream == (uint32_t)CaptureStream::Depth && (rb.tag.aux & kReadbackDepthFiles)) {
+      if (s.on_depth_file) s.on_depth_file(cf.pf, rb.tag.aux, rb.pbuf);
+    } else if (rb.tag.stream == (uint32_t)CaptureStream::Depth && (rb.tag.aux & kReadbackDepthVideo)) {
+      cf.depth_video_ok = depth_gray8_from_packedbuf(rb.pbuf, pool, cf.depth_video, cf.dw, cf.dh, cf.tone, cf.depth_scale);
+    } else if (rb.tag.stream == (uint32_t)CaptureStream::Depth) {
+      cf.raw_depth_ok = raw_depth_float32_from_packedbuf(rb.pbuf, cf.raw_depth, cf.dw, cf.dh, cf.depth_scale);
+    }
+    rb.pbuf = simple_packed_buf();   // converted: the staging copy can go
+  }
+}
+
+void capture_annotate_stage(CaptureFrame& cf) {
+  GcvFrameRecord& frec = cf.pf.frec;
+  if (cf.color_grabbed) cf.color.set_stamp(frec.frame_idx, frec.time_us);
+  if (cf.depth_video_ok) cf.depth_video.set_stamp(frec.frame_idx, frec.time_us);
+  if (!(frec.flags & GCVF_NO_COLOR) && !cf.color_submitted) frec.flags |= GCVF_COLOR_DROPPED;
+}
+
+void capture_sink_stage(const CaptureStages& s, CaptureFrame& cf) {
+  for (PendingFrame& pf : cf.refused) log_refused_frame(s, pf);
+  PendingFrame& pf = cf.pf;
+  if (!(pf.frec.flags & GCVF_NO_COLOR)) {
+    if (cf.color_submitted) {
+      deliver_color(s, pf, cf.color_grabbed, cf.color, cf.w, cf.h);
+    } else {
+      s.out->push_color(FrameRef());   // every staging texture still in flight: dropped (flagged by annotate)
+    }
+  }
+  if (cf.depth_video_ok) s.out->push_depth(std::move(cf.depth_video));
+  if (cf.raw_depth_ok) deliver_raw_depth(s, pf, cf.raw_depth, cf.dw, cf.dh);
+  log_pending_frame(s, pf);
+}
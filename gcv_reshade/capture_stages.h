@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "capture_trace.h"
+#include "frame_pool.h"
+#include "frame_sidecar.h"
+#include "gcv_utils/camera_data_struct.h"
+#include "gcv_utils/simple_packed_buf.h"
+#include "latency_histogram.h"
+#include "packedbuf_frames.h"
+#include "readback_ring.h"
+
+// The stages a recorded frame takes from the ReadbackRing to the recorder (run by the StagePipeline
+// of capture_pipeline.h): readback -> convert -> annotate -> sink. The addon runs them into its
+// Recorder; the capture replay (capture_replay.h) runs the same functions on a traced recording,
+// into a stand-in whose encoders write nothing. What differs between the two is in CaptureStages.
+
+// frames.bin / cam.jsonl record of a captured frame; logged in capture order
+struct PendingFrame {
+  GcvFrameRecord frec{};
+  CamMatrixData cam;
+  std::string cam_err;
+  bool cam_ok = false;
+  bool log_pose = false;
+  int depth_bits = 23;                 // raw depth mantissa bits kept (the governor's, as of the capture)
+  bool depth_readback = false;         // depth goes through the readback ring (none if the frame is refused)
+};
+
+// ReadbackTag::aux of a recording's texture: the low byte is its TextureInterpretation
+constexpr uint32_t kReadbackDepthVideo = 0x100;   // depth for depth.mp4 (otherwise raw depth)
+constexpr uint32_t kReadbackDepthFiles = 0x200;   // depth for per-frame files (CaptureStages::on_depth_file)
+
+// A recorded frame on its way through the stages: the render thread fills in the record and
+// copies the textures into the ring; the stages read them back, convert them, finish the record
+// and hand everything to the recorder.
+struct CaptureFrame {
+  PendingFrame pf;
+  std::vector<PendingFrame> refused;   // frames turned away (pipeline full) since the previous token; logged first
+  bool color_submitted = false;
+  FrameFormat color_fmt = FrameFormat::I420;   // conversion settings as of the capture
+  int color_scale = 1, depth_scale = 1;
+  DepthToneParams tone;
+  struct Readback {
+    ReadbackTag tag;
+    simple_packed_buf pbuf;
+    bool ok = false;
+  };
+  std::vector<Readback> readbacks;     // submit order
+  FrameRef color, depth_video;
+  bool color_grabbed = false, depth_video_ok = false, raw_depth_ok = false;
+  int w = 0, h = 0, dw = 0, dh = 0;
+  std::vector<float> raw_depth;
+};
+
+// Where the stages deliver: the part of the Recorder they use (recorder.h)
+class CaptureOutput {
+public:
+  virtual ~CaptureOutput() = default;
+  virtual FramePool& frame_pool() = 0;
+  virtual CaptureLatency& latency() = 0;
+  virtual bool push_color(FrameRef&& frame) = 0;   // false if dropped; an empty frame counts as dropped
+  virtual void refuse_color() = 0;                  // color of a frame the pipeline had no room for (dropped)
+  virtual uint32_t color_repeat_run() const = 0;
+  virtual void push_depth(FrameRef&& frame) = 0;
+  virtual void push_raw_depth(const float* data, int w, int h, uint64_t frame_idx, int64_t timestamp_us) = 0;
+  virtual uint32_t depth_repeat_run() const = 0;
+  virtual void log_camera(uint64_t idx, int64_t t_us, const CamMatrixData* cam, const std::string& cam_err, int img_w, int img_h) = 0;
+  virtual void log_frame(const GcvFrameRecord& r) = 0;
+};
+
+// A readback into a simple_packed_buf; aux is its ReadbackTag::aux (copy_readback_into_packedbuf
+// in the addon, which needs ReShade's format tables)
+using ReadbackUnpack = std::function<bool(simple_packed_buf& dst, const ReadbackKey& key, const ReadbackMapped& mapped, uint32_t aux)>;
+
+struct CaptureStages {
+  ReadbackRing* ring = nullptr;
+  CaptureOutput* out = nullptr;
+  ReadbackUnpack unpack;
+  CaptureTraceWriter* trace = nullptr;   // textures and frame records go in while it is open
+  std::function<uint32_t(const ReadbackKey& key)> row_bytes;   // of a traced texture (readback_row_bytes); none: the row pitch
+  // raw depth after the recorder has it, on the sink stage (the addon's codec benchmark)
+  std::function<void(const std::vector<float>& depth, int w, int h)> on_raw_depth;
+  // per-frame depth files, on the convert stage: the unpacked texture and its ReadbackTag::aux (none: not written)
+  std::function<void(const PendingFrame& pf, uint32_t aux, simple_packed_buf& depth)> on_depth_file;
+};
+
+// the frame's textures out of the ring, unpacked
+bool capture_readback_stage(const CaptureStages& s, CaptureFrame& cf, bool wait);
+// color to the encoder's format and depth to gray8 / float, into frame pool slots
+void capture_convert_stage(const CaptureStages& s, CaptureFrame& cf);
+// stamps and what the record can tell before the recorder has seen the frame
+void capture_annotate_stage(CaptureFrame& cf);
+// recorder pushes and log entries, in capture order (the recorder's single producer while recording)
+void capture_sink_stage(const CaptureStages& s, CaptureFrame& cf);
+
+// The sink stage's steps; the addon's synchronous grab path calls them too.
+// color of pf's frame: 'frame' when grabbed; w x h is the read back size (0: the copy failed)
+void deliver_color(const CaptureStages& s, PendingFrame& pf, bool grabbed, FrameRef& frame, int w, int h);
+// raw float depth of pf's frame -> depth.gcvd (kept to pf.depth_bits if the governor lowered them)
+void deliver_raw_depth(const CaptureStages& s, PendingFrame& pf, std::vector<float>& raw_depth, int dw, int dh);
+// cam.jsonl and frames.bin entries of a frame whose color and depth are in
+void log_pending_frame(const CaptureStages& s, const PendingFrame& pf);
+// a frame the pipeline had no room for: no textures were copied, its color and ring depth are dropped
+void log_refused_frame(const CaptureStages& s, PendingFrame& pf);
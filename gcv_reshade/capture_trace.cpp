@@ -0,0 +1,240 @@
+#include "capture_trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+
+namespace {
+const char kTraceMagic[8] = { 'G', 'C', 'V', 'T', 'R', 'A', 'C', 'E' };
+const uint32_t kTraceVersion = 1;
+
+FILE* open_trace_file(const std::string& path, const char* mode) {
+#ifdef _WIN32
+  FILE* f = nullptr;
+  if (fopen_s(&f, path.c_str(), mode) != 0) return nullptr;
+  return f;
+#else
+  return std::fopen(path.c_str(), mode);
+#endif
+}
+}
+
+bool CaptureTraceWriter::open(const std::string& path, uint64_t max_frames) {
+  close();
+  std::lock_guard<std::mutex> lk(mtx_);
+  f_ = open_trace_file(path, "wb");
+  if (!f_) return false;
+  std::setvbuf(f_, nullptr, _IOFBF, 1 << 20);
+  CaptureTraceHeader h{};
+  std::memcpy(h.magic, kTraceMagic, sizeof(h.magic));
+  h.version = kTraceVersion;
+  h.header_bytes = sizeof(CaptureTraceHeader);
+  st_ = CaptureTraceStats();
+  if (std::fwrite(&h, sizeof(h), 1, f_) != 1) {
+    std::fclose(f_);
+    f_ = nullptr;
+    return false;
+  }
+  st_.bytes = sizeof(h);
+  max_frames_ = max_frames;
+  first_ = next_frame_ = 0;
+  have_first_ = false;
+  open_.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+void CaptureTraceWriter::close() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  open_.store(false, std::memory_order_relaxed);
+  if (f_) {
+    if (std::fclose(f_) != 0) st_.failed = true;
+    f_ = nullptr;
+  }
+}
+
+CaptureTraceStats CaptureTraceWriter::stats() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return st_;
+}
+
+bool CaptureTraceWriter::begin_record(CaptureTraceKind kind, uint64_t frame_idx, size_t bytes) {
+  if (!f_ || st_.failed) return false;
+  if (!traced(frame_idx)) {
+    ++st_.skipped;
+    return false;
+  }
+  CaptureTraceRecordHeader rh{};
+  rh.kind = (uint32_t)kind;
+  rh.bytes = (uint32_t)bytes;
+  rh.frame_idx = frame_idx;
+  if (!put(&rh, sizeof(rh))) return false;
+  ++st_.records;
+  return true;
+}
+
+bool CaptureTraceWriter::put(const void* p, size_t bytes) {
+  if (st_.failed) return false;
+  if (bytes && std::fwrite(p, 1, bytes, f_) != bytes) {
+    st_.failed = true;
+    return false;
+  }
+  st_.bytes += bytes;
+  return true;
+}
+
+void CaptureTraceWriter::begin_frame(uint64_t frame_idx, int64_t time_us, uint32_t due) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (!f_) return;
+  if (!have_first_) {
+    first_ = frame_idx;
+    have_first_ = true;
+  }
+  const uint32_t d[2] = { due, 0 };
+  if (begin_record(CaptureTraceKind::Frame, frame_idx, sizeof(time_us) + sizeof(d)) && put(&time_us, sizeof(time_us)) && put(d, sizeof(d)))
+    ++st_.frames;
+  next_frame_ = frame_idx + 1;
+}
+
+void CaptureTraceWriter::add_texture(const ReadbackTag& tag, const ReadbackKey& key, const ReadbackMapped& mapped, uint32_t row_bytes) {
+  if (!mapped.data || row_bytes == 0 || row_bytes > mapped.row_pitch) return;
+  const uint32_t p[6] = { tag.stream, tag.aux, key.format, key.width, key.height, row_bytes };
+  const size_t bytes = (size_t)row_bytes * key.height;
+  if (sizeof(p) + bytes > UINT32_MAX) return;
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (!begin_record(CaptureTraceKind::Texture, tag.frame_idx, sizeof(p) + bytes) || !put(p, sizeof(p))) return;
+  // rows without the pitch padding
+  bool ok = true;
+  if (row_bytes == mapped.row_pitch) ok = put(mapped.data, bytes);
+  for (uint32_t y = 0; ok && row_bytes != mapped.row_pitch && y < key.height; ++y)
+    ok = put(mapped.data + (size_t)y * mapped.row_pitch, row_bytes);
+  if (ok) ++st_.textures;
+}
+
+void CaptureTraceWriter::add_record(const GcvFrameRecord& r) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (begin_record(CaptureTraceKind::Record, r.frame_idx, sizeof(r))) put(&r, sizeof(r));
+}
+
+void CaptureTraceWriter::add_values(CaptureTraceKind kind, const char* name, const void* values, size_t count, size_t value_bytes) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  const uint32_t name_bytes = (uint32_t)std::strlen(name);
+  const uint32_t p[2] = { name_bytes, (uint32_t)count };
+  if (begin_record(kind, next_frame_, sizeof(p) + name_bytes + count * value_bytes) && put(p, sizeof(p)) && put(name, name_bytes))
+    put(values, count * value_bytes);
+}
+
+void CaptureTraceWriter::add_uniform(const char* name, const float* values, size_t count) {
+  add_values(CaptureTraceKind::Uniform, name, values, count, sizeof(float));
+}
+
+void CaptureTraceWriter::add_buffer(const char* name, const double* values, size_t count) {
+  add_values(CaptureTraceKind::Buffer, name, values, count, sizeof(double));
+}
+
+void CaptureTraceWriter::add_event(uint64_t frame_idx, const char* name, int64_t start_us, int64_t dur_us) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  const int64_t t[2] = { start_us, dur_us };
+  const uint32_t name_bytes = (uint32_t)std::strlen(name);
+  if (begin_record(CaptureTraceKind::Event, frame_idx, sizeof(t) + sizeof(name_bytes) + name_bytes) && put(t, sizeof(t)) &&
+      put(&name_bytes, sizeof(name_bytes)))
+    put(name, name_bytes);
+}
+
+bool load_capture_trace(const std::string& path, CaptureTrace& out, std::string& err) {
+  out = CaptureTrace();
+  FILE* f = open_trace_file(path, "rb");
+  if (!f) { err = "cannot open " + path; return false; }
+  CaptureTraceHeader h{};
+  if (std::fread(&h, sizeof(h), 1, f) != 1 || std::memcmp(h.magic, kTraceMagic, sizeof(h.magic)) != 0 ||
+      h.version != kTraceVersion || h.header_bytes < sizeof(h)) {
+    std::fclose(f);
+    err = path + " is not a capture trace (version " + std::to_string(kTraceVersion) + ")";
+    return false;
+  }
+  fseek(f, (long)h.header_bytes, SEEK_SET);
+  out.bytes = h.header_bytes;
+
+  std::map<uint64_t, CaptureTraceFrame> frames;
+  std::set<uint64_t> begun;   // frames with a Frame record
+  std::vector<uint8_t> buf;
+  CaptureTraceRecordHeader rh;
+  while (std::fread(&rh, sizeof(rh), 1, f) == 1) {
+    buf.resize(rh.bytes);
+    if (rh.bytes && std::fread(buf.data(), 1, rh.bytes, f) != rh.bytes) break;
+    out.bytes += sizeof(rh) + rh.bytes;
+    const uint8_t* p = buf.data();
+    const size_t n = rh.bytes;
+    CaptureTraceFrame& fr = frames[rh.frame_idx];
+    fr.frame_idx = rh.frame_idx;
+    switch ((CaptureTraceKind)rh.kind) {
+    case CaptureTraceKind::Frame:
+      if (n < 12) break;
+      std::memcpy(&fr.time_us, p, 8);
+      std::memcpy(&fr.due, p + 8, 4);
+      begun.insert(rh.frame_idx);
+      break;
+    case CaptureTraceKind::Texture: {
+      uint32_t t[6];
+      if (n < sizeof(t)) break;
+      std::memcpy(t, p, sizeof(t));
+      CaptureTraceTexture tex;
+      tex.stream = t[0];
+      tex.aux = t[1];
+      tex.key.format = t[2];
+      tex.key.width = t[3];
+      tex.key.height = t[4];
+      tex.row_bytes = t[5];
+      if (n - sizeof(t) != (size_t)tex.row_bytes * tex.key.height) break;
+      tex.bytes.assign(p + sizeof(t), p + n);
+      out.texture_bytes += tex.bytes.size();
+      fr.textures.push_back(std::move(tex));
+      break;
+    }
+    case CaptureTraceKind::Record:
+      if (n != sizeof(GcvFrameRecord)) break;
+      std::memcpy(&fr.record, p, n);
+      fr.have_record = true;
+      break;
+    case CaptureTraceKind::Uniform:
+    case CaptureTraceKind::Buffer: {
+      uint32_t t[2];
+      if (n < sizeof(t)) break;
+      std::memcpy(t, p, sizeof(t));
+      const bool dbl = (CaptureTraceKind)rh.kind == CaptureTraceKind::Buffer;
+      const size_t vb = dbl ? sizeof(double) : sizeof(float);
+      if (n != sizeof(t) + t[0] + (size_t)t[1] * vb) break;
+      CaptureTraceValues v;
+      v.name.assign((const char*)p + sizeof(t), t[0]);
+      const uint8_t* vp = p + sizeof(t) + t[0];
+      for (uint32_t i = 0; i < t[1]; ++i) {
+        if (dbl) { double d; std::memcpy(&d, vp + i * vb, vb); v.values.push_back(d); }
+        else { float x; std::memcpy(&x, vp + i * vb, vb); v.values.push_back((double)x); }
+      }
+      (dbl ? fr.buffers : fr.uniforms).push_back(std::move(v));
+      break;
+    }
+    case CaptureTraceKind::Event: {
+      if (n < 20) break;
+      CaptureTraceEvent e;
+      uint32_t name_bytes = 0;
+      std::memcpy(&e.start_us, p, 8);
+      std::memcpy(&e.dur_us, p + 8, 8);
+      std::memcpy(&name_bytes, p + 16, 4);
+      if (n != 20 + (size_t)name_bytes) break;
+      e.name.assign((const char*)p + 20, name_bytes);
+      fr.events.push_back(std::move(e));
+      break;
+    }
+    default:
+      break;   // a newer kind: skipped
+    }
+  }
+  std::fclose(f);
+
+  // frames without a Frame record only have what was traced after the last frame (uniforms read
+  // at presents that recorded nothing)
+  for (auto& kv : frames)
+    if (begun.count(kv.first)) out.frames.push_back(std::move(kv.second));
+  return true;
+}
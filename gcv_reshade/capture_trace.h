@@ -0,0 +1,133 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "frame_sidecar.h"
+#include "readback_ring.h"
+
+// capture.gcvt: what a recording saw of the game, so its capture path can be replayed without the
+// game (capture_replay.h). Per recorded frame: the present time and the streams that were due, the
+// read back textures (layout and bytes, rows without padding), the IGCS uniforms and the camera
+// buffer they were turned into, timed events of the render thread and the final frames.bin record.
+// All integers little-endian. Layout:
+//   CaptureTraceHeader
+//   records: CaptureTraceRecordHeader, then 'bytes' of payload (see CaptureTraceKind)
+// Records of different frames may interleave (textures come from the readback thread); readers
+// group them by frame_idx. A trace cut short by a crash reads up to its last whole record.
+
+enum class CaptureTraceKind : uint32_t {
+  Frame = 1,     // int64 time_us, uint32 due (capture_stream_bit mask), uint32 0
+  Texture = 2,   // uint32 stream, aux, format, width, height, row_bytes; height * row_bytes bytes
+  Record = 3,    // GcvFrameRecord
+  Uniform = 4,   // uint32 name_bytes, count; name; count x float
+  Buffer = 5,    // uint32 name_bytes, count; name; count x double
+  Event = 6,     // int64 start_us, dur_us; uint32 name_bytes; name
+};
+
+#pragma pack(push, 1)
+struct CaptureTraceHeader {
+  char magic[8];              // "GCVTRACE"
+  uint32_t version;           // 1
+  uint32_t header_bytes;      // sizeof(CaptureTraceHeader)
+  uint8_t reserved[16];
+};
+struct CaptureTraceRecordHeader {
+  uint32_t kind;              // CaptureTraceKind
+  uint32_t bytes;             // payload
+  uint64_t frame_idx;
+};
+#pragma pack(pop)
+static_assert(sizeof(CaptureTraceHeader) == 32, "capture.gcvt header layout");
+static_assert(sizeof(CaptureTraceRecordHeader) == 16, "capture.gcvt record layout");
+
+struct CaptureTraceStats {
+  uint64_t frames = 0;
+  uint64_t textures = 0;
+  uint64_t records = 0;       // of every kind
+  uint64_t bytes = 0;
+  uint64_t skipped = 0;       // records of frames past max_frames
+  bool failed = false;        // a write failed; the trace ends there
+};
+
+// Writes capture.gcvt; every call may come from any thread (one lock, buffered writes). Meant for
+// short diagnostic recordings: the texture bytes are written on the thread that read them back.
+class CaptureTraceWriter {
+public:
+  CaptureTraceWriter() = default;
+  ~CaptureTraceWriter() { close(); }
+  CaptureTraceWriter(const CaptureTraceWriter&) = delete;
+  CaptureTraceWriter& operator=(const CaptureTraceWriter&) = delete;
+
+  // max_frames: frames traced, those after it are skipped (0: no limit)
+  bool open(const std::string& path, uint64_t max_frames = 0);
+  void close();
+  // cheap enough to check on the render thread before gathering what to trace
+  bool is_open() const { return open_.load(std::memory_order_relaxed); }
+
+  // a recorded frame; the uniforms and buffers added before it belong to it
+  void begin_frame(uint64_t frame_idx, int64_t time_us, uint32_t due);
+  // row_bytes: bytes of a row's pixels (mapped.row_pitch may be larger)
+  void add_texture(const ReadbackTag& tag, const ReadbackKey& key, const ReadbackMapped& mapped, uint32_t row_bytes);
+  void add_record(const GcvFrameRecord& r);
+  void add_uniform(const char* name, const float* values, size_t count);
+  void add_buffer(const char* name, const double* values, size_t count);
+  void add_event(uint64_t frame_idx, const char* name, int64_t start_us, int64_t dur_us);
+
+  CaptureTraceStats stats() const;
+
+private:
+  bool traced(uint64_t frame_idx) const { return max_frames_ == 0 || frame_idx < first_ + max_frames_; }
+  // with mtx_ held; false: not traced (past max_frames) or the file failed
+  bool begin_record(CaptureTraceKind kind, uint64_t frame_idx, size_t bytes);
+  bool put(const void* p, size_t bytes);
+  void add_values(CaptureTraceKind kind, const char* name, const void* values, size_t count, size_t value_bytes);
+
+  mutable std::mutex mtx_;
+  std::atomic<bool> open_{false};
+  FILE* f_ = nullptr;
+  uint64_t max_frames_ = 0;
+  uint64_t first_ = 0;
+  bool have_first_ = false;
+  uint64_t next_frame_ = 0;   // frame the uniforms and buffers go to
+  CaptureTraceStats st_;
+};
+
+struct CaptureTraceTexture {
+  uint32_t stream = 0, aux = 0;
+  ReadbackKey key;
+  uint32_t row_bytes = 0;
+  std::vector<uint8_t> bytes;   // height * row_bytes
+};
+
+struct CaptureTraceValues {
+  std::string name;
+  std::vector<double> values;
+};
+
+struct CaptureTraceEvent {
+  std::string name;
+  int64_t start_us = 0, dur_us = 0;
+};
+
+struct CaptureTraceFrame {
+  uint64_t frame_idx = 0;
+  int64_t time_us = 0;
+  uint32_t due = 0;
+  bool have_record = false;
+  GcvFrameRecord record{};
+  std::vector<CaptureTraceTexture> textures;   // readback order
+  std::vector<CaptureTraceValues> uniforms, buffers;
+  std::vector<CaptureTraceEvent> events;
+};
+
+struct CaptureTrace {
+  std::vector<CaptureTraceFrame> frames;   // frame_idx order; only frames with a Frame record
+  uint64_t bytes = 0;
+  uint64_t texture_bytes = 0;
+};
+
+// false (err says why) if the file is not a trace; a truncated last record is dropped silently
+bool load_capture_trace(const std::string& path, CaptureTrace& out, std::string& err);
@@ -5,6 +5,8 @@
 #include <string>
 #include "gcv_games/game_interface.h"
 #include "gcv_utils/simple_packed_buf.h"
+#include "packedbuf_frames.h"
+#include "readback_ring.h"
 
 struct depth_tex_settings {
 	int depthbyteskeep = 0;
@@ -16,14 +18,25 @@ struct depth_tex_settings {
 	bool more_verbose = false;
 };
 
-enum TextureInterpretation {
-	TexInterp_RGB = 0,
-	TexInterp_Depth,
-	TexInterp_IndexedSeg,
-	TexInterp_LinearDepthF32,
-};
-
 bool copy_texture_image_needing_resource_barrier_into_packedbuf(
 	GameInterface *gamehandle, simple_packed_buf &dstBuf,
 	reshade::api::command_queue* queue, reshade::api::resource tex,
 	TextureInterpretation tex_interp, const depth_tex_settings &debug_settings);
+
+bool copy_texture_image_given_ready_resource_into_packedbuf(
+	GameInterface *gamehandle, simple_packed_buf &dstBuf,
+	const reshade::api::resource_desc &desc, const reshade::api::subresource_data &mapped_data,
+	TextureInterpretation tex_interp, const depth_tex_settings &depth_settings);
+
+// ReadbackRing backend over the queue's device (readback_ring_reshade.cpp); the ring's textures are
+// resource handles
+std::unique_ptr<ReadbackBackend> make_reshade_readback_backend(reshade::api::command_queue* queue);
+
+// Bytes of a row of pixels of a readback (its row_pitch may be padded past them)
+uint32_t readback_row_bytes(const ReadbackKey &key);
+
+// A ReadbackRing readback into dstBuf, interpreted like copy_texture_image_needing_resource_barrier_into_packedbuf
+bool copy_readback_into_packedbuf(
+	GameInterface *gamehandle, simple_packed_buf &dstBuf,
+	const ReadbackKey &key, const ReadbackMapped &mapped,
+	TextureInterpretation tex_interp, const depth_tex_settings &depth_settings);
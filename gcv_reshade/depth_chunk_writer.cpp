@@ -0,0 +1,249 @@
+#include "depth_chunk_writer.h"
+#include <reshade.hpp>
+#include <cerrno>
+#include <cstring>
+#ifdef _WIN32
+#include <share.h>
+#endif
+#include "lz4/lz4.h"
+#include "gcv_utils/depth_delta_codec.h"
+
+namespace {
+// readers (gcv_depth_reader.py on a live session) may open the file while it is written
+FILE* open_gcvd_file(const std::string& path) {
+#ifdef _WIN32
+  return _fsopen(path.c_str(), "wb", _SH_DENYNO);
+#else
+  return std::fopen(path.c_str(), "wb");
+#endif
+}
+}
+
+DepthChunkWriter::~DepthChunkWriter() {
+  close();
+}
+
+bool DepthChunkWriter::open(const std::string& path, int fps, uint32_t frames_per_chunk, uint32_t max_pending_chunks,
+                            bool delta) {
+  if (f_) return true;
+  f_ = open_gcvd_file(path);
+  if (!f_) {
+    char buf[512];
+    std::snprintf(buf, sizeof(buf), "[CV Capture] open %s failed: errno=%d", path.c_str(), errno);
+    reshade::log_message(reshade::log_level::error, buf);
+    return false;
+  }
+  setvbuf(f_, nullptr, _IOFBF, 1 << 20);
+  path_ = path;
+  frames_per_chunk_ = frames_per_chunk ? frames_per_chunk : 1;
+  max_pending_ = max_pending_chunks ? max_pending_chunks : 1;
+  delta_ = delta;
+  stop_ = false;
+  io_error_ = false;
+  file_pos_ = 0;
+  index_.clear();
+
+  GcvdFileHeader hdr{};
+  std::memcpy(hdr.magic, "GCVDEPTH", 8);
+  hdr.version = delta_ ? 2 : 1;
+  hdr.header_bytes = sizeof(GcvdFileHeader);
+  hdr.fps = (uint32_t)(fps > 0 ? fps : 0);
+  hdr.frames_per_chunk = frames_per_chunk_;
+  hdr.dtype = 0;
+  if (!write_bytes(&hdr, sizeof(hdr))) {
+    fclose(f_); f_ = nullptr;
+    return false;
+  }
+  th_ = std::thread(&DepthChunkWriter::flush_loop, this);
+  return true;
+}
+
+bool DepthChunkWriter::push(const float* data, int w, int h, uint64_t frame_idx, int64_t timestamp_us) {
+  if (!f_ || !data || w <= 0 || h <= 0) return false;
+  if (cur_ && (cur_->w != w || cur_->h != h)) seal_current();   // resolution change starts a new chunk
+  if (!cur_) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!spare_.empty()) { cur_ = std::move(spare_.back()); spare_.pop_back(); }
+  }
+  if (!cur_) cur_.reset(new Chunk());
+  if (cur_->frame_idx.empty()) {
+    cur_->w = w; cur_->h = h;
+    cur_->data.reserve((size_t)w * (size_t)h * frames_per_chunk_);
+  }
+  const size_t n = (size_t)w * (size_t)h;
+  cur_->frame_idx.push_back(frame_idx);
+  cur_->timestamp_us.push_back(timestamp_us);
+  cur_->data.insert(cur_->data.end(), data, data + n);
+  if (cur_->frame_idx.size() >= frames_per_chunk_) seal_current();
+  return true;
+}
+
+void DepthChunkWriter::seal_current(bool force) {
+  if (!cur_ || cur_->frame_idx.empty()) return;
+  std::unique_ptr<Chunk> dropped;
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!force && pending_.size() >= max_pending_) {
+      dropped = std::move(cur_);
+    } else {
+      pending_.push_back(std::move(cur_));
+    }
+  }
+  if (dropped) {
+    frames_dropped_.fetch_add(dropped->frame_idx.size(), std::memory_order_relaxed);
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "[CV Capture] depth writer behind, dropped frames %llu..%llu",
+                  (unsigned long long)dropped->frame_idx.front(), (unsigned long long)dropped->frame_idx.back());
+    reshade::log_message(reshade::log_level::warning, buf);
+    dropped->frame_idx.clear(); dropped->timestamp_us.clear(); dropped->data.clear();
+    cur_ = std::move(dropped);   // reuse right away
+    return;
+  }
+  cv_.notify_one();
+}
+
+void DepthChunkWriter::flush_loop() {
+  for (;;) {
+    std::unique_ptr<Chunk> c;
+    {
+      std::unique_lock<std::mutex> lk(mtx_);
+      cv_.wait(lk, [this] { return stop_ || !pending_.empty(); });
+      if (pending_.empty()) break;   // stop_ and drained
+      c = std::move(pending_.front());
+      pending_.pop_front();
+    }
+    if (!io_error_ && !write_chunk(*c)) {
+      io_error_ = true;
+      reshade::log_message(reshade::log_level::error, "[CV Capture] depth.gcvd write failed; further depth frames are discarded");
+    }
+    if (io_error_) frames_dropped_.fetch_add(c->frame_idx.size(), std::memory_order_relaxed);
+    c->frame_idx.clear(); c->timestamp_us.clear(); c->data.clear();
+    std::lock_guard<std::mutex> lk(mtx_);
+    spare_.push_back(std::move(c));
+  }
+}
+
+bool DepthChunkWriter::write_bytes(const void* p, size_t n) {
+  if (n) {
+    LatencyScope timed(write_lat_);
+    if (fwrite(p, 1, n, f_) != n) return false;
+  }
+  file_pos_ += n;
+  file_bytes_.fetch_add(n, std::memory_order_relaxed);
+  return true;
+}
+
+bool DepthChunkWriter::write_chunk(const Chunk& c) {
+  const uint32_t nf = (uint32_t)c.frame_idx.size();
+  const size_t frame_bytes = (size_t)c.w * (size_t)c.h * sizeof(float);
+
+  // compress every frame into one buffer first, the entry table precedes the payloads
+  const bool delta = delta_ && !fast_.load(std::memory_order_relaxed);   // codecs are per frame, either reads back
+  const int bound = delta ? (int)depth_codec_bound(c.w, c.h) : LZ4_compressBound((int)frame_bytes);
+  const bool can_lz4 = frame_bytes <= (size_t)LZ4_MAX_INPUT_SIZE && bound > 0;
+  comp_.resize(can_lz4 ? (size_t)bound * nf : 0);
+  std::vector<GcvdFrameEntry> entries(nf);
+  size_t comp_off = 0;
+  for (uint32_t i = 0; i < nf; ++i) {
+    GcvdFrameEntry& e = entries[i];
+    e.frame_idx = c.frame_idx[i];
+    e.timestamp_us = c.timestamp_us[i];
+    e.codec = GCVD_CODEC_RAW;
+    e.stored_bytes = frame_bytes;
+    if (can_lz4 && delta) {
+      // the frames are kept as pushed, so the previous one is exactly what a decoder will have
+      const float* cur = c.data.data() + (size_t)i * ((size_t)c.w * (size_t)c.h);
+      const float* prev = i ? cur - (size_t)c.w * (size_t)c.h : nullptr;
+      uint8_t* dst = reinterpret_cast<uint8_t*>(comp_.data() + comp_off);
+      const size_t n = depth_codec_encode(cur, prev, c.w, c.h, dst, (size_t)bound, codec_scratch_);
+      if (n > 0 && n < frame_bytes) {
+        e.codec = prev ? GCVD_CODEC_DELTA : GCVD_CODEC_KEY;
+        e.stored_bytes = (uint64_t)n;
+        comp_off += n;
+      }
+    } else if (can_lz4) {
+      const char* src = reinterpret_cast<const char*>(c.data.data()) + (size_t)i * frame_bytes;
+      const int n = LZ4_compress_default(src, comp_.data() + comp_off, (int)frame_bytes, bound);
+      if (n > 0 && (size_t)n < frame_bytes) {
+        e.codec = GCVD_CODEC_LZ4;
+        e.stored_bytes = (uint64_t)n;
+        comp_off += (size_t)n;
+      }
+    }
+  }
+
+  GcvdIndexEntry ie{};
+  ie.offset = file_pos_;
+  ie.first_frame_idx = c.frame_idx.front();
+  ie.last_frame_idx = c.frame_idx.back();
+  ie.num_frames = nf;
+
+  GcvdChunkHeader ch{};
+  std::memcpy(ch.magic, "GCVC", 4);
+  ch.num_frames = nf;
+  ch.width = (uint32_t)c.w;
+  ch.height = (uint32_t)c.h;
+  if (!write_bytes(&ch, sizeof(ch))) return false;
+  if (!write_bytes(entries.data(), entries.size() * sizeof(GcvdFrameEntry))) return false;
+
+  size_t off = 0;
+  uint64_t stored = 0;
+  for (uint32_t i = 0; i < nf; ++i) {
+    const GcvdFrameEntry& e = entries[i];
+    const bool packed = e.codec != GCVD_CODEC_RAW;
+    const void* p = packed
+      ? (const void*)(comp_.data() + off)
+      : (const void*)(reinterpret_cast<const char*>(c.data.data()) + (size_t)i * frame_bytes);
+    if (!write_bytes(p, (size_t)e.stored_bytes)) return false;
+    if (packed) off += (size_t)e.stored_bytes;
+    stored += e.stored_bytes;
+  }
+
+  index_.push_back(ie);
+  frames_written_.fetch_add(nf, std::memory_order_relaxed);
+  chunks_written_.fetch_add(1, std::memory_order_relaxed);
+  raw_bytes_.fetch_add((uint64_t)frame_bytes * nf, std::memory_order_relaxed);
+  stored_bytes_.fetch_add(stored, std::memory_order_relaxed);
+  return true;
+}
+
+void DepthChunkWriter::close() {
+  if (!f_) return;
+  seal_current(true);   // nothing is produced after this, so the window may overflow by one
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  if (th_.joinable()) th_.join();
+
+  if (!io_error_) {
+    GcvdTrailer tr{};
+    tr.index_offset = file_pos_;
+    tr.num_chunks = index_.size();
+    std::memcpy(tr.magic, "GCVDIDX1", 8);
+    if (!write_bytes(index_.data(), index_.size() * sizeof(GcvdIndexEntry)) || !write_bytes(&tr, sizeof(tr))) {
+      reshade::log_message(reshade::log_level::error, "[CV Capture] depth.gcvd index write failed (file is still readable by scanning)");
+    }
+  }
+  fclose(f_);
+  f_ = nullptr;
+
+  const DepthChunkWriterStats st = stats();
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "[CV Capture] depth.gcvd: %llu frames in %llu chunks, %llu dropped, %.1f MB -> %.1f MB",
+                (unsigned long long)st.frames_written, (unsigned long long)st.chunks_written,
+                (unsigned long long)st.frames_dropped, st.raw_bytes / 1048576.0, st.stored_bytes / 1048576.0);
+  reshade::log_message(reshade::log_level::info, buf);
+}
+
+DepthChunkWriterStats DepthChunkWriter::stats() const {
+  DepthChunkWriterStats s;
+  s.frames_written = frames_written_.load(std::memory_order_relaxed);
+  s.frames_dropped = frames_dropped_.load(std::memory_order_relaxed);
+  s.chunks_written = chunks_written_.load(std::memory_order_relaxed);
+  s.raw_bytes      = raw_bytes_.load(std::memory_order_relaxed);
+  s.stored_bytes   = stored_bytes_.load(std::memory_order_relaxed);
+  s.file_bytes     = file_bytes_.load(std::memory_order_relaxed);
+  return s;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_histogram.h"
+
+// Streaming container for raw float32 depth frames (depth.gcvd), replacing the depth_group_*.h5 files.
+// All integers little-endian. Layout:
+//   file header   GcvdFileHeader
+//   chunk 0       GcvdChunkHeader, num_frames x GcvdFrameEntry, then the frame payloads back to back
+//   chunk 1 ...
+//   index         num_chunks x GcvdIndexEntry          (written by close())
+//   trailer       GcvdTrailer                          (written by close())
+// Chunks are independent, so a reader can seek to any chunk through the index (or, if the session
+// crashed before close(), by walking the chunk headers from the start). Version 1 compresses every
+// frame on its own (LZ4); version 2 (delta) makes the first frame of a chunk a keyframe and codes
+// the others against the frame before them (gcv_utils/depth_delta_codec.h), so the chunk is also
+// the keyframe interval and a frame is decoded starting from its chunk's first frame.
+// Reader: python_threedee/gcv_depth_reader.py
+
+enum GcvdCodec : uint32_t {
+  GCVD_CODEC_RAW = 0,
+  GCVD_CODEC_LZ4 = 1,
+  GCVD_CODEC_KEY = 2,     // depth_codec_encode keyframe
+  GCVD_CODEC_DELTA = 3,   // depth_codec_encode against the previous frame of the chunk
+};
+
+#pragma pack(push, 1)
+struct GcvdFileHeader {
+  char magic[8];              // "GCVDEPTH"
+  uint32_t version;           // 1, or 2 if frames may use GCVD_CODEC_KEY / GCVD_CODEC_DELTA
+  uint32_t header_bytes;      // sizeof(GcvdFileHeader)
+  uint32_t fps;
+  uint32_t frames_per_chunk;
+  uint32_t dtype;             // 0 = float32
+  uint32_t reserved;
+};
+struct GcvdChunkHeader {
+  char magic[4];              // "GCVC"
+  uint32_t num_frames;
+  uint32_t width, height;
+};
+struct GcvdFrameEntry {
+  uint64_t frame_idx;
+  int64_t timestamp_us;
+  uint64_t stored_bytes;      // payload size on disk
+  uint32_t codec;             // GcvdCodec
+  uint32_t reserved;
+};
+struct GcvdIndexEntry {
+  uint64_t offset;            // file offset of the GcvdChunkHeader
+  uint64_t first_frame_idx, last_frame_idx;
+  uint32_t num_frames;
+  uint32_t reserved;
+};
+struct GcvdTrailer {
+  uint64_t index_offset;
+  uint64_t num_chunks;
+  char magic[8];              // "GCVDIDX1"
+};
+#pragma pack(pop)
+
+struct DepthChunkWriterStats {
+  uint64_t frames_written = 0;
+  uint64_t frames_dropped = 0;   // flusher fell more than the window behind
+  uint64_t chunks_written = 0;
+  uint64_t raw_bytes = 0;
+  uint64_t stored_bytes = 0;
+  uint64_t file_bytes = 0;       // everything written to depth.gcvd so far (headers, index included)
+};
+
+// push() copies the frame into the open chunk on the caller's thread; full chunks are handed to a
+// background thread that compresses and writes them. At most max_pending_chunks sealed chunks are
+// held in memory; beyond that whole chunks are dropped and counted, the render thread never waits.
+class DepthChunkWriter {
+public:
+  DepthChunkWriter() = default;
+  ~DepthChunkWriter();
+  DepthChunkWriter(const DepthChunkWriter&) = delete;
+  DepthChunkWriter& operator=(const DepthChunkWriter&) = delete;
+
+  // delta: keyframe + delta coding within each chunk (version 2), otherwise plain LZ4 per frame
+  bool open(const std::string& path, int fps, uint32_t frames_per_chunk = 8, uint32_t max_pending_chunks = 2,
+            bool delta = true);
+  bool push(const float* data, int w, int h, uint64_t frame_idx, int64_t timestamp_us);
+  void close();   // seals the partial chunk, drains the flusher, writes index + trailer
+  bool is_open() const { return f_ != nullptr; }
+  bool delta() const { return delta_; }
+  // delta files: chunks written from now on use plain LZ4 (still lossless, cheaper, larger); any thread
+  void set_fast(bool fast) { fast_.store(fast, std::memory_order_relaxed); }
+
+  DepthChunkWriterStats stats() const;
+  // Before open(): the flusher's file writes are timed into h, one per fwrite
+  void set_write_latency(LatencyHistogram* h) { write_lat_ = h; }
+
+private:
+  struct Chunk {
+    int w = 0, h = 0;
+    std::vector<uint64_t> frame_idx;
+    std::vector<int64_t> timestamp_us;
+    std::vector<float> data;       // frames back to back
+  };
+  void seal_current(bool force = false);   // caller thread
+  void flush_loop();               // flusher thread
+  bool write_chunk(const Chunk& c);
+  bool write_bytes(const void* p, size_t n);
+
+  FILE* f_ = nullptr;
+  std::string path_;
+  uint32_t frames_per_chunk_ = 8, max_pending_ = 2;
+  bool delta_ = true;
+  std::atomic<bool> fast_{false};
+
+  std::unique_ptr<Chunk> cur_;
+  std::deque<std::unique_ptr<Chunk>> pending_;
+  std::vector<std::unique_ptr<Chunk>> spare_;   // recycled chunk buffers
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::thread th_;
+
+  // flusher thread only
+  uint64_t file_pos_ = 0;
+  std::vector<GcvdIndexEntry> index_;
+  std::vector<char> comp_;
+  std::vector<uint8_t> codec_scratch_;
+  bool io_error_ = false;
+  LatencyHistogram* write_lat_ = nullptr;
+
+  std::atomic<uint64_t> frames_written_{0}, frames_dropped_{0}, chunks_written_{0};
+  std::atomic<uint64_t> raw_bytes_{0}, stored_bytes_{0}, file_bytes_{0};
+};
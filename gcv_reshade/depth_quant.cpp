@@ -0,0 +1,89 @@
+#include "depth_quant.h"
+#include <cmath>
+#include <cstring>
+
+const char* depth_curve_name(DepthCurve c) {
+  switch (c) {
+    case DepthCurve::Linear:  return "linear";
+    case DepthCurve::Log:     return "log";
+    case DepthCurve::Inverse: return "inverse";
+  }
+  return "?";
+}
+
+bool depth_curve_from_name(const std::string& name, DepthCurve& out) {
+  for (DepthCurve c : { DepthCurve::Linear, DepthCurve::Log, DepthCurve::Inverse }) {
+    if (name == depth_curve_name(c)) { out = c; return true; }
+  }
+  return false;
+}
+
+bool Depth16Params::valid() const {
+  if (!std::isfinite(near_z) || !std::isfinite(far_z) || !(near_z < far_z)) return false;
+  return curve == DepthCurve::Linear || near_z > 0.0f;
+}
+
+// t in [0,1] -> code; NaN goes to far like the gray8 path does
+static inline uint16_t code_from_t(float t) {
+  if (!(t > 0.0f)) return t == t ? 0 : kDepth16CodeMax;
+  if (t >= 1.0f) return kDepth16CodeMax;
+  return (uint16_t)(t * (float)kDepth16CodeMax + 0.5f);
+}
+
+void quantize_depth16(const float* src, size_t n, const Depth16Params& p, uint16_t* dst) {
+  // each curve is t = (f(d) - f(near)) * scale with a monotonic f; the per-pixel work is one f()
+  switch (p.curve) {
+    case DepthCurve::Linear: {
+      const float scale = 1.0f / (p.far_z - p.near_z);
+      for (size_t i = 0; i < n; ++i) dst[i] = code_from_t((src[i] - p.near_z) * scale);
+      return;
+    }
+    case DepthCurve::Log: {
+      const float lnear = std::log(p.near_z);
+      const float scale = 1.0f / (std::log(p.far_z) - lnear);
+      for (size_t i = 0; i < n; ++i) {
+        const float d = src[i];
+        dst[i] = d > 0.0f ? code_from_t((std::log(d) - lnear) * scale) : (d == d ? 0 : kDepth16CodeMax);
+      }
+      return;
+    }
+    case DepthCurve::Inverse: {
+      const float inear = 1.0f / p.near_z;
+      const float scale = 1.0f / (inear - 1.0f / p.far_z);
+      for (size_t i = 0; i < n; ++i) {
+        const float d = src[i];
+        dst[i] = d > 0.0f ? code_from_t((inear - 1.0f / d) * scale) : (d == d ? 0 : kDepth16CodeMax);
+      }
+      return;
+    }
+  }
+}
+
+float dequantize_depth16(uint16_t code, const Depth16Params& p) {
+  const double t = (double)code / (double)kDepth16CodeMax;
+  switch (p.curve) {
+    case DepthCurve::Linear:  return (float)(p.near_z + t * ((double)p.far_z - p.near_z));
+    case DepthCurve::Log:     return (float)(p.near_z * std::pow((double)p.far_z / p.near_z, t));
+    case DepthCurve::Inverse: {
+      const double inear = 1.0 / p.near_z;
+      return (float)(1.0 / (inear - t * (inear - 1.0 / p.far_z)));
+    }
+  }
+  return 0.0f;
+}
+
+void truncate_depth_mantissa(float* data, size_t n, int keep_bits) {
+  if (!data || keep_bits >= 23) return;
+  const int drop = 23 - (keep_bits < 1 ? 1 : keep_bits);
+  const uint32_t half = 1u << (drop - 1);
+  const uint32_t mask = ~((1u << drop) - 1u);
+  for (size_t i = 0; i < n; ++i) {
+    uint32_t u;
+    std::memcpy(&u, &data[i], 4);
+    if ((u & 0x7F800000u) == 0x7F800000u) continue;   // inf, NaN
+    // a carry out of the mantissa is the next power of two, still correctly rounded; up to infinity it truncates
+    uint32_t r = (u + half) & mask;
+    if ((r & 0x7F800000u) == 0x7F800000u) r = u & mask;
+    std::memcpy(&data[i], &r, 4);
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Float depth -> 16-bit codes for the lossless depth16.mkv stream (FFV1, gray16le).
+// Code 0 is near_z, 65535 is far_z; values outside [near_z, far_z] and non-finite values clamp.
+//   Linear   t = (d - near) / (far - near)                     uniform absolute error
+//   Log      t = log(d / near) / log(far / near)               uniform relative error
+//   Inverse  t = (1/near - 1/d) / (1/near - 1/far)             uniform in disparity (most codes close up)
+// The inverse mapping is implemented by python_threedee/gcv_depth16.py; keep the two in sync.
+
+enum class DepthCurve : int { Linear = 0, Log = 1, Inverse = 2 };
+
+const char* depth_curve_name(DepthCurve c);
+bool depth_curve_from_name(const std::string& name, DepthCurve& out);
+
+struct Depth16Params {
+  DepthCurve curve = DepthCurve::Log;
+  float near_z = 0.01f;   // in the units of the grabbed depth (see grab_raw_depth_float32)
+  float far_z = 1000.0f;
+
+  // Log and Inverse need 0 < near < far, Linear only near < far
+  bool valid() const;
+};
+
+static const uint16_t kDepth16CodeMax = 65535;
+
+void quantize_depth16(const float* src, size_t n, const Depth16Params& p, uint16_t* dst);
+float dequantize_depth16(uint16_t code, const Depth16Params& p);
+
+// Keeps keep_bits (1..23) of the float mantissa, rounded to nearest: a relative error of at most
+// 2^-(keep_bits+1), and long runs of zero bits for the depth codec. Non-finite values are kept.
+// Used by the capture governor's depth precision step (capture_governor.h).
+void truncate_depth_mantissa(float* data, size_t n, int keep_bits);
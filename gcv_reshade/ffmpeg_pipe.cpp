@@ -0,0 +1,280 @@
+#include "ffmpeg_pipe.h"
+#include "mkv_feed.h"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+// output dir with a trailing separator, created if needed
+static std::string prepare_outdir(const std::string& outdir_raw) {
+#ifdef _WIN32
+  const char sep = '\\';
+#else
+  const char sep = '/';
+#endif
+  std::string outdir = outdir_raw;
+  for (auto& ch : outdir)
+    if (ch == '/' || ch == '\\') ch = sep;
+  if (!outdir.empty() && outdir.back() != sep) outdir.push_back(sep);
+  if (!outdir.empty()) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(outdir), ec);
+  }
+  return outdir;
+}
+
+FfmpegPipe::FfmpegPipe() {}
+
+FfmpegPipe::~FfmpegPipe() {
+  stop();
+}
+
+const char* video_timing_name(VideoTiming t) {
+  switch (t) {
+    case VideoTiming::WallClock: return "wallclock";
+    case VideoTiming::Vfr:       return "vfr";
+    case VideoTiming::Cfr:       return "cfr";
+    default:                     return "?";
+  }
+}
+
+// Input and frame-rate options of a live encoder. WallClock: raw frames read at 'fps' in real time
+// (-re), so frame k is shown at k / fps whenever it actually arrived. Otherwise a Matroska stream
+// whose frames carry their capture times, read as fast as the encoder goes: Vfr passes those times
+// through (in the input's microsecond time base), Cfr resamples them to fps.
+static std::vector<std::string> live_input_args(const std::string& exe, const char* pix_fmt, int width, int height, int fps,
+                                                VideoTiming timing) {
+  const std::string size = std::to_string(width) + "x" + std::to_string(height);
+  const std::string rate = std::to_string(fps);
+  switch (timing) {
+    case VideoTiming::Vfr:
+      return { exe, "-loglevel", "error", "-y", "-f", "matroska", "-i", "pipe:0", "-vsync", "passthrough", "-enc_time_base", "-1" };
+    case VideoTiming::Cfr:
+      return { exe, "-loglevel", "error", "-y", "-f", "matroska", "-i", "pipe:0", "-vsync", "cfr", "-r", rate };
+    default:
+      return {
+        exe, "-loglevel", "error", "-y",
+        "-re",
+        "-f", "rawvideo", "-pix_fmt", pix_fmt,
+        "-s", size,
+        "-framerate", rate,
+        "-i", "pipe:0",
+        "-vsync", "cfr", "-r", rate,
+      };
+  }
+}
+
+std::vector<std::string> FfmpegPipe::bgra_args(const std::string& exe, int width, int height, int fps, const std::string& out_path,
+                                               VideoTiming timing) {
+  std::vector<std::string> a = live_input_args(exe, "bgra", width, height, fps, timing);
+  a.insert(a.end(), {
+    "-c:v", "libx264", "-preset", "veryfast", "-crf", "18",
+    "-pix_fmt", "yuv420p", "-movflags", "+faststart",
+    out_path,
+  });
+  return a;
+}
+
+std::vector<std::string> FfmpegPipe::yuv420_args(const std::string& exe, int width, int height, int fps, const std::string& out_path, bool nv12,
+                                                 VideoTiming timing) {
+  std::vector<std::string> a = live_input_args(exe, nv12 ? "nv12" : "yuv420p", width, height, fps, timing);
+  a.insert(a.end(), {
+    "-c:v", "libx264", "-preset", "veryfast", "-crf", "18",
+    "-pix_fmt", "yuv420p", "-movflags", "+faststart",
+    out_path,
+  });
+  return a;
+}
+
+std::vector<std::string> FfmpegPipe::gray_args(const std::string& exe, int width, int height, int fps, const std::string& out_path,
+                                               VideoTiming timing) {
+  std::vector<std::string> a = live_input_args(exe, "gray", width, height, fps, timing);
+  a.insert(a.end(), {
+    "-c:v", "libx264", "-preset", "veryfast", "-crf", "18",
+    "-pix_fmt", "yuv420p",
+    out_path,
+  });
+  return a;
+}
+
+// lossless: no -re and no frame-rate conversion, so video frame k is exactly the k-th frame written
+std::vector<std::string> FfmpegPipe::gray16_args(const std::string& exe, int width, int height, int fps, const std::string& out_path) {
+  const std::string size = std::to_string(width) + "x" + std::to_string(height);
+  const std::string rate = std::to_string(fps);
+  return {
+    exe, "-loglevel", "error", "-y",
+    "-f", "rawvideo", "-pix_fmt", "gray16le",
+    "-s", size,
+    "-framerate", rate,
+    "-i", "pipe:0",
+    "-c:v", "ffv1", "-level", "3", "-g", "1", "-slices", "4", "-slicecrc", "1",
+    "-pix_fmt", "gray16le",
+    out_path,
+  };
+}
+
+std::vector<std::string> FfmpegPipe::segment_args(const std::string& exe, int width, int height, int fps, const std::string& out_path,
+                                                 const char* pix_fmt, int gop) {
+  const std::string size = std::to_string(width) + "x" + std::to_string(height);
+  const std::string rate = std::to_string(fps);
+  const std::string g = std::to_string(gop > 0 ? gop : 1);
+  return {
+    exe, "-loglevel", "error", "-y",
+    "-f", "rawvideo", "-pix_fmt", pix_fmt,
+    "-s", size,
+    "-framerate", rate,
+    "-i", "pipe:0",
+    "-vsync", "cfr", "-r", rate,
+    // same settings as capture.mp4 so the segments concatenate with -c copy; one IDR per segment
+    "-c:v", "libx264", "-preset", "veryfast", "-crf", "18",
+    "-g", g, "-keyint_min", g, "-sc_threshold", "0",
+    "-pix_fmt", "yuv420p", "-movflags", "+faststart",
+    out_path,
+  };
+}
+
+bool FfmpegPipe::start_args(const std::vector<std::string>& args, const std::string& outdir_raw) {
+  if (args.empty()) return false;
+  stop();
+  out_path_.clear();
+  timestamped_ = false;
+  pts0_us_ = 0;
+  last_pts_us_.store(-1, std::memory_order_relaxed);
+  prepare_outdir(outdir_raw);
+  std::unique_ptr<PipeProcess> p = make_pipe_process();
+  if (!p || !p->spawn(args)) return false;
+  proc_ = std::move(p);
+  return true;
+}
+
+bool FfmpegPipe::start_live(const std::vector<std::string>& args, const std::string& outdir, const std::string& file_name,
+                            const char* pix_fmt, int width, int height) {
+  if (!start_args(args, outdir)) return false;
+  out_path_ = outdir + file_name;
+  if (timing_ == VideoTiming::WallClock) return true;
+  // ffmpeg waits for the stream header before it reads any frame
+  const std::string hdr = mkv_stream_header(width, height, mkv_fourcc_for_pix_fmt(pix_fmt));
+  if (!write_bytes(hdr.data(), hdr.size())) {
+    stop();
+    return false;
+  }
+  timestamped_ = true;
+  return true;
+}
+
+bool FfmpegPipe::start_bgra(int width, int height, int fps, const std::string& outdir_raw) {
+  const std::string outdir = prepare_outdir(outdir_raw);
+  return start_live(bgra_args(exe_, width, height, fps, outdir + "capture.mp4", timing_), outdir, "capture.mp4", "bgra", width, height);
+}
+
+bool FfmpegPipe::start_yuv420(int width, int height, int fps, const std::string& outdir_raw, bool nv12) {
+  const std::string outdir = prepare_outdir(outdir_raw);
+  return start_live(yuv420_args(exe_, width, height, fps, outdir + "capture.mp4", nv12, timing_), outdir, "capture.mp4",
+                    nv12 ? "nv12" : "yuv420p", width, height);
+}
+
+bool FfmpegPipe::start_gray(int width, int height, int fps, const std::string& outdir_raw) {
+  const std::string outdir = prepare_outdir(outdir_raw);
+  return start_live(gray_args(exe_, width, height, fps, outdir + "depth.mp4", timing_), outdir, "depth.mp4", "gray", width, height);
+}
+
+bool FfmpegPipe::start_gray16(int width, int height, int fps, const std::string& outdir_raw) {
+  const std::string outdir = prepare_outdir(outdir_raw);
+  if (!start_args(gray16_args(exe_, width, height, fps, outdir + "depth16.mkv"), outdir)) return false;
+  out_path_ = outdir + "depth16.mkv";
+  return true;
+}
+
+bool FfmpegPipe::start_segment(int width, int height, int fps, const std::string& outdir_raw, const std::string& file_name,
+                               const char* pix_fmt, int gop) {
+  const std::string outdir = prepare_outdir(outdir_raw);
+  if (!start_args(segment_args(exe_, width, height, fps, outdir + file_name, pix_fmt, gop), outdir)) return false;
+  out_path_ = outdir + file_name;
+  return true;
+}
+
+bool FfmpegPipe::write(const void* data, size_t bytes) {
+  if (!write_bytes(data, bytes)) return false;
+  writes_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool FfmpegPipe::write_frame(const void* data, size_t bytes, int64_t timestamp_us) {
+  if (!timestamped_) return write(data, bytes);
+  if (!proc_ || !data || bytes == 0) return false;
+  int64_t last = last_pts_us_.load(std::memory_order_relaxed);
+  if (last < 0) pts0_us_ = timestamp_us;
+  int64_t pts = timestamp_us - pts0_us_;
+  if (last >= 0 && pts <= last) {   // same stamp twice, or the clock went back: the muxer needs rising times
+    pts = last + 1;
+    pts_fixups_.fetch_add(1, std::memory_order_relaxed);
+  }
+  uint8_t hdr[kMkvMaxFrameHeader];
+  const size_t n = mkv_frame_header(hdr, pts, bytes);
+  if (!write_bytes(hdr, n) || !write_bytes(data, bytes)) return false;
+  last_pts_us_.store(pts, std::memory_order_relaxed);
+  writes_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool FfmpegPipe::write_bytes(const void* data, size_t bytes) {
+  if (!proc_ || !data || bytes == 0) return false;
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  size_t left = bytes;
+  while (left > 0) {
+    size_t n = 0;
+    const PipeProcess::WriteStatus st = proc_->write_some(p, left, n);
+    if (st == PipeProcess::WriteStatus::Error) return false;
+    if (n > 0) {
+      p += n;
+      left -= n;
+      bytes_.fetch_add(n, std::memory_order_relaxed);
+      pieces_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    // pipe full: the encoder is behind, wait for it to read
+    const auto t0 = std::chrono::steady_clock::now();
+    const bool ok = proc_->wait_writable(50);
+    stalls_.fetch_add(1, std::memory_order_relaxed);
+    stall_us_.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - t0).count(), std::memory_order_relaxed);
+    if (!ok) return false;
+  }
+  return true;
+}
+
+void FfmpegPipe::take_over(FfmpegPipe& warm) {
+  if (&warm == this) return;
+  stop();
+  proc_ = std::move(warm.proc_);
+  out_path_ = std::move(warm.out_path_);
+  warm.out_path_.clear();
+  // the warm child already has its stream header; times start with the first frame written here
+  timing_ = warm.timing_;
+  timestamped_ = warm.timestamped_;
+  warm.timestamped_ = false;
+  pts0_us_ = 0;
+  last_pts_us_.store(-1, std::memory_order_relaxed);
+}
+
+void FfmpegPipe::stop(bool wait_exit) {
+  if (!proc_) return;
+  proc_->close(wait_exit);
+  proc_.reset();
+}
+
+bool FfmpegPipe::alive() const {
+  return proc_ && proc_->alive();
+}
+
+PipeWriteStats FfmpegPipe::stats() const {
+  PipeWriteStats s;
+  s.bytes          = bytes_.load(std::memory_order_relaxed);
+  s.writes         = writes_.load(std::memory_order_relaxed);
+  s.pieces         = pieces_.load(std::memory_order_relaxed);
+  s.stalls         = stalls_.load(std::memory_order_relaxed);
+  s.stall_us       = stall_us_.load(std::memory_order_relaxed);
+  s.pts_fixups     = pts_fixups_.load(std::memory_order_relaxed);
+  s.last_pts_us    = last_pts_us_.load(std::memory_order_relaxed);
+  return s;
+}
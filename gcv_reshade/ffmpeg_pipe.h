@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Child process fed through its stdin. One backend per platform:
+//   ffmpeg_pipe_win.cpp    CreateProcess + anonymous pipe in PIPE_NOWAIT mode
+//   ffmpeg_pipe_posix.cpp  posix_spawn + pipe with O_NONBLOCK on our end
+// The child's stderr is forwarded to the ReShade log by a reader thread owned by the backend.
+class PipeProcess {
+public:
+  enum class WriteStatus { Ok, WouldBlock, Error };
+
+  virtual ~PipeProcess() {}
+
+  // args[0] is the executable (looked up on PATH). Fails if the child exits right away.
+  virtual bool spawn(const std::vector<std::string>& args) = 0;
+  // Non-blocking: writes what fits right now (possibly 0 bytes) and reports it in 'written'.
+  virtual WriteStatus write_some(const void* data, size_t bytes, size_t& written) = 0;
+  // Waits up to timeout_ms for the pipe to accept more data; false if the child is gone.
+  virtual bool wait_writable(int timeout_ms) = 0;
+  // Closes our end of stdin (the child sees EOF). Optionally waits for the child to exit.
+  virtual void close(bool wait_exit) = 0;
+  virtual bool alive() const = 0;
+};
+
+std::unique_ptr<PipeProcess> make_pipe_process();   // defined by the platform backend
+
+struct PipeWriteStats {
+  uint64_t bytes = 0;            // bytes accepted by the child
+  uint64_t writes = 0;           // write() calls (one per frame)
+  uint64_t pieces = 0;           // write_some calls that made progress (frames go out in several)
+  uint64_t stalls = 0;           // times the pipe was full and we had to wait
+  uint64_t stall_us = 0;         // total time spent waiting for the pipe
+  uint64_t pts_fixups = 0;       // timestamped frames whose time was not after the previous one's (moved 1 us past it)
+  int64_t last_pts_us = -1;      // time of the last timestamped frame, relative to the first
+};
+
+// How the live encoders (capture.mp4, depth.mp4) learn when each frame was captured
+enum class VideoTiming : uint8_t {
+  WallClock = 0,   // raw frames at a fixed -framerate, paced by -re: frame k plays at k / fps
+  Vfr,             // Matroska with each frame's capture time (mkv_feed.h); encoded as fast as possible, times kept
+  Cfr,             // same feed, resampled by ffmpeg to fps (repeats or drops frames to follow the capture times)
+};
+const char* video_timing_name(VideoTiming t);
+
+class FfmpegPipe {
+public:
+  FfmpegPipe();
+  ~FfmpegPipe();
+  FfmpegPipe(const FfmpegPipe&) = delete;
+  FfmpegPipe& operator=(const FfmpegPipe&) = delete;
+
+  // capture.mp4 (BGRA stream)
+  bool start_bgra(int width, int height, int fps, const std::string& outdir_raw);
+  // capture.mp4 from frames already converted to 4:2:0 (yuv420p, or nv12 if 'nv12'); x264 encodes them as-is
+  bool start_yuv420(int width, int height, int fps, const std::string& outdir_raw, bool nv12 = false);
+  // depth.mp4 (gray stream)
+  bool start_gray(int width, int height, int fps, const std::string& outdir_raw);
+  // depth16.mkv (gray16le stream, FFV1 lossless, every frame a keyframe)
+  bool start_gray16(int width, int height, int fps, const std::string& outdir_raw);
+  // One GOP-aligned segment of the color stream (segmented encoding): pix_fmt is the raw input
+  // layout ("bgra", "yuv420p", "nv12"); the segment is a single GOP of up to 'gop' frames. No -re:
+  // segments are encoded as fast as the process can, several at a time.
+  bool start_segment(int width, int height, int fps, const std::string& outdir_raw, const std::string& file_name,
+                     const char* pix_fmt, int gop);
+  // Any consumer reading raw frames from stdin (e.g. a stub process when benchmarking the pipe)
+  bool start_args(const std::vector<std::string>& args, const std::string& outdir_raw);
+
+  // Executable used by start_bgra/start_gray, "ffmpeg" (from PATH) by default
+  void set_executable(const std::string& exe) { exe_ = exe; }
+  // Feed of start_bgra/start_yuv420/start_gray (WallClock by default); set before starting
+  void set_timing(VideoTiming t) { timing_ = t; }
+  VideoTiming timing() const { return timing_; }
+  // The running child reads a Matroska stream: frames go through write_frame with their time
+  bool timestamped() const { return timestamped_; }
+
+  // Write a whole frame (called by the background thread). Uses non-blocking partial writes and
+  // waits for the pipe to drain in between; returns false if the child died or the pipe broke.
+  bool write(const void* data, size_t bytes);
+  // Same for a frame captured at timestamp_us; with a timestamped feed its time goes along
+  // (relative to the first frame's, kept rising). Otherwise the plain write().
+  bool write_frame(const void* data, size_t bytes, int64_t timestamp_us);
+
+  // Moves a running child (and its output path) from 'warm' into this pipe, e.g. an encoder spawned
+  // ahead of time for the next recording. Stats stay with this pipe; 'warm' is left stopped.
+  void take_over(FfmpegPipe& warm);
+
+  // wait_exit: block until the child has finished (flushed its output file)
+  void stop(bool wait_exit = false);
+
+  bool alive() const;
+
+  PipeWriteStats stats() const;
+  // File the encoder writes (empty for start_args); its size is only final after stop(true)
+  const std::string& output_path() const { return out_path_; }
+
+  // ffmpeg command lines, also used by tools that start the encoder themselves
+  static std::vector<std::string> bgra_args(const std::string& exe, int width, int height, int fps, const std::string& out_path,
+                                            VideoTiming timing = VideoTiming::WallClock);
+  static std::vector<std::string> yuv420_args(const std::string& exe, int width, int height, int fps, const std::string& out_path, bool nv12 = false,
+                                              VideoTiming timing = VideoTiming::WallClock);
+  static std::vector<std::string> gray_args(const std::string& exe, int width, int height, int fps, const std::string& out_path,
+                                            VideoTiming timing = VideoTiming::WallClock);
+  static std::vector<std::string> segment_args(const std::string& exe, int width, int height, int fps, const std::string& out_path,
+                                               const char* pix_fmt, int gop);
+  static std::vector<std::string> gray16_args(const std::string& exe, int width, int height, int fps, const std::string& out_path);
+
+private:
+  bool write_bytes(const void* data, size_t bytes);
+  // start_args, then the Matroska header if the feed is timestamped
+  bool start_live(const std::vector<std::string>& args, const std::string& outdir, const std::string& file_name,
+                  const char* pix_fmt, int width, int height);
+
+  std::unique_ptr<PipeProcess> proc_;
+  std::string exe_ = "ffmpeg";
+  std::string out_path_;
+  VideoTiming timing_ = VideoTiming::WallClock;
+  bool timestamped_ = false;
+  int64_t pts0_us_ = 0;   // writer thread
+
+  std::atomic<uint64_t> bytes_{0}, writes_{0}, pieces_{0}, stalls_{0}, stall_us_{0}, pts_fixups_{0};
+  std::atomic<int64_t> last_pts_us_{-1};
+};
@@ -0,0 +1,163 @@
+#ifndef _WIN32
+#include "ffmpeg_pipe.h"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <reshade.hpp>
+
+extern char** environ;
+
+namespace {
+
+void log_child_stderr(int fd) {
+  char buf[512];
+  for (;;) {
+    const ssize_t got = read(fd, buf, sizeof(buf) - 1);
+    if (got < 0 && errno == EINTR) continue;
+    if (got <= 0) break;
+    buf[got] = 0;
+    reshade::log_message(reshade::log_level::error, std::string("[ffmpeg] ").append(buf).c_str());
+  }
+}
+
+bool set_flag(int fd, int get_cmd, int set_cmd, int flag) {
+  const int fl = fcntl(fd, get_cmd);
+  return fl >= 0 && fcntl(fd, set_cmd, fl | flag) == 0;
+}
+
+class PipeProcessPosix : public PipeProcess {
+public:
+  ~PipeProcessPosix() override { close(false); }
+
+  bool spawn(const std::vector<std::string>& args) override {
+    // a write to a pipe whose reader has exited must fail with EPIPE, not kill the host process
+    struct sigaction sa {};
+    if (sigaction(SIGPIPE, nullptr, &sa) == 0 && sa.sa_handler == SIG_DFL) signal(SIGPIPE, SIG_IGN);
+
+    int in[2] = {-1, -1}, err[2] = {-1, -1};
+    if (pipe(in) != 0) return false;
+    if (pipe(err) != 0) { ::close(in[0]); ::close(in[1]); return false; }
+    // our ends must not leak into the child
+    set_flag(in[1], F_GETFD, F_SETFD, FD_CLOEXEC);
+    set_flag(err[0], F_GETFD, F_SETFD, FD_CLOEXEC);
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, in[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&fa, err[1], STDERR_FILENO);
+    posix_spawn_file_actions_addclose(&fa, in[0]);
+    posix_spawn_file_actions_addclose(&fa, err[1]);
+
+    std::vector<char*> argv;
+    for (const auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid = -1;
+    const int rc = posix_spawnp(&pid, argv[0], &fa, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&fa);
+    ::close(in[0]);
+    ::close(err[1]);
+    if (rc != 0) {
+      ::close(in[1]);
+      ::close(err[0]);
+      reshade::log_message(reshade::log_level::error,
+        (std::string("[ffmpeg] spawn failed: ") + std::strerror(rc)).c_str());
+      return false;
+    }
+    pid_ = pid;
+    fd_ = in[1];
+    exited_ = false;
+
+    // Instant exit detection
+    usleep(120 * 1000);
+    int status = 0;
+    if (waitpid(pid_, &status, WNOHANG) == pid_) {
+      log_child_stderr(err[0]);
+      ::close(err[0]);
+      ::close(fd_);
+      fd_ = -1;
+      pid_ = -1;
+      return false;
+    }
+
+    // our end never blocks: write_some returns what fits and wait_writable polls for space
+    set_flag(fd_, F_GETFL, F_SETFL, O_NONBLOCK);
+
+    // the thread owns err[0] and ends when the child closes its stderr
+    const int efd = err[0];
+    std::thread([efd]() { log_child_stderr(efd); ::close(efd); }).detach();
+    return true;
+  }
+
+  WriteStatus write_some(const void* data, size_t bytes, size_t& written) override {
+    written = 0;
+    if (fd_ < 0) return WriteStatus::Error;
+    for (;;) {
+      const ssize_t n = ::write(fd_, data, bytes);
+      if (n >= 0) { written = (size_t)n; return n ? WriteStatus::Ok : WriteStatus::WouldBlock; }
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return WriteStatus::WouldBlock;
+      return WriteStatus::Error;   // EPIPE: the child closed its end
+    }
+  }
+
+  bool wait_writable(int timeout_ms) override {
+    if (fd_ < 0) return false;
+    pollfd p{};
+    p.fd = fd_;
+    p.events = POLLOUT;
+    const int r = poll(&p, 1, timeout_ms);
+    if (r < 0) return errno == EINTR;
+    if (r > 0 && (p.revents & (POLLERR | POLLHUP | POLLNVAL))) return false;
+    return true;   // writable, or timed out (the caller retries)
+  }
+
+  void close(bool wait_exit) override {
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+    if (pid_ > 0 && !exited_) {
+      int status = 0;
+      if (wait_exit) {
+        while (waitpid(pid_, &status, 0) < 0 && errno == EINTR) {}
+      } else if (waitpid(pid_, &status, WNOHANG) == 0) {
+        // still encoding: reap it in the background so it doesn't linger as a zombie
+        const pid_t pid = pid_;
+        std::thread([pid]() { int st = 0; while (waitpid(pid, &st, 0) < 0 && errno == EINTR) {} }).detach();
+      }
+    }
+    pid_ = -1;
+  }
+
+  // reaps the child once it has exited; ECHILD: another thread's alive() already did
+  bool alive() const override {
+    if (pid_ <= 0 || exited_) return false;
+    int status = 0;
+    const pid_t r = waitpid(pid_, &status, WNOHANG);
+    if (r == 0 || (r < 0 && errno == EINTR)) return true;
+    exited_ = true;
+    return false;
+  }
+
+private:
+  int fd_ = -1;      // our end of the child's stdin
+  pid_t pid_ = -1;
+  mutable std::atomic<bool> exited_{false};   // reaped by alive()
+};
+
+} // namespace
+
+std::unique_ptr<PipeProcess> make_pipe_process() {
+  return std::unique_ptr<PipeProcess>(new PipeProcessPosix());
+}
+
+#endif // !_WIN32
@@ -1,188 +1,168 @@
-#include "ffmpeg_pipe_win.h" 
+#ifdef _WIN32
+#include "ffmpeg_pipe.h"
 
-#include <ShlObj.h>
-#include <process.h>
+#include <Windows.h>
 
 #include <cstdio>
 #include <cstring>
 #include <reshade.hpp>
-#include <sstream>
-
-// ensure dir exists
-static void ensure_dir_existsA(const std::string& dir) {
-    std::string d = dir;
-    for (auto& ch : d)
-        if (ch == '/') ch = '\\';
-    if (!d.empty() && d.back() != '\\') d.push_back('\\');
-    SHCreateDirectoryExA(nullptr, d.c_str(), nullptr);
+#include <thread>
+
+namespace {
+
+// stdin pipe buffer size
+const DWORD kPipeBytes = 1 << 20;
+// in PIPE_NOWAIT mode a write larger than the free space may be refused entirely,
+// so writes are issued in small pieces that fit as soon as the child has read a little
+const DWORD kWriteSlice = 64 << 10;
+
+// Windows command line from argv (quoting per the MSVC CRT rules)
+std::string join_cmdline(const std::vector<std::string>& args) {
+  std::string cmd;
+  for (size_t i = 0; i < args.size(); ++i) {
+    const std::string& a = args[i];
+    if (i) cmd.push_back(' ');
+    if (!a.empty() && a.find_first_of(" \t\"") == std::string::npos) { cmd += a; continue; }
+    cmd.push_back('"');
+    size_t backslashes = 0;
+    for (char ch : a) {
+      if (ch == '\\') { ++backslashes; continue; }
+      if (ch == '"') cmd.append(backslashes * 2 + 1, '\\');
+      else cmd.append(backslashes, '\\');
+      backslashes = 0;
+      cmd.push_back(ch);
+    }
+    cmd.append(backslashes * 2, '\\');
+    cmd.push_back('"');
+  }
+  return cmd;
+}
+
+void log_child_stderr(HANDLE hErrRead) {
+  char buf[512];
+  for (;;) {
+    DWORD got = 0;
+    if (!ReadFile(hErrRead, buf, sizeof(buf) - 1, &got, nullptr) || got == 0) break;
+    buf[got] = 0;
+    reshade::log_message(reshade::log_level::error, std::string("[ffmpeg] ").append(buf).c_str());
+  }
 }
 
-bool FfmpegPipe::start_cmd(const std::string& cmdline, const std::string& out_dir_raw) {
+class PipeProcessWin : public PipeProcess {
+public:
+  ~PipeProcessWin() override { close(false); }
+
+  bool spawn(const std::vector<std::string>& args) override {
     SECURITY_ATTRIBUTES sa{sizeof(SECURITY_ATTRIBUTES)};
     sa.bInheritHandle = TRUE;
     sa.lpSecurityDescriptor = NULL;
 
-    std::string out_dir = out_dir_raw;
-    for (auto& ch : out_dir)
-        if (ch == '/') ch = '\\';
-    if (!out_dir.empty() && out_dir.back() != '\\') out_dir.push_back('\\');
-    ensure_dir_existsA(out_dir);
-
-    if (!CreatePipe(&hRead_, &hWrite_, &sa, 1 << 20)) return false;
+    HANDLE hRead = NULL, hErrRead = NULL, hErrWrite = NULL;
+    if (!CreatePipe(&hRead, &hWrite_, &sa, kPipeBytes)) return false;
     SetHandleInformation(hWrite_, HANDLE_FLAG_INHERIT, 0);
 
-    if (!CreatePipe(&hErrRead_, &hErrWrite_, &sa, 1 << 15)) {
-        CloseHandle(hRead_);
-        CloseHandle(hWrite_);
-        hRead_ = hWrite_ = NULL;
-        return false;
+    if (!CreatePipe(&hErrRead, &hErrWrite, &sa, 1 << 15)) {
+      CloseHandle(hRead);
+      CloseHandle(hWrite_);
+      hWrite_ = NULL;
+      return false;
     }
-    SetHandleInformation(hErrRead_, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(hErrRead, HANDLE_FLAG_INHERIT, 0);
 
     STARTUPINFOA si{};
     si.cb = sizeof(si);
     si.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
     si.wShowWindow = SW_HIDE;
-    si.hStdInput = hRead_;
-    si.hStdError = hErrWrite_;
+    si.hStdInput = hRead;
+    si.hStdError = hErrWrite;
     si.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
 
-    ZeroMemory(&pi_, sizeof(pi_));
-
+    PROCESS_INFORMATION pi{};
+    std::string cmdline = join_cmdline(args);
     BOOL ok = CreateProcessA(
-        NULL, (LPSTR)cmdline.c_str(),
+        NULL, &cmdline[0],
         NULL, NULL, TRUE, CREATE_NO_WINDOW,
-        NULL, NULL, &si, &pi_);
+        NULL, NULL, &si, &pi);
 
-    CloseHandle(hRead_);
-    hRead_ = NULL;
-    CloseHandle(hErrWrite_);
-    hErrWrite_ = NULL;
+    CloseHandle(hRead);
+    CloseHandle(hErrWrite);
 
     if (!ok) {
-        CloseHandle(hWrite_);
-        hWrite_ = NULL;
-        CloseHandle(hErrRead_);
-        hErrRead_ = NULL;
-        return false;
+      CloseHandle(hWrite_);
+      hWrite_ = NULL;
+      CloseHandle(hErrRead);
+      return false;
     }
-
-    hProc_ = pi_.hProcess;
+    if (pi.hThread) CloseHandle(pi.hThread);
+    hProc_ = pi.hProcess;
 
     // Instant exit detection
     Sleep(120);
     DWORD code = 0;
-    if (!GetExitCodeProcess(pi_.hProcess, &code) || code != STILL_ACTIVE) {
-        char buf[512];
-        for (;;) {
-            DWORD got = 0;
-            if (!ReadFile(hErrRead_, buf, sizeof(buf) - 1, &got, nullptr) || got == 0) break;
-            buf[got] = 0;
-            reshade::log_message(reshade::log_level::error, std::string("[ffmpeg] ").append(buf).c_str());
-        }
-        if (pi_.hThread) {
-            CloseHandle(pi_.hThread);
-            pi_.hThread = NULL;
-        }
-        if (pi_.hProcess) {
-            CloseHandle(pi_.hProcess);
-            pi_.hProcess = NULL;
-        }
-        if (hWrite_) {
-            CloseHandle(hWrite_);
-            hWrite_ = NULL;
-        }
-        if (hErrRead_) {
-            CloseHandle(hErrRead_);
-            hErrRead_ = NULL;
-        }
-        hProc_ = NULL;
-        return false;
+    if (!GetExitCodeProcess(hProc_, &code) || code != STILL_ACTIVE) {
+      log_child_stderr(hErrRead);
+      CloseHandle(hErrRead);
+      CloseHandle(hWrite_);
+      hWrite_ = NULL;
+      CloseHandle(hProc_);
+      hProc_ = NULL;
+      return false;
     }
 
-    // Asynchronously read stderr and print it to the ReShade log
-    _beginthreadex(nullptr, 0, [](void* arg) -> unsigned {
-      auto *self = (FfmpegPipe*)arg; char buf[512];
-      for (;;) {
-        DWORD got = 0;
-        if (!ReadFile(self->hErrRead_, buf, sizeof(buf)-1, &got, nullptr) || got==0) break;
-        buf[got] = 0;
-        reshade::log_message(reshade::log_level::error, std::string("[ffmpeg] ").append(buf).c_str());
-      }
-      return 0u; }, this, 0, nullptr);
+    // our end never blocks: write_some returns what fits and wait_writable paces the retries
+    DWORD mode = PIPE_NOWAIT;
+    SetNamedPipeHandleState(hWrite_, &mode, NULL, NULL);
 
+    // Asynchronously read stderr and print it to the ReShade log; the thread owns hErrRead
+    // and ends when the child closes its stderr
+    std::thread([hErrRead]() { log_child_stderr(hErrRead); CloseHandle(hErrRead); }).detach();
     return true;
-}
-
-bool FfmpegPipe::start_bgra(int width, int height, int fps, const std::string& outdir_raw) {
-    std::string outdir = outdir_raw;
-    for (auto& ch : outdir)
-        if (ch == '/') ch = '\\';
-    if (!outdir.empty() && outdir.back() != '\\') outdir.push_back('\\');
-    const std::string out_mp4 = outdir + "capture.mp4";
-
-    std::ostringstream cmd;
-    cmd << "ffmpeg -loglevel error -y "
-        << "-re "
-        << "-f rawvideo -pix_fmt bgra "
-        << "-s " << width << "x" << height << " "
-        << "-framerate " << fps << " "
-        << "-i pipe:0 "
-        << "-vsync cfr -r " << fps << " "
-        << "-c:v libx264 -preset veryfast -crf 18 "
-        << "-pix_fmt yuv420p -movflags +faststart "
-        << "\"" << out_mp4 << "\"";
-    return start_cmd(cmd.str(), outdir);
-}
-
-bool FfmpegPipe::start_gray(int width, int height, int fps, const std::string& outdir_raw) {
-    std::string outdir = outdir_raw;
-    for (auto& ch : outdir)
-        if (ch == '/') ch = '\\';
-    if (!outdir.empty() && outdir.back() != '\\') outdir.push_back('\\');
-    const std::string out_mp4 = outdir + "depth.mp4";
-
-    std::ostringstream cmd;
-    cmd << "ffmpeg -loglevel error -y "
-        << "-re "
-        << "-f rawvideo -pix_fmt gray "
-        << "-s " << width << "x" << height << " "
-        << "-framerate " << fps << " "
-        << "-i pipe:0 "
-        << "-vsync cfr -r " << fps << " "
-        << "-c:v libx264 -preset veryfast -crf 18 "
-        << "-pix_fmt yuv420p "
-        << "\"" << out_mp4 << "\"";
-    return start_cmd(cmd.str(), outdir);
-}
+  }
 
-bool FfmpegPipe::write(const void* data, size_t bytes) {
-    if (!hProc_ || !hWrite_ || !data || bytes == 0) return false;
+  WriteStatus write_some(const void* data, size_t bytes, size_t& written) override {
+    written = 0;
+    if (!hWrite_) return WriteStatus::Error;
+    const DWORD n = (DWORD)(bytes < kWriteSlice ? bytes : kWriteSlice);
     DWORD wrote = 0;
-    if (!WriteFile(hWrite_, data, (DWORD)bytes, &wrote, nullptr)) return false;
-    return wrote == bytes;
-}
+    if (!WriteFile(hWrite_, data, n, &wrote, nullptr)) {
+      return WriteStatus::Error;   // typically ERROR_NO_DATA: the child closed its end
+    }
+    written = wrote;
+    return wrote ? WriteStatus::Ok : WriteStatus::WouldBlock;
+  }
+
+  bool wait_writable(int timeout_ms) override {
+    // anonymous pipes can't be waited on for free space: check the child is still there and
+    // back off one scheduler tick (well below timeout_ms), the caller retries
+    (void)timeout_ms;
+    if (!hProc_ || WaitForSingleObject(hProc_, 0) == WAIT_OBJECT_0) return false;
+    Sleep(1);
+    return true;
+  }
 
-void FfmpegPipe::stop() {
+  void close(bool wait_exit) override {
     if (hWrite_) {
-        CloseHandle(hWrite_);
-        hWrite_ = NULL;
-    }
-    if (hErrRead_) {
-        CloseHandle(hErrRead_);
-        hErrRead_ = NULL;
-    }
-    if (hErrWrite_) {
-        CloseHandle(hErrWrite_);
-        hErrWrite_ = NULL;
-    }
-    if (pi_.hThread) {
-        CloseHandle(pi_.hThread);
-        pi_.hThread = NULL;
+      CloseHandle(hWrite_);
+      hWrite_ = NULL;
     }
-    if (pi_.hProcess) {
-        CloseHandle(pi_.hProcess);
-        pi_.hProcess = NULL;
+    if (hProc_) {
+      if (wait_exit) WaitForSingleObject(hProc_, INFINITE);
+      CloseHandle(hProc_);
+      hProc_ = NULL;
     }
-    hProc_ = NULL;
+  }
+
+  bool alive() const override { return hProc_ != NULL && WaitForSingleObject(hProc_, 0) == WAIT_TIMEOUT; }
+
+private:
+  HANDLE hWrite_ = NULL;   // our end of the child's stdin
+  HANDLE hProc_ = NULL;
+};
+
+} // namespace
+
+std::unique_ptr<PipeProcess> make_pipe_process() {
+  return std::unique_ptr<PipeProcess>(new PipeProcessWin());
 }
+
+#endif // _WIN32
@@ -0,0 +1,236 @@
+#include "frame_bus.h"
+
+#include <algorithm>
+#include <chrono>
+
+static int64_t steady_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* bus_topic_name(BusTopic t) {
+  switch (t) {
+    case BusTopic::Color:   return "color";
+    case BusTopic::Depth:   return "depth";
+    case BusTopic::Depth16: return "depth16";
+    default:                return "?";
+  }
+}
+
+FrameBus::~FrameBus() {
+  close();
+}
+
+int FrameBus::add_sink(BusTopic topic, std::unique_ptr<FrameSink> sink, size_t capacity, QueuePolicy policy) {
+  lanes_.push_back(std::make_unique<Lane>(topic, std::move(sink), capacity, policy));
+  return (int)lanes_.size() - 1;
+}
+
+size_t FrameBus::sink_count(BusTopic topic) const {
+  size_t n = 0;
+  for (const auto& l : lanes_) n += l->topic == topic ? 1 : 0;
+  return n;
+}
+
+bool FrameBus::publish(BusTopic topic, const FrameRef& f) {
+  if (!f) return false;
+  bool all = true;
+  for (auto& lp : lanes_) {
+    Lane& l = *lp;
+    if (l.topic != topic) continue;
+    if (!l.started.load(std::memory_order_relaxed)) {
+      l.th = std::thread(&FrameBus::run, this, std::ref(l));
+      l.started.store(true, std::memory_order_release);
+    }
+    l.published.fetch_add(1, std::memory_order_relaxed);
+    // a failed sink has closed its queue: the push is refused and counted as dropped
+    all &= l.q.push(FrameRef(f));
+  }
+  return all;
+}
+
+bool FrameBus::started(int id) const {
+  return id >= 0 && id < (int)lanes_.size() && lanes_[id]->started.load(std::memory_order_acquire);
+}
+
+bool FrameBus::failed(int id) const {
+  return id >= 0 && id < (int)lanes_.size() && lanes_[id]->failed.load(std::memory_order_acquire);
+}
+
+FrameSink* FrameBus::sink(int id) const {
+  return (id >= 0 && id < (int)lanes_.size()) ? lanes_[id]->sink.get() : nullptr;
+}
+
+void FrameBus::run(Lane& l) {
+  FrameRef f, prev;
+  uint32_t repeat = 0;
+  int64_t pushed_us = 0;
+  bool opened = false, ok = true;
+  while (ok && l.q.pop(f, repeat, &pushed_us)) {
+    if (!opened) {
+      ok = l.sink->open(f);
+      if (!ok) break;
+      opened = true;
+    }
+    if (queue_lat_) queue_lat_->record_ns((uint64_t)std::max<int64_t>(0, steady_us() - pushed_us) * 1000);
+    // DuplicateLast: frames dropped before this one are filled with the previous frame
+    uint64_t n = 0, b = 0;
+    if (!l.sink->repeats()) repeat = 0;
+    for (uint32_t i = 0; ok && prev && i < repeat; ++i) {
+      LatencyScope timed(consume_lat_);
+      ok = l.sink->consume(prev);
+      if (ok) { ++n; b += prev.size(); }
+    }
+    if (ok) {
+      LatencyScope timed(consume_lat_);
+      ok = l.sink->consume(f);
+      if (ok) { ++n; b += f.size(); }
+    }
+    l.consumed.fetch_add(n, std::memory_order_relaxed);
+    l.bytes.fetch_add(b, std::memory_order_relaxed);
+    const uint64_t lag = (uint64_t)std::max<int64_t>(0, steady_us() - pushed_us);
+    l.lag_us_sum.fetch_add(lag, std::memory_order_relaxed);
+    if (lag > l.lag_us_max.load(std::memory_order_relaxed)) l.lag_us_max.store(lag, std::memory_order_relaxed);
+    if (ok) prev = std::move(f);
+  }
+  if (ok) {   // closed and drained: the normal end
+    if (opened) l.sink->close();
+    return;
+  }
+  // open or consume failed: refuse further frames and hand what is still queued back to the pool
+  l.failed.store(true, std::memory_order_release);
+  l.q.close();
+  uint64_t lost = f ? 1 : 0;
+  f.reset();
+  prev.reset();
+  while (l.q.pop(f, repeat)) { ++lost; f.reset(); }
+  l.lost.fetch_add(lost, std::memory_order_relaxed);
+  if (opened) l.sink->close();
+}
+
+void FrameBus::close() {
+  for (auto& l : lanes_) l->q.close();
+  for (auto& l : lanes_) if (l->th.joinable()) l->th.join();
+}
+
+FrameBusSinkStats FrameBus::stats(int id) const {
+  FrameBusSinkStats s;
+  if (id < 0 || id >= (int)lanes_.size()) return s;
+  const Lane& l = *lanes_[id];
+  s.name = l.sink->name();
+  s.topic = l.topic;
+  s.capacity = l.q.capacity();
+  s.policy = l.q.policy();
+  s.started = l.started.load(std::memory_order_acquire);
+  s.failed = l.failed.load(std::memory_order_acquire);
+  s.published = l.published.load(std::memory_order_relaxed);
+  s.consumed = l.consumed.load(std::memory_order_relaxed);
+  s.bytes = l.bytes.load(std::memory_order_relaxed);
+  s.queued = l.q.depth();
+  s.queue = l.q.stats();
+  s.dropped = s.queue.dropped + l.lost.load(std::memory_order_relaxed);
+  // lag per popped frame (a repeat run is consumed along with the frame that follows it)
+  if (s.queue.popped) s.lag_mean_ms = (double)l.lag_us_sum.load(std::memory_order_relaxed) / (double)s.queue.popped / 1000.0;
+  s.lag_max_ms = (double)l.lag_us_max.load(std::memory_order_relaxed) / 1000.0;
+  return s;
+}
+
+std::vector<FrameBusSinkStats> FrameBus::stats() const {
+  std::vector<FrameBusSinkStats> out;
+  for (int i = 0; i < (int)lanes_.size(); ++i) out.push_back(stats(i));
+  return out;
+}
+
+//=================================================================================================
+
+bool MockFrameSink::open(const FrameRef& first) {
+  (void)first;
+  opened = true;
+  return !fail_open_;
+}
+
+bool MockFrameSink::consume(const FrameRef& f) {
+  if (consume_us_ > 0) std::this_thread::sleep_for(std::chrono::microseconds(consume_us_));
+  frame_idx.push_back(f.frame_idx());
+  data.push_back(f.data());
+  checksum += f.size() ? f.data()[0] : 0;
+  return true;
+}
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+std::string run_frame_bus_tests() {
+  FramePool pool(16);
+  FrameBus bus;
+  auto* fast = new MockFrameSink("fast");
+  auto* slow = new MockFrameSink("slow", 2000);
+  auto* dup = new MockFrameSink("slow_dup", 2000);
+  auto* norep = new MockFrameSink("slow_no_repeats", 2000);
+  norep->take_repeats = false;
+  auto* broken = new MockFrameSink("broken", 0, true);
+  auto* depth = new MockFrameSink("depth");
+  const int id_fast = bus.add_sink(BusTopic::Color, std::unique_ptr<FrameSink>(fast), 4, QueuePolicy::Block);
+  const int id_slow = bus.add_sink(BusTopic::Color, std::unique_ptr<FrameSink>(slow), 2, QueuePolicy::DropNewest);
+  const int id_dup = bus.add_sink(BusTopic::Color, std::unique_ptr<FrameSink>(dup), 2, QueuePolicy::DuplicateLast);
+  bus.add_sink(BusTopic::Color, std::unique_ptr<FrameSink>(norep), 2, QueuePolicy::DuplicateLast);
+  const int id_broken = bus.add_sink(BusTopic::Color, std::unique_ptr<FrameSink>(broken), 2, QueuePolicy::DropNewest);
+  const int id_depth = bus.add_sink(BusTopic::Depth, std::unique_ptr<FrameSink>(depth), 4, QueuePolicy::Block);
+  if (bus.sink_count(BusTopic::Color) != 5 || bus.sink_count(BusTopic::Depth16) != 0) RETURNFAILST("frame bus: sink_count");
+
+  const int kFrames = 100;
+  uint64_t sum = 0;
+  auto publish = [&](BusTopic topic, uint64_t idx) -> bool {
+    FrameRef f;
+    for (int tries = 0; !f && tries < 1000; ++tries) {   // every slot may be queued somewhere for a moment
+      f = pool.acquire(64);
+      if (!f) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    if (!f) return false;
+    f.set_geometry(16, 1, 64, FrameFormat::BGRA);
+    f.set_stamp(idx, (int64_t)idx * 1000);
+    f.data()[0] = (uint8_t)(idx & 0xFF);
+    bus.publish(topic, f);
+    return true;
+  };
+  for (int i = 0; i < kFrames; ++i) {
+    if (!publish(BusTopic::Color, (uint64_t)i)) RETURNFAILST("frame bus: pool exhausted, slots are not coming back");
+    sum += (uint64_t)(i & 0xFF);
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+  for (int i = 0; i < 10; ++i) if (!publish(BusTopic::Depth, 1000u + (uint64_t)i)) RETURNFAILST("frame bus: pool exhausted (depth)");
+  bus.close();
+
+  // the Block sink sees every frame in order
+  if (fast->frame_idx.size() != (size_t)kFrames || fast->checksum != sum) RETURNFAILST("frame bus: fast sink got " + std::to_string(fast->frame_idx.size()) + " frames");
+  for (int i = 0; i < kFrames; ++i) if (fast->frame_idx[i] != (uint64_t)i) RETURNFAILST("frame bus: fast sink out of order");
+  // the slow sinks lose frames without holding up the others
+  const FrameBusSinkStats ss = bus.stats(id_slow);
+  if (ss.published != (uint64_t)kFrames || ss.consumed + ss.dropped != (uint64_t)kFrames || ss.dropped == 0)
+    RETURNFAILST("frame bus: slow sink published " + std::to_string(ss.published) + " consumed " + std::to_string(ss.consumed) + " dropped " + std::to_string(ss.dropped));
+  if (!(ss.lag_mean_ms >= 1.0)) RETURNFAILST("frame bus: slow sink lag " + std::to_string(ss.lag_mean_ms) + " ms");
+  // one slot, many readers: the same memory, not a copy
+  for (size_t k = 0; k < slow->frame_idx.size(); ++k) {
+    if (slow->data[k] != fast->data[(size_t)slow->frame_idx[k]]) RETURNFAILST("frame bus: slow sink read a copy");
+  }
+  // DuplicateLast fills the gaps with repeats of the previous frame
+  bool repeats = false;
+  for (size_t k = 1; k < dup->frame_idx.size(); ++k) {
+    if (dup->frame_idx[k] < dup->frame_idx[k - 1]) RETURNFAILST("frame bus: duplicate sink out of order");
+    repeats |= dup->frame_idx[k] == dup->frame_idx[k - 1];
+  }
+  if (!repeats || dup->frame_idx.size() > (size_t)kFrames) RETURNFAILST("frame bus: duplicate sink did not repeat frames");
+  // ... unless the sink does not take repeats
+  if (norep->frame_idx.empty()) RETURNFAILST("frame bus: no-repeat sink got nothing");
+  for (size_t k = 1; k < norep->frame_idx.size(); ++k)
+    if (norep->frame_idx[k] <= norep->frame_idx[k - 1]) RETURNFAILST("frame bus: no-repeat sink got a repeat");
+  // a sink that fails to open is shut; its frames are dropped, not queued forever
+  const FrameBusSinkStats sb = bus.stats(id_broken);
+  if (!bus.failed(id_broken) || !broken->opened || broken->closed || sb.consumed != 0 || sb.dropped != (uint64_t)kFrames)
+    RETURNFAILST("frame bus: broken sink consumed " + std::to_string(sb.consumed) + " dropped " + std::to_string(sb.dropped));
+  if (bus.failed(id_fast) || !fast->closed) RETURNFAILST("frame bus: fast sink not closed");
+  // topics are separate
+  if (depth->frame_idx.size() != 10 || depth->frame_idx[0] != 1000) RETURNFAILST("frame bus: depth sink got " + std::to_string(depth->frame_idx.size()) + " frames");
+  if (bus.stats(id_dup).published != (uint64_t)kFrames || bus.stats(id_depth).published != 10) RETURNFAILST("frame bus: published counts");
+  // every reference is gone: all slots are back
+  if (pool.num_free() != pool.num_slots()) RETURNFAILST("frame bus: " + std::to_string(pool.num_slots() - pool.num_free()) + " slots not returned");
+  return std::string("ok");
+}
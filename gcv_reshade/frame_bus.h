@@ -0,0 +1,122 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame_pool.h"
+#include "frame_queue.h"
+#include "latency_histogram.h"
+
+// In-process fan-out of grabbed frames. A frame is published once per topic; every sink subscribed
+// to the topic gets another reference to the same pool slot (no copy) through its own FrameQueue,
+// with its own capacity and QueuePolicy, and consumes it on its own thread. A slow or failed sink
+// only loses its own frames.
+
+enum class BusTopic : uint8_t { Color = 0, Depth, Depth16, Count };   // Depth: tone-mapped gray8, Depth16: quantized raw depth
+const char* bus_topic_name(BusTopic t);
+
+class FrameSink {
+public:
+  virtual ~FrameSink() = default;
+  virtual const char* name() const = 0;
+  // Sink thread, before the first frame (start an encoder, open a file). false: the sink is shut
+  // and the frames published to it from then on count as dropped.
+  virtual bool open(const FrameRef& first) { (void)first; return true; }
+  // Sink thread, once per frame; frames dropped under DuplicateLast come again as repeats of the
+  // previous one. false: the sink failed and is shut.
+  virtual bool consume(const FrameRef& f) = 0;
+  // false: the sink does not want those repeats (e.g. it keeps frame times); checked after open
+  virtual bool repeats() const { return true; }
+  // Sink thread, after the last frame (also after a failure, not if open was never called)
+  virtual void close() {}
+};
+
+struct FrameBusSinkStats {
+  const char* name = "";
+  BusTopic topic = BusTopic::Color;
+  size_t capacity = 0;
+  QueuePolicy policy = QueuePolicy::DropNewest;
+  bool started = false;          // the sink thread was started (first frame published)
+  bool failed = false;
+  uint64_t published = 0;        // frames offered to the sink
+  uint64_t consumed = 0;         // consume() calls that succeeded, repeats included
+  uint64_t bytes = 0;            // of those frames
+  uint64_t dropped = 0;          // by the queue policy, or lost to a failed sink
+  uint64_t queued = 0;           // right now
+  double lag_mean_ms = 0.0;      // publish -> consume() done, over the frames consumed
+  double lag_max_ms = 0.0;
+  FrameQueueStats queue;
+};
+
+class FrameBus {
+public:
+  FrameBus() = default;
+  ~FrameBus();
+  FrameBus(const FrameBus&) = delete;
+  FrameBus& operator=(const FrameBus&) = delete;
+
+  // Before the first publish; returns the sink's id
+  int add_sink(BusTopic topic, std::unique_ptr<FrameSink> sink, size_t capacity, QueuePolicy policy);
+  size_t sink_count(BusTopic topic) const;
+  // Before the first publish: every sink's time queued (publish -> taken by its thread) and in
+  // consume() goes to these; null: not timed
+  void set_latency(LatencyHistogram* queue_wait, LatencyHistogram* consume) { queue_lat_ = queue_wait; consume_lat_ = consume; }
+  // Render thread (single producer): every sink of the topic gets a reference to f. A sink's thread
+  // starts with the first frame it is offered. True if every sink took the frame (empty f: false).
+  bool publish(BusTopic topic, const FrameRef& f);
+  bool started(int id) const;
+  bool failed(int id) const;
+  FrameSink* sink(int id) const;
+  // Closes the queues and joins the sink threads; each drains what it has queued first
+  void close();
+
+  std::vector<FrameBusSinkStats> stats() const;
+  FrameBusSinkStats stats(int id) const;
+
+private:
+  struct Lane {
+    Lane(BusTopic t, std::unique_ptr<FrameSink> s, size_t capacity, QueuePolicy policy)
+      : topic(t), sink(std::move(s)), q(capacity, policy) {}
+    BusTopic topic;
+    std::unique_ptr<FrameSink> sink;
+    FrameQueue q;
+    std::thread th;                      // publishing thread and close() only
+    std::atomic<bool> started{false};    // th was started; what other threads (stats, the overlay) read
+    std::atomic<bool> failed{false};
+    std::atomic<uint64_t> published{0}, consumed{0}, bytes{0}, lost{0}, lag_us_sum{0}, lag_us_max{0};
+  };
+  void run(Lane& l);
+
+  std::vector<std::unique_ptr<Lane>> lanes_;
+  LatencyHistogram* queue_lat_ = nullptr;
+  LatencyHistogram* consume_lat_ = nullptr;
+};
+
+// Test sink: remembers what it consumed, optionally slow or failing
+class MockFrameSink : public FrameSink {
+public:
+  explicit MockFrameSink(const char* name, int consume_us = 0, bool fail_open = false)
+    : name_(name), consume_us_(consume_us), fail_open_(fail_open) {}
+  const char* name() const override { return name_; }
+  bool open(const FrameRef& first) override;
+  bool consume(const FrameRef& f) override;
+  void close() override { closed = true; }
+  bool repeats() const override { return take_repeats; }
+  bool take_repeats = true;   // set before the first publish
+
+  // read after FrameBus::close()
+  std::vector<uint64_t> frame_idx;        // consumed, in order (repeats included)
+  std::vector<const uint8_t*> data;       // slot memory each frame was read from
+  uint64_t checksum = 0;                  // sum of the first byte of every frame consumed
+  bool opened = false, closed = false;
+
+private:
+  const char* name_;
+  int consume_us_;
+  bool fail_open_;
+};
+
+// Fan-out self-test with mock sinks (fast, slow, failing); "ok" or what failed (like run_utils_tests)
+std::string run_frame_bus_tests();
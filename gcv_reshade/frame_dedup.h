@@ -0,0 +1,42 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "xxhash.h"
+
+// Spots runs of identical consecutive frames (menus, pauses, loading screens) by an XXH3 fingerprint
+// of the grabbed buffer, so the recorder can skip storing them. One detector per output stream,
+// render thread only. A repeat always refers to the last frame that was actually stored.
+class RepeatDetector {
+public:
+  // true: same size, layout and content as the last stored frame (run() counts it)
+  bool check(const void* data, size_t bytes, int w, int h, uint32_t layout) {
+    const uint64_t seed = ((uint64_t)(uint32_t)w << 32) ^ ((uint64_t)(uint32_t)h << 8) ^ layout;
+    const uint64_t hash = XXH3_64bits_withSeed(data, bytes, seed);
+    if (valid_ && hash == hash_) {
+      ++run_;
+      ++repeats_;
+      longest_ = std::max<uint64_t>(longest_, run_);
+      return true;
+    }
+    pending_ = hash;
+    run_ = 0;
+    return false;
+  }
+  // after a frame that was not a repeat: ok = it went into the output (and later frames may repeat it)
+  void stored(bool ok) {
+    valid_ = ok;
+    hash_ = pending_;
+    run_ = 0;
+  }
+
+  uint32_t run() const { return run_; }         // repeats in a row ending with the last frame; 0 = it was stored
+  uint64_t repeats() const { return repeats_; }
+  uint64_t longest_run() const { return longest_; }
+
+private:
+  uint64_t hash_ = 0, pending_ = 0;
+  bool valid_ = false;
+  uint32_t run_ = 0;
+  uint64_t repeats_ = 0, longest_ = 0;
+};
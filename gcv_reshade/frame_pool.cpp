@@ -0,0 +1,72 @@
+#include "frame_pool.h"
+#include "gcv_utils/yuv_convert.h"
+
+void FrameRef::reset() {
+  if (!s_) return;
+  FrameSlot* s = s_;
+  s_ = nullptr;
+  if (s->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    s->owner->release(s);
+  }
+}
+
+void FrameRef::set_geometry(int w, int h, size_t stride, FrameFormat format) {
+  if (!s_) return;
+  s_->w = w; s_->h = h; s_->stride = stride;
+  s_->format = format;
+  const bool yuv = format == FrameFormat::I420 || format == FrameFormat::NV12;
+  s_->size = yuv ? yuv420_frame_bytes(w, h) : stride * (size_t)h;
+}
+
+void FrameRef::set_stamp(uint64_t frame_idx, int64_t timestamp_us) {
+  if (!s_) return;
+  s_->frame_idx = frame_idx;
+  s_->timestamp_us = timestamp_us;
+}
+
+FramePool::FramePool(size_t num_slots) {
+  slots_.reserve(num_slots);
+  free_.reserve(num_slots);
+  for (size_t i = 0; i < num_slots; ++i) {
+    slots_.emplace_back(new FrameSlot());
+    slots_.back()->owner = this;
+    free_.push_back(slots_.back().get());
+  }
+}
+
+FramePool::~FramePool() {
+  // every FrameRef must have been dropped by now (the pool is owned by the Recorder,
+  // which joins its writer threads before it is destroyed)
+}
+
+FrameRef FramePool::acquire(size_t bytes) {
+  FrameSlot* s = nullptr;
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!free_.empty()) { s = free_.back(); free_.pop_back(); }
+  }
+  if (!s) {
+    exhausted_.fetch_add(1, std::memory_order_relaxed);
+    return FrameRef();
+  }
+  // first use of a slot (or a resolution change) allocates; afterwards this is a no-op
+  if (s->bytes.size() < bytes) s->bytes.resize(bytes);
+  s->size = bytes;
+  s->stride = 0;
+  s->w = s->h = 0;
+  s->format = FrameFormat::BGRA;
+  s->frame_idx = 0;
+  s->timestamp_us = 0;
+  s->refs.store(1, std::memory_order_relaxed);
+  return FrameRef(s);
+}
+
+size_t FramePool::num_free() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return free_.size();
+}
+
+void FramePool::release(FrameSlot* s) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  free_.push_back(s);
+}
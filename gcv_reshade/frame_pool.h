@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Fixed-size pool of reference-counted frame buffers.
+// The grabbers convert straight into a slot, the recorder rings and writer threads pass
+// FrameRefs around, and a slot returns to the pool when its last reference is dropped.
+// Keeping the "last frame" or duplicating it is therefore just another reference, not a copy.
+
+class FramePool;
+
+// what a slot holds; YUV420 formats are three tightly packed planes (see gcv_utils/yuv_convert.h)
+enum class FrameFormat : uint8_t { BGRA, Gray8, I420, NV12, Gray16 };
+
+struct FrameSlot {
+  std::vector<uint8_t> bytes;   // grows to the largest frame ever stored, never shrinks
+  size_t size = 0, stride = 0;
+  int w = 0, h = 0;
+  FrameFormat format = FrameFormat::BGRA;
+  uint64_t frame_idx = 0;
+  int64_t timestamp_us = 0;
+
+  std::atomic<uint32_t> refs{0};
+  FramePool* owner = nullptr;
+};
+
+class FrameRef {
+public:
+  FrameRef() = default;
+  ~FrameRef() { reset(); }
+  FrameRef(const FrameRef& o) : s_(o.s_) { if (s_) s_->refs.fetch_add(1, std::memory_order_relaxed); }
+  FrameRef(FrameRef&& o) noexcept : s_(o.s_) { o.s_ = nullptr; }
+  FrameRef& operator=(const FrameRef& o) {
+    if (this != &o) { FrameRef tmp(o); std::swap(s_, tmp.s_); }
+    return *this;
+  }
+  FrameRef& operator=(FrameRef&& o) noexcept {
+    if (this != &o) { reset(); s_ = o.s_; o.s_ = nullptr; }
+    return *this;
+  }
+
+  void reset();
+  explicit operator bool() const { return s_ != nullptr; }
+  bool same_slot(const FrameRef& o) const { return s_ == o.s_; }
+
+  uint8_t* data() const { return s_ ? s_->bytes.data() : nullptr; }
+  size_t size() const { return s_ ? s_->size : 0; }
+  size_t stride() const { return s_ ? s_->stride : 0; }
+  int w() const { return s_ ? s_->w : 0; }
+  int h() const { return s_ ? s_->h : 0; }
+  FrameFormat format() const { return s_ ? s_->format : FrameFormat::BGRA; }
+  uint64_t frame_idx() const { return s_ ? s_->frame_idx : 0; }
+  int64_t timestamp_us() const { return s_ ? s_->timestamp_us : 0; }
+
+  // Only valid while the caller holds the sole reference (i.e. right after FramePool::acquire)
+  // stride is the (luma) row pitch; size is stride*h for packed formats, Y+U+V for I420/NV12
+  void set_geometry(int w, int h, size_t stride, FrameFormat format = FrameFormat::BGRA);
+  void set_stamp(uint64_t frame_idx, int64_t timestamp_us);
+
+private:
+  friend class FramePool;
+  explicit FrameRef(FrameSlot* s) : s_(s) {}
+  FrameSlot* s_ = nullptr;
+};
+
+class FramePool {
+public:
+  explicit FramePool(size_t num_slots);
+  ~FramePool();
+  FramePool(const FramePool&) = delete;
+  FramePool& operator=(const FramePool&) = delete;
+
+  // Returns an empty FrameRef when every slot is still referenced (caller should count a drop)
+  FrameRef acquire(size_t bytes);
+
+  size_t num_slots() const { return slots_.size(); }
+  size_t num_free() const;
+  uint64_t exhausted_count() const { return exhausted_.load(std::memory_order_relaxed); }
+
+private:
+  friend class FrameRef;
+  void release(FrameSlot* s);
+
+  std::vector<std::unique_ptr<FrameSlot>> slots_;
+  std::vector<FrameSlot*> free_;
+  mutable std::mutex mtx_;
+  std::atomic<uint64_t> exhausted_{0};
+};
@@ -0,0 +1,192 @@
+#include "frame_queue.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+// sleepers re-check on a timeout as well, so a missed notify costs at most this much latency
+static const std::chrono::milliseconds kWaitSlice(20);
+
+static int64_t steady_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* queue_policy_name(QueuePolicy p) {
+  switch (p) {
+    case QueuePolicy::Block:         return "block";
+    case QueuePolicy::DropOldest:    return "drop_oldest";
+    case QueuePolicy::DropNewest:    return "drop_newest";
+    case QueuePolicy::DuplicateLast: return "duplicate_last";
+  }
+  return "unknown";
+}
+
+bool queue_policy_from_name(const char* name, QueuePolicy& out) {
+  if (!name) return false;
+  for (int i = 0; i <= (int)QueuePolicy::DuplicateLast; ++i) {
+    if (std::strcmp(name, queue_policy_name((QueuePolicy)i)) == 0) { out = (QueuePolicy)i; return true; }
+  }
+  return false;
+}
+
+FrameQueue::FrameQueue(size_t capacity, QueuePolicy policy)
+  : cap_(capacity < 1 ? 1 : capacity), slots_(cap_ < 2 ? 2 : cap_), policy_(policy), cells_(new Cell[slots_]) {
+  for (size_t i = 0; i < slots_; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+}
+
+FrameQueue::~FrameQueue() {
+  close();
+}
+
+// A cell at position pos is free for the producer when seq == pos,
+// and holds a frame for a consumer when seq == pos + 1. A capacity below the number of cells
+// (capacity 1) is kept by the producer not running more than cap_ ahead of the consumer.
+bool FrameQueue::can_push() const {
+  const size_t pos = enq_pos_.load(std::memory_order_relaxed);
+  return pos - deq_pos_.load(std::memory_order_acquire) < cap_ && cells_[pos % slots_].seq.load(std::memory_order_acquire) == pos;
+}
+
+bool FrameQueue::can_pop() const {
+  const size_t pos = deq_pos_.load(std::memory_order_relaxed);
+  return cells_[pos % slots_].seq.load(std::memory_order_acquire) == pos + 1;
+}
+
+bool FrameQueue::try_push(FrameRef& f, uint32_t lead_dups) {
+  // single producer: no CAS needed on enq_pos_
+  const size_t pos = enq_pos_.load(std::memory_order_relaxed);
+  Cell& c = cells_[pos % slots_];
+  if (c.seq.load(std::memory_order_acquire) != pos || pos - deq_pos_.load(std::memory_order_acquire) >= cap_) return false;  // full
+  c.frame = std::move(f);
+  c.lead_dups = lead_dups;
+  c.pushed_us = steady_us();
+  enq_pos_.store(pos + 1, std::memory_order_relaxed);
+  c.seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+bool FrameQueue::try_pop(FrameRef& out, uint32_t& lead_dups, int64_t& pushed_us) {
+  // the writer thread and (under DropOldest) the producer may both pop, hence the CAS
+  size_t pos = deq_pos_.load(std::memory_order_relaxed);
+  for (;;) {
+    Cell& c = cells_[pos % slots_];
+    const size_t seq = c.seq.load(std::memory_order_acquire);
+    const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (deq_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        out = std::move(c.frame);
+        lead_dups = c.lead_dups;
+        pushed_us = c.pushed_us;
+        c.seq.store(pos + slots_, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;  // empty
+    } else {
+      pos = deq_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void FrameQueue::wake(const std::atomic<bool>& sleeping) {
+  // pairs with the fence in the sleeper: either it sees our publish, or we see its flag
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    cv_.notify_all();
+  }
+}
+
+bool FrameQueue::push(FrameRef&& f) {
+  for (;;) {
+    if (closed_.load(std::memory_order_acquire)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (try_push(f, pending_dups_)) {
+      pending_dups_ = 0;
+      pushed_.fetch_add(1, std::memory_order_relaxed);
+      const uint64_t d = depth();
+      if (d > max_depth_.load(std::memory_order_relaxed)) max_depth_.store(d, std::memory_order_relaxed);
+      wake(consumer_sleeping_);
+      return true;
+    }
+
+    switch (policy_) {
+      case QueuePolicy::DropNewest:
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      case QueuePolicy::DuplicateLast:
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        ++pending_dups_;
+        return false;
+      case QueuePolicy::DropOldest: {
+        FrameRef old;
+        uint32_t old_dups = 0;
+        int64_t old_us = 0;
+        if (try_pop(old, old_dups, old_us)) dropped_.fetch_add(1, std::memory_order_relaxed);
+        break;  // retry; 'old' goes back to the pool here
+      }
+      case QueuePolicy::Block: {
+        producer_waits_.fetch_add(1, std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lk(mtx_);
+        producer_sleeping_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!can_push() && !closed_.load(std::memory_order_acquire)) cv_.wait_for(lk, kWaitSlice);
+        producer_sleeping_.store(false, std::memory_order_relaxed);
+        break;
+      }
+    }
+  }
+}
+
+bool FrameQueue::pop(FrameRef& out, uint32_t& repeat, int64_t* pushed_us) {
+  for (;;) {
+    int64_t t_push = 0;
+    if (try_pop(out, repeat, t_push)) {
+      popped_.fetch_add(1, std::memory_order_relaxed);
+      const uint64_t waited = (uint64_t)std::max<int64_t>(0, steady_us() - t_push);
+      wait_us_sum_.fetch_add(waited, std::memory_order_relaxed);
+      if (waited > wait_us_max_.load(std::memory_order_relaxed)) wait_us_max_.store(waited, std::memory_order_relaxed);
+      if (pushed_us) *pushed_us = t_push;
+      duplicated_.fetch_add(repeat, std::memory_order_relaxed);
+      wake(producer_sleeping_);
+      return true;
+    }
+    if (closed_.load(std::memory_order_acquire)) {
+      // a push may have landed between our try_pop and the close
+      if (can_pop()) continue;
+      return false;
+    }
+    consumer_waits_.fetch_add(1, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lk(mtx_);
+    consumer_sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!can_pop() && !closed_.load(std::memory_order_acquire)) cv_.wait_for(lk, kWaitSlice);
+    consumer_sleeping_.store(false, std::memory_order_relaxed);
+  }
+}
+
+void FrameQueue::close() {
+  closed_.store(true, std::memory_order_release);
+  std::lock_guard<std::mutex> lk(mtx_);
+  cv_.notify_all();
+}
+
+size_t FrameQueue::depth() const {
+  const size_t e = enq_pos_.load(std::memory_order_acquire);
+  const size_t d = deq_pos_.load(std::memory_order_acquire);
+  return e > d ? e - d : 0;
+}
+
+FrameQueueStats FrameQueue::stats() const {
+  FrameQueueStats s;
+  s.pushed         = pushed_.load(std::memory_order_relaxed);
+  s.popped         = popped_.load(std::memory_order_relaxed);
+  s.dropped        = dropped_.load(std::memory_order_relaxed);
+  s.duplicated     = duplicated_.load(std::memory_order_relaxed);
+  s.producer_waits = producer_waits_.load(std::memory_order_relaxed);
+  s.consumer_waits = consumer_waits_.load(std::memory_order_relaxed);
+  s.max_depth      = max_depth_.load(std::memory_order_relaxed);
+  s.wait_us_sum    = wait_us_sum_.load(std::memory_order_relaxed);
+  s.wait_us_max    = wait_us_max_.load(std::memory_order_relaxed);
+  return s;
+}
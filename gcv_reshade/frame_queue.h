@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include "frame_pool.h"
+
+// What the producer (render thread) does when the queue to a writer thread is full
+enum class QueuePolicy : int {
+  Block = 0,          // wait for the writer to make room (nothing is lost, the game may stall)
+  DropOldest = 1,     // discard the oldest queued frame to make room for the new one
+  DropNewest = 2,     // discard the incoming frame
+  DuplicateLast = 3,  // discard the incoming frame, the writer repeats its last frame in its place
+};
+const char* queue_policy_name(QueuePolicy p);
+bool queue_policy_from_name(const char* name, QueuePolicy& out);
+
+struct FrameQueueStats {
+  uint64_t pushed = 0;          // frames accepted
+  uint64_t popped = 0;          // frames handed to the writer
+  uint64_t dropped = 0;         // frames lost (by DropOldest/DropNewest/DuplicateLast or a closed queue)
+  uint64_t duplicated = 0;      // repeats emitted by the writer under DuplicateLast
+  uint64_t producer_waits = 0;  // times the producer had to sleep (Block)
+  uint64_t consumer_waits = 0;  // times the writer found the queue empty and slept
+  uint64_t max_depth = 0;       // high-water mark of queued frames
+  uint64_t wait_us_sum = 0;     // time the popped frames spent queued
+  uint64_t wait_us_max = 0;
+};
+
+// Bounded queue of FrameRefs between the render thread and one writer thread.
+// Slots carry sequence numbers (Vyukov-style), so the producer may also pop when it has to
+// discard the oldest frame. The fast path is lock-free; the mutex/condvar are only touched
+// when one side actually has to sleep, and each side only notifies if the other is sleeping.
+class FrameQueue {
+public:
+  FrameQueue(size_t capacity, QueuePolicy policy);
+  ~FrameQueue();
+  FrameQueue(const FrameQueue&) = delete;
+  FrameQueue& operator=(const FrameQueue&) = delete;
+
+  // Render thread. Returns false if the frame was not queued (counted as dropped).
+  bool push(FrameRef&& f);
+  // Writer thread. Blocks until a frame is available; returns false once closed and drained.
+  // Under DuplicateLast, 'repeat' is how many frames were dropped right before this one:
+  // the writer re-emits its previous frame that many times first, so the timeline stays intact.
+  // pushed_us: when the frame was pushed (steady clock, microseconds), if the caller wants it.
+  bool pop(FrameRef& out, uint32_t& repeat, int64_t* pushed_us = nullptr);
+  // Wakes both sides; later pushes fail, pop() drains what is left.
+  void close();
+  bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+  size_t capacity() const { return cap_; }
+  QueuePolicy policy() const { return policy_; }
+  size_t depth() const;
+  FrameQueueStats stats() const;
+
+private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    FrameRef frame;
+    uint32_t lead_dups = 0;
+    int64_t pushed_us = 0;
+  };
+  bool try_push(FrameRef& f, uint32_t lead_dups);
+  bool try_pop(FrameRef& out, uint32_t& lead_dups, int64_t& pushed_us);
+  bool can_push() const;
+  bool can_pop() const;
+  void wake(const std::atomic<bool>& sleeping);
+
+  const size_t cap_;
+  const size_t slots_;   // cells: at least two, with one a full cell and a free one look the same
+  const QueuePolicy policy_;
+  std::unique_ptr<Cell[]> cells_;
+
+  alignas(64) std::atomic<size_t> enq_pos_{0};
+  alignas(64) std::atomic<size_t> deq_pos_{0};
+  alignas(64) std::atomic<bool> consumer_sleeping_{false};
+  std::atomic<bool> producer_sleeping_{false};
+  std::atomic<bool> closed_{false};
+  uint32_t pending_dups_ = 0;   // producer only
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+
+  std::atomic<uint64_t> pushed_{0}, popped_{0}, dropped_{0}, duplicated_{0};
+  std::atomic<uint64_t> producer_waits_{0}, consumer_waits_{0}, max_depth_{0};
+  std::atomic<uint64_t> wait_us_sum_{0}, wait_us_max_{0};   // consumer only writes
+};
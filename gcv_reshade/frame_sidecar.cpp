@@ -0,0 +1,129 @@
+#include "frame_sidecar.h"
+#include "gcv_utils/camera_data_struct.h"
+
+#include <cstring>
+#include <reshade.hpp>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+void frame_record_set_camera(GcvFrameRecord& r, const CamMatrixData& cam) {
+  const std::array<ftype, 12> m = cam_matrix_to_flattened_row_major_array(cam.extrinsic_cam2world);
+  for (int i = 0; i < 12; ++i) r.cam2world[i] = (double)m[i];
+  r.flags |= GCVF_CAM_VALID;
+  if (cam.extrinsic_status == CamMatrix_AllGood) r.flags |= GCVF_CAM_GOOD;
+  if (cam.fov_v_degrees > ftype(0.0)) { r.flags |= GCVF_FOV_V; r.fov_v_degrees = (double)cam.fov_v_degrees; }
+  if (cam.fov_h_degrees > ftype(0.0)) { r.flags |= GCVF_FOV_H; r.fov_h_degrees = (double)cam.fov_h_degrees; }
+}
+
+FrameSidecarWriter::~FrameSidecarWriter() {
+  close();
+}
+
+bool FrameSidecarWriter::open(const std::string& path, int fps, size_t grow_records) {
+  close();
+  grow_ = grow_records ? grow_records : 1;
+  count_ = 0;
+#ifdef _WIN32
+  HANDLE h = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                         CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (h == INVALID_HANDLE_VALUE) {
+    reshade::log_message(reshade::log_level::error, ("[CV Capture] open frames.bin failed: " + path).c_str());
+    return false;
+  }
+  file_ = h;
+#else
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    reshade::log_message(reshade::log_level::error, ("[CV Capture] open frames.bin failed: " + path).c_str());
+    return false;
+  }
+#endif
+  if (!map(grow_)) {
+    close();
+    return false;
+  }
+  GcvFramesHeader hdr{};
+  std::memcpy(hdr.magic, "GCVFRAME", 8);
+  hdr.version = 1;
+  hdr.header_bytes = sizeof(GcvFramesHeader);
+  hdr.record_bytes = sizeof(GcvFrameRecord);
+  hdr.fps = (uint32_t)(fps > 0 ? fps : 0);
+  hdr.num_records = 0;
+  std::memcpy(base_, &hdr, sizeof(hdr));
+  return true;
+}
+
+bool FrameSidecarWriter::append(const GcvFrameRecord& r) {
+  if (!base_) return false;
+  if (count_ >= capacity_ && !map(capacity_ + grow_)) return false;
+  std::memcpy(base_ + sizeof(GcvFramesHeader) + (size_t)count_ * sizeof(GcvFrameRecord), &r, sizeof(r));
+  ++count_;
+  // the count goes in after the record, so a reader of a crashed file never sees a torn record
+  std::memcpy(base_ + offsetof(GcvFramesHeader, num_records), &count_, sizeof(count_));
+  return true;
+}
+
+void FrameSidecarWriter::close() {
+  const bool had_file =
+#ifdef _WIN32
+    file_ != nullptr;
+#else
+    fd_ >= 0;
+#endif
+  if (!had_file) return;
+  unmap();
+  const uint64_t size = sizeof(GcvFramesHeader) + count_ * sizeof(GcvFrameRecord);
+#ifdef _WIN32
+  LARGE_INTEGER li;
+  li.QuadPart = (LONGLONG)size;
+  if (SetFilePointerEx((HANDLE)file_, li, nullptr, FILE_BEGIN)) SetEndOfFile((HANDLE)file_);
+  CloseHandle((HANDLE)file_);
+  file_ = nullptr;
+#else
+  if (ftruncate(fd_, (off_t)size) != 0) {
+    reshade::log_message(reshade::log_level::warning, "[CV Capture] frames.bin: trimming the preallocation failed");
+  }
+  ::close(fd_);
+  fd_ = -1;
+#endif
+  capacity_ = 0;
+}
+
+bool FrameSidecarWriter::map(size_t records) {
+  unmap();
+  const uint64_t size = sizeof(GcvFramesHeader) + (uint64_t)records * sizeof(GcvFrameRecord);
+#ifdef _WIN32
+  // a mapping larger than the file extends it (zero-filled)
+  HANDLE m = CreateFileMappingA((HANDLE)file_, nullptr, PAGE_READWRITE,
+                                (DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFFu), nullptr);
+  if (!m) return false;
+  void* p = MapViewOfFile(m, FILE_MAP_WRITE, 0, 0, (SIZE_T)size);
+  if (!p) { CloseHandle(m); return false; }
+  mapping_ = m;
+  base_ = static_cast<uint8_t*>(p);
+#else
+  if (ftruncate(fd_, (off_t)size) != 0) return false;
+  void* p = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) return false;
+  base_ = static_cast<uint8_t*>(p);
+#endif
+  capacity_ = records;
+  return true;
+}
+
+void FrameSidecarWriter::unmap() {
+  if (!base_) return;
+#ifdef _WIN32
+  UnmapViewOfFile(base_);
+  if (mapping_) { CloseHandle((HANDLE)mapping_); mapping_ = nullptr; }
+#else
+  munmap(base_, sizeof(GcvFramesHeader) + capacity_ * sizeof(GcvFrameRecord));
+#endif
+  base_ = nullptr;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct CamMatrixData;
+
+// frames.bin: one fixed-size record per recorded frame (pose, fov, keys, timestamps, drop flags),
+// the binary counterpart of cam.jsonl + actions.csv + frame_XXXXXX_camera.json.
+// All integers little-endian. Layout:
+//   GcvFramesHeader            (header_bytes)
+//   num_records x GcvFrameRecord
+// num_records in the header is updated after every append, so a file left behind by a crash is
+// still valid (the capacity past num_records is zero-filled preallocation, trimmed by close()).
+// Readers: python_threedee/gcv_frames.py (numpy memmap, plus converters to the JSON/CSV layouts)
+
+enum GcvFrameFlags : uint32_t {
+  GCVF_CAM_VALID     = 1u << 0,   // cam2world holds a pose ("extrinsic_WIP" unless GCVF_CAM_GOOD)
+  GCVF_CAM_GOOD      = 1u << 1,   // pose status AllGood ("extrinsic_cam2world")
+  GCVF_FOV_V         = 1u << 2,
+  GCVF_FOV_H         = 1u << 3,
+  GCVF_KEYS          = 1u << 4,   // letters/modifiers sampled (F7 mode)
+  GCVF_COLOR_DROPPED = 1u << 5,   // no color frame went into capture.mp4 for this index
+  GCVF_CONTROL_LATE  = 1u << 6,   // camera sampling took too long; not in cam.jsonl
+  GCVF_DEPTH_LATE    = 1u << 7,   // depth grab took too long; not in cam.jsonl
+  GCVF_COLOR_REPEAT  = 1u << 8,   // color identical to the last stored frame, not stored again (color_run)
+  GCVF_DEPTH_REPEAT  = 1u << 9,   // raw depth identical to the last stored frame (depth_run)
+  // capture profiles run each stream at its own rate; a frame holds the streams that were due
+  GCVF_NO_COLOR      = 1u << 10,  // color not captured at this frame (img_w/img_h are 0)
+  GCVF_NO_DEPTH      = 1u << 11,
+  GCVF_NO_POSE       = 1u << 12,  // camera not sampled; cam2world is not valid and not in cam.jsonl
+  GCVF_SEGMENTATION  = 1u << 13,  // segmentation snapshot requested at this frame
+  // capture governor (capture_governor.h): quality lowered while the writers were behind
+  GCVF_GOV_RATE        = 1u << 14,   // color and depth captured below their rate (divisor in GCVF_GOV_DIVISOR)
+  GCVF_GOV_DEPTH_BITS  = 1u << 15,   // raw depth mantissa cut to the governor's min_depth_bits (meta.json)
+  GCVF_GOV_DEPTH_FAST  = 1u << 16,   // depth.gcvd without delta coding from this frame's chunk on (lossless)
+  GCVF_DEPTH_DROPPED   = 1u << 17,   // depth was due but not read back: the capture pipeline was full
+  GCVF_GOV_LEVEL       = 0xFu << 20, // governor steps in effect (0: full quality)
+  GCVF_GOV_DIVISOR     = 0xFu << 24, // rate divisor: every n-th due color/depth frame captured (0: 1)
+};
+static const int kGcvfGovLevelShift = 20;
+static const int kGcvfGovDivisorShift = 24;
+
+#pragma pack(push, 1)
+struct GcvFramesHeader {
+  char magic[8];              // "GCVFRAME"
+  uint32_t version;           // 1
+  uint32_t header_bytes;      // sizeof(GcvFramesHeader)
+  uint32_t record_bytes;      // sizeof(GcvFrameRecord)
+  uint32_t fps;
+  uint64_t num_records;
+  uint8_t reserved[32];
+};
+struct GcvFrameRecord {
+  uint64_t frame_idx;
+  int64_t time_us;            // frame timestamp (same clock as actions.csv / cam.jsonl time_us)
+  int64_t cam_time_us;        // when the camera matrix was read
+  double cam2world[12];       // row-major 3x4
+  double fov_v_degrees;       // valid if GCVF_FOV_V
+  double fov_h_degrees;       // valid if GCVF_FOV_H
+  uint32_t letters_mask;      // bit i = 'A' + i
+  uint32_t modifiers_mask;    // bit 0..6: shift, ctrl, alt, space, enter, escape, tab
+  uint32_t flags;             // GcvFrameFlags
+  uint32_t img_w, img_h;
+  uint16_t color_run;         // GCVF_COLOR_REPEAT: n-th repeat in a row (saturates at 65535)
+  uint16_t depth_run;         // GCVF_DEPTH_REPEAT: same for depth
+};
+#pragma pack(pop)
+
+static_assert(sizeof(GcvFramesHeader) == 64, "frames.bin header layout");
+static_assert(sizeof(GcvFrameRecord) == 160, "frames.bin record layout");
+
+// Copies pose/fov/status from the game camera into r (sets the GCVF_CAM_* and GCVF_FOV_* flags)
+void frame_record_set_camera(GcvFrameRecord& r, const CamMatrixData& cam);
+
+// Append-only writer over a memory-mapped file: append() is a memcpy into the mapping, the file
+// grows (and is remapped) grow_records at a time.
+class FrameSidecarWriter {
+public:
+  FrameSidecarWriter() = default;
+  ~FrameSidecarWriter();
+  FrameSidecarWriter(const FrameSidecarWriter&) = delete;
+  FrameSidecarWriter& operator=(const FrameSidecarWriter&) = delete;
+
+  bool open(const std::string& path, int fps, size_t grow_records = 4096);
+  bool append(const GcvFrameRecord& r);
+  void close();   // trims the preallocation and unmaps
+  bool is_open() const { return base_ != nullptr; }
+  uint64_t num_records() const { return count_; }
+  uint64_t file_bytes() const { return count_ ? sizeof(GcvFramesHeader) + count_ * sizeof(GcvFrameRecord) : 0; }
+
+private:
+  bool map(size_t records);   // (re)maps the file sized for 'records' records
+  void unmap();
+
+  uint8_t* base_ = nullptr;
+  size_t capacity_ = 0;        // records that fit in the current mapping
+  size_t grow_ = 4096;
+  uint64_t count_ = 0;
+#ifdef _WIN32
+  void* file_ = nullptr;       // HANDLE
+  void* mapping_ = nullptr;    // HANDLE
+#else
+  int fd_ = -1;
+#endif
+};
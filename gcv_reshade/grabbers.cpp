@@ -1,8 +1,9 @@
 #include "grabbers.h"
 #include "copy_texture_into_packedbuf.h"
-#include <cmath>
-#include <cstring>
- 
+
+// The grab_* functions read the texture back synchronously, then convert it with the
+// *_from_packedbuf functions of packedbuf_frames.cpp.
+
 bool grab_bgra_frame(reshade::api::command_queue* q, reshade::api::resource tex,
                      std::vector<uint8_t>& out_bgra, int& w, int& h) {
   simple_packed_buf pbuf;
@@ -12,36 +13,32 @@ bool grab_bgra_frame(reshade::api::command_queue* q, reshade::api::resource tex,
     return false;
   }
   w = (int)pbuf.width; h = (int)pbuf.height;
-  const size_t row_bgra = (size_t)w * 4;
-  out_bgra.resize((size_t)h * row_bgra);
+  out_bgra.resize((size_t)h * (size_t)w * 4);
+  return packedbuf_to_bgra(pbuf, out_bgra.data());
+}
 
-  if (pbuf.pixfmt == BUF_PIX_FMT_RGBA) {
-    for (int y = 0; y < h; ++y) {
-      const uint8_t* src = pbuf.rowptr<uint8_t>(y);
-      uint8_t* dst = out_bgra.data() + (size_t)y * row_bgra;
-      for (int x = 0; x < w; ++x) {
-        const uint8_t r = src[4*x+0], g = src[4*x+1], b = src[4*x+2], a = src[4*x+3];
-        dst[4*x+0] = b; dst[4*x+1] = g; dst[4*x+2] = r; dst[4*x+3] = a;
-      }
-    }
-    return true;
-  } else if (pbuf.pixfmt == BUF_PIX_FMT_RGB24) {
-    for (int y = 0; y < h; ++y) {
-      const uint8_t* src = pbuf.rowptr<uint8_t>(y);
-      uint8_t* dst = out_bgra.data() + (size_t)y * row_bgra;
-      for (int x = 0; x < w; ++x) {
-        const uint8_t r = src[3*x+0], g = src[3*x+1], b = src[3*x+2];
-        dst[4*x+0] = b; dst[4*x+1] = g; dst[4*x+2] = r; dst[4*x+3] = 255;
-      }
-    }
-    return true;
-  } else {
-    reshade::log_message(reshade::log_level::error, "grab_bgra_frame: unsupported pixfmt");
+bool grab_bgra_frame(reshade::api::command_queue* q, reshade::api::resource tex,
+                     FramePool& pool, FrameRef& out, int& w, int& h, int downscale) {
+  simple_packed_buf pbuf;
+  depth_tex_settings depth_cfg{};
+  if (!copy_texture_image_needing_resource_barrier_into_packedbuf(
+          nullptr, pbuf, q, tex, TexInterp_RGB, depth_cfg)) {
     return false;
   }
+  return bgra_frame_from_packedbuf(pbuf, pool, out, w, h, downscale);
 }
 
-static inline uint8_t u8clamp_i(int v){ return (uint8_t)(v<0?0:(v>255?255:v)); }
+bool grab_yuv420_frame(reshade::api::command_queue* q, reshade::api::resource tex,
+                       FramePool& pool, FrameRef& out, int& w, int& h, FrameFormat layout, int downscale) {
+  if (layout != FrameFormat::I420 && layout != FrameFormat::NV12) return false;
+  simple_packed_buf pbuf;
+  depth_tex_settings depth_cfg{};
+  if (!copy_texture_image_needing_resource_barrier_into_packedbuf(
+          nullptr, pbuf, q, tex, TexInterp_RGB, depth_cfg)) {
+    return false;
+  }
+  return yuv420_frame_from_packedbuf(pbuf, pool, out, w, h, layout, downscale);
+}
 
 bool grab_depth_gray8(reshade::api::command_queue* q,
                       reshade::api::resource depth_tex,
@@ -59,168 +56,43 @@ bool grab_depth_gray8(reshade::api::command_queue* q,
   w = (int)pbuf.width; h = (int)pbuf.height;
   if (w<=0 || h<=0) return false;
   out_gray.resize((size_t)w * (size_t)h);
+  return packedbuf_depth_to_gray8(pbuf, out_gray.data(), p);
+}
 
-  const float alpha = (p.log_alpha > 0.f ? p.log_alpha : 1.f);
-  const float denom = std::log1p(alpha);
-  auto map01_farwhite_log = [&](float t01)->uint8_t {
-    if (t01 < 0.f) t01 = 0.f; else if (t01 > 1.f) t01 = 1.f;
-    float y = std::log1p(alpha * t01) / denom;
-    int g = (int)std::lround(y * 255.0f);
-    return u8clamp_i(g);
-  };
-
-  switch (pbuf.pixfmt) {
-    case BUF_PIX_FMT_GRAYF32: {
-      reshade::log_message(reshade::log_level::info, "grabbers: enter GRAYF32 branch");
-      const float lo = p.clip_low;
-      const float hi = (p.clip_high > lo ? p.clip_high : lo + 1e-6f);
-      const float invspan = 1.0f / (hi - lo);
-      for (int y = 0; y < h; ++y) {
-        const float* src = pbuf.rowptr<float>(y);
-        uint8_t* dst = out_gray.data() + (size_t)y * (size_t)w;
-        for (int x = 0; x < w; ++x) {
-          float d = src[x];
-          if (!std::isfinite(d)) d = hi;
-          float t = (d - lo) * invspan;
-          dst[x] = map01_farwhite_log(t);
-        }
-      }
-      return true;
-    }
-    case BUF_PIX_FMT_GRAYU32: {
-      // 1) 统计 vmin/vmax（已有）
-      uint32_t vmin = UINT32_MAX, vmax = 0;
-      for (int y = 0; y < h; ++y) {
-        const uint32_t* src = pbuf.rowptr<uint32_t>(y);
-        for (int x = 0; x < w; ++x) {
-          uint32_t v = src[x];
-          if (v < vmin) vmin = v;
-          if (v > vmax) vmax = v;
-        }
-      }
-      const double span = (vmax > vmin) ? double(vmax - vmin) : 1.0;
-
-      // 2) 轻量级“百分位裁剪”：均匀抽样，算 p5/p95，避免极端值把对比度拉平
-      constexpr int STRIDE = 8; // 抽样步长
-      std::vector<float> samples;
-      samples.reserve((w/STRIDE + 1) * (h/STRIDE + 1));
-      for (int y = 0; y < h; y += STRIDE) {
-        const uint32_t* src = pbuf.rowptr<uint32_t>(y);
-        for (int x = 0; x < w; x += STRIDE) {
-          double t0 = (double(src[x]) - double(vmin)) / span; // 0..1
-          samples.push_back((float)t0);
-        }
-      }
-      if (!samples.empty()) {
-        std::nth_element(samples.begin(), samples.begin() + samples.size()/20, samples.end());
-        float p05 = samples[samples.size()/20];               // 5%
-        std::nth_element(samples.begin(), samples.begin() + samples.size()*95/100, samples.end());
-        float p95 = samples[samples.size()*95/100];           // 95%
-        // 避免 p95==p05
-        if (p95 - p05 < 1e-6f) { p05 = std::max(0.f, p05 - 0.05f); p95 = std::min(1.f, p95 + 0.05f); }
-
-        // 3) 可调参数
-        const bool  invert = true;   // 近黑远白（需要近白远黑则置 false）
-        const float gamma  = 1.0f;   // >1 提升高亮；<1 提升暗部；=1 线性
-        const float alpha  = (p.log_alpha > 0.f ? p.log_alpha : 0.f); // 若想关闭对数映射，请设 0
-
-        for (int y = 0; y < h; ++y) {
-          const uint32_t* src = pbuf.rowptr<uint32_t>(y);
-          uint8_t* dst = out_gray.data() + (size_t)y * (size_t)w;
-          for (int x = 0; x < w; ++x) {
-            // 归一化到 [0,1]
-            float t = float((double(src[x]) - double(vmin)) / span);
-            // 百分位裁剪并线性拉伸
-            t = (t - p05) / (p95 - p05);
-            if (t < 0.f) t = 0.f; else if (t > 1.f) t = 1.f;
-            // 极性
-            if (invert) t = 1.0f - t;
-            // 伽马（可比对数映射更直观）
-            if (gamma != 1.0f) t = std::pow(t, 1.0f/gamma);
-            // 可选：对数映射（如要用，建议 alpha 取 2~6；alpha=0 表示关闭）
-            if (alpha > 0.f) {
-              t = std::log1p(alpha * t) / std::log1p(alpha);
-            }
-            // 写出
-            int g = (int)std::lround(t * 255.0f);
-            dst[x] = u8clamp_i(g);
-          }
-        }
-      } else {
-        // 退化：没有样本时的线性流程
-        for (int y = 0; y < h; ++y) {
-          const uint32_t* src = pbuf.rowptr<uint32_t>(y);
-          uint8_t* dst = out_gray.data() + (size_t)y * (size_t)w;
-          for (int x = 0; x < w; ++x) {
-            float t = float((double(src[x]) - double(vmin)) / span);
-            dst[x] = u8clamp_i((int)std::lround(t * 255.0f));
-          }
-        }
-      }
-      return true;
-    }
-
-
-    default:
-      reshade::log_message(reshade::log_level::info, "grabbers: enter default branch");
-      reshade::log_message(reshade::log_level::error, "grab_depth_gray8: unsupported depth pixfmt");
-      return false;
+bool grab_depth_gray8(reshade::api::command_queue* q,
+                      reshade::api::resource depth_tex,
+                      FramePool& pool, FrameRef& out,
+                      int& w, int& h,
+                      const DepthToneParams& p,
+                      int downscale)
+{
+  simple_packed_buf pbuf;
+  depth_tex_settings depth_cfg{};
+  if (!copy_texture_image_needing_resource_barrier_into_packedbuf(
+          nullptr, pbuf, q, depth_tex, TexInterp_Depth, depth_cfg)) {
+    return false;
   }
+  return depth_gray8_from_packedbuf(pbuf, pool, out, w, h, p, downscale);
 }
 
-
-
 bool grab_raw_depth_float32(
     reshade::api::command_queue* q,
     reshade::api::resource depth_tex,
     std::vector<float>& out_floats,
-    int& w, int& h)
+    int& w, int& h,
+    TextureInterpretation interp,
+    int downscale)
 {
     if (!q || depth_tex.handle == 0) return false;
 
     simple_packed_buf pbuf;
     depth_tex_settings depth_cfg{};
     
-    // 使用 TexInterp_Depth 或 TexInterp_DepthLinear
+    // 使用 TexInterp_Depth 或 TexInterp_LinearDepthF32
     if (!copy_texture_image_needing_resource_barrier_into_packedbuf(
-            nullptr, pbuf, q, depth_tex, TexInterp_Depth, depth_cfg)) {
-        return false;
-    }
-
-    w = static_cast<int>(pbuf.width);
-    h = static_cast<int>(pbuf.height);
-    if (w <= 0 || h <= 0) return false;
-
-    const size_t num_pixels = (size_t)w * h;
-    out_floats.resize(num_pixels);
-
-    // 支持多种格式
-    if (pbuf.pixfmt == BUF_PIX_FMT_GRAYF32) {
-        // 直接拷贝
-        for (int y = 0; y < h; ++y) {
-            const float* src = pbuf.rowptr<float>(y);
-            std::memcpy(out_floats.data() + y * w, src, w * sizeof(float));
-        }
-        return true;
-    }
-    else if (pbuf.pixfmt == BUF_PIX_FMT_GRAYU32) {
-        // R32 深度（如线性深度）
-        for (int y = 0; y < h; ++y) {
-            const uint32_t* src = pbuf.rowptr<uint32_t>(y);
-            float* dst = out_floats.data() + y * w;
-            for (int x = 0; x < w; ++x) {
-                uint32_t u = src[x];
-                // 根据游戏调整解码方式
-                // 示例：直接转 float（如果是线性深度）
-                dst[x] = *reinterpret_cast<float*>(&u);
-            }
-        }
-        return true;
-    }
-    else {
-        // 打印实际格式，用于调试
-        reshade::log_message(reshade::log_level::warning,
-            ("grab_raw_depth_float32: unsupported pixfmt = " + std::to_string(pbuf.pixfmt)).c_str());
+            nullptr, pbuf, q, depth_tex, interp, depth_cfg)) {
         return false;
     }
+    return raw_depth_float32_from_packedbuf(pbuf, out_floats, w, h, downscale);
 }
+
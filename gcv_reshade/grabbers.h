@@ -1,13 +1,9 @@
 #pragma once
 #include <vector> 
 #include <reshade.hpp>
-
-// parameters from depth to grayscale
-struct DepthToneParams {
-  float clip_low  = 0.0f;  // Proximal truncation
-  float clip_high = 1.0f;  // Distal truncation
-  float log_alpha = 6.0f;  // log enhance
-};
+#include "frame_pool.h"
+#include "copy_texture_into_packedbuf.h"
+#include "packedbuf_frames.h"
 
 // Read RGBA/RGB to BGRA (A=255) and output continuous memory
 bool grab_bgra_frame(reshade::api::command_queue* q,
@@ -15,6 +11,25 @@ bool grab_bgra_frame(reshade::api::command_queue* q,
                      std::vector<uint8_t>& out_bgra,
                      int& w, int& h);
 
+// Same, but converts straight into a slot from the recorder's frame pool (no extra copy).
+// Returns false (and leaves out empty) if the pool has no free slot.
+// downscale 2 or 4: averages each downscale x downscale block (w and h are the reduced size).
+bool grab_bgra_frame(reshade::api::command_queue* q,
+                     reshade::api::resource color_tex,
+                     FramePool& pool, FrameRef& out,
+                     int& w, int& h,
+                     int downscale = 1);
+
+// Same, but converts straight from the readback buffer to YUV 4:2:0 (BT.601 limited range, SIMD
+// kernels from gcv_utils/yuv_convert.h) in a pool slot: one pass over the pixels and 3/8 of the
+// BGRA bytes to hand to ffmpeg, which then takes yuv420p input without converting again.
+bool grab_yuv420_frame(reshade::api::command_queue* q,
+                       reshade::api::resource color_tex,
+                       FramePool& pool, FrameRef& out,
+                       int& w, int& h,
+                       FrameFormat layout = FrameFormat::I420,
+                       int downscale = 1);
+
 // Read the depth texture and map it to grayscale (far white, near black, with clip and logarithmic enhancement)
 bool grab_depth_gray8(reshade::api::command_queue* q,
                       reshade::api::resource depth_tex,
@@ -22,8 +37,19 @@ bool grab_depth_gray8(reshade::api::command_queue* q,
                       int& w, int& h,
                       const DepthToneParams& p);
 
+// downscale: every downscale-th pixel (depth is subsampled, never averaged across edges)
+bool grab_depth_gray8(reshade::api::command_queue* q,
+                      reshade::api::resource depth_tex,
+                      FramePool& pool, FrameRef& out,
+                      int& w, int& h,
+                      const DepthToneParams& p,
+                      int downscale = 1);
+
+// Raw depth as float32 (TexInterp_Depth for depth-stencil buffers, TexInterp_LinearDepthF32 for the shader's linear depth)
 bool grab_raw_depth_float32(reshade::api::command_queue* q,
                             reshade::api::resource depth_tex,
                             std::vector<float>& out_floats,
-                            int& w, int& h
-);
\ No newline at end of file
+                            int& w, int& h,
+                            TextureInterpretation interp = TexInterp_Depth,
+                            int downscale = 1
+);
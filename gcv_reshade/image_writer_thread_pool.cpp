@@ -40,13 +40,17 @@ image_writer_thread_pool::~image_writer_thread_pool() {
 
 void image_writer_thread_loop(ConcurrentQueue<queue_item_image2write*>* images2writequeue,
                               logqueue* errlogqueue,
-                              std::atomic<int>* keeplooping) {
+                              std::atomic<int>* keeplooping,
+                              SinkCounter* written) {
     queue_item_image2write* img2write = nullptr;
     while (keeplooping->load() > 0) {
         img2write = nullptr;
         if (images2writequeue->try_dequeue(img2write) && img2write != nullptr) {
             std::string logdesc(std::string(" img \'") + img2write->filepath_noexten + std::string("\' of type ") + std::to_string(img2write->mybuf.pixfmt) + std::string(" with writer(s) ") + std::to_string(img2write->writers) + std::string(" "));
-            if (!img2write->write_to_disk(logdesc)) {
+            uint64_t files = 0, bytes = 0;
+            const bool saved = img2write->write_to_disk(logdesc, &files, &bytes);
+            written->add(bytes, files);
+            if (!saved) {
                 errlogqueue->enqueue(reshade::log_level::error, std::string("FAILED to save") + logdesc);
             } else {
                 errlogqueue->enqueue(reshade::log_level::info, std::string("Saved") + logdesc);
@@ -66,7 +70,7 @@ void image_writer_thread_pool::create_threads(size_t howmany) {
     }
     for (size_t ii = 0; ii < howmany; ++ii) {
         threadkeepalives.push_back(new std::atomic<int>(1));
-        workthreads.emplace_back(image_writer_thread_loop, &images2writequeue, this, threadkeepalives.back());
+        workthreads.emplace_back(image_writer_thread_loop, &images2writequeue, this, threadkeepalives.back(), &written);
     }
     reshade::log_message(reshade::log_level::info, std::string(std::string("created ") + std::to_string(howmany) + std::string(" image writer threads")).c_str());
 }
@@ -158,6 +162,59 @@ bool image_writer_thread_pool::save_texture_image_needing_resource_barrier_copy(
     return true;
 }
 
+bool image_writer_thread_pool::save_packed_image(const std::string& base_filename, uint64_t image_writers, simple_packed_buf&& buf) {
+    if (num_threads() == 0) change_num_threads(3);
+    if (num_threads() == 0) return false;
+    queue_item_image2write* qume = new queue_item_image2write(image_writers,
+                                                              output_filepath_creates_outdir_if_needed(base_filename));
+    qume->mybuf = std::move(buf);
+    if (!images2writequeue.enqueue(qume)) {
+        delete qume;
+        return false;
+    }
+    return true;
+}
+
+size_t image_writer_thread_pool::save_texture_images_batched(
+    std::vector<TextureSaveRequest>& requests, reshade::api::command_queue* queue, ReadbackBatchTiming* timing) {
+    for (TextureSaveRequest& r : requests) r.ok = false;
+    if (num_threads() == 0) change_num_threads(3);
+    if (num_threads() == 0) return 0;
+    init_in_game();
+    std::unique_ptr<ReadbackBackend> backend = make_reshade_readback_backend(queue);
+    if (!backend) return 0;
+    ReadbackBatch batch(backend.get());
+    std::vector<queue_item_image2write*> items;   // per batch entry
+    std::vector<size_t> request_of;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const TextureSaveRequest& r = requests[i];
+        if (r.tex == 0) {
+            reshade::log_message(reshade::log_level::error, std::string(std::string("texture null: failed to save ") + r.base_filename).c_str());
+            continue;
+        }
+        queue_item_image2write* qume = new queue_item_image2write(r.image_writers, output_filepath_creates_outdir_if_needed(r.base_filename));
+        const TextureInterpretation tex_interp = r.tex_interp;
+        // runs on a batch thread: only reads game and depth_settings
+        batch.add(r.base_filename, r.tex.handle, [this, qume, tex_interp](const ReadbackKey& key, const ReadbackMapped& data) {
+            return copy_readback_into_packedbuf(game, qume->mybuf, key, data, tex_interp, depth_settings);
+        });
+        items.push_back(qume);
+        request_of.push_back(i);
+    }
+    size_t queued = 0;
+    if (!items.empty()) batch.run();
+    for (size_t k = 0; k < items.size(); ++k) {
+        if (batch.ok(k) && images2writequeue.enqueue(items[k])) {
+            requests[request_of[k]].ok = true;
+            ++queued;
+        } else {
+            delete items[k];
+        }
+    }
+    if (timing) *timing = batch.timing();
+    return queued;
+}
+
 bool image_writer_thread_pool::save_segmentation_app_indexed_image_needing_resource_barrier_copy(
     const std::string& base_filename, reshade::api::command_queue* queue, nlohmann::json& metajson) {
     if (num_threads() == 0) change_num_threads(3);
@@ -12,6 +12,7 @@
 #include "gcv_utils/image_queue_entry.h"
 #include "gcv_utils/log_queue_thread_safe.h"
 #include "copy_texture_into_packedbuf.h"
+#include "sink_counter.h"
 
 class __declspec(uuid("3cc75b62-7d40-444c-aef8-574977a58346")) image_writer_thread_pool : public logqueue {
 	std::vector<std::thread> workthreads;
@@ -27,6 +28,9 @@ public:
 	depth_tex_settings depth_settings;
 	std::wstring images_save_dir = L"cv_saved";
 
+	// every file saved by the worker threads (recordings read the difference over their session)
+	SinkCounter written;
+
 	bool camcoordsinitialized = false;
 	bool grabcamcoords = false;
 
@@ -54,6 +58,23 @@ public:
 		reshade::api::command_queue *queue, reshade::api::resource tex,
 		TextureInterpretation tex_interp);
 
+	// Several textures in one readback (readback_ring.h ReadbackBatch): copied together, one wait, converted
+	// in parallel, then queued like save_texture_image_needing_resource_barrier_copy. Sets each request's ok;
+	// returns how many were queued.
+	struct TextureSaveRequest {
+		std::string base_filename;
+		uint64_t image_writers = 0;
+		reshade::api::resource tex = { 0 };
+		TextureInterpretation tex_interp = TexInterp_RGB;
+		bool ok = false;
+	};
+	size_t save_texture_images_batched(std::vector<TextureSaveRequest> &requests,
+		reshade::api::command_queue *queue, ReadbackBatchTiming *timing = nullptr);
+
+	// A texture the ReadbackRing already read back and unpacked (asynchronous recording): queued like
+	// the copies above, without a copy or wait of its own
+	bool save_packed_image(const std::string &base_filename, uint64_t image_writers, simple_packed_buf &&buf);
+
 	bool save_segmentation_app_indexed_image_needing_resource_barrier_copy(
 		const std::string& base_filename, reshade::api::command_queue* queue, nlohmann::json & metajson);
 };
\ No newline at end of file
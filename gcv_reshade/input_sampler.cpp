@@ -0,0 +1,190 @@
+#include "input_sampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+void SyntheticInputSource::poll(InputSample& s) {
+  const uint64_t n = n_.fetch_add(1, std::memory_order_relaxed);
+  s.letters_mask = 1u << (n % 26);
+  s.modifiers_mask = (n & 1) ? 1u : 0u;
+  s.mouse_dx = 1;
+  s.mouse_dy = -1;
+  s.mouse_buttons = (uint8_t)(n & 1);
+  s.pad_connected = true;
+  s.pad_buttons = (uint16_t)(1u << ((n / 4) % 16));
+  s.pad_lt = (uint8_t)(n & 0xff);
+  s.pad_lx = (int16_t)(n * 100);
+}
+
+#ifndef _WIN32
+std::unique_ptr<InputSource> make_system_input_source() { return nullptr; }
+#endif
+
+bool InputSampler::start(std::unique_ptr<InputSource> source, int rate_hz, Clock clock, size_t capacity) {
+  stop();
+  if (!source || !clock || rate_hz <= 0) return false;
+  source_ = std::move(source);
+  clock_ = std::move(clock);
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    ring_.assign(std::max<size_t>(capacity, 2), InputSample());
+    head_ = taken_ = 0;
+    st_ = InputSamplerStats();
+    st_.source = source_->name();
+    first_us_ = last_us_ = 0;
+    pick_offset_sum_ms_ = 0.0;
+    stop_ = false;
+  }
+  const int64_t period_us = std::max<int64_t>(1, 1000000 / rate_hz);
+  th_ = std::thread([this, period_us] { loop(period_us); });
+  return true;
+}
+
+void InputSampler::stop() {
+  if (!th_.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  th_.join();
+  source_.reset();
+}
+
+void InputSampler::loop(int64_t period_us) {
+  using clk = std::chrono::steady_clock;
+  const clk::duration period = std::chrono::microseconds(period_us);
+  clk::time_point next = clk::now();
+  std::unique_lock<std::mutex> lk(mtx_);
+  while (!stop_) {
+    lk.unlock();
+    InputSample s;
+    source_->poll(s);
+    s.time_us = clock_();
+    lk.lock();
+
+    const size_t cap = ring_.size();
+    if (head_ - taken_ >= cap && head_ >= cap) ++st_.overwritten;   // the oldest sample goes unseen
+    if (head_ >= cap && taken_ <= head_ - cap) taken_ = head_ - cap + 1;
+    ring_[head_ % cap] = s;
+    if (head_ == 0) first_us_ = s.time_us;
+    else st_.max_interval_ms = std::max(st_.max_interval_ms, (double)(s.time_us - last_us_) / 1000.0);
+    last_us_ = s.time_us;
+    ++head_;
+    ++st_.samples;
+
+    // fixed schedule; a wake-up more than a period late skips the missed slots instead of bursting
+    next += period;
+    const clk::time_point now = clk::now();
+    if (now > next + period) {
+      ++st_.late;
+      next = now + period;
+    }
+    cv_.wait_until(lk, next, [this] { return stop_; });
+  }
+}
+
+bool InputSampler::take_nearest(int64_t t_us, InputPick& out) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (head_ == 0) return false;
+  const size_t cap = ring_.size();
+  const uint64_t oldest = head_ > cap ? head_ - cap : 0;
+  // samples are in time order: walk back from the newest while they get closer
+  uint64_t best = head_ - 1;
+  while (best > oldest && std::llabs(ring_[(best - 1) % cap].time_us - t_us) <= std::llabs(ring_[best % cap].time_us - t_us)) --best;
+
+  out.sample = ring_[best % cap];
+  out.sample.mouse_dx = out.sample.mouse_dy = 0;
+  out.samples = 0;
+  for (uint64_t i = std::max(taken_, oldest); i <= best; ++i) {
+    out.sample.mouse_dx += ring_[i % cap].mouse_dx;
+    out.sample.mouse_dy += ring_[i % cap].mouse_dy;
+    ++out.samples;
+  }
+  taken_ = std::max(taken_, best + 1);
+
+  const double off_ms = (double)std::llabs(out.sample.time_us - t_us) / 1000.0;
+  ++st_.picks;
+  pick_offset_sum_ms_ += off_ms;
+  st_.pick_offset_max_ms = std::max(st_.pick_offset_max_ms, off_ms);
+  return true;
+}
+
+InputSamplerStats InputSampler::stats() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  InputSamplerStats s = st_;
+  if (head_ > 1 && last_us_ > first_us_) s.rate_hz = (double)(head_ - 1) * 1e6 / (double)(last_us_ - first_us_);
+  if (s.picks) s.pick_offset_mean_ms = pick_offset_sum_ms_ / (double)s.picks;
+  return s;
+}
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+namespace {
+// waits (up to 5 s) until the sampler has taken n samples
+bool wait_samples(const InputSampler& s, uint64_t n) {
+  for (int i = 0; i < 5000 && s.stats().samples < n; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  return s.stats().samples >= n;
+}
+}
+
+std::string run_input_sampler_tests() {
+  {
+    // scripted clock: sample k is taken at (k + 1) ms, so picks are exact
+    auto ticks = std::make_shared<std::atomic<int64_t>>(0);
+    InputSampler s;
+    if (!s.start(std::unique_ptr<InputSource>(new SyntheticInputSource()), 1000,
+                 [ticks] { return (ticks->fetch_add(1) + 1) * 1000; }, 256))
+      RETURNFAILST("input sampler: start");
+    if (!wait_samples(s, 60)) RETURNFAILST("input sampler: no samples");
+    s.stop();
+
+    InputPick p;
+    if (!s.take_nearest(10400, p) || p.sample.time_us != 10000 || p.sample.letters_mask != (1u << 9) ||
+        p.samples != 10 || p.sample.mouse_dx != 10 || p.sample.mouse_dy != -10)
+      RETURNFAILST("input sampler: nearest to 10.4 ms was " + std::to_string(p.sample.time_us) + " over " + std::to_string(p.samples) + " samples");
+    if (!s.take_nearest(10600, p) || p.sample.time_us != 11000 || p.samples != 1 || p.sample.mouse_dx != 1)
+      RETURNFAILST("input sampler: second pick");
+    if (!s.take_nearest(10900, p) || p.sample.time_us != 11000 || p.samples != 0 || p.sample.mouse_dx != 0)
+      RETURNFAILST("input sampler: same sample twice moved the mouse");
+    if (!s.take_nearest(30600, p) || p.sample.time_us != 31000 || p.samples != 20 || p.sample.mouse_dx != 20 ||
+        p.sample.pad_buttons != (1u << ((30 / 4) % 16)) || !p.sample.pad_connected)
+      RETURNFAILST("input sampler: pick after a gap");
+    if (!s.take_nearest(0, p) || p.sample.time_us != 1000) RETURNFAILST("input sampler: pick before the first sample");
+    const InputSamplerStats st = s.stats();
+    if (st.picks != 5 || st.late > st.samples || st.source != "synthetic") RETURNFAILST("input sampler: stats");
+  }
+  {
+    // a ring much smaller than the frame interval: what fell out is counted, not summed twice
+    auto ticks = std::make_shared<std::atomic<int64_t>>(0);
+    InputSampler s;
+    s.start(std::unique_ptr<InputSource>(new SyntheticInputSource()), 1000,
+            [ticks] { return (ticks->fetch_add(1) + 1) * 1000; }, 16);
+    if (!wait_samples(s, 100)) RETURNFAILST("input sampler (small ring): no samples");
+    s.stop();
+    const uint64_t n = s.stats().samples;
+    InputPick p;
+    if (!s.take_nearest(INT64_MAX / 2, p) || p.sample.time_us != (int64_t)n * 1000 || p.samples != 16 ||
+        s.stats().overwritten + p.samples != n)
+      RETURNFAILST("input sampler (small ring): " + std::to_string(p.samples) + " picked, " +
+                   std::to_string(s.stats().overwritten) + " overwritten of " + std::to_string(n));
+  }
+  {
+    // real clock: keeps roughly its rate and the nearest sample is recent
+    const auto t0 = std::chrono::steady_clock::now();
+    auto now_us = [t0] { return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count(); };
+    InputSampler s;
+    s.start(std::unique_ptr<InputSource>(new SyntheticInputSource()), 500, now_us);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    InputPick p;
+    const int64_t t = now_us();
+    if (!s.take_nearest(t, p) || p.samples == 0 || p.sample.mouse_dx != (int32_t)p.samples || t - p.sample.time_us > 50000)
+      RETURNFAILST("input sampler (real clock): pick " + std::to_string(t - p.sample.time_us) + " us old");
+    s.stop();
+    const InputSamplerStats st = s.stats();
+    if (st.samples < 10 || st.rate_hz < 100.0 || st.rate_hz > 1000.0)
+      RETURNFAILST("input sampler (real clock): " + std::to_string(st.rate_hz) + " Hz over " + std::to_string(st.samples) + " samples");
+  }
+  return "ok";
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Keyboard, mouse and gamepad sampled on a thread of their own at a fixed rate (250-1000 Hz)
+// into a timestamped ring, instead of 33 GetAsyncKeyState calls on the render thread per
+// recorded frame. The frame takes the sample nearest its capture time, so a key tapped between two
+// frames at a low fps is still seen at the sample rate, and the mouse movement of every sample
+// since the previous frame is summed up.
+//
+// The state is read through an InputSource: input_source_win.cpp polls Windows (GetAsyncKeyState,
+// the cursor, XInput), SyntheticInputSource replays a scripted pattern for the self-test.
+
+struct InputSample {
+  int64_t time_us = 0;
+  uint32_t letters_mask = 0;     // bit 0='A' .. bit 25='Z' (as in actions.csv)
+  uint32_t modifiers_mask = 0;   // bit 0..6: shift, ctrl, alt, space, enter, escape, tab
+  int32_t mouse_dx = 0, mouse_dy = 0;   // cursor movement since the previous sample
+  uint8_t mouse_buttons = 0;     // bit 0..4: left, right, middle, x1, x2
+  bool pad_connected = false;
+  uint16_t pad_buttons = 0;      // XINPUT_GAMEPAD_* bits of the first connected pad
+  uint8_t pad_lt = 0, pad_rt = 0;
+  int16_t pad_lx = 0, pad_ly = 0, pad_rx = 0, pad_ry = 0;
+};
+
+class InputSource {
+public:
+  virtual ~InputSource() {}
+  // Fills everything but time_us; called on the sampler thread only
+  virtual void poll(InputSample& s) = 0;
+  virtual const char* name() const = 0;
+};
+
+// This platform's source (input_source_win.cpp); null where there is none
+std::unique_ptr<InputSource> make_system_input_source();
+
+// Deterministic input for tests: sample n holds letter n % 26, moves the mouse by (1, -1) and
+// pulses pad button bit (n / 4) % 16
+class SyntheticInputSource : public InputSource {
+public:
+  void poll(InputSample& s) override;
+  const char* name() const override { return "synthetic"; }
+  uint64_t polls() const { return n_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> n_{0};
+};
+
+struct InputSamplerStats {
+  uint64_t samples = 0;
+  uint64_t late = 0;             // periods the thread woke up more than one period late
+  uint64_t overwritten = 0;      // samples dropped from the ring before any frame looked at them
+  uint64_t picks = 0;            // take_nearest calls that found a sample
+  double rate_hz = 0.0;          // achieved sample rate
+  double max_interval_ms = 0.0;  // longest gap between two samples
+  double pick_offset_mean_ms = 0.0, pick_offset_max_ms = 0.0;   // |frame time - sample time|
+  std::string source;
+};
+
+// What a frame takes from the ring
+struct InputPick {
+  InputSample sample;            // nearest to the frame, with mouse_dx/dy summed since the previous pick
+  uint32_t samples = 0;          // samples since the previous pick (those the mouse movement covers)
+};
+
+class InputSampler {
+public:
+  // Microseconds on the same clock as the frames' time_us
+  using Clock = std::function<int64_t()>;
+
+  InputSampler() = default;
+  ~InputSampler() { stop(); }
+  InputSampler(const InputSampler&) = delete;
+  InputSampler& operator=(const InputSampler&) = delete;
+
+  // capacity: samples kept; at least a couple of frames' worth at the slowest frame rate recorded
+  bool start(std::unique_ptr<InputSource> source, int rate_hz, Clock clock, size_t capacity = 2048);
+  void stop();
+  bool running() const { return th_.joinable(); }
+
+  // The sample nearest t_us among those taken so far; false if there is none yet
+  bool take_nearest(int64_t t_us, InputPick& out);
+  InputSamplerStats stats() const;
+
+private:
+  void loop(int64_t period_us);
+
+  std::unique_ptr<InputSource> source_;
+  Clock clock_;
+  std::thread th_;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+
+  // ring, guarded by mtx_
+  std::vector<InputSample> ring_;
+  uint64_t head_ = 0;            // samples ever written
+  uint64_t taken_ = 0;           // samples up to here were covered by a pick
+  InputSamplerStats st_;
+  int64_t first_us_ = 0, last_us_ = 0;
+  double pick_offset_sum_ms_ = 0.0;
+};
+
+// Sampler against SyntheticInputSource: rate, nearest pick, summed mouse movement, ring overrun;
+// "ok" or what failed (like run_utils_tests)
+std::string run_input_sampler_tests();
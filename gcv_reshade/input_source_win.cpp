@@ -0,0 +1,100 @@
+#ifdef _WIN32
+// InputSource over Windows (input_sampler.h): GetAsyncKeyState, the cursor and XInput
+#include "input_sampler.h"
+
+#include <Windows.h>
+#include <Xinput.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+
+namespace {
+
+typedef DWORD(WINAPI* XInputGetStateFn)(DWORD, XINPUT_STATE*);
+
+class WinInputSource : public InputSource {
+public:
+  WinInputSource() {
+    // Sleep and waits on the sampler thread are only as fine as the system timer
+    timeBeginPeriod(1);
+    // loaded at run time: no import the game could lack, and either DLL will do
+    xinput_ = LoadLibraryA("xinput1_4.dll");
+    if (!xinput_) xinput_ = LoadLibraryA("xinput9_1_0.dll");
+    if (xinput_) get_state_ = (XInputGetStateFn)GetProcAddress(xinput_, "XInputGetState");
+    have_cursor_ = GetCursorPos(&last_cursor_) != 0;
+  }
+  ~WinInputSource() override {
+    if (xinput_) FreeLibrary(xinput_);
+    timeEndPeriod(1);
+  }
+
+  void poll(InputSample& s) override {
+    // same bits as the render thread used to read per frame (actions.csv)
+    for (int i = 0; i < 26; ++i)
+      if (GetAsyncKeyState('A' + i) & 0x8000) s.letters_mask |= 1u << i;
+    static const int modifiers[] = { VK_SHIFT, VK_CONTROL, VK_MENU, VK_SPACE, VK_RETURN, VK_ESCAPE, VK_TAB };
+    for (int i = 0; i < 7; ++i)
+      if (GetAsyncKeyState(modifiers[i]) & 0x8000) s.modifiers_mask |= 1u << i;
+    static const int buttons[] = { VK_LBUTTON, VK_RBUTTON, VK_MBUTTON, VK_XBUTTON1, VK_XBUTTON2 };
+    for (int i = 0; i < 5; ++i)
+      if (GetAsyncKeyState(buttons[i]) & 0x8000) s.mouse_buttons |= (uint8_t)(1u << i);
+
+    // cursor movement; raw input would need a window registration of our own, which replaces
+    // the game's. Games that recenter a hidden cursor every frame still show their mouse look here.
+    POINT p;
+    if (GetCursorPos(&p)) {
+      if (have_cursor_) {
+        s.mouse_dx = p.x - last_cursor_.x;
+        s.mouse_dy = p.y - last_cursor_.y;
+      }
+      last_cursor_ = p;
+      have_cursor_ = true;
+    }
+
+    poll_pad(s);
+  }
+  const char* name() const override { return get_state_ ? "win32+xinput" : "win32"; }
+
+private:
+  void poll_pad(InputSample& s) {
+    if (!get_state_) return;
+    // XInputGetState on an empty port is slow (it enumerates devices), so while nothing is
+    // connected the ports are only looked at about once a second
+    const ULONGLONG now = GetTickCount64();
+    if (pad_ < 0 && now < next_scan_ms_) return;
+    if (pad_ < 0) {
+      next_scan_ms_ = now + 1000;
+      for (DWORD i = 0; i < XUSER_MAX_COUNT && pad_ < 0; ++i) {
+        XINPUT_STATE st = {};
+        if (get_state_(i, &st) == ERROR_SUCCESS) pad_ = (int)i;
+      }
+      if (pad_ < 0) return;
+    }
+    XINPUT_STATE st = {};
+    if (get_state_((DWORD)pad_, &st) != ERROR_SUCCESS) {
+      pad_ = -1;
+      return;
+    }
+    s.pad_connected = true;
+    s.pad_buttons = st.Gamepad.wButtons;
+    s.pad_lt = st.Gamepad.bLeftTrigger;
+    s.pad_rt = st.Gamepad.bRightTrigger;
+    s.pad_lx = st.Gamepad.sThumbLX;
+    s.pad_ly = st.Gamepad.sThumbLY;
+    s.pad_rx = st.Gamepad.sThumbRX;
+    s.pad_ry = st.Gamepad.sThumbRY;
+  }
+
+  HMODULE xinput_ = nullptr;
+  XInputGetStateFn get_state_ = nullptr;
+  int pad_ = -1;                 // port of the pad being read; -1: none connected
+  ULONGLONG next_scan_ms_ = 0;
+  POINT last_cursor_ = {};
+  bool have_cursor_ = false;
+};
+
+} // namespace
+
+std::unique_ptr<InputSource> make_system_input_source() {
+  return std::unique_ptr<InputSource>(new WinInputSource());
+}
+#endif
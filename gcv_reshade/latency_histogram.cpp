@@ -0,0 +1,142 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+const char* latency_stage_name(LatencyStage s) {
+  switch (s) {
+  case LatencyStage::ReadbackWait: return "readback_wait";
+  case LatencyStage::Map: return "map";
+  case LatencyStage::Convert: return "convert";
+  case LatencyStage::PoseFetch: return "pose_fetch";
+  case LatencyStage::QueueWait: return "queue_wait";
+  case LatencyStage::EncodeWrite: return "encode_write";
+  case LatencyStage::DiskWrite: return "disk_write";
+  default: return "?";
+  }
+}
+
+static int highest_bit(uint64_t v) {   // v > 0
+#ifdef _MSC_VER
+  unsigned long i = 0;
+  _BitScanReverse64(&i, v);
+  return (int)i;
+#else
+  return 63 - __builtin_clzll(v);
+#endif
+}
+
+// values below 2 << kSubBits have a bucket each; above, every power of two is split into
+// 1 << kSubBits buckets by the bits below the highest one
+size_t LatencyHistogram::bucket_of(uint64_t ns) {
+  if (ns < (2u << kSubBits)) return (size_t)ns;
+  int shift = highest_bit(ns) - kSubBits;
+  if (shift > kMaxShift) return kBuckets - 1;
+  return ((size_t)shift << kSubBits) + (size_t)(ns >> shift);
+}
+
+uint64_t LatencyHistogram::bucket_high_ns(size_t i) {
+  if (i < (2u << kSubBits)) return i;
+  const int shift = (int)(i >> kSubBits) - 1;
+  const uint64_t top = i - ((size_t)shift << kSubBits);
+  return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record_ns(uint64_t ns) {
+  buckets_[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+  uint64_t m = max_ns_.load(std::memory_order_relaxed);
+  while (ns > m && !max_ns_.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::reset() {
+  for (std::atomic<uint64_t>& b : buckets_) b.store(0, std::memory_order_relaxed);
+  count_.store(0, std::memory_order_relaxed);
+  sum_ns_.store(0, std::memory_order_relaxed);
+  max_ns_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::quantile_ns(double q) const {
+  // the bucket counts themselves, not count_: a value being recorded may be in one and not the other
+  uint64_t total = 0;
+  for (const std::atomic<uint64_t>& b : buckets_) total += b.load(std::memory_order_relaxed);
+  if (total == 0) return 0;
+  const uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(std::min(1.0, std::max(0.0, q)) * (double)total));
+  const uint64_t max_ns = max_ns_.load(std::memory_order_relaxed);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBuckets; ++i) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) return std::min(bucket_high_ns(i), max_ns);
+  }
+  return max_ns;
+}
+
+LatencySummary LatencyHistogram::summary() const {
+  LatencySummary s;
+  s.count = count_.load(std::memory_order_relaxed);
+  if (s.count == 0) return s;
+  s.mean_ms = (double)sum_ns_.load(std::memory_order_relaxed) / (double)s.count / 1e6;
+  s.p50_ms = (double)quantile_ns(0.50) / 1e6;
+  s.p95_ms = (double)quantile_ns(0.95) / 1e6;
+  s.p99_ms = (double)quantile_ns(0.99) / 1e6;
+  s.max_ms = (double)max_ns_.load(std::memory_order_relaxed) / 1e6;
+  return s;
+}
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+std::string run_latency_histogram_tests() {
+  // every value lands in a bucket that holds it, within 1/32 of it
+  for (uint64_t v : { 0ull, 1ull, 63ull, 64ull, 65ull, 1000ull, 123456789ull, (1ull << 41) + 12345ull }) {
+    const size_t b = LatencyHistogram::bucket_of(v);
+    const uint64_t hi = LatencyHistogram::bucket_high_ns(b);
+    const uint64_t lo = b ? LatencyHistogram::bucket_high_ns(b - 1) + 1 : 0;
+    if (b >= LatencyHistogram::kBuckets || v < lo || v > hi || (double)(hi - lo) > (double)v / 32.0 + 1.0)
+      RETURNFAILST("latency histogram: " + std::to_string(v) + " in bucket [" + std::to_string(lo) + ", " + std::to_string(hi) + "]");
+  }
+  if (LatencyHistogram::bucket_of(~0ull) != LatencyHistogram::kBuckets - 1) RETURNFAILST("latency histogram: overflow bucket");
+  {
+    // 1..1000 us: quantiles within a bucket of the exact ones
+    LatencyHistogram h;
+    for (uint64_t us = 1; us <= 1000; ++us) h.record_ns(us * 1000);
+    const LatencySummary s = h.summary();
+    auto near = [](double got, double want) { return got >= want && got <= want * 1.04; };
+    if (s.count != 1000 || !near(s.p50_ms, 0.5) || !near(s.p95_ms, 0.95) || !near(s.p99_ms, 0.99) || s.max_ms != 1.0 ||
+        std::fabs(s.mean_ms - 0.5005) > 1e-9)
+      RETURNFAILST("latency histogram: p50 " + std::to_string(s.p50_ms) + " p95 " + std::to_string(s.p95_ms) +
+                   " p99 " + std::to_string(s.p99_ms) + " max " + std::to_string(s.max_ms));
+    h.reset();
+    if (h.summary().count != 0 || h.quantile_ns(0.5) != 0) RETURNFAILST("latency histogram: reset");
+  }
+  {
+    // a rare outlier shows in max and p99 only when it is more than 1% of the values
+    LatencyHistogram h;
+    for (int i = 0; i < 999; ++i) h.record_ns(100000);
+    h.record_ns(50000000);
+    const LatencySummary s = h.summary();
+    if (s.p99_ms > 0.11 || s.max_ms != 50.0) RETURNFAILST("latency histogram: outlier p99 " + std::to_string(s.p99_ms));
+  }
+  {
+    // several threads at once: nothing lost
+    LatencyHistogram h;
+    std::vector<std::thread> th;
+    for (int t = 0; t < 4; ++t)
+      th.emplace_back([&h, t] { for (int i = 0; i < 20000; ++i) h.record_ns((uint64_t)(t + 1) * 1000 + (uint64_t)(i & 255)); });
+    for (std::thread& x : th) x.join();
+    const LatencySummary s = h.summary();
+    if (s.count != 80000 || s.max_ms != (4000.0 + 255.0) / 1e6) RETURNFAILST("latency histogram: concurrent count " + std::to_string(s.count));
+  }
+  {
+    LatencyHistogram h;
+    { LatencyScope scope(&h); std::this_thread::sleep_for(std::chrono::milliseconds(2)); }
+    { LatencyScope scope(nullptr); }
+    if (h.count() != 1 || h.summary().max_ms < 1.5) RETURNFAILST("latency histogram: scope timer");
+  }
+  return "ok";
+}
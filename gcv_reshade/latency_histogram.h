@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Latency distributions of the capture path. Recording a value is a few relaxed atomic adds, no
+// lock and no allocation, so any thread can time itself on every frame. Buckets are log-linear
+// like HdrHistogram's: 32 per power of two (every value kept to within ~3%), from 1 ns to about
+// 73 minutes; longer values land in the last bucket. A summary taken while others record is a
+// snapshot, not an exact cut.
+
+struct LatencySummary {
+  uint64_t count = 0;
+  double mean_ms = 0.0;
+  double p50_ms = 0.0, p95_ms = 0.0, p99_ms = 0.0;   // highest value of the quantile's bucket, at most max
+  double max_ms = 0.0;
+};
+
+class LatencyHistogram {
+public:
+  static const int kSubBits = 5;
+  static const int kMaxShift = 36;
+  static const size_t kBuckets = (size_t)(kMaxShift + 2) << kSubBits;
+
+  LatencyHistogram() { reset(); }
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+  // The clock the stages are timed with: steady_clock's raw counter (QueryPerformanceCounter on
+  // Windows), converted to time only when recorded
+  static uint64_t now() { return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count(); }
+  static uint64_t ticks_to_ns(uint64_t ticks) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::duration(ticks)).count();
+  }
+
+  void record_ns(uint64_t ns);
+  // now() - t0 (a now() taken earlier on any thread)
+  void record_since(uint64_t t0) {
+    const uint64_t t1 = now();
+    record_ns(t1 > t0 ? ticks_to_ns(t1 - t0) : 0);
+  }
+  void reset();
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  // ns at quantile q (0..1): the highest value of the bucket it falls in, at most the maximum
+  uint64_t quantile_ns(double q) const;
+  LatencySummary summary() const;
+
+  static size_t bucket_of(uint64_t ns);
+  static uint64_t bucket_high_ns(size_t i);
+
+private:
+  std::atomic<uint64_t> buckets_[kBuckets];
+  std::atomic<uint64_t> count_{0}, sum_ns_{0}, max_ns_{0};
+};
+
+// Times the enclosing scope into h (nothing if h is null)
+class LatencyScope {
+public:
+  explicit LatencyScope(LatencyHistogram* h) : h_(h), t0_(h ? LatencyHistogram::now() : 0) {}
+  ~LatencyScope() { if (h_) h_->record_since(t0_); }
+  LatencyScope(const LatencyScope&) = delete;
+  LatencyScope& operator=(const LatencyScope&) = delete;
+
+private:
+  LatencyHistogram* h_;
+  uint64_t t0_;
+};
+
+// The stages a recorded frame's time goes to, from the GPU copy to the files
+enum class LatencyStage : uint8_t {
+  ReadbackWait = 0,   // readback ring: blocked on the copy's fence
+  Map,                // staging texture mapped, copied out, unmapped
+  Convert,            // color/depth conversion into pool slots (capture pipeline)
+  PoseFetch,          // camera matrix from the game
+  QueueWait,          // frame queued in front of an encoder
+  EncodeWrite,        // frame written into an encoder's pipe
+  DiskWrite,          // actions/camera logs and depth.gcvd, per write call
+  Count
+};
+static const int kLatencyStages = (int)LatencyStage::Count;
+const char* latency_stage_name(LatencyStage s);
+
+struct CaptureLatency {
+  LatencyHistogram stage[kLatencyStages];
+  LatencyHistogram& operator[](LatencyStage s) { return stage[(int)s]; }
+  const LatencyHistogram& operator[](LatencyStage s) const { return stage[(int)s]; }
+};
+
+// Bucketing, quantiles and concurrent recording; "ok" or what failed (like run_utils_tests)
+std::string run_latency_histogram_tests();
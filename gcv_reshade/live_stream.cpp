@@ -0,0 +1,315 @@
+#include "live_stream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <reshade.hpp>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// seq/published/state live in memory other processes read; 64-bit atomics on x64 are lock-free
+// and address-free, so they can be used in place in the mapping
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "live stream needs lock-free 64-bit atomics");
+static std::atomic<uint64_t>& atomic_u64(void* p) { return *reinterpret_cast<std::atomic<uint64_t>*>(p); }
+static std::atomic<uint32_t>& atomic_u32(void* p) { return *reinterpret_cast<std::atomic<uint32_t>*>(p); }
+
+static size_t align_up(size_t n, size_t a) { return (n + a - 1) / a * a; }
+
+LiveStreamWriter::~LiveStreamWriter() {
+  close();
+}
+
+bool LiveStreamWriter::open(const std::string& name, int slots, size_t color_capacity, size_t depth_capacity, int fps) {
+  close();
+  const uint32_t nslots = (uint32_t)(slots > 1 ? slots : 2);
+  const size_t stride = align_up(sizeof(GcvLiveSlot) + align_up(color_capacity, 64) + align_up(depth_capacity, 64), 4096);
+  const size_t size = sizeof(GcvLiveHeader) + (size_t)nslots * stride;
+  char err[256];
+#ifdef _WIN32
+  const std::string map_name = "Local\\gcv_live_" + name;
+  HANDLE m = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                (DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xFFFFFFFFu), map_name.c_str());
+  if (!m) {
+    _snprintf_s(err, _TRUNCATE, "[CV Capture] live stream: CreateFileMapping %s failed (%lu)", map_name.c_str(), GetLastError());
+    reshade::log_message(reshade::log_level::error, err);
+    return false;
+  }
+  // a consumer still holding the previous stream keeps the old object (and its size) alive
+  const bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+  void* p = MapViewOfFile(m, FILE_MAP_WRITE, 0, 0, 0);
+  MEMORY_BASIC_INFORMATION mbi{};
+  if (!p || (existed && (!VirtualQuery(p, &mbi, sizeof(mbi)) || mbi.RegionSize < size))) {
+    if (p) UnmapViewOfFile(p);
+    CloseHandle(m);
+    _snprintf_s(err, _TRUNCATE, "[CV Capture] live stream: mapping %s is held open with another size; close its readers", map_name.c_str());
+    reshade::log_message(reshade::log_level::error, err);
+    return false;
+  }
+  mapping_ = m;
+#else
+  const std::string shm = "/gcv_live_" + name;
+  shm_unlink(shm.c_str());   // readers of a previous stream keep their (closed) mapping
+  const int fd = shm_open(shm.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 || ftruncate(fd, (off_t)size) != 0) {
+    if (fd >= 0) { ::close(fd); shm_unlink(shm.c_str()); }
+    snprintf(err, sizeof(err), "[CV Capture] live stream: shm_open %s failed", shm.c_str());
+    reshade::log_message(reshade::log_level::error, err);
+    return false;
+  }
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    shm_unlink(shm.c_str());
+    return false;
+  }
+  shm_name_ = shm;
+#endif
+  base_ = static_cast<uint8_t*>(p);
+  size_ = size;
+  writing_ = false;
+  published_ = 0;
+  stats_ = LiveStreamStats();
+
+  GcvLiveHeader& h = hdr_;
+  h = GcvLiveHeader();
+  std::memcpy(h.magic, "GCVLIVE1", 8);
+  h.version = 1;
+  h.header_bytes = sizeof(GcvLiveHeader);
+  h.slot_count = nslots;
+  h.slot_header_bytes = sizeof(GcvLiveSlot);
+  h.slot_stride = stride;
+  h.color_capacity = color_capacity;
+  h.depth_capacity = depth_capacity;
+  h.fps = (uint32_t)(fps > 0 ? fps : 0);
+#ifdef _WIN32
+  h.producer_pid = (uint32_t)GetCurrentProcessId();
+#else
+  h.producer_pid = (uint32_t)getpid();
+#endif
+  h.stream_id = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+  h.state = GCVLIVE_OPEN;
+  // readers treat the stream as valid once the magic is there, so it goes in last
+  for (uint32_t i = 0; i < nslots; ++i) atomic_u64(slot_ptr(i)).store(0, std::memory_order_relaxed);
+  std::memcpy(base_ + 8, reinterpret_cast<const uint8_t*>(&h) + 8, sizeof(h) - 8);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(base_, h.magic, 8);
+  return true;
+}
+
+void LiveStreamWriter::close() {
+  if (!base_) return;
+  if (writing_) publish();   // whatever arrived of the last frame
+  atomic_u32(base_ + offsetof(GcvLiveHeader, state)).store(GCVLIVE_CLOSED, std::memory_order_release);
+#ifdef _WIN32
+  UnmapViewOfFile(base_);
+  if (mapping_) { CloseHandle((HANDLE)mapping_); mapping_ = nullptr; }
+#else
+  munmap(base_, size_);
+  shm_unlink(shm_name_.c_str());
+  shm_name_.clear();
+#endif
+  base_ = nullptr;
+  size_ = 0;
+}
+
+uint8_t* LiveStreamWriter::slot_ptr(uint64_t n) const {
+  return base_ + hdr_.header_bytes + (size_t)(n % hdr_.slot_count) * (size_t)hdr_.slot_stride;
+}
+
+GcvLiveSlot* LiveStreamWriter::begin(uint64_t frame_idx) {
+  if (writing_ && writing_idx_ == frame_idx) return reinterpret_cast<GcvLiveSlot*>(slot_ptr(published_));
+  if (writing_) publish();   // the previous frame never got its commit()
+  uint8_t* p = slot_ptr(published_);
+  // odd: readers of the frame that was here see the change and drop what they read
+  atomic_u64(p).store(2 * published_ + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  GcvLiveSlot* s = reinterpret_cast<GcvLiveSlot*>(p);
+  std::memset(p + sizeof(uint64_t), 0, sizeof(GcvLiveSlot) - sizeof(uint64_t));
+  s->frame_idx = frame_idx;
+  writing_ = true;
+  writing_idx_ = frame_idx;
+  return s;
+}
+
+void LiveStreamWriter::publish() {
+  uint8_t* p = slot_ptr(published_);
+  ++published_;
+  atomic_u64(p).store(2 * published_, std::memory_order_release);
+  atomic_u64(base_ + offsetof(GcvLiveHeader, published)).store(published_, std::memory_order_release);
+  writing_ = false;
+  stats_.published = published_;
+}
+
+void LiveStreamWriter::put_color(uint64_t frame_idx, const uint8_t* data, size_t bytes, int w, int h, size_t stride, uint32_t format) {
+  if (!base_ || !data || !bytes) return;
+  GcvLiveSlot* s = begin(frame_idx);
+  if (bytes > hdr_.color_capacity) { ++stats_.oversize; return; }
+  std::memcpy(reinterpret_cast<uint8_t*>(s) + sizeof(GcvLiveSlot), data, bytes);
+  s->color_format = format;
+  s->color_w = (uint32_t)w;
+  s->color_h = (uint32_t)h;
+  s->color_stride = (uint32_t)stride;
+  s->color_bytes = bytes;
+}
+
+void LiveStreamWriter::put_depth(uint64_t frame_idx, const float* data, int w, int h) {
+  if (!base_ || !data || w <= 0 || h <= 0) return;
+  GcvLiveSlot* s = begin(frame_idx);
+  const size_t bytes = (size_t)w * (size_t)h * sizeof(float);
+  if (bytes > hdr_.depth_capacity) { ++stats_.oversize; return; }
+  std::memcpy(reinterpret_cast<uint8_t*>(s) + sizeof(GcvLiveSlot) + align_up(hdr_.color_capacity, 64), data, bytes);
+  s->depth_w = (uint32_t)w;
+  s->depth_h = (uint32_t)h;
+  s->depth_bytes = bytes;
+}
+
+void LiveStreamWriter::commit(const GcvFrameRecord& r) {
+  if (!base_) return;
+  GcvLiveSlot* s = begin(r.frame_idx);
+  s->time_us = r.time_us;
+  s->cam_time_us = r.cam_time_us;
+  std::memcpy(s->cam2world, r.cam2world, sizeof(s->cam2world));
+  s->fov_v_degrees = r.fov_v_degrees;
+  s->fov_h_degrees = r.fov_h_degrees;
+  s->flags = r.flags;
+  s->letters_mask = r.letters_mask;
+  s->modifiers_mask = r.modifiers_mask;
+  publish();
+}
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+namespace {
+// read-only view of a stream by name, opened like a consumer does
+struct LiveStreamView {
+  const uint8_t* base = nullptr;
+  size_t size = 0;
+#ifdef _WIN32
+  HANDLE mapping = nullptr;
+#endif
+  bool open(const std::string& name) {
+#ifdef _WIN32
+    mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, ("Local\\gcv_live_" + name).c_str());
+    if (!mapping) return false;
+    base = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    MEMORY_BASIC_INFORMATION mbi{};
+    if (base && VirtualQuery(base, &mbi, sizeof(mbi))) size = mbi.RegionSize;
+#else
+    const int fd = shm_open(("/gcv_live_" + name).c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (p != MAP_FAILED) { base = static_cast<const uint8_t*>(p); size = (size_t)st.st_size; }
+    }
+    ::close(fd);
+#endif
+    return base != nullptr;
+  }
+  ~LiveStreamView() {
+#ifdef _WIN32
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+#else
+    if (base) munmap(const_cast<uint8_t*>(base), size);
+#endif
+  }
+  const GcvLiveHeader& header() const { return *reinterpret_cast<const GcvLiveHeader*>(base); }
+  uint64_t published() const { return atomic_u64(const_cast<uint8_t*>(base) + offsetof(GcvLiveHeader, published)).load(std::memory_order_acquire); }
+  uint32_t state() const { return atomic_u32(const_cast<uint8_t*>(base) + offsetof(GcvLiveHeader, state)).load(std::memory_order_acquire); }
+  const uint8_t* slot(uint64_t n) const {
+    const GcvLiveHeader& h = header();
+    return base + h.header_bytes + (size_t)(n % h.slot_count) * (size_t)h.slot_stride;
+  }
+  uint64_t seq(uint64_t n) const { return atomic_u64(const_cast<uint8_t*>(slot(n))).load(std::memory_order_acquire); }
+};
+
+// frame k of the test carries value k+1 everywhere (like gcv_live.py's demo producer)
+GcvFrameRecord test_record(uint64_t k) {
+  GcvFrameRecord r{};
+  r.frame_idx = k;
+  r.time_us = (int64_t)(1000 + 16667 * k);
+  for (double& v : r.cam2world) v = (double)(k + 1);
+  r.flags = GCVF_CAM_VALID;
+  r.letters_mask = (uint32_t)(k + 1);
+  return r;
+}
+}
+
+std::string run_live_stream_tests() {
+  const int cw = 32, ch = 8, dw = 16, dh = 4;
+  const size_t color_cap = (size_t)cw * ch * 4 + 100;   // not a multiple of 64: the depth buffer is aligned after it
+  const size_t depth_cap = (size_t)dw * dh * sizeof(float);
+#ifdef _WIN32
+  const std::string name = "selftest_" + std::to_string(GetCurrentProcessId());
+#else
+  const std::string name = "selftest_" + std::to_string(getpid());
+#endif
+  LiveStreamWriter w;
+  if (!w.open(name, 3, color_cap, depth_cap, 60)) RETURNFAILST("live stream: open");
+  LiveStreamView v;
+  if (!v.open(name)) RETURNFAILST("live stream: the stream cannot be opened by name");
+
+  const GcvLiveHeader& h = v.header();
+  if (std::memcmp(h.magic, "GCVLIVE1", 8) != 0 || h.version != 1) RETURNFAILST("live stream: magic/version");
+  if (h.header_bytes != 128 || h.slot_header_bytes != 256 || h.slot_count != 3) RETURNFAILST("live stream: header/slot sizes");
+  if (h.slot_stride % 4096 != 0 || h.slot_stride < 256 + align_up(color_cap, 64) + depth_cap) RETURNFAILST("live stream: slot stride");
+  if (v.size < h.header_bytes + h.slot_count * h.slot_stride) RETURNFAILST("live stream: mapping smaller than its slots");
+  if (h.color_capacity != color_cap || h.depth_capacity != depth_cap || h.fps != 60) RETURNFAILST("live stream: capacities/fps");
+  if (v.state() != GCVLIVE_OPEN || v.published() != 0) RETURNFAILST("live stream: a new stream is not open and empty");
+
+  std::vector<uint8_t> color((size_t)cw * ch * 4);
+  std::vector<float> depth((size_t)dw * dh);
+  const uint64_t frames = 5;   // laps the 3 slots
+  for (uint64_t k = 0; k < frames; ++k) {
+    std::fill(color.begin(), color.end(), (uint8_t)((k + 1) & 0xFF));
+    std::fill(depth.begin(), depth.end(), (float)(k + 1));
+    w.put_color(k, color.data(), color.size(), cw, ch, (size_t)cw * 4, 0);
+    w.put_depth(k, depth.data(), dw, dh);
+    if (v.seq(k) != 2 * k + 1) RETURNFAILST("live stream: a slot being written does not have an odd seq");
+    w.commit(test_record(k));
+    if (v.published() != k + 1 || v.seq(k) != 2 * (k + 1)) RETURNFAILST("live stream: seq/published after commit");
+  }
+  // the last slot_count frames are readable, each in slot n % slot_count
+  for (uint64_t k = frames - h.slot_count; k < frames; ++k) {
+    const uint8_t* p = v.slot(k);
+    const GcvLiveSlot& s = *reinterpret_cast<const GcvLiveSlot*>(p);
+    const uint8_t value = (uint8_t)(k + 1);
+    if (s.seq != 2 * (k + 1) || s.frame_idx != k || s.time_us != test_record(k).time_us) RETURNFAILST("live stream: slot header of frame " + std::to_string(k));
+    if (s.cam2world[0] != (double)(k + 1) || s.cam2world[11] != (double)(k + 1) || s.flags != GCVF_CAM_VALID || s.letters_mask != k + 1)
+      RETURNFAILST("live stream: pose/flags/keys of frame " + std::to_string(k));
+    if (s.color_format != 0 || s.color_w != (uint32_t)cw || s.color_h != (uint32_t)ch || s.color_stride != (uint32_t)cw * 4 || s.color_bytes != color.size())
+      RETURNFAILST("live stream: color description of frame " + std::to_string(k));
+    if (s.depth_w != (uint32_t)dw || s.depth_h != (uint32_t)dh || s.depth_bytes != depth_cap) RETURNFAILST("live stream: depth description of frame " + std::to_string(k));
+    const uint8_t* c = p + h.slot_header_bytes;
+    if (c[0] != value || c[color.size() - 1] != value) RETURNFAILST("live stream: color buffer of frame " + std::to_string(k));
+    float d0, dn;
+    std::memcpy(&d0, c + align_up(h.color_capacity, 64), sizeof(float));
+    std::memcpy(&dn, c + align_up(h.color_capacity, 64) + depth_cap - sizeof(float), sizeof(float));
+    if (d0 != (float)(k + 1) || dn != (float)(k + 1)) RETURNFAILST("live stream: depth buffer of frame " + std::to_string(k));
+  }
+  // pieces larger than the capacity are left out, the frame is still published
+  std::vector<uint8_t> big(color_cap + 1, 7);
+  w.put_color(frames, big.data(), big.size(), cw, ch, (size_t)cw * 4, 0);
+  w.commit(test_record(frames));
+  if (w.stats().oversize != 1 || reinterpret_cast<const GcvLiveSlot*>(v.slot(frames))->color_bytes != 0 || v.published() != frames + 1)
+    RETURNFAILST("live stream: oversize color");
+  // a frame without its commit() is published when the next one starts, and on close
+  w.put_depth(frames + 1, depth.data(), dw, dh);
+  w.put_depth(frames + 2, depth.data(), dw, dh);
+  if (v.published() != frames + 2 || reinterpret_cast<const GcvLiveSlot*>(v.slot(frames + 1))->frame_idx != frames + 1)
+    RETURNFAILST("live stream: uncommitted frame not published by the next one");
+  w.close();
+  if (v.state() != GCVLIVE_CLOSED || v.published() != frames + 3) RETURNFAILST("live stream: close");
+  return "ok";
+}
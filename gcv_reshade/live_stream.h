@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "frame_sidecar.h"
+
+// Live frame stream: the recorder publishes every frame (pose, keys, color, raw depth) into a ring
+// of slots in shared memory, for consumers such as online training or teleoperation that should
+// not go through disk and ffmpeg. POSIX shm "/gcv_live_<name>" (/dev/shm) on Linux, a named file
+// mapping "Local\gcv_live_<name>" on Windows. All integers little-endian. Layout:
+//   GcvLiveHeader                (header_bytes)
+//   slot_count x slot_stride:    GcvLiveSlot, color buffer (color_capacity), depth buffer (depth_capacity)
+// Each slot is a seqlock. The producer never waits for readers: frame n goes into slot
+// n % slot_count; seq is made odd while the slot is written and set to 2*(n+1) when frame n is
+// complete, then 'published' becomes n+1. A reader takes slot (published-1) % slot_count, checks
+// seq == 2*published, reads, and re-checks seq: a changed value means the producer lapped it.
+// Reader: python_threedee/gcv_live.py (numpy views straight into the mapping)
+
+enum GcvLiveState : uint32_t {
+  GCVLIVE_OPEN   = 1,
+  GCVLIVE_CLOSED = 2,   // producer is gone; a new stream may appear under the same name
+};
+
+#pragma pack(push, 1)
+struct GcvLiveHeader {
+  char magic[8];              // "GCVLIVE1"
+  uint32_t version;           // 1
+  uint32_t header_bytes;      // sizeof(GcvLiveHeader), slot 0 starts here
+  uint32_t slot_count;
+  uint32_t slot_header_bytes; // sizeof(GcvLiveSlot)
+  uint64_t slot_stride;
+  uint64_t color_capacity;    // bytes reserved per slot for the color frame
+  uint64_t depth_capacity;    // bytes reserved per slot for float32 depth
+  uint32_t fps;
+  uint32_t producer_pid;
+  uint64_t stream_id;         // differs between producer sessions
+  uint64_t published;         // frames completed so far (atomic)
+  uint32_t state;             // GcvLiveState (atomic)
+  uint8_t reserved[52];
+};
+struct GcvLiveSlot {
+  uint64_t seq;               // seqlock (atomic): odd while written, 2*(n+1) holding frame n
+  uint64_t frame_idx;         // recorder frame index (frames.bin / cam.jsonl)
+  int64_t time_us;
+  int64_t cam_time_us;
+  double cam2world[12];       // row-major 3x4, valid if GCVF_CAM_VALID
+  double fov_v_degrees;
+  double fov_h_degrees;
+  uint32_t flags;             // GcvFrameFlags
+  uint32_t letters_mask;
+  uint32_t modifiers_mask;
+  uint32_t color_format;      // FrameFormat: 0 BGRA, 1 Gray8, 2 I420, 3 NV12, 4 Gray16
+  uint32_t color_w, color_h;
+  uint32_t color_stride;      // luma row pitch
+  uint32_t depth_w, depth_h;  // float32, row-major, tightly packed
+  uint32_t reserved0;
+  uint64_t color_bytes;       // 0: no color for this frame (or larger than color_capacity)
+  uint64_t depth_bytes;       // 0: no depth
+  uint8_t reserved[56];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(GcvLiveHeader) == 128, "live stream header layout");
+static_assert(sizeof(GcvLiveSlot) == 256, "live stream slot layout");
+
+struct LiveStreamStats {
+  uint64_t published = 0;
+  uint64_t oversize = 0;      // color/depth buffers left out because they exceeded the capacity
+};
+
+// Producer side, one thread (the render thread). A frame is assembled in its slot as the pieces
+// arrive (put_color/put_depth with the frame's index) and made visible by commit().
+class LiveStreamWriter {
+public:
+  LiveStreamWriter() = default;
+  ~LiveStreamWriter();
+  LiveStreamWriter(const LiveStreamWriter&) = delete;
+  LiveStreamWriter& operator=(const LiveStreamWriter&) = delete;
+
+  bool open(const std::string& name, int slots, size_t color_capacity, size_t depth_capacity, int fps);
+  void close();   // marks the stream closed; consumers keep their mapping until they let go
+  bool is_open() const { return base_ != nullptr; }
+
+  void put_color(uint64_t frame_idx, const uint8_t* data, size_t bytes, int w, int h, size_t stride, uint32_t format);
+  void put_depth(uint64_t frame_idx, const float* data, int w, int h);
+  void commit(const GcvFrameRecord& r);   // pose/keys/flags of frame r.frame_idx; publishes it
+
+  LiveStreamStats stats() const { return stats_; }
+
+private:
+  GcvLiveSlot* begin(uint64_t frame_idx);   // the slot frame_idx is written into
+  void publish();
+  uint8_t* slot_ptr(uint64_t n) const;
+
+  uint8_t* base_ = nullptr;
+  size_t size_ = 0;
+  GcvLiveHeader hdr_{};            // copy of the constant part
+  bool writing_ = false;           // a slot is open (seq odd)
+  uint64_t writing_idx_ = 0;       // frame_idx being assembled
+  uint64_t published_ = 0;
+  LiveStreamStats stats_;
+  std::string shm_name_;
+#ifdef _WIN32
+  void* mapping_ = nullptr;        // HANDLE
+#endif
+};
+
+// Writes a few frames and reads them back through a second mapping of the stream, the way a
+// consumer (gcv_live.py) sees them: header, slot offsets, seqlock values, lapping and close.
+// "ok" or what failed (like run_utils_tests)
+std::string run_live_stream_tests();
@@ -10,8 +10,11 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <deque>
+#include <filesystem>
 #include <fstream>
 #include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <sstream>
 #include <string>
@@ -20,12 +23,24 @@
 
 #include "copy_texture_into_packedbuf.h"
 #include "gcv_games/game_interface_factory.h"
+#include "gcv_utils/depth_delta_codec.h"
 #include "gcv_utils/miscutils.h"
+#include "gcv_utils/yuv_convert.h"
 #include "generic_depth_struct.h"
 #include "grabbers.h"
 #include "hud_renderer.h"
 #include "image_writer_thread_pool.h"
+#include "capture_governor.h"
+#include "capture_pipeline.h"
+#include "capture_replay.h"
+#include "capture_stages.h"
+#include "capture_trace.h"
+#include "input_sampler.h"
+#include "capture_profile.h"
+#include "motion_trigger.h"
+#include "readback_ring.h"
 #include "recorder.h"
+#include "session_controller.h"
 #include "render_target_stats/render_target_stats_tracking.hpp"
 #include "segmentation/reshade_hooks.hpp"
 #include "segmentation/segmentation_app_data.hpp"
@@ -150,6 +165,13 @@ static double g_camera_data_buffer[17] = {
     0.0, 0.0, 0.0, 0.0, 0.0, 980.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
 static double g_camera_buffer_counter = 0.0;
 
+// capture.gcvt of the running recording (capture_trace.h), for replaying its capture path offline
+static bool g_trace_enabled = false;
+static int g_trace_max_frames = 300;
+static CaptureTraceWriter g_trace;
+static std::string g_trace_path;   // last one written
+static std::atomic<bool> g_replay_running{false};   // the overlay's replay of it, on a worker thread
+
 // create overloaded functions for ReShade API 
 // 
 reshade::api::effect_uniform_variable find_uniform(reshade::api::effect_runtime* runtime, const char* name)
@@ -166,6 +188,7 @@ bool read_uniform_value(reshade::api::effect_runtime* runtime, const char* name,
     reshade::api::effect_uniform_variable var = find_uniform(runtime, name);
     if (var != 0) {
         runtime->get_uniform_value_bool(var, &value, 1);
+        if (g_trace.is_open()) { const float v = value ? 1.0f : 0.0f; g_trace.add_uniform(name, &v, 1); }
         return true;
     }
     return false;
@@ -175,6 +198,7 @@ bool read_uniform_value(reshade::api::effect_runtime* runtime, const char* name,
     reshade::api::effect_uniform_variable var = find_uniform(runtime, name);
     if (var != 0) {
         runtime->get_uniform_value_float(var, &value, 1);
+        if (g_trace.is_open()) g_trace.add_uniform(name, &value, 1);
         return true;
     }
     return false;
@@ -184,6 +208,7 @@ bool read_uniform_value(reshade::api::effect_runtime* runtime, const char* name,
     reshade::api::effect_uniform_variable var = find_uniform(runtime, name);
     if (var != 0) {
         runtime->get_uniform_value_float(var, values, count);
+        if (g_trace.is_open()) g_trace.add_uniform(name, values, count);
         return true;
     }
     return false;
@@ -258,15 +283,30 @@ void UpdateCameraBufferFromReshade(reshade::api::effect_runtime* runtime)
     }
     g_camera_data_buffer[15] = poshash1;
     g_camera_data_buffer[16] = poshash2;
+    if (g_trace.is_open()) g_trace.add_buffer("camera_data_buffer", g_camera_data_buffer, 17);
 }
 
 typedef std::chrono::steady_clock hiresclock;
 
 // ------------------ Global recording status ------------------
-static int g_recording_mode = 0;  // 0: not recording, 1: depth mode, 2: controls mode
-static int g_video_fps = 1;
+static int g_recording_mode = 0;  // 0: not recording, 1: per-frame depth files (F9 layout), 2: streams (F7 layout)
+static int g_video_fps = 1;       // color rate of the running profile
+static std::vector<CaptureProfile> g_profiles = builtin_capture_profiles();   // capture_profiles.json if there is one
+static std::string g_profiles_status = "built-in profiles (F9, F7, F6 motion)";
+static CaptureProfile g_profile;  // profile of the running recording
+static CaptureScheduler g_sched;
+static MotionTrigger g_trigger;   // streams of g_profile driven by camera motion (g_profile.trigger)
+static TriggerDecision g_last_trigger;
+static bool g_seg_stream_due = false;   // segmentation stream: snapshot to request this frame
+static int g_seg_stream_wait = 0;       // frames since it was requested (0: none pending)
+static uint64_t g_seg_stream_idx = 0;   // recorder frame index it belongs to
 static std::unique_ptr<Recorder> g_rec;
 static std::string g_rec_dir;
+static SessionController g_session;   // starts/stops g_rec off the render thread
+static uint64_t g_rec_session = 0;    // capture begins once g_session.ready(g_rec_session)
+static bool g_prewarm_encoder = true; // keep a color encoder spawned for the next recording
+static bool g_warm_requested = false;
+static int g_warm_fps = 24;           // fps of the last recording mode (F7 until one was made)
 
 static FILE* g_actions_csv = nullptr;
 // It is only used to determine whether a header needs to be written. It is actually written in Recorder
@@ -276,20 +316,254 @@ static int64_t g_last_cap_us = 0;
 static int g_copy_fail_in_row = 0;
 static const int g_copy_fail_stop_threshold = 60;
 static DepthToneParams g_depth_tone;  // clip/log parameter
+static int g_queue_capacity = 8;      // writer queue settings, applied when the next recording starts
+static int g_queue_policy = (int)QueuePolicy::DropNewest;
+static const FrameFormat g_color_formats[] = { FrameFormat::I420, FrameFormat::NV12, FrameFormat::BGRA };
+static Depth16Params g_depth16;       // F7 raw depth also goes to depth16.mkv with this curve
+static bool g_depth16_enabled = true;
+static bool g_depth_delta = true;     // F7 depth.gcvd: keyframe + delta coding
+static bool g_depth_gcvz = false;     // F9: per-frame depth as .gcvz instead of .npy
+static int g_depth_bench_collect = 0; // raw depth frames still to collect for the codec benchmark
+static std::vector<std::vector<float>> g_depth_bench_frames;
+static int g_depth_bench_w = 0, g_depth_bench_h = 0;
+static std::mutex g_depth_bench_mtx;  // the frames are collected by the pipeline's sink thread
+static bool g_camera_json_files = true;    // F9: per-frame camera json files besides frames.bin / cam.jsonl
+static bool g_dedup_frames = false;   // don't store identical consecutive frames again (menus, pauses, loading screens)
+static bool g_live_stream = false;    // publish frames to shared memory gcv_live_default (python_threedee/gcv_live.py)
+static int g_color_format = 0;        // index into g_color_formats; YUV is converted here with SIMD, BGRA by ffmpeg
+static int g_video_timing = (int)VideoTiming::Vfr;   // how capture.mp4/depth.mp4 get the frame times (ffmpeg_pipe.h)
+static int g_segment_encoders = 1;    // >1: color is encoded as GOP-aligned segments by this many ffmpeg processes
+static int g_segment_frames = 48;     // frames per segment
+static bool g_async_readback = true;  // recording textures go through g_readback instead of a staging copy + wait_idle each
+static int g_readback_latency = 2;    // presents between a copy and its map
+static int g_readback_depth = 3;      // staging textures per format and size
+static ReadbackRing g_readback;
+// lowers rate / depth cost while the writers fall behind (capture_governor.h); bounds from the
+// profile's "governor" block, or the defaults for profiles without one if g_governor_default
+static CaptureGovernor g_governor;
+static bool g_governor_default = false;
+static int64_t g_governor_next_us = 0;   // next pressure reading
+static const int64_t kGovernorPeriodUs = 250000;
+static bool g_input_sampler = true;   // keys, mouse and gamepad polled on their own thread; a frame takes the nearest sample
+static int g_input_rate_hz = 500;
+static InputSampler g_input;
+
+static StagePipeline<CaptureFrame> g_pipeline;        // running while a recording reads back asynchronously
+static std::vector<PendingFrame> g_refused_frames;    // render thread: waiting for the next token
+static CaptureStages g_stages;                        // what the capture stages work on (capture_stages.h); out is g_rec
+
+// capture_profiles.json in the output directory replaces the built-in F9/F7 profiles
+static void load_profiles(image_writer_thread_pool& shdata) {
+    const std::string path = shdata.output_filepath_creates_outdir_if_needed("capture_profiles.json");
+    std::error_code ec;
+    if (!std::filesystem::exists(std::filesystem::u8path(path), ec)) {
+        g_profiles = builtin_capture_profiles();
+        g_profiles_status = "built-in profiles (F9, F7, F6 motion); no " + path;
+        return;
+    }
+    std::vector<CaptureProfile> loaded;
+    std::string err;
+    if (load_capture_profiles(path, loaded, err) && !loaded.empty()) {
+        g_profiles = loaded;
+        g_profiles_status = std::to_string(loaded.size()) + " profiles from " + path;
+        reshade::log_message(reshade::log_level::info, ("[CV Capture] " + g_profiles_status).c_str());
+    } else {
+        g_profiles = builtin_capture_profiles();
+        g_profiles_status = "built-in profiles (F9, F7, F6 motion); " + (err.empty() ? std::string("no profiles in ") + path : err);
+        reshade::log_message(reshade::log_level::error, ("[CV Capture] " + g_profiles_status).c_str());
+    }
+}
+
+static FrameFormat profile_color_format(const CaptureProfile& p) {
+    const std::string& f = p.stream(CaptureStream::Color).format;
+    if (f == "i420") return FrameFormat::I420;
+    if (f == "nv12") return FrameFormat::NV12;
+    if (f == "bgra") return FrameFormat::BGRA;
+    return g_color_formats[g_color_format];   // "": the overlay setting
+}
+
+// raw depth frames for the codec benchmark, from the sink stage (or the render thread without it)
+static void collect_bench_depth(const std::vector<float>& depth, int w, int h) {
+    std::lock_guard<std::mutex> lk(g_depth_bench_mtx);
+    if (g_depth_bench_collect <= 0) return;
+    if (g_depth_bench_frames.empty()) { g_depth_bench_w = w; g_depth_bench_h = h; }
+    if (w == g_depth_bench_w && h == g_depth_bench_h) {
+        g_depth_bench_frames.push_back(depth);
+        --g_depth_bench_collect;
+    }
+}
+
+// per-frame depth files (F9) of the recording: its device's image writers, which also convert the
+// depth like save_texture_image_needing_resource_barrier_copy does (game and depth settings)
+static constexpr uint32_t kReadbackFilesGcvz = 0x400;   // with kReadbackDepthFiles: .gcvz instead of .npy
+static image_writer_thread_pool* g_files_writers = nullptr;
+static GameInterface* g_files_game = nullptr;
+
+// readbacks unpacked like the grab_* functions do
+static bool unpack_recorded_readback(simple_packed_buf& dst, const ReadbackKey& key, const ReadbackMapped& mapped, uint32_t aux) {
+    if ((aux & kReadbackDepthFiles) && g_files_writers)
+        return copy_readback_into_packedbuf(g_files_game, dst, key, mapped, (TextureInterpretation)(aux & 0xFF), g_files_writers->depth_settings);
+    depth_tex_settings depth_cfg{};
+    return copy_readback_into_packedbuf(nullptr, dst, key, mapped, (TextureInterpretation)(aux & 0xFF), depth_cfg);
+}
+
+// with every new g_rec: the stages deliver into it
+static void bind_capture_stages(image_writer_thread_pool& shdata) {
+    g_stages.ring = &g_readback;
+    g_stages.out = g_rec.get();
+    g_stages.unpack = unpack_recorded_readback;
+    g_stages.trace = &g_trace;
+    g_stages.row_bytes = readback_row_bytes;
+    g_stages.on_raw_depth = collect_bench_depth;
+    g_files_writers = &shdata;
+    g_files_game = shdata.get_game_interface();
+    g_stages.on_depth_file = [dir = g_rec_dir](const PendingFrame& pf, uint32_t aux, simple_packed_buf& depth) {
+        char basebuf[512];
+        _snprintf_s(basebuf, _TRUNCATE, "%s/frame_%06llu_depth", dir.c_str(), (unsigned long long)pf.frec.frame_idx);
+        if (!g_files_writers->save_packed_image(basebuf, (aux & kReadbackFilesGcvz) ? ImageWriter_gcvz : ImageWriter_numpy, std::move(depth)))
+            reshade::log_message(reshade::log_level::warning, "record: failed to queue per-frame depth (.npy/.gcvz)");
+    };
+}
+
+// at recording start: the ring on this queue and the stages behind it; false leaves the recording
+// on the synchronous grab_* path
+static bool start_capture_pipeline(reshade::api::command_queue* q) {
+    if (!g_readback.has_backend()) g_readback.set_backend(make_reshade_readback_backend(q));
+    if (!g_readback.has_backend()) return false;
+    CapturePipelineConfig cfg;
+    // D3D11/OpenGL map on the render thread: the readback stage is pumped there, behind 'latency'
+    cfg.readback_on_caller = !g_readback.maps_off_thread();
+    g_readback.set_latency(&g_rec->latency()[LatencyStage::ReadbackWait], &g_rec->latency()[LatencyStage::Map]);
+    g_pipeline.start(cfg,
+        [](CaptureFrame& cf, bool wait) { return capture_readback_stage(g_stages, cf, wait); },
+        [](CaptureFrame& cf) { capture_convert_stage(g_stages, cf); },
+        capture_annotate_stage,
+        [](CaptureFrame& cf) { capture_sink_stage(g_stages, cf); });
+    return true;
+}
+
+// the frames still in the pipeline go out before the recorder closes; then the render thread is
+// the recorder's producer again
+static void stop_capture_pipeline() {
+    g_pipeline.stop();
+    g_readback.set_latency(nullptr, nullptr);   // the histograms go with g_rec
+    if (g_rec)
+        for (PendingFrame& pf : g_refused_frames) log_refused_frame(g_stages, pf);
+    g_refused_frames.clear();
+    if (g_trace.is_open()) {   // after the last frame record
+        g_trace.close();
+        const CaptureTraceStats ts = g_trace.stats();
+        reshade::log_message(ts.failed ? reshade::log_level::warning : reshade::log_level::info,
+            ("capture trace: " + std::to_string(ts.frames) + " frames, " + std::to_string(ts.textures) + " textures, "
+             + std::to_string(ts.bytes >> 20) + " MB" + (ts.failed ? " (write failed)" : "") + " -> " + g_trace_path).c_str());
+    }
+}
+
+// copies tex for pf's frame into the ring; false if it has no free staging texture or the copy failed
+static bool submit_readback(reshade::api::resource tex, PendingFrame& pf, CaptureStream stream, uint32_t aux) {
+    ReadbackTag tag;
+    tag.frame_idx = pf.frec.frame_idx;
+    tag.time_us = pf.frec.time_us;
+    tag.stream = (uint32_t)stream;
+    tag.aux = aux;
+    return g_readback.submit(tex.handle, tag);
+}
+
+static Json readback_stats_json() {
+    const ReadbackRingStats rs = g_readback.stats();
+    Json j;
+    j["async"] = g_async_readback;
+    j["latency_frames"] = g_readback.latency();
+    j["depth"] = g_readback.depth();
+    j["fenced"] = rs.fenced;
+    j["submitted"] = rs.submitted;
+    j["completed"] = rs.completed;
+    j["failed"] = rs.failed;
+    j["no_slot"] = rs.no_slot;
+    j["late"] = rs.late;
+    j["waits"] = rs.waits;
+    j["fence_signals"] = rs.signals;
+    j["staging_created"] = rs.staging_created;
+    j["latency_mean_frames"] = rs.latency_mean_frames;
+    j["latency_max_frames"] = rs.latency_max_frames;
+    return j;
+}
+
+static Json pipeline_stats_json() {
+    Json j;
+    j["readback_on_render_thread"] = g_pipeline.readback_on_caller();
+    for (const CaptureStageStats& s : g_pipeline.stats()) {
+        Json st;
+        st["capacity"] = s.capacity;
+        st["max_queued"] = s.max_queued;
+        st["processed"] = s.processed;
+        st["refused"] = s.refused;
+        st["busy_mean_ms"] = s.busy_mean_ms;
+        st["busy_max_ms"] = s.busy_max_ms;
+        st["wait_mean_ms"] = s.wait_mean_ms;
+        st["wait_max_ms"] = s.wait_max_ms;
+        j[s.name] = st;
+    }
+    return j;
+}
+
+// what the governor watches: queue fill, drops and encode time on the color side (readback
+// pipeline, color encoder), fill and drops on the depth side (depth.gcvd, depth encoders)
+static GovernorSample governor_sample() {
+    GovernorSample s;
+    for (const CaptureStageStats& st : g_pipeline.stats()) {
+        if (st.capacity) s.color.fill = std::max(s.color.fill, (double)st.queued / (double)st.capacity);
+        s.color.drops += st.refused;
+    }
+    for (const FrameBusSinkStats& b : g_rec->bus_stats()) {
+        GovernorPath& path = b.topic == BusTopic::Color ? s.color : s.depth;
+        if (b.capacity) path.fill = std::max(path.fill, (double)b.queued / (double)b.capacity);
+        if (b.topic != BusTopic::Color) path.drops += b.dropped;   // color drops are in color_dropped()
+    }
+    s.color.drops += g_rec->color_dropped();
+    s.depth.drops += g_rec->depth_seq_stats().frames_dropped;
+    const LatencySummary enc = g_rec->latency()[LatencyStage::EncodeWrite].summary();
+    s.color.lat_count = enc.count;
+    s.color.lat_sum_ms = enc.mean_ms * (double)enc.count;
+    // an encoder slower than the color rate can only fall further behind
+    if (g_profile.has(CaptureStream::Color)) s.color.budget_ms = 1000.0 / std::max(1, g_profile.fps(CaptureStream::Color));
+    return s;
+}
+
+static Json input_stats_json() {
+    const InputSamplerStats s = g_input.stats();
+    Json j = Json::object();
+    j["source"] = s.source;
+    j["samples"] = s.samples;
+    j["rate_hz"] = s.rate_hz;
+    j["late"] = s.late;
+    j["overwritten"] = s.overwritten;
+    j["max_interval_ms"] = s.max_interval_ms;
+    j["picks"] = s.picks;
+    j["pick_offset_mean_ms"] = s.pick_offset_mean_ms;
+    j["pick_offset_max_ms"] = s.pick_offset_max_ms;
+    return j;
+}
 
 static void on_init(reshade::api::device* device) {
     auto& shdata = device->create_private_data<image_writer_thread_pool>();
     reshade::log_message(reshade::log_level::info, std::string(std::string("tests: ") + run_utils_tests()).c_str());
     shdata.init_time = hiresclock::now();
+    load_profiles(shdata);
 }
 static void on_destroy(reshade::api::device* device) {
     device->get_private_data<image_writer_thread_pool>().change_num_threads(0);
     device->get_private_data<image_writer_thread_pool>().print_waiting_log_messages();
 
+    stop_capture_pipeline();   // still pushes into g_rec
+    g_input.stop();
+    g_readback.release();      // staging textures belong to this device
     if (g_rec) {
-        g_rec->stop();
-        g_rec.reset();
+        g_session.stop(std::move(g_rec), {}, hiresclock::now(), /*write_meta=*/false);
     }
+    g_session.shutdown();   // waits for the stop above and removes an unused warm encoder
+    g_recording_mode = 0;
+    g_warm_requested = false;
     if (g_actions_csv) {
         fclose(g_actions_csv);
         g_actions_csv = nullptr;
@@ -323,18 +597,17 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
         // start record
         if (ctrl_down && g_recording_mode == 0) {
             bool start_rec = false;
-            if (runtime->is_key_pressed(VK_F9)) {
-                // Logic 1: 5fps, depth, rgb video, camera
-                g_recording_mode = 1;
-                g_video_fps = 1;
-                start_rec = true;
-				PlaySound(TEXT("SystemStart"), NULL, SND_ALIAS | SND_ASYNC);
-            } else if (runtime->is_key_pressed(VK_F7)) {
-                // Logic 2: 24fps, rgb video, controls, camera
-                g_recording_mode = 2;
-                g_video_fps = 24;
-                start_rec = true;
-				PlaySound(TEXT("SystemStart"), NULL, SND_ALIAS | SND_ASYNC);
+            for (const CaptureProfile& p : g_profiles) {
+                if (p.hotkey_vk && runtime->is_key_pressed(p.hotkey_vk)) {
+                    // built-in F9: 1 fps color video, per-frame depth, camera; F7: 24 fps color, depth.gcvd, controls, camera;
+                    // F6: F9's streams whenever the camera moved enough
+                    g_profile = p;
+                    g_recording_mode = p.depth_per_frame_files() ? 1 : 2;
+                    g_video_fps = p.fps(CaptureStream::Color);
+                    start_rec = true;
+                    PlaySound(TEXT("SystemStart"), NULL, SND_ALIAS | SND_ASYNC);
+                    break;
+                }
             }
 
             if (start_rec) {
@@ -344,21 +617,72 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
                 // 录制开始前清空上一次录制累积的丢帧记录，避免跨会话残留
                 vecDroppedcamJson.clear();
 
-                const std::string dirname = std::string("actions_") + get_datestr_yyyy_mm_dd() + "_" + std::to_string(now_us) + "/";
-                g_rec_dir = shdata.output_filepath_creates_outdir_if_needed(dirname);
+                const auto t_key = hiresclock::now();
+                std::string warm_dir;
+                // segmented recordings spawn one encoder per segment; the warm one would go unused
+                const FrameFormat color_fmt = profile_color_format(g_profile);
+                const bool use_warm = g_prewarm_encoder && g_segment_encoders <= 1 && g_profile.has(CaptureStream::Color) &&
+                    g_session.claim_warm(g_video_fps, color_fmt, (VideoTiming)g_video_timing, warm_dir);
+                if (use_warm) {
+                    g_rec_dir = warm_dir;   // the pre-spawned encoder already writes there
+                } else {
+                    const std::string dirname = std::string("actions_") + get_datestr_yyyy_mm_dd() + "_" + std::to_string(now_us) + "/";
+                    g_rec_dir = shdata.output_filepath_creates_outdir_if_needed(dirname);
+                }
 
                 RecorderConfig cfg{g_video_fps, g_rec_dir, true};  // constructor init
+                cfg.queue_capacity = (size_t)std::max(1, g_queue_capacity);
+                cfg.queue_policy = (QueuePolicy)g_queue_policy;
+                cfg.color_format = color_fmt;
+                cfg.video_timing = (VideoTiming)g_video_timing;
+                cfg.write_depth16 = g_depth16_enabled;
+                cfg.depth_delta = g_depth_delta;
+                cfg.depth16 = g_depth16;
+                cfg.depth_fps = g_profile.has(CaptureStream::Depth) ? g_profile.fps(CaptureStream::Depth) : 0;
+                cfg.write_camera_json_files = g_profile.stream(CaptureStream::Pose).sink == "json_files" ||
+                    (g_camera_json_files && g_recording_mode == 1);
+                cfg.profile_name = g_profile.name;
+                cfg.profile = g_profile.to_json();
+                cfg.write_trigger_log = g_profile.trigger.enabled;
+                cfg.write_input_log = g_input_sampler && g_profile.has(CaptureStream::Actions);
+                cfg.dedup_frames = g_dedup_frames;
+                if (g_live_stream) cfg.live_stream = "default";
+                // the sliders' ranges (ctrl+click can type past them)
+                cfg.segment_encoders = std::clamp(g_segment_encoders, 1, 8);
+                cfg.segment_frames = std::clamp(g_segment_frames, 8, 240);
                 g_rec = std::make_unique<Recorder>(cfg);
-                g_rec->start();
+                bind_capture_stages(shdata);
+                g_rec->attach_image_counter(&shdata.written);
 
 				Json game_settings = Json::object();
-                g_rec->init_session_meta(/*game_name*/"", /*recording_mode*/ g_recording_mode, game_settings);
+                // start(), the ffmpeg spawn and the system queries for meta.json run on the controller thread
+                g_rec_session = g_session.start(g_rec.get(), /*recording_mode*/ g_recording_mode, game_settings, t_key, use_warm);
+                g_warm_fps = g_video_fps;
+                g_warm_requested = false;
 
                 g_rec_idx = 0;
                 g_last_cap_us = 0;
                 g_copy_fail_in_row = 0;
+                g_readback.configure(g_readback_latency, g_readback_depth);
+                if (g_async_readback && !start_capture_pipeline(runtime->get_command_queue()))
+                    reshade::log_message(reshade::log_level::warning, "REC: no readback ring on this device, reading back synchronously");
+                // the trace has the textures the ring reads back, so only pipelined recordings get one
+                if (g_trace_enabled && g_pipeline.running()) {
+                    g_trace_path = (std::filesystem::path(g_rec_dir) / "capture.gcvt").string();
+                    if (!g_trace.open(g_trace_path, (uint64_t)std::max(1, g_trace_max_frames)))
+                        reshade::log_message(reshade::log_level::warning, ("REC: cannot write " + g_trace_path).c_str());
+                }
+                if (cfg.write_input_log) {
+                    // sample times on the frames' clock (time_us), so the nearest sample is a plain comparison
+                    const hiresclock::time_point t0 = shdata.init_time;
+                    if (!g_input.start(make_system_input_source(), std::max(1, g_input_rate_hz),
+                                       [t0] { return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(hiresclock::now() - t0).count(); }))
+                        reshade::log_message(reshade::log_level::warning, "REC: no input source, reading keys per frame");
+                }
+                g_seg_stream_due = false;
+                g_seg_stream_wait = 0;
 
-                reshade::log_message(reshade::log_level::info, ("REC start (mode " + std::to_string(g_recording_mode) + "): " + g_rec_dir).c_str());
+                reshade::log_message(reshade::log_level::info, ("REC start (profile " + g_profile.name + "): " + g_rec_dir).c_str());
             }
         }
 
@@ -366,9 +690,23 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
         if (ctrl_down && (runtime->is_key_pressed(VK_F10) || runtime->is_key_pressed(VK_F8)) && g_recording_mode != 0) {
             g_recording_mode = 0;
             if (g_rec) {
-                g_rec->stop();
-                g_rec->finalize_and_write_meta_json(vecDroppedcamJson);
-                g_rec.reset();
+                const bool pipelined = g_pipeline.running();
+                stop_capture_pipeline();
+                Json sched = g_sched.stats_json();
+                if (g_profile.trigger.enabled) sched["trigger"] = g_trigger.stats_json();
+                if (g_governor.enabled()) sched["governor"] = g_governor.stats_json();
+                sched["readback"] = readback_stats_json();
+                if (pipelined) sched["pipeline"] = pipeline_stats_json();
+                if (g_input.running()) {
+                    g_input.stop();
+                    sched["input"] = input_stats_json();
+                }
+                g_readback.release();
+                g_rec->set_schedule_stats(sched);
+                // joining the writers, closing the encoders and meta.json happen on the controller thread
+                g_session.stop(std::move(g_rec), std::move(vecDroppedcamJson), hiresclock::now());
+                vecDroppedcamJson.clear();
+                g_rec_session = 0;
             }
             if (g_actions_csv) {
                 fclose(g_actions_csv);
@@ -378,16 +716,98 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
 			PlaySound(TEXT("SystemStart"), NULL, SND_ALIAS | SND_ASYNC);
         }
 
-        // recording
-        if (g_recording_mode != 0) {
-            const int fps = std::max(1, g_video_fps);
-            const int64_t period_us = 1000000LL / fps;
-            static int64_t next_due_us = 0;
-            if (g_last_cap_us == 0) {
-                g_last_cap_us = now_us;
-                next_due_us = now_us;
+        // idle: have an encoder running for the next recording, sized like the back buffer
+        if (g_recording_mode == 0 && g_prewarm_encoder && g_segment_encoders <= 1 && !g_warm_requested && g_session.idle()) {
+            uint32_t bw = 0, bh = 0;
+            runtime->get_screenshot_width_and_height(&bw, &bh);
+            WarmEncoderParams wp;
+            wp.w = (int)bw;
+            wp.h = (int)bh;
+            wp.fps = g_warm_fps;
+            wp.fmt = g_color_formats[g_color_format];
+            wp.timing = (VideoTiming)g_video_timing;
+            const std::string dirname = std::string("actions_") + get_datestr_yyyy_mm_dd() + "_" + std::to_string(now_us) + "/";
+            wp.out_dir = shdata.output_filepath_creates_outdir_if_needed(dirname);
+            g_session.prewarm(wp);
+            g_warm_requested = true;
+        }
+
+        // recording (frames are taken once the controller has the session up)
+        if (g_recording_mode != 0 && g_rec && g_session.ready(g_rec_session)) {
+            if (g_last_cap_us == 0) {   // first frame of the session
+                g_sched.reset(g_profile, now_us);
+                g_trigger.reset(g_profile.trigger);
+                GovernorParams gp = g_profile.governor;
+                gp.enabled = gp.enabled || g_governor_default;
+                g_governor.reset(gp);
+                g_governor_next_us = now_us;
+            }
+            // D3D11/OpenGL: the frames whose copies are a few presents old are read back here, the rest of
+            // their way is on the pipeline's threads
+            if (g_pipeline.running()) {
+                g_readback.next_frame();
+                g_pipeline.pump();
+            }
+            // streams due at this present, each at its own rate; the frame index counts presents where any was due
+            uint32_t due = g_sched.tick(now_us);
+            // motion trigger: the camera is read at every present, its streams are due when it moved enough
+            CamMatrixData trigger_cam;
+            std::string trigger_cam_err;
+            bool trigger_cam_read = false, trigger_cam_ok = false;
+            TriggerDecision td;
+            uint32_t triggered = 0;   // streams the trigger makes due
+            if (g_profile.trigger.enabled) {
+                trigger_cam_read = true;
+                {
+                    LatencyScope timed(&g_rec->latency()[LatencyStage::PoseFetch]);
+                    trigger_cam_ok = shdata.get_camera_matrix(trigger_cam, trigger_cam_err);
+                }
+                const std::array<ftype, 12> m = cam_matrix_to_flattened_row_major_array(trigger_cam.extrinsic_cam2world);
+                double pose[12];
+                for (int i = 0; i < 12; ++i) pose[i] = (double)m[i];
+                const double fov = trigger_cam.fov_v_degrees > ftype(0.0) ? (double)trigger_cam.fov_v_degrees : (double)trigger_cam.fov_h_degrees;
+                td = g_trigger.decide(now_us, trigger_cam_ok ? pose : nullptr, fov);
+                for (int i = 0; i < kCaptureStreams; ++i)
+                    if (g_profile.triggered((CaptureStream)i)) triggered |= capture_stream_bit((CaptureStream)i);
+                if (td.fire) due |= triggered;
             }
-            if (now_us >= next_due_us) {
+            // capture governor: a pressure reading every kGovernorPeriodUs; its rate step skips color and depth
+            if (g_governor.enabled()) {
+                if (now_us >= g_governor_next_us) {
+                    g_governor_next_us = now_us + kGovernorPeriodUs;
+                    if (g_governor.update(now_us, g_rec_idx, governor_sample())) {
+                        g_rec->set_fast_depth_compression(g_governor.fast_depth_compression());
+                        reshade::log_message(reshade::log_level::info, ("REC governor: level " + std::to_string(g_governor.level())
+                            + ", rate 1/" + std::to_string(g_governor.rate_divisor()) + ", depth mantissa " + std::to_string(g_governor.depth_bits())
+                            + " bits" + (g_governor.fast_depth_compression() ? ", fast depth compression" : "")
+                            + " from frame " + std::to_string(g_rec_idx)).c_str());
+                    }
+                }
+                due = g_governor.filter_due(due);
+            }
+            // logged after the governor, which may have left out every stream the trigger made due
+            if (td.reason != TriggerReason::None) {
+                const bool captured = td.fire && (due & triggered) != 0;
+                TriggerRecord tr{};
+                // a capture gets the index it is recorded under; a held or skipped one the last captured
+                tr.frame_idx = captured ? g_rec_idx : (g_rec_idx ? g_rec_idx - 1 : 0);
+                tr.time_us = now_us;
+                tr.since_us = td.since_us;
+                tr.translation = td.translation;
+                tr.rotation_deg = td.rotation_deg;
+                tr.fov_deg = td.fov_deg;
+                tr.fired = td.fire ? 1 : 0;
+                tr.governor_skipped = (td.fire && !captured) ? 1 : 0;
+                _snprintf_s(tr.reason, _TRUNCATE, "%s", trigger_reason_name(td.reason));
+                g_rec->log_trigger(tr);
+                g_last_trigger = td;
+            }
+            const bool want_color = (due & capture_stream_bit(CaptureStream::Color)) != 0;
+            const bool want_depth = (due & capture_stream_bit(CaptureStream::Depth)) != 0;
+            const bool want_pose = (due & capture_stream_bit(CaptureStream::Pose)) != 0;
+            const bool want_actions = (due & capture_stream_bit(CaptureStream::Actions)) != 0;
+            const bool want_seg = (due & capture_stream_bit(CaptureStream::Segmentation)) != 0;
+            if (due != 0) {
                 bool delta_depth_ok = true;
                 bool delta_control_ok = true;
 
@@ -397,29 +817,42 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
                 reshade::api::command_queue* const q = runtime->get_command_queue();
                 const reshade::api::resource color_res = dev->get_resource_from_view(rtv);
 
-                bool color_ok = false;
                 int w = 0, h = 0;
 
-                if (color_res.handle == 0) {
+                if (want_color && color_res.handle == 0) {
                     reshade::log_message(reshade::log_level::warning, "stream skip: color resource null");
                 } else {
-                    std::vector<uint8_t> bgra;
+                    FrameRef frame;
+                    // this frame's record; with async readback it travels with the frame's token through
+                    // g_pipeline, or waits for the next token when the pipeline is full (no copies then)
+                    const bool async_rb = g_pipeline.running();
+                    std::unique_ptr<CaptureFrame> token;
+                    if (async_rb && g_pipeline.has_room()) token.reset(new CaptureFrame());
+                    PendingFrame sync_pf;
+                    PendingFrame& pf = token ? token->pf : sync_pf;
+                    pf.frec.frame_idx = g_rec_idx;
+                    pf.frec.time_us = now_us;
+                    pf.frec.flags |= g_governor.frame_flags();   // degraded frames are marked in frames.bin
+                    pf.depth_bits = g_governor.depth_bits();
+                    if (g_trace.is_open()) g_trace.begin_frame(g_rec_idx, now_us, due);
 
                     // camera position
                     const int64_t now_us_control_1 = std::chrono::duration_cast<std::chrono::microseconds>(hiresclock::now() - shdata.init_time).count();
                     CamMatrixData cam;
                     std::string cam_err;
-                    const auto cam_ok = shdata.get_camera_matrix(cam, cam_err);
-                    Json camj;
-                    if (cam_ok) {
-                        cam.into_json(camj);
-                    } else {
-                        camj["cam_status"] = "uninitialized";
-                        if (!cam_err.empty()) camj["err"] = cam_err;
+                    bool cam_ok = false;
+                    if (want_pose && trigger_cam_read) {   // read a moment ago for the trigger
+                        cam = trigger_cam;
+                        cam_err = trigger_cam_err;
+                        cam_ok = trigger_cam_ok;
+                    } else if (want_pose) {
+                        LatencyScope timed(&g_rec->latency()[LatencyStage::PoseFetch]);
+                        cam_ok = shdata.get_camera_matrix(cam, cam_err);
                     }
 
 					const int64_t now_us_control_2 = std::chrono::duration_cast<std::chrono::microseconds>(hiresclock::now() - shdata.init_time).count();
 					const int64_t delta_us_control = now_us_control_2 - now_us_control_1;
+					if (g_trace.is_open()) g_trace.add_event(g_rec_idx, "pose_fetch", now_us_control_1, delta_us_control);
 					/*reshade::log_message(reshade::log_level::info,
 							("Frame delta: Δt=%lld us", std::to_string(delta_us_control).c_str()));*/
 					if (std::abs(delta_us_control) > 1000) {
@@ -431,8 +864,9 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
 
                     const int64_t now_us_depth_1 = std::chrono::duration_cast<std::chrono::microseconds>(hiresclock::now() - shdata.init_time).count();
 
-                    // Logic 1: save depth data
-                    if (g_recording_mode == 1) {
+                    const StreamProfile& depth_stream = g_profile.stream(CaptureStream::Depth);
+                    // per-frame depth files (.npy / .gcvz)
+                    if (want_depth && g_profile.depth_per_frame_files()) {
                         reshade::api::resource depth_res = try_get_depth_capture_resource(runtime);
                         TextureInterpretation depth_interp = TexInterp_LinearDepthF32;
                         if (depth_res.handle == 0) {
@@ -443,13 +877,19 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
                         }
                         reshade::api::command_queue* const q2 = runtime->get_command_queue();
 
-                        if (depth_res.handle != 0) {
+                        const bool gcvz = depth_stream.sink == "gcvz" || (depth_stream.sink == "files" && g_depth_gcvz);
+                        if (depth_res.handle != 0 && async_rb) {
+                            // through the ring like color: written by the image writers once the convert stage has it
+                            pf.depth_readback = true;
+                            if (token) submit_readback(depth_res, pf, CaptureStream::Depth,
+                                                       (uint32_t)depth_interp | kReadbackDepthFiles | (gcvz ? kReadbackFilesGcvz : 0));
+                        } else if (depth_res.handle != 0) {
                             char basebuf[512];
                             _snprintf_s(basebuf, _TRUNCATE, "%s/frame_%06llu_",
                                         g_rec_dir.c_str(), (unsigned long long)g_rec_idx);
                             const std::string basefilen = std::string(basebuf);
 
-                            uint32_t writers = ImageWriter_numpy;
+                            uint32_t writers = gcvz ? ImageWriter_gcvz : ImageWriter_numpy;
                             const bool ok_depth =
                                 shdata.save_texture_image_needing_resource_barrier_copy(
                                     basefilen + "depth",
@@ -468,10 +908,43 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
 									"record: depth buffer not found (selected_depth_stencil=0, override_depth_stencil=0). Cannot save depth.npy files.");
 							}
                         }
+                    } else if (want_depth && depth_stream.sink == "gcvd") {
+                        // raw float depth -> depth.gcvd (chunked + compressed on the recorder's writer thread)
+                        reshade::api::resource depth_res = try_get_depth_capture_resource(runtime);
+                        TextureInterpretation depth_interp = TexInterp_LinearDepthF32;
+                        if (depth_res.handle == 0) {
+                            generic_depth_data& genericdepdata = runtime->get_private_data<generic_depth_data>();
+                            depth_res = genericdepdata.selected_depth_stencil;
+                            depth_interp = TexInterp_Depth;
+                        }
+                        static std::vector<float> raw_depth;   // reused between frames
+                        int dw = 0, dh = 0;
+                        if (depth_res.handle != 0 && async_rb) {
+                            pf.depth_readback = true;
+                            if (token) submit_readback(depth_res, pf, CaptureStream::Depth, (uint32_t)depth_interp);
+                        } else if (depth_res.handle != 0 &&
+                            grab_raw_depth_float32(runtime->get_command_queue(), depth_res, raw_depth, dw, dh, depth_interp, depth_stream.scale)) {
+                            deliver_raw_depth(g_stages, pf, raw_depth, dw, dh);
+                        }
+                    } else if (want_depth && depth_stream.sink == "video") {
+                        // tone-mapped 8-bit depth -> depth.mp4
+                        reshade::api::resource depth_res = try_get_depth_capture_resource(runtime);
+                        if (depth_res.handle == 0) depth_res = runtime->get_private_data<generic_depth_data>().selected_depth_stencil;
+                        FrameRef depth_frame;
+                        int dw = 0, dh = 0;
+                        if (depth_res.handle != 0 && async_rb) {
+                            pf.depth_readback = true;
+                            if (token) submit_readback(depth_res, pf, CaptureStream::Depth, (uint32_t)TexInterp_Depth | kReadbackDepthVideo);
+                        } else if (depth_res.handle != 0 &&
+                            grab_depth_gray8(runtime->get_command_queue(), depth_res, g_rec->frame_pool(), depth_frame, dw, dh, g_depth_tone, depth_stream.scale)) {
+                            depth_frame.set_stamp(g_rec_idx, now_us);
+                            g_rec->push_depth(std::move(depth_frame));
+                        }
                     }
 
                     const int64_t now_us_depth_2 = std::chrono::duration_cast<std::chrono::microseconds>(hiresclock::now() - shdata.init_time).count();
                     const int64_t delta_us_depth = now_us_depth_2 - now_us_depth_1;
+                    if (g_trace.is_open()) g_trace.add_event(g_rec_idx, "depth", now_us_depth_1, delta_us_depth);
                     // reshade::log_message(reshade::log_level::info,
                     //                      ("Frame delta: Δt=%lld us", std::to_string(delta_us_depth).c_str()));
                     if (std::abs(delta_us_depth) > 50000) {
@@ -484,8 +957,16 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
                     uint32_t keymask_letters = 0;    // bit 0='A', bit 1='B', ..., bit 25='Z'
                     uint32_t keymask_modifiers = 0;  // 其他控制键
 
+                    // from the input thread: the sample nearest this frame (same bits as below)
+                    InputPick input;
+                    const bool sampled_keys = want_actions && g_input.running() && g_input.take_nearest(now_us, input);
+                    if (sampled_keys) {
+                        keymask_letters = input.sample.letters_mask;
+                        keymask_modifiers = input.sample.modifiers_mask;
+                    }
+
                     // 记录 A-Z
-                    for (int i = 0; i < 26; ++i) {
+                    for (int i = 0; i < 26 && want_actions && !sampled_keys; ++i) {
                         char vk = 'A' + i;
                         if (GetAsyncKeyState(vk) & 0x8000) {
                             keymask_letters |= (1u << i);
@@ -501,6 +982,7 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
                     const int ESCAPE_BIT = 5;
                     const int TAB_BIT = 6;
 
+					if (want_actions && !sampled_keys) {
 					if (GetAsyncKeyState(VK_SHIFT)   & 0x8000) keymask_modifiers |= (1u << SHIFT_BIT);
 					if (GetAsyncKeyState(VK_CONTROL) & 0x8000) keymask_modifiers |= (1u << CTRL_BIT);
 					if (GetAsyncKeyState(VK_MENU)    & 0x8000) keymask_modifiers |= (1u << ALT_BIT);     // VK_MENU = Alt
@@ -508,37 +990,98 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
 					if (GetAsyncKeyState(VK_RETURN)  & 0x8000) keymask_modifiers |= (1u << ENTER_BIT);
 					if (GetAsyncKeyState(VK_ESCAPE)  & 0x8000) keymask_modifiers |= (1u << ESCAPE_BIT);
 					if (GetAsyncKeyState(VK_TAB)     & 0x8000) keymask_modifiers |= (1u << TAB_BIT);
+					}
 
 
-					if (grab_bgra_frame(q, color_res, bgra, w, h)) {
-						g_copy_fail_in_row = 0;
-						// hud::draw_keys_bgra(bgra.data(), w, h, keymask);
+					const FrameFormat color_fmt = g_rec->color_format();
+					const int color_scale = g_profile.stream(CaptureStream::Color).scale;
+					if (want_color && async_rb) {
+						// converted and pushed by the pipeline once the copy is back
+						if (token) token->color_submitted = submit_readback(color_res, pf, CaptureStream::Color, (uint32_t)TexInterp_RGB);
+					} else if (want_color) {
+						const bool grabbed = (color_fmt == FrameFormat::BGRA)
+							? grab_bgra_frame(q, color_res, g_rec->frame_pool(), frame, w, h, color_scale)
+							: grab_yuv420_frame(q, color_res, g_rec->frame_pool(), frame, w, h, color_fmt, color_scale);
+						// hud::draw_keys_bgra(frame.data(), w, h, keymask);
 						// 不画了
-						g_rec->push_color(bgra.data(), w, h);
-						color_ok = true;
-							
-					} 
-
-					if(delta_depth_ok && delta_control_ok){
-						g_rec->log_camera_json(/*idx=*/g_rec_idx,
-										/*time_us=*/now_us,
-										/*cam_json=*/camj,
-										/*img_w=*/w, /*img_h=*/h);
+						if (grabbed) g_copy_fail_in_row = 0;
+						deliver_color(g_stages, pf, grabbed, frame, w, h);
 					}
-					if (!delta_depth_ok || !delta_control_ok) {
+					// the frame's copies behind one fence signal, before the readback stage can wait for it
+					if (token) g_readback.commit();
+
+					// cam.jsonl gets the pose with the frame record (log_pending_frame)
+					pf.log_pose = want_pose && delta_depth_ok && delta_control_ok;
+					pf.cam = cam;
+					pf.cam_err = cam_err;
+					pf.cam_ok = cam_ok;
+					if (want_pose && (!delta_depth_ok || !delta_control_ok)) {
 						vecDroppedcamJson.emplace_back(g_rec_idx);
 					}
-					if (g_recording_mode == 2) { // Logic 2: save control signals
+					if (want_actions) { // save control signals
 						g_rec->log_action(g_rec_idx, now_us, keymask_letters, keymask_modifiers);
 					}
+					if (sampled_keys) { // mouse and gamepad -> input.csv
+						InputRecord ir{};
+						ir.frame_idx = g_rec_idx;
+						ir.time_us = now_us;
+						ir.sample_time_us = input.sample.time_us;
+						ir.samples = input.samples;
+						ir.mouse_dx = input.sample.mouse_dx;
+						ir.mouse_dy = input.sample.mouse_dy;
+						ir.mouse_buttons = input.sample.mouse_buttons;
+						ir.pad_connected = input.sample.pad_connected ? 1 : 0;
+						ir.pad_buttons = input.sample.pad_buttons;
+						ir.pad_lt = input.sample.pad_lt;
+						ir.pad_rt = input.sample.pad_rt;
+						ir.pad_lx = input.sample.pad_lx;
+						ir.pad_ly = input.sample.pad_ly;
+						ir.pad_rx = input.sample.pad_rx;
+						ir.pad_ry = input.sample.pad_ry;
+						g_rec->log_input(ir);
+					}
+
+					// the same frame as one binary record (frames.bin); color and depth results are already in
+					// (or come with the readbacks)
+					GcvFrameRecord& frec = pf.frec;
+					frec.cam_time_us = now_us_control_1;
+					if (cam_ok) frame_record_set_camera(frec, cam);
+					if (want_actions) {
+						frec.letters_mask = keymask_letters;
+						frec.modifiers_mask = keymask_modifiers;
+						frec.flags |= GCVF_KEYS;
+					}
+					if (!want_color) frec.flags |= GCVF_NO_COLOR;
+					if (!want_depth) frec.flags |= GCVF_NO_DEPTH;
+					if (!want_pose) frec.flags |= GCVF_NO_POSE;
+					if (want_seg) {
+						frec.flags |= GCVF_SEGMENTATION;
+						// taken by the snapshot path below, next frame
+						g_seg_stream_due = true;
+						g_seg_stream_idx = g_rec_idx;
+					}
+					if (!delta_control_ok) frec.flags |= GCVF_CONTROL_LATE;
+					if (!delta_depth_ok) frec.flags |= GCVF_DEPTH_LATE;
+					if (token) {
+						token->refused.swap(g_refused_frames);
+						token->color_fmt = color_fmt;
+						token->color_scale = color_scale;
+						token->depth_scale = depth_stream.scale;
+						token->tone = g_depth_tone;
+						g_pipeline.submit(std::move(token));
+					} else if (async_rb) {
+						g_refused_frames.push_back(std::move(sync_pf));
+					} else {
+						log_pending_frame(g_stages, pf);
+					}
 					++g_rec_idx;
 					
 				}
 
-				next_due_us += period_us;
 				g_last_cap_us = now_us;
 			}
-			return;
+			// a segmentation stream is captured by the snapshot path below
+			if (!g_profile.has(CaptureStream::Segmentation)) return;
 		}
     }
 
@@ -548,14 +1091,27 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
         // This handles the case where shader was still compiling on first attempt
         reset_depth_capture_lookup();
     }
-    if (segmentation_app_update_on_finish_effects(runtime, f11_pressed)) {
+    // segmentation stream of a capture profile: the snapshot arrives the frame after the request,
+    // or never (nothing selected to segment)
+    const bool seg_stream_request = g_seg_stream_due && g_recording_mode != 0;
+    g_seg_stream_due = false;
+    if (seg_stream_request) g_seg_stream_wait = 1;
+    else if (g_seg_stream_wait > 0 && ++g_seg_stream_wait > 3) g_seg_stream_wait = 0;
+    if (segmentation_app_update_on_finish_effects(runtime, f11_pressed || seg_stream_request)) {
         PlaySound(TEXT("SystemStart"), NULL, SND_ALIAS | SND_ASYNC);
 
         generic_depth_data& genericdepdata = runtime->get_private_data<generic_depth_data>();
         reshade::api::command_queue* cmdqueue = runtime->get_command_queue();
         const int64_t microseconds_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(hiresclock::now() - shdata.init_time).count();
         const std::string microelapsedstr = std::to_string(microseconds_elapsed);
-        const std::string basefilen = shdata.gamename_simpler() + std::string("_") + get_datestr_yyyy_mm_dd() + std::string("_") + microelapsedstr + std::string("_");
+        std::string basefilen = shdata.gamename_simpler() + std::string("_") + get_datestr_yyyy_mm_dd() + std::string("_") + microelapsedstr + std::string("_");
+        if (g_seg_stream_wait > 0 && g_recording_mode != 0) {
+            // into the recording, named after the frame that requested it (GCVF_SEGMENTATION in frames.bin)
+            char segbuf[512];
+            _snprintf_s(segbuf, _TRUNCATE, "%sframe_%06llu_", g_rec_dir.c_str(), (unsigned long long)g_seg_stream_idx);
+            basefilen = segbuf;
+        }
+        g_seg_stream_wait = 0;
         std::stringstream capmessage;
         capmessage << "capture " << basefilen << ": ";
         bool capgood = true;
@@ -606,34 +1162,35 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
             }
         }
         if (g_recording_mode == 0) {
-            const int64_t now_us_depth_11 = std::chrono::duration_cast<std::chrono::microseconds>(hiresclock::now() - shdata.init_time).count();
-            if (shdata.save_texture_image_needing_resource_barrier_copy(basefilen + std::string("RGB"),
-                                                                        ImageWriter_STB_png, cmdqueue, device->get_resource_from_view(rtv), TexInterp_RGB)) {
-                const int64_t now_us_depth_21 = std::chrono::duration_cast<std::chrono::microseconds>(hiresclock::now() - shdata.init_time).count();
-                const int64_t delta_us_depth1 = now_us_depth_21 - now_us_depth_11;
-                reshade::log_message(reshade::log_level::info,
-                                     ("Frame delta1111: Δt=%lld us", std::to_string(delta_us_depth1).c_str()));
-                if (std::abs(delta_us_depth1) > 6000) {
-                    // delta_depth_ok = false;
-                    reshade::log_message(reshade::log_level::info,
-                                         ("Frame skipped1111: Δt=%lld us", std::to_string(delta_us_depth1).c_str()));
-                }
-                reshade::api::resource f11_depth_res = try_get_depth_capture_resource(runtime);
-                TextureInterpretation f11_depth_interp = TexInterp_LinearDepthF32;
-                if (f11_depth_res.handle == 0) {
-                    f11_depth_res = genericdepdata.selected_depth_stencil;
-                    f11_depth_interp = TexInterp_Depth;
-                }
-                if (shdata.save_texture_image_needing_resource_barrier_copy(basefilen + std::string("depth"),
-                                                                            ImageWriter_STB_png | ImageWriter_epr | ImageWriter_numpy | (shdata.game_knows_depthbuffer() ? ImageWriter_fpzip : 0),
-                                                                            cmdqueue, f11_depth_res, f11_depth_interp)) {
-                    capmessage << "RGB and depth good";
-                } else {
-                    capmessage << "RGB good, but failed to capture depth";
-                    capgood = false;
-                }
+            reshade::api::resource f11_depth_res = try_get_depth_capture_resource(runtime);
+            TextureInterpretation f11_depth_interp = TexInterp_LinearDepthF32;
+            if (f11_depth_res.handle == 0) {
+                f11_depth_res = genericdepdata.selected_depth_stencil;
+                f11_depth_interp = TexInterp_Depth;
+            }
+            // RGB and depth in one readback: both copies, one wait, converted side by side
+            std::vector<image_writer_thread_pool::TextureSaveRequest> saves(2);
+            saves[0].base_filename = basefilen + std::string("RGB");
+            saves[0].image_writers = ImageWriter_STB_png;
+            saves[0].tex = device->get_resource_from_view(rtv);
+            saves[0].tex_interp = TexInterp_RGB;
+            saves[1].base_filename = basefilen + std::string("depth");
+            saves[1].image_writers = ImageWriter_STB_png | ImageWriter_epr | ImageWriter_numpy | (shdata.game_knows_depthbuffer() ? ImageWriter_fpzip : 0);
+            saves[1].tex = f11_depth_res;
+            saves[1].tex_interp = f11_depth_interp;
+            ReadbackBatchTiming rb_timing;
+            shdata.save_texture_images_batched(saves, cmdqueue, &rb_timing);
+            reshade::log_message(reshade::log_level::info, rb_timing.summary().c_str());
+            if (saves[0].ok && saves[1].ok) {
+                capmessage << "RGB and depth good";
+            } else if (saves[0].ok) {
+                capmessage << "RGB good, but failed to capture depth";
+                capgood = false;
+            } else if (saves[1].ok) {
+                capmessage << "depth good, but failed to capture RGB";
+                capgood = false;
             } else {
-                capmessage << "failed to capture RGB (so didnt try depth)";
+                capmessage << "failed to capture RGB and depth";
                 capgood = false;
             }
             if (!errstr.empty()) {
@@ -701,6 +1258,247 @@ static void draw_settings_overlay(reshade::api::effect_runtime* runtime) {
             ImGui::Text(errstr.c_str());
         }
     }
+    if (ImGui::CollapsingHeader("Capture profiles")) {
+        ImGui::TextWrapped("%s", g_profiles_status.c_str());
+        for (const CaptureProfile& p : g_profiles) {
+            std::string line = "Ctrl+" + capture_hotkey_name(p.hotkey_vk) + "  " + p.name + ":";
+            for (int i = 0; i < kCaptureStreams; ++i) {
+                const StreamProfile& st = p.streams[i];
+                if (!st.enabled) continue;
+                char buf[96];
+                if (p.triggered((CaptureStream)i))
+                    _snprintf_s(buf, _TRUNCATE, " %s on motion %s%s", capture_stream_name((CaptureStream)i), st.sink.c_str(),
+                                st.scale > 1 ? (" 1/" + std::to_string(st.scale)).c_str() : "");
+                else
+                    _snprintf_s(buf, _TRUNCATE, " %s %.4g Hz %s%s", capture_stream_name((CaptureStream)i), st.rate_hz, st.sink.c_str(),
+                                st.scale > 1 ? (" 1/" + std::to_string(st.scale)).c_str() : "");
+                line += buf;
+            }
+            ImGui::TextUnformatted(line.c_str());
+            if (p.trigger.enabled) {
+                ImGui::Text("    motion: %.3g units, %.3g deg, fov %.3g deg; every %.3g s to %.3g s", p.trigger.translation,
+                            p.trigger.rotation_deg, p.trigger.fov_deg, p.trigger.min_interval_s, p.trigger.max_interval_s);
+            }
+            if (p.governor.enabled) {
+                ImGui::Text("    governor: rate down to 1/%d, depth down to %d mantissa bits%s", p.governor.max_rate_divisor,
+                            p.governor.min_depth_bits, p.governor.fast_depth_compression ? ", fast depth compression" : "");
+            }
+        }
+        ImGui::Checkbox("Quality governor for profiles without a \"governor\" block (default bounds)", &g_governor_default);
+        if (g_recording_mode == 0 && ImGui::Button("Reload capture_profiles.json")) load_profiles(shdata);
+        const std::string path = shdata.output_filepath_creates_outdir_if_needed("capture_profiles.json");
+        std::error_code ec;
+        if (!std::filesystem::exists(std::filesystem::u8path(path), ec) && ImGui::Button("Write the built-in profiles to capture_profiles.json")) {
+            if (!save_capture_profiles(path, builtin_capture_profiles())) reshade::log_message(reshade::log_level::error, ("[CV Capture] failed to write " + path).c_str());
+        }
+        if (g_recording_mode != 0) {
+            // how closely each stream keeps its rate (sub-frame: within half a present interval)
+            ImGui::Text("Recording with %s, presents every %.2f ms", g_profile.name.c_str(), g_sched.frame_interval_us() / 1000.0);
+            for (int i = 0; i < kCaptureStreams; ++i) {
+                if (!g_profile.streams[i].enabled) continue;
+                const CaptureScheduler::StreamStats& st = g_sched.stats((CaptureStream)i);
+                ImGui::Text("%-12s %7llu taken %5llu missed  error mean %.2f ms, max %.2f ms", capture_stream_name((CaptureStream)i),
+                            (unsigned long long)st.fired, (unsigned long long)st.missed, st.mean_abs_err_us / 1000.0, st.max_abs_err_us / 1000.0);
+            }
+            if (g_profile.trigger.enabled) {
+                std::string counts;
+                for (int r = (int)TriggerReason::Start; r < (int)TriggerReason::Count; ++r)
+                    counts += std::string(" ") + trigger_reason_name((TriggerReason)r) + " " + std::to_string(g_trigger.count((TriggerReason)r));
+                ImGui::Text("Motion trigger:%s", counts.c_str());
+                ImGui::Text("  last: %s after %.2f s (moved %.3g, turned %.3g deg, fov %.3g deg)", trigger_reason_name(g_last_trigger.reason),
+                            g_last_trigger.since_us / 1e6, g_last_trigger.translation, g_last_trigger.rotation_deg, g_last_trigger.fov_deg);
+            }
+            if (g_governor.enabled()) {
+                ImGui::Text("Governor: level %d (rate 1/%d, depth %d bits%s), %zu adjustments", g_governor.level(), g_governor.rate_divisor(),
+                            g_governor.depth_bits(), g_governor.fast_depth_compression() ? ", fast compression" : "", g_governor.adjustments().size());
+            }
+        }
+        if (ImGui::Button("Self-test capture scheduler (synthetic presents)")) {
+            reshade::log_message(reshade::log_level::info, ("[CV Capture] capture scheduler test: " + run_capture_scheduler_tests()).c_str());
+        }
+        if (ImGui::Button("Self-test motion trigger (synthetic camera path)")) {
+            reshade::log_message(reshade::log_level::info, ("[CV Capture] motion trigger test: " + run_motion_trigger_tests()).c_str());
+        }
+        if (ImGui::Button("Self-test capture governor (synthetic pressure)")) {
+            reshade::log_message(reshade::log_level::info, ("[CV Capture] capture governor test: " + run_capture_governor_tests()).c_str());
+        }
+    }
+    if (ImGui::CollapsingHeader("Recording queues")) {
+        static const char* policy_names[] = { "Block", "Drop oldest", "Drop newest", "Duplicate last" };
+        ImGui::SliderInt("Queue capacity (frames)", &g_queue_capacity, 1, 64);
+        ImGui::Combo("When queue is full", &g_queue_policy, policy_names, IM_ARRAYSIZE(policy_names));
+        static const char* color_format_names[] = { "yuv420p (converted here)", "nv12 (converted here)", "bgra (converted by ffmpeg)" };
+        if (ImGui::Combo("Color pipe input", &g_color_format, color_format_names, IM_ARRAYSIZE(color_format_names))) {
+            g_warm_requested = false;   // re-spawn the warm encoder for the new input layout
+        }
+        static const char* timing_names[] = { "wall clock (-re, fixed rate)", "capture times (vfr)", "capture times, resampled to fps (cfr)" };
+        if (ImGui::Combo("Video frame timing", &g_video_timing, timing_names, IM_ARRAYSIZE(timing_names))) {
+            g_warm_requested = false;
+        }
+        if (ImGui::Checkbox("Pre-spawn the color encoder for the next recording", &g_prewarm_encoder)) {
+            if (!g_prewarm_encoder) g_session.release_warm();
+            g_warm_requested = false;
+        }
+        if (ImGui::SliderInt("Parallel color encoders (segments)", &g_segment_encoders, 1, 8)) {
+            if (g_segment_encoders > 1) g_session.release_warm();
+            g_warm_requested = false;
+        }
+        ImGui::SliderInt("Frames per segment (GOP)", &g_segment_frames, 8, 240);
+        static const char* warm_names[] = { "none", "starting", "ready", "failed (ffmpeg missing?)" };
+        ImGui::Text("Warm encoder: %s", warm_names[(int)g_session.warm_state()]);
+        ImGui::Text("YUV kernel: %s", yuv_simd_name(yuv_simd_detect()));
+        ImGui::Checkbox("Asynchronous GPU readback (staging ring, no wait_idle)", &g_async_readback);
+        ImGui::SliderInt("Readback latency (frames)", &g_readback_latency, 1, 4);
+        ImGui::SliderInt("Staging textures per format", &g_readback_depth, 1, 8);
+        if (ImGui::Button("Self-test readback ring (mock device)")) {
+            reshade::log_message(reshade::log_level::info, ("[CV Capture] readback ring test: " + run_readback_ring_tests()).c_str());
+        }
+        if (ImGui::Button("Self-test capture pipeline (mock device)")) {
+            reshade::log_message(reshade::log_level::info, ("[CV Capture] capture pipeline test: " + run_capture_pipeline_tests()).c_str());
+        }
+        if (ImGui::Button("Self-test latency histogram")) {
+            reshade::log_message(reshade::log_level::info, ("[CV Capture] latency histogram test: " + run_latency_histogram_tests()).c_str());
+        }
+        ImGui::Checkbox("Input thread: keys, mouse and gamepad (input.csv)", &g_input_sampler);
+        ImGui::SliderInt("Input sample rate (Hz)", &g_input_rate_hz, 250, 1000);
+        if (ImGui::Button("Self-test input sampler (synthetic input)")) {
+            reshade::log_message(reshade::log_level::info, ("[CV Capture] input sampler test: " + run_input_sampler_tests()).c_str());
+        }
+        ImGui::Checkbox("Trace the next recording (capture.gcvt, asynchronous readback only)", &g_trace_enabled);
+        ImGui::SliderInt("Traced frames", &g_trace_max_frames, 30, 3000);
+        if (g_replay_running.load()) {
+            ImGui::TextUnformatted("Replaying the last trace (the result goes to the log)");
+        } else if (!g_trace_path.empty() && !g_trace.is_open() && ImGui::Button("Replay last trace (as fast as possible)")) {
+            // loading and replaying take seconds on long traces: not on the render thread
+            g_replay_running = true;
+            std::thread([path = g_trace_path]() {
+                CaptureTrace trace;
+                std::string err;
+                CaptureReplayConfig rcfg;
+                rcfg.speed = 0.0;
+                rcfg.unpack = unpack_recorded_readback;
+                const std::string res = load_capture_trace(path, trace, err) ? replay_capture_trace(trace, rcfg).summary() : err;
+                reshade::log_message(reshade::log_level::info, ("[CV Capture] replay " + path + ": " + res).c_str());
+                g_replay_running = false;
+            }).detach();
+        }
+        if (ImGui::Button("Self-test capture trace and replay (synthetic trace)")) {
+            reshade::log_message(reshade::log_level::info, ("[CV Capture] capture replay test: " + run_capture_replay_tests()).c_str());
+        }
+        ImGui::Checkbox("F9: also write frame_XXXXXX_camera.json", &g_camera_json_files);
+        ImGui::Checkbox("Skip identical consecutive frames (flagged as repeats in frames.bin; color with vfr/cfr timing only)", &g_dedup_frames);
+        ImGui::Checkbox("Live stream to shared memory (gcv_live.py)", &g_live_stream);
+        if (ImGui::Button("Self-test live stream (reads its own mapping back)")) {
+            reshade::log_message(reshade::log_level::info, ("[CV Capture] live stream test: " + run_live_stream_tests()).c_str());
+        }
+        if (ImGui::Button("Benchmark actions/camera log writer")) {
+            const SessionLogBenchResult b = bench_session_log(
+                shdata.output_filepath_creates_outdir_if_needed(""), 2000);
+            char buf[256];
+            _snprintf_s(buf, _TRUNCATE, "[CV Capture] log writer benchmark (%d frames): fprintf/fflush+json %.2f us/frame, async %.3f us/frame (drain %.1f ms)",
+                b.frames, b.legacy_us_per_frame, b.async_us_per_frame, b.async_close_ms);
+            reshade::log_message(reshade::log_level::info, buf);
+        }
+        if (ImGui::Button("Self-test frame bus (mock sinks)")) {
+            reshade::log_message(reshade::log_level::info, ("[CV Capture] frame bus test: " + run_frame_bus_tests()).c_str());
+        }
+        ImGui::TextUnformatted("Applied at the next recording start; counters are saved in meta.json.");
+    }
+    if (g_rec && g_session.ready(g_rec_session) && ImGui::CollapsingHeader("Recording throughput", ImGuiTreeNodeFlags_DefaultOpen)) {
+        // running counters kept by each sink; video rows are raw frames going into the encoder
+        static ThroughputMeter meters[8];
+        const std::vector<SinkStats> sinks = g_rec->sink_stats();
+        uint64_t total = 0;
+        for (size_t i = 0; i < sinks.size() && i < IM_ARRAYSIZE(meters); ++i) {
+            const double mbps = meters[i].update(sinks[i].bytes);
+            ImGui::Text("%-14s %9.1f MB  %6llu files  %7.1f MB/s", sinks[i].name, sinks[i].bytes / 1048576.0,
+                        (unsigned long long)sinks[i].files, mbps);
+            total += sinks[i].bytes;
+        }
+        ImGui::Text("%-14s %9.1f MB", "total", total / 1048576.0);
+        // frame bus: each encoder sink has its own queue; lag is publish -> written to the encoder
+        for (const FrameBusSinkStats& b : g_rec->bus_stats()) {
+            if (!b.started) continue;
+            ImGui::Text("%-14s queued %2llu/%-2zu  %6llu written  %5llu dropped  lag %.1f ms (max %.1f)%s", b.name,
+                        (unsigned long long)b.queued, b.capacity, (unsigned long long)b.consumed, (unsigned long long)b.dropped,
+                        b.lag_mean_ms, b.lag_max_ms, b.failed ? "  FAILED" : "");
+        }
+        if (g_readback.has_backend()) {
+            const ReadbackRingStats rs = g_readback.stats();
+            ImGui::Text("%-14s %u in flight  %6llu read  %5llu no slot  %5llu late  latency %.1f frames (max %u)  %u staging%s", "readback",
+                        rs.in_flight, (unsigned long long)rs.completed, (unsigned long long)rs.no_slot, (unsigned long long)rs.late,
+                        rs.latency_mean_frames, rs.latency_max_frames, rs.staging, rs.fenced ? "" : "  (no fences)");
+        }
+        // capture stages after the GPU copies; busy is time in the stage, wait time queued in front of it
+        if (g_pipeline.running()) {
+            for (const CaptureStageStats& st : g_pipeline.stats()) {
+                ImGui::Text("%-14s queued %2zu/%-2zu  %6llu done  %5llu refused  busy %.2f ms (max %.1f)  wait %.1f ms (max %.1f)%s", st.name,
+                            st.queued, st.capacity, (unsigned long long)st.processed, (unsigned long long)st.refused,
+                            st.busy_mean_ms, st.busy_max_ms, st.wait_mean_ms, st.wait_max_ms, st.on_caller ? "  (render thread)" : "");
+            }
+        }
+        if (g_input.running()) {
+            const InputSamplerStats is = g_input.stats();
+            ImGui::Text("%-14s %7.1f Hz  %6llu late  max gap %.1f ms  frame offset %.2f ms (max %.1f)  %s", "input",
+                        is.rate_hz, (unsigned long long)is.late, is.max_interval_ms, is.pick_offset_mean_ms, is.pick_offset_max_ms, is.source.c_str());
+        }
+        // per-stage latency since the recording started (meta.json gets the same at the end)
+        const CaptureLatency& lat = g_rec->latency();
+        for (int i = 0; i < kLatencyStages; ++i) {
+            const LatencySummary ls = lat.stage[i].summary();
+            if (ls.count == 0) continue;
+            ImGui::Text("%-14s %8llu  p50 %7.3f  p95 %7.3f  p99 %7.3f  max %8.2f ms", latency_stage_name((LatencyStage)i),
+                        (unsigned long long)ls.count, ls.p50_ms, ls.p95_ms, ls.p99_ms, ls.max_ms);
+        }
+    }
+    if (ImGui::CollapsingHeader("16-bit depth video (F7)")) {
+        static const char* curve_names[] = { "Linear (uniform absolute error)", "Log (uniform relative error)", "Inverse (disparity)" };
+        int curve = (int)g_depth16.curve;
+        ImGui::Checkbox("Write depth16.mkv (FFV1, lossless)", &g_depth16_enabled);
+        if (ImGui::Combo("Quantization curve", &curve, curve_names, IM_ARRAYSIZE(curve_names))) g_depth16.curve = (DepthCurve)curve;
+        ImGui::InputFloat("Near", &g_depth16.near_z, 0.0f, 0.0f, "%.4f");
+        ImGui::InputFloat("Far", &g_depth16.far_z, 0.0f, 0.0f, "%.1f");
+        if (!g_depth16.valid()) ImGui::TextUnformatted("Invalid range: need near < far (and near > 0 for log/inverse).");
+        ImGui::TextUnformatted("Units are those of the raw depth; near/far/curve are saved in meta.json.");
+    }
+    if (ImGui::CollapsingHeader("Raw depth compression")) {
+        ImGui::Checkbox("F7 depth.gcvd: keyframe + delta coding (otherwise LZ4 per frame)", &g_depth_delta);
+        ImGui::Checkbox("F9: write depth as .gcvz (lossless, compressed) instead of .npy", &g_depth_gcvz);
+        auto log_bench = [](const char* what, const DepthCodecBenchResult& b) {
+            for (const DepthCodecBenchRow& r : b.rows) {
+                char buf[256];
+                _snprintf_s(buf, _TRUNCATE, "[CV Capture] depth codec benchmark, %s %dx%d x%d: %-16s ratio %6.2f, encode %7.0f MB/s, decode %7.0f MB/s",
+                    what, b.width, b.height, b.frames, r.name, r.ratio, r.encode_mb_s, r.decode_mb_s);
+                reshade::log_message(reshade::log_level::info, buf);
+            }
+        };
+        if (ImGui::Button("Benchmark on synthetic depth")) {
+            uint32_t bw = 0, bh = 0;
+            runtime->get_screenshot_width_and_height(&bw, &bh);
+            const int w = bw ? (int)bw : 1920, h = bh ? (int)bh : 1080;
+            log_bench("synthetic", bench_depth_codec(make_synthetic_depth_sequence(w, h, 24), w, h, 8));
+        }
+        // the collected frames are taken out under the lock and benchmarked without it: the
+        // pipeline's sink thread takes the lock for every raw depth frame
+        std::vector<std::vector<float>> bench_frames;
+        int bench_w = 0, bench_h = 0;
+        {
+            std::lock_guard<std::mutex> bench_lk(g_depth_bench_mtx);
+            if (g_depth_bench_collect > 0) {
+                ImGui::Text("Collecting recorded depth: %d frames to go (record with F7)", g_depth_bench_collect);
+            } else if (ImGui::Button("Benchmark on the next 24 recorded depth frames (F7)")) {
+                g_depth_bench_frames.clear();
+                g_depth_bench_collect = 24;
+            }
+            if (g_depth_bench_collect == 0 && !g_depth_bench_frames.empty()) {
+                bench_frames.swap(g_depth_bench_frames);
+                bench_w = g_depth_bench_w;
+                bench_h = g_depth_bench_h;
+            }
+        }
+        if (!bench_frames.empty())
+            log_bench("recorded", bench_depth_codec(bench_frames, bench_w, bench_h, 8));
+    }
     ImGui::Text("Render targets:");
     imgui_draw_rgb_render_target_stats_in_reshade_overlay(runtime);
     imgui_draw_custom_shader_debug_viz_in_reshade_overlay(runtime);
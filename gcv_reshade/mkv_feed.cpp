@@ -0,0 +1,125 @@
+#include "mkv_feed.h"
+
+#include <cstring>
+
+namespace {
+// EBML element IDs (the marker bits are part of the ID)
+const uint32_t kEbml = 0x1A45DFA3, kEbmlVersion = 0x4286, kEbmlReadVersion = 0x42F7, kEbmlMaxIdLength = 0x42F2,
+               kEbmlMaxSizeLength = 0x42F3, kDocType = 0x4282, kDocTypeVersion = 0x4287, kDocTypeReadVersion = 0x4285;
+const uint32_t kSegment = 0x18538067, kInfo = 0x1549A966, kTimestampScale = 0x2AD7B1, kMuxingApp = 0x4D80, kWritingApp = 0x5741;
+const uint32_t kTracks = 0x1654AE6B, kTrackEntry = 0xAE, kTrackNumber = 0xD7, kTrackUid = 0x73C5, kTrackType = 0x83,
+               kFlagLacing = 0x9C, kCodecId = 0x86, kVideo = 0xE0, kPixelWidth = 0xB0, kPixelHeight = 0xBA, kColourSpace = 0x2EB524;
+const uint32_t kCluster = 0x1F43B675, kTimestamp = 0xE7, kSimpleBlock = 0xA3;
+
+size_t put_id(uint8_t* p, uint32_t id) {
+  size_t n = id > 0xFFFFFF ? 4 : id > 0xFFFF ? 3 : id > 0xFF ? 2 : 1;
+  for (size_t i = 0; i < n; ++i) p[i] = (uint8_t)(id >> (8 * (n - 1 - i)));
+  return n;
+}
+
+// element size as an EBML variable-length integer, as short as it can be (8 bytes with 'wide')
+size_t put_size(uint8_t* p, uint64_t v, bool wide = false) {
+  size_t n = 1;
+  while (!wide && n < 8 && v >= (1ull << (7 * n)) - 1) ++n;   // all ones is reserved for "unknown"
+  if (wide) n = 8;
+  for (size_t i = 0; i < n; ++i) p[i] = (uint8_t)(v >> (8 * (n - 1 - i)));
+  p[0] |= (uint8_t)(0x80 >> (n - 1));
+  return n;
+}
+
+size_t put_uint(uint8_t* p, uint32_t id, uint64_t v) {
+  size_t n = 1;
+  while (n < 8 && (v >> (8 * n))) ++n;
+  size_t k = put_id(p, id);
+  k += put_size(p + k, n);
+  for (size_t i = 0; i < n; ++i) p[k + i] = (uint8_t)(v >> (8 * (n - 1 - i)));
+  return k + n;
+}
+
+void append_raw(std::string& s, const uint8_t* p, size_t n) { s.append((const char*)p, n); }
+
+void append_uint(std::string& s, uint32_t id, uint64_t v) {
+  uint8_t b[16];
+  append_raw(s, b, put_uint(b, id, v));
+}
+
+void append_bytes(std::string& s, uint32_t id, const void* data, size_t bytes) {
+  uint8_t b[16];
+  size_t k = put_id(b, id);
+  k += put_size(b + k, bytes);
+  append_raw(s, b, k);
+  s.append((const char*)data, bytes);
+}
+
+void append_master(std::string& s, uint32_t id, const std::string& body) { append_bytes(s, id, body.data(), body.size()); }
+} // namespace
+
+const char* mkv_fourcc_for_pix_fmt(const char* pix_fmt) {
+  if (!pix_fmt) return nullptr;
+  if (!strcmp(pix_fmt, "bgra")) return "BGRA";
+  if (!strcmp(pix_fmt, "yuv420p")) return "I420";
+  if (!strcmp(pix_fmt, "nv12")) return "NV12";
+  if (!strcmp(pix_fmt, "gray")) return "Y800";
+  if (!strcmp(pix_fmt, "gray16le")) return "Y1\0\x10";
+  return nullptr;
+}
+
+std::string mkv_stream_header(int width, int height, const char* fourcc) {
+  std::string ebml;
+  append_uint(ebml, kEbmlVersion, 1);
+  append_uint(ebml, kEbmlReadVersion, 1);
+  append_uint(ebml, kEbmlMaxIdLength, 4);
+  append_uint(ebml, kEbmlMaxSizeLength, 8);
+  append_bytes(ebml, kDocType, "matroska", 8);
+  append_uint(ebml, kDocTypeVersion, 4);
+  append_uint(ebml, kDocTypeReadVersion, 2);
+
+  std::string info;
+  append_uint(info, kTimestampScale, 1000);   // ns per tick: timestamps are in us
+  append_bytes(info, kMuxingApp, "gcv_reshade", 11);
+  append_bytes(info, kWritingApp, "gcv_reshade", 11);
+
+  std::string video;
+  append_uint(video, kPixelWidth, (uint64_t)width);
+  append_uint(video, kPixelHeight, (uint64_t)height);
+  append_bytes(video, kColourSpace, fourcc, 4);
+  std::string track;
+  append_uint(track, kTrackNumber, 1);
+  append_uint(track, kTrackUid, 1);
+  append_uint(track, kTrackType, 1);   // video
+  append_uint(track, kFlagLacing, 0);
+  append_bytes(track, kCodecId, "V_UNCOMPRESSED", 14);
+  append_master(track, kVideo, video);
+  std::string entry;
+  append_master(entry, kTrackEntry, track);
+
+  std::string out;
+  append_master(out, kEbml, ebml);
+  uint8_t b[16];
+  size_t k = put_id(b, kSegment);
+  k += put_size(b + k, 0x00FFFFFFFFFFFFFFull, true);   // unknown size: the stream ends when the pipe closes
+  append_raw(out, b, k);
+  append_master(out, kInfo, info);
+  append_master(out, kTracks, entry);
+  return out;
+}
+
+size_t mkv_frame_header(uint8_t* out, int64_t pts_us, size_t frame_bytes) {
+  uint8_t ts[16];
+  const size_t ts_len = put_uint(ts, kTimestamp, (uint64_t)(pts_us > 0 ? pts_us : 0));
+  const uint64_t block_len = 4 + (uint64_t)frame_bytes;   // track number, relative time, flags
+  uint8_t bs[16];
+  const size_t bs_len = put_size(bs, block_len, true);
+  size_t k = put_id(out, kCluster);
+  k += put_size(out + k, ts_len + 1 + bs_len + block_len, true);
+  memcpy(out + k, ts, ts_len);
+  k += ts_len;
+  k += put_id(out + k, kSimpleBlock);
+  memcpy(out + k, bs, bs_len);
+  k += bs_len;
+  out[k++] = 0x81;   // track 1
+  out[k++] = 0;      // time relative to the cluster's
+  out[k++] = 0;
+  out[k++] = 0x80;   // keyframe
+  return k;
+}
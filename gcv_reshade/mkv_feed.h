@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Minimal Matroska muxer for the encoder pipes: one uncompressed video track (V_UNCOMPRESSED, the
+// layout given by a FourCC), written as a stream (Segment of unknown size, no SeekHead or Cues) so
+// ffmpeg can read it from stdin. Every frame is a keyframe in a Cluster of its own carrying the
+// frame's time in microseconds (TimestampScale 1000 ns), so the encoder sees the real capture
+// times instead of a fixed frame rate.
+
+// Largest mkv_frame_header() output
+static const size_t kMkvMaxFrameHeader = 40;
+
+// FourCC ffmpeg maps back to the pix_fmt ("bgra", "yuv420p", "nv12", "gray", "gray16le"); nullptr if none
+const char* mkv_fourcc_for_pix_fmt(const char* pix_fmt);
+// EBML header, Segment start, Info and Tracks; written once before the first frame
+std::string mkv_stream_header(int width, int height, const char* fourcc);
+// Cluster + SimpleBlock header of one frame of frame_bytes at pts_us (>= 0); the frame data follows.
+// 'out' has room for kMkvMaxFrameHeader bytes; returns the bytes used.
+size_t mkv_frame_header(uint8_t* out, int64_t pts_us, size_t frame_bytes);
@@ -0,0 +1,168 @@
+#include "motion_trigger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using json = nlohmann::json;
+
+static const char* const kReasonNames[(int)TriggerReason::Count] = {
+  "none", "start", "translation", "rotation", "fov", "max_interval", "no_pose", "held" };
+
+const char* trigger_reason_name(TriggerReason r) {
+  const int i = (int)r;
+  return (i >= 0 && i < (int)TriggerReason::Count) ? kReasonNames[i] : "?";
+}
+
+double pose_rotation_angle_deg(const double* a, const double* b) {
+  // trace(Ra^T Rb) = 1 + 2 cos(angle)
+  double tr = 0.0;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j) tr += a[4 * i + j] * b[4 * i + j];
+  const double c = std::min(1.0, std::max(-1.0, 0.5 * (tr - 1.0)));
+  return std::acos(c) * (180.0 / 3.14159265358979323846);
+}
+
+void MotionTrigger::reset(const MotionTriggerParams& p) {
+  p_ = p;
+  started_ = false;
+  have_pose_ = false;
+  held_ = false;
+  last_us_ = 0;
+  last_fov_ = 0.0;
+  std::fill(std::begin(counts_), std::end(counts_), 0);
+}
+
+TriggerDecision MotionTrigger::decide(int64_t now_us, const double* cam2world, double fov_deg) {
+  TriggerDecision d;
+  if (!started_) {
+    d.fire = true;
+    d.reason = TriggerReason::Start;
+  } else {
+    d.since_us = now_us - last_us_;
+    TriggerReason moved = TriggerReason::None;
+    if (cam2world && have_pose_) {
+      const double dx = cam2world[3] - last_pose_[3], dy = cam2world[7] - last_pose_[7], dz = cam2world[11] - last_pose_[11];
+      d.translation = std::sqrt(dx * dx + dy * dy + dz * dz);
+      d.rotation_deg = pose_rotation_angle_deg(cam2world, last_pose_);
+      d.fov_deg = (fov_deg > 0.0 && last_fov_ > 0.0) ? std::fabs(fov_deg - last_fov_) : 0.0;
+      // the reason is the change furthest past its threshold
+      double best = 1.0;
+      auto consider = [&](double v, double thr, TriggerReason r) {
+        if (thr > 0.0 && v / thr >= best) { best = v / thr; moved = r; }
+      };
+      consider(d.translation, p_.translation, TriggerReason::Translation);
+      consider(d.rotation_deg, p_.rotation_deg, TriggerReason::Rotation);
+      consider(d.fov_deg, p_.fov_deg, TriggerReason::Fov);
+    }
+    const double since_s = (double)d.since_us * 1e-6;
+    if (moved != TriggerReason::None) {
+      if (since_s >= p_.min_interval_s) {
+        d.fire = true;
+        d.reason = moved;
+      } else if (!held_) {
+        // reported once per window; the capture follows when min_interval is up, if still moved
+        held_ = true;
+        d.reason = TriggerReason::Held;
+        ++counts_[(int)TriggerReason::Held];
+      }
+    }
+    if (!d.fire && p_.max_interval_s > 0.0 && since_s >= p_.max_interval_s) {
+      d.fire = true;
+      d.reason = cam2world ? TriggerReason::MaxInterval : TriggerReason::NoPose;
+    }
+  }
+  if (d.fire) {
+    started_ = true;
+    held_ = false;
+    last_us_ = now_us;
+    // without a pose the reference stays the last one seen, so motion is measured across the gap
+    if (cam2world) {
+      std::memcpy(last_pose_, cam2world, sizeof(last_pose_));
+      have_pose_ = true;
+    }
+    if (fov_deg > 0.0) last_fov_ = fov_deg;
+    ++counts_[(int)d.reason];
+  }
+  return d;
+}
+
+json MotionTrigger::stats_json() const {
+  json j;
+  j["translation"] = p_.translation;
+  j["rotation_deg"] = p_.rotation_deg;
+  j["fov_deg"] = p_.fov_deg;
+  j["min_interval"] = p_.min_interval_s;
+  j["max_interval"] = p_.max_interval_s;
+  json c = json::object();
+  for (int i = 1; i < (int)TriggerReason::Count; ++i) c[kReasonNames[i]] = counts_[i];
+  j["counts"] = c;
+  return j;
+}
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+// camera at (x, 0, z), yaw about +y, fov
+static void synth_pose(double* m, double x, double z, double yaw_deg) {
+  const double a = yaw_deg * (3.14159265358979323846 / 180.0);
+  const double c = std::cos(a), s = std::sin(a);
+  const double r[12] = { c, 0.0, s, x,   0.0, 1.0, 0.0, 0.0,   -s, 0.0, c, z };
+  std::memcpy(m, r, sizeof(r));
+}
+
+std::string run_motion_trigger_tests() {
+  MotionTriggerParams p;
+  p.enabled = true;
+  p.translation = 0.5;
+  p.rotation_deg = 5.0;
+  p.fov_deg = 2.0;
+  p.min_interval_s = 0.1;
+  p.max_interval_s = 2.0;
+
+  {
+    double m[12], n[12];
+    synth_pose(m, 0.0, 0.0, 10.0);
+    synth_pose(n, 3.0, 1.0, 40.0);
+    const double ang = pose_rotation_angle_deg(m, n);
+    if (std::fabs(ang - 30.0) > 1e-6) RETURNFAILST("trigger: rotation angle " + std::to_string(ang) + ", expected 30");
+  }
+
+  // 60 Hz presents: 3 s still, 1 s turning at 90 deg/s, 2 s walking at 2 units/s, 1 s zooming at
+  // 10 deg/s, 3 s without a pose
+  MotionTrigger t;
+  t.reset(p);
+  const int64_t frame_us = 16667;
+  double x = 0.0, yaw = 0.0, fov = 60.0;
+  uint64_t phase_fires[5] = {};
+  int64_t last_fire = -1, min_gap = INT64_MAX;
+  for (int k = 0; k < 600; ++k) {
+    const int64_t now = 1000000 + (int64_t)k * frame_us;
+    const double ts = (double)k * frame_us * 1e-6;
+    const int phase = ts < 3.0 ? 0 : ts < 4.0 ? 1 : ts < 6.0 ? 2 : ts < 7.0 ? 3 : 4;
+    if (phase == 1) yaw += 90.0 * frame_us * 1e-6;
+    if (phase == 2) x += 2.0 * frame_us * 1e-6;
+    if (phase == 3) fov += 10.0 * frame_us * 1e-6;
+    double m[12];
+    synth_pose(m, x, 0.0, yaw);
+    const TriggerDecision d = t.decide(now, phase == 4 ? nullptr : m, fov);
+    if (!d.fire) continue;
+    ++phase_fires[phase];
+    if (last_fire >= 0) min_gap = std::min(min_gap, now - last_fire);
+    last_fire = now;
+    if (phase == 1 && d.reason != TriggerReason::Rotation) RETURNFAILST(std::string("trigger: turning fired for ") + trigger_reason_name(d.reason));
+    if (phase == 2 && d.reason != TriggerReason::Translation) RETURNFAILST(std::string("trigger: walking fired for ") + trigger_reason_name(d.reason));
+    if (phase == 3 && d.reason != TriggerReason::Fov) RETURNFAILST(std::string("trigger: zooming fired for ") + trigger_reason_name(d.reason));
+    if (phase == 4 && d.reason != TriggerReason::NoPose) RETURNFAILST(std::string("trigger: no pose fired for ") + trigger_reason_name(d.reason));
+  }
+  // still: start + one at max_interval; turning: capped at 10/s by min_interval (5 deg would be 18/s);
+  // walking: every 0.25 units -> 8; zooming: every 2 deg -> 5; no pose: at max_interval
+  const struct { int phase; uint64_t lo, hi; const char* what; } expect[] = {
+    { 0, 2, 2, "still" }, { 1, 9, 11, "turning" }, { 2, 7, 9, "walking" }, { 3, 4, 6, "zooming" }, { 4, 1, 2, "no pose" } };
+  for (const auto& e : expect) {
+    if (phase_fires[e.phase] < e.lo || phase_fires[e.phase] > e.hi)
+      RETURNFAILST(std::string("trigger: ") + e.what + " fired " + std::to_string(phase_fires[e.phase]) + " times");
+  }
+  if (min_gap < 100000) RETURNFAILST("trigger: two captures " + std::to_string(min_gap) + " us apart, min_interval is 100 ms");
+  if (t.count(TriggerReason::Held) == 0) RETURNFAILST("trigger: turning faster than min_interval allows was never held");
+  return std::string("ok");
+}
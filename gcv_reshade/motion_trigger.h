@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Pose-driven capture trigger: instead of a fixed rate, a frame is captured once the camera has
+// moved, turned or zoomed enough since the last captured frame, so the frames of a dataset follow
+// viewpoint change rather than wall-clock time. Bounds: never two captures closer than
+// min_interval (fast turns), never longer than max_interval without one (standing still, lost pose).
+// Part of a capture profile ("trigger" in capture_profiles.json, see capture_profile.h):
+//   "trigger": { "mode": "motion", "translation": 0.5, "rotation_deg": 5, "fov_deg": 2,
+//                "min_interval": 0.1, "max_interval": 2, "streams": ["color", "depth", "pose"] }
+
+struct MotionTriggerParams {
+  bool enabled = false;
+  double translation = 0.5;       // distance since the last capture, in game units; <= 0: not a reason
+  double rotation_deg = 5.0;      // rotation angle since the last capture; <= 0: not a reason
+  double fov_deg = 2.0;           // fov change since the last capture; <= 0: not a reason
+  double min_interval_s = 0.1;
+  double max_interval_s = 2.0;    // <= 0: no upper bound
+  uint32_t streams = 0;           // capture_stream_bit() of the streams the trigger drives; the others keep their rate
+};
+
+enum class TriggerReason : uint8_t {
+  None = 0,      // no capture
+  Start,         // first frame of the recording
+  Translation,
+  Rotation,
+  Fov,
+  MaxInterval,   // nothing moved enough for max_interval
+  NoPose,        // pose unavailable; captured at max_interval
+  Held,          // a threshold was crossed within min_interval of the last capture; not captured (yet)
+  Count
+};
+const char* trigger_reason_name(TriggerReason r);
+
+struct TriggerDecision {
+  bool fire = false;
+  TriggerReason reason = TriggerReason::None;
+  // change since the last captured frame
+  double translation = 0.0;
+  double rotation_deg = 0.0;
+  double fov_deg = 0.0;
+  int64_t since_us = 0;
+};
+
+class MotionTrigger {
+public:
+  void reset(const MotionTriggerParams& p);
+  // One call per present. cam2world: row-major 3x4 pose (as in frames.bin), nullptr if the camera
+  // could not be read; fov_deg <= 0 if unknown.
+  TriggerDecision decide(int64_t now_us, const double* cam2world, double fov_deg);
+  uint64_t count(TriggerReason r) const { return counts_[(int)r]; }
+  nlohmann::json stats_json() const;
+
+private:
+  MotionTriggerParams p_;
+  bool started_ = false;
+  bool have_pose_ = false;
+  bool held_ = false;             // Held already reported for the current min_interval window
+  int64_t last_us_ = 0;
+  double last_pose_[12] = {};
+  double last_fov_ = 0.0;
+  uint64_t counts_[(int)TriggerReason::Count] = {};
+};
+
+// Rotation angle between the rotation parts of two row-major 3x4 poses, in degrees
+double pose_rotation_angle_deg(const double* a, const double* b);
+
+// Self-test on a synthetic camera path; "ok" or what failed (like run_utils_tests)
+std::string run_motion_trigger_tests();
@@ -0,0 +1,315 @@
+#include "packedbuf_frames.h"
+#include "gcv_utils/yuv_convert.h"
+#include <reshade.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// pbuf (RGBA or RGB24) -> tightly packed BGRA rows at dst
+bool packedbuf_to_bgra(const simple_packed_buf& pbuf, uint8_t* dst_base) {
+  const int w = (int)pbuf.width, h = (int)pbuf.height;
+  const size_t row_bgra = (size_t)w * 4;
+  if (pbuf.pixfmt == BUF_PIX_FMT_RGBA) {
+    for (int y = 0; y < h; ++y) {
+      const uint8_t* src = pbuf.crowptr<uint8_t>(y);
+      uint8_t* dst = dst_base + (size_t)y * row_bgra;
+      for (int x = 0; x < w; ++x) {
+        const uint8_t r = src[4*x+0], g = src[4*x+1], b = src[4*x+2], a = src[4*x+3];
+        dst[4*x+0] = b; dst[4*x+1] = g; dst[4*x+2] = r; dst[4*x+3] = a;
+      }
+    }
+    return true;
+  } else if (pbuf.pixfmt == BUF_PIX_FMT_RGB24) {
+    for (int y = 0; y < h; ++y) {
+      const uint8_t* src = pbuf.crowptr<uint8_t>(y);
+      uint8_t* dst = dst_base + (size_t)y * row_bgra;
+      for (int x = 0; x < w; ++x) {
+        const uint8_t r = src[3*x+0], g = src[3*x+1], b = src[3*x+2];
+        dst[4*x+0] = b; dst[4*x+1] = g; dst[4*x+2] = r; dst[4*x+3] = 255;
+      }
+    }
+    return true;
+  }
+  reshade::log_message(reshade::log_level::error, "grab_bgra_frame: unsupported pixfmt");
+  return false;
+}
+
+static bool pixfmt_is_color(BufPixelFormat f) {
+  return f == BUF_PIX_FMT_RGBA || f == BUF_PIX_FMT_RGB24;
+}
+
+// k in {2, 4} and not larger than the image, else 1
+static int effective_downscale(int k, int w, int h) {
+  return ((k == 2 || k == 4) && w >= k && h >= k) ? k : 1;
+}
+
+// pbuf (RGBA or RGB24) -> (w/k) x (h/k) pixels, each the average of a k x k block, 4 bytes per
+// pixel in RGBA order (BGRA if 'bgra'), tightly packed at dst
+static void packedbuf_downscale_color(const simple_packed_buf& pbuf, int k, bool bgra, uint8_t* dst) {
+  const int dw = (int)pbuf.width / k, dh = (int)pbuf.height / k;
+  const int bpp = pbuf.pixfmt == BUF_PIX_FMT_RGBA ? 4 : 3;
+  const int n = k * k;
+  const int r_out = bgra ? 2 : 0, b_out = bgra ? 0 : 2;
+  for (int y = 0; y < dh; ++y) {
+    uint8_t* d = dst + (size_t)y * (size_t)dw * 4;
+    for (int x = 0; x < dw; ++x) {
+      int sum[4] = { 0, 0, 0, 0 };
+      for (int yy = 0; yy < k; ++yy) {
+        const uint8_t* src = pbuf.crowptr<uint8_t>((size_t)y * k + yy) + (size_t)x * k * bpp;
+        for (int xx = 0; xx < k; ++xx, src += bpp) {
+          sum[0] += src[0]; sum[1] += src[1]; sum[2] += src[2];
+          sum[3] += bpp == 4 ? src[3] : 255;
+        }
+      }
+      d[4*x + r_out] = (uint8_t)((sum[0] + n / 2) / n);
+      d[4*x + 1]     = (uint8_t)((sum[1] + n / 2) / n);
+      d[4*x + b_out] = (uint8_t)((sum[2] + n / 2) / n);
+      d[4*x + 3]     = (uint8_t)((sum[3] + n / 2) / n);
+    }
+  }
+}
+
+// every k-th pixel of a w x h plane, in place; w and h become the reduced size
+template<typename T>
+static void subsample_plane(T* data, int& w, int& h, int k) {
+  const int dw = w / k, dh = h / k;
+  for (int y = 0; y < dh; ++y) {
+    const T* src = data + (size_t)(y * k + k / 2) * (size_t)w + k / 2;
+    T* dst = data + (size_t)y * (size_t)dw;
+    for (int x = 0; x < dw; ++x) dst[x] = src[(size_t)x * k];
+  }
+  w = dw;
+  h = dh;
+}
+
+bool bgra_frame_from_packedbuf(const simple_packed_buf& pbuf, FramePool& pool, FrameRef& out,
+                               int& w, int& h, int downscale) {
+  if (!pixfmt_is_color(pbuf.pixfmt)) {
+    reshade::log_message(reshade::log_level::error, "grab_bgra_frame: unsupported pixfmt");
+    return false;
+  }
+  const int k = effective_downscale(downscale, (int)pbuf.width, (int)pbuf.height);
+  w = (int)pbuf.width / k; h = (int)pbuf.height / k;
+  const size_t row_bgra = (size_t)w * 4;
+  FrameRef f = pool.acquire(row_bgra * (size_t)h);
+  if (!f) return false;  // every slot is still queued/referenced; caller counts it as a drop
+  f.set_geometry(w, h, row_bgra);
+  if (k > 1) packedbuf_downscale_color(pbuf, k, /*bgra=*/true, f.data());
+  else if (!packedbuf_to_bgra(pbuf, f.data())) return false;
+  out = std::move(f);
+  return true;
+}
+
+bool yuv420_frame_from_packedbuf(const simple_packed_buf& pbuf, FramePool& pool, FrameRef& out,
+                                 int& w, int& h, FrameFormat layout, int downscale) {
+  if (layout != FrameFormat::I420 && layout != FrameFormat::NV12) return false;
+  if (!pixfmt_is_color(pbuf.pixfmt)) {
+    reshade::log_message(reshade::log_level::error, "grab_yuv420_frame: unsupported pixfmt");
+    return false;
+  }
+  const int k = effective_downscale(downscale, (int)pbuf.width, (int)pbuf.height);
+  w = (int)pbuf.width / k; h = (int)pbuf.height / k;
+  if (w<=0 || h<=0) return false;
+  FrameRef f = pool.acquire(yuv420_frame_bytes(w, h));
+  if (!f) return false;
+  f.set_geometry(w, h, (size_t)w, layout);
+  const YuvLayout yuv = layout == FrameFormat::NV12 ? YuvLayout::NV12 : YuvLayout::I420;
+  if (k > 1) {
+    // the reduced frame is a fraction of the readback, so the extra pass is cheap
+    static thread_local std::vector<uint8_t> small;
+    small.resize((size_t)w * (size_t)h * 4);
+    packedbuf_downscale_color(pbuf, k, /*bgra=*/false, small.data());
+    rgb_to_yuv420(small.data(), (size_t)w * 4, YuvSrcOrder::RGBA, w, h, yuv, f.data());
+  } else {
+    const YuvSrcOrder order = pbuf.pixfmt == BUF_PIX_FMT_RGBA ? YuvSrcOrder::RGBA : YuvSrcOrder::RGB24;
+    rgb_to_yuv420(pbuf.cdata<uint8_t>(), pbuf.rowstride_bytes(), order, w, h, yuv, f.data());
+  }
+  out = std::move(f);
+  return true;
+}
+
+static inline uint8_t u8clamp_i(int v){ return (uint8_t)(v<0?0:(v>255?255:v)); }
+
+// depth pbuf (GRAYF32 or GRAYU32) -> w*h gray8 at dst_base
+bool packedbuf_depth_to_gray8(const simple_packed_buf& pbuf, uint8_t* dst_base,
+                                     const DepthToneParams& p)
+{
+  const int w = (int)pbuf.width, h = (int)pbuf.height;
+  const float alpha = (p.log_alpha > 0.f ? p.log_alpha : 1.f);
+  const float denom = std::log1p(alpha);
+  auto map01_farwhite_log = [&](float t01)->uint8_t {
+    if (t01 < 0.f) t01 = 0.f; else if (t01 > 1.f) t01 = 1.f;
+    float y = std::log1p(alpha * t01) / denom;
+    int g = (int)std::lround(y * 255.0f);
+    return u8clamp_i(g);
+  };
+
+  switch (pbuf.pixfmt) {
+    case BUF_PIX_FMT_GRAYF32: {
+      reshade::log_message(reshade::log_level::info, "grabbers: enter GRAYF32 branch");
+      const float lo = p.clip_low;
+      const float hi = (p.clip_high > lo ? p.clip_high : lo + 1e-6f);
+      const float invspan = 1.0f / (hi - lo);
+      for (int y = 0; y < h; ++y) {
+        const float* src = pbuf.crowptr<float>(y);
+        uint8_t* dst = dst_base + (size_t)y * (size_t)w;
+        for (int x = 0; x < w; ++x) {
+          float d = src[x];
+          if (!std::isfinite(d)) d = hi;
+          float t = (d - lo) * invspan;
+          dst[x] = map01_farwhite_log(t);
+        }
+      }
+      return true;
+    }
+    case BUF_PIX_FMT_GRAYU32: {
+      // 1) 统计 vmin/vmax（已有）
+      uint32_t vmin = UINT32_MAX, vmax = 0;
+      for (int y = 0; y < h; ++y) {
+        const uint32_t* src = pbuf.crowptr<uint32_t>(y);
+        for (int x = 0; x < w; ++x) {
+          uint32_t v = src[x];
+          if (v < vmin) vmin = v;
+          if (v > vmax) vmax = v;
+        }
+      }
+      const double span = (vmax > vmin) ? double(vmax - vmin) : 1.0;
+
+      // 2) 轻量级“百分位裁剪”：均匀抽样，算 p5/p95，避免极端值把对比度拉平
+      constexpr int STRIDE = 8; // 抽样步长
+      std::vector<float> samples;
+      samples.reserve((w/STRIDE + 1) * (h/STRIDE + 1));
+      for (int y = 0; y < h; y += STRIDE) {
+        const uint32_t* src = pbuf.crowptr<uint32_t>(y);
+        for (int x = 0; x < w; x += STRIDE) {
+          double t0 = (double(src[x]) - double(vmin)) / span; // 0..1
+          samples.push_back((float)t0);
+        }
+      }
+      if (!samples.empty()) {
+        std::nth_element(samples.begin(), samples.begin() + samples.size()/20, samples.end());
+        float p05 = samples[samples.size()/20];               // 5%
+        std::nth_element(samples.begin(), samples.begin() + samples.size()*95/100, samples.end());
+        float p95 = samples[samples.size()*95/100];           // 95%
+        // 避免 p95==p05
+        if (p95 - p05 < 1e-6f) { p05 = std::max(0.f, p05 - 0.05f); p95 = std::min(1.f, p95 + 0.05f); }
+
+        // 3) 可调参数
+        const bool  invert = true;   // 近黑远白（需要近白远黑则置 false）
+        const float gamma  = 1.0f;   // >1 提升高亮；<1 提升暗部；=1 线性
+        const float alpha  = (p.log_alpha > 0.f ? p.log_alpha : 0.f); // 若想关闭对数映射，请设 0
+
+        for (int y = 0; y < h; ++y) {
+          const uint32_t* src = pbuf.crowptr<uint32_t>(y);
+          uint8_t* dst = dst_base + (size_t)y * (size_t)w;
+          for (int x = 0; x < w; ++x) {
+            // 归一化到 [0,1]
+            float t = float((double(src[x]) - double(vmin)) / span);
+            // 百分位裁剪并线性拉伸
+            t = (t - p05) / (p95 - p05);
+            if (t < 0.f) t = 0.f; else if (t > 1.f) t = 1.f;
+            // 极性
+            if (invert) t = 1.0f - t;
+            // 伽马（可比对数映射更直观）
+            if (gamma != 1.0f) t = std::pow(t, 1.0f/gamma);
+            // 可选：对数映射（如要用，建议 alpha 取 2~6；alpha=0 表示关闭）
+            if (alpha > 0.f) {
+              t = std::log1p(alpha * t) / std::log1p(alpha);
+            }
+            // 写出
+            int g = (int)std::lround(t * 255.0f);
+            dst[x] = u8clamp_i(g);
+          }
+        }
+      } else {
+        // 退化：没有样本时的线性流程
+        for (int y = 0; y < h; ++y) {
+          const uint32_t* src = pbuf.crowptr<uint32_t>(y);
+          uint8_t* dst = dst_base + (size_t)y * (size_t)w;
+          for (int x = 0; x < w; ++x) {
+            float t = float((double(src[x]) - double(vmin)) / span);
+            dst[x] = u8clamp_i((int)std::lround(t * 255.0f));
+          }
+        }
+      }
+      return true;
+    }
+
+
+    default:
+      reshade::log_message(reshade::log_level::info, "grabbers: enter default branch");
+      reshade::log_message(reshade::log_level::error, "grab_depth_gray8: unsupported depth pixfmt");
+      return false;
+  }
+}
+
+bool depth_gray8_from_packedbuf(const simple_packed_buf& pbuf, FramePool& pool, FrameRef& out,
+                                int& w, int& h, const DepthToneParams& p, int downscale)
+{
+  w = (int)pbuf.width; h = (int)pbuf.height;
+  if (w<=0 || h<=0) return false;
+  const int k = effective_downscale(downscale, w, h);
+  FrameRef f = pool.acquire((size_t)(w / k) * (size_t)(h / k));
+  if (!f) return false;
+  if (k > 1) {
+    static thread_local std::vector<uint8_t> full;
+    full.resize((size_t)w * (size_t)h);
+    if (!packedbuf_depth_to_gray8(pbuf, full.data(), p)) return false;
+    subsample_plane(full.data(), w, h, k);
+    std::memcpy(f.data(), full.data(), (size_t)w * (size_t)h);
+  } else if (!packedbuf_depth_to_gray8(pbuf, f.data(), p)) {
+    return false;
+  }
+  f.set_geometry(w, h, (size_t)w, FrameFormat::Gray8);
+  out = std::move(f);
+  return true;
+}
+
+bool raw_depth_float32_from_packedbuf(
+    const simple_packed_buf& pbuf,
+    std::vector<float>& out_floats,
+    int& w, int& h,
+    int downscale)
+{
+    w = static_cast<int>(pbuf.width);
+    h = static_cast<int>(pbuf.height);
+    if (w <= 0 || h <= 0) return false;
+
+    const size_t num_pixels = (size_t)w * h;
+    out_floats.resize(num_pixels);
+
+    // 支持多种格式
+    if (pbuf.pixfmt == BUF_PIX_FMT_GRAYF32) {
+        // 直接拷贝
+        for (int y = 0; y < h; ++y) {
+            const float* src = pbuf.crowptr<float>(y);
+            std::memcpy(out_floats.data() + y * w, src, w * sizeof(float));
+        }
+        if (const int k = effective_downscale(downscale, w, h); k > 1) {
+            subsample_plane(out_floats.data(), w, h, k);
+            out_floats.resize((size_t)w * h);
+        }
+        return true;
+    }
+    else if (pbuf.pixfmt == BUF_PIX_FMT_GRAYU32) {
+        // R32 深度（如线性深度）
+        for (int y = 0; y < h; ++y) {
+            const uint32_t* src = pbuf.crowptr<uint32_t>(y);
+            float* dst = out_floats.data() + y * w;
+            // 根据游戏调整解码方式
+            // 示例：直接转 float（如果是线性深度）；memcpy 复制位模式（不违反 strict aliasing）
+            std::memcpy(dst, src, (size_t)w * sizeof(float));
+        }
+        if (const int k = effective_downscale(downscale, w, h); k > 1) {
+            subsample_plane(out_floats.data(), w, h, k);
+            out_floats.resize((size_t)w * h);
+        }
+        return true;
+    }
+    else {
+        // 打印实际格式，用于调试
+        reshade::log_message(reshade::log_level::warning,
+            ("grab_raw_depth_float32: unsupported pixfmt = " + std::to_string(pbuf.pixfmt)).c_str());
+        return false;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "frame_pool.h"
+#include "gcv_utils/simple_packed_buf.h"
+
+// From a texture read back into a simple_packed_buf to what the recorder takes: the conversions
+// behind the grab_* functions (grabbers.h) and the readback pipeline's convert stage
+// (capture_stages.h). Nothing here touches the device.
+
+// How a texture's bytes are read into a simple_packed_buf (copy_texture_into_packedbuf.h)
+enum TextureInterpretation {
+	TexInterp_RGB = 0,
+	TexInterp_Depth,
+	TexInterp_IndexedSeg,
+	TexInterp_LinearDepthF32,
+};
+
+// parameters from depth to grayscale
+struct DepthToneParams {
+  float clip_low  = 0.0f;  // Proximal truncation
+  float clip_high = 1.0f;  // Distal truncation
+  float log_alpha = 6.0f;  // log enhance
+};
+
+// pbuf (RGBA or RGB24) -> tightly packed BGRA rows at dst_base (A=255 for RGB24)
+bool packedbuf_to_bgra(const simple_packed_buf& pbuf, uint8_t* dst_base);
+// depth pbuf (GRAYF32 or GRAYU32) -> w*h gray8 at dst_base (far white, near black, with clip and
+// logarithmic enhancement)
+bool packedbuf_depth_to_gray8(const simple_packed_buf& pbuf, uint8_t* dst_base, const DepthToneParams& p);
+
+// Into a slot of the recorder's frame pool; false (and out left empty) if the pool has no free
+// slot or pbuf is not a color / depth format. downscale 2 or 4: color averages each block, depth
+// takes every downscale-th pixel (w and h are the reduced size).
+bool bgra_frame_from_packedbuf(const simple_packed_buf& pbuf, FramePool& pool, FrameRef& out,
+                               int& w, int& h, int downscale = 1);
+// YUV 4:2:0 (BT.601 limited range, SIMD kernels from gcv_utils/yuv_convert.h)
+bool yuv420_frame_from_packedbuf(const simple_packed_buf& pbuf, FramePool& pool, FrameRef& out,
+                                 int& w, int& h, FrameFormat layout = FrameFormat::I420, int downscale = 1);
+bool depth_gray8_from_packedbuf(const simple_packed_buf& pbuf, FramePool& pool, FrameRef& out,
+                                int& w, int& h, const DepthToneParams& p, int downscale = 1);
+bool raw_depth_float32_from_packedbuf(const simple_packed_buf& pbuf, std::vector<float>& out_floats,
+                                      int& w, int& h, int downscale = 1);
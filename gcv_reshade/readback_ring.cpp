@@ -0,0 +1,638 @@
+#include "readback_ring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+ReadbackRing::~ReadbackRing() {
+  release();
+}
+
+void ReadbackRing::configure(int latency, int depth) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  latency_ = std::max(1, latency);
+  depth_ = std::max(latency_, depth);
+}
+
+void ReadbackRing::set_backend(std::unique_ptr<ReadbackBackend> backend) {
+  release();
+  std::lock_guard<std::mutex> lk(mtx_);
+  backend_ = std::move(backend);
+  fenced_ = backend_ && backend_->create_fence();
+  fence_value_ = 0;
+}
+
+void ReadbackRing::drop_idle_other_layouts(const ReadbackKey& key) {
+  // after a resize the old staging textures would only sit there; in-flight ones go once mapped
+  for (Slot& s : slots_) {
+    if (s.busy || !s.staging || s.key == key) continue;
+    backend_->destroy_staging(s.staging);
+    s.staging = 0;
+    ++st_.staging_destroyed;
+  }
+}
+
+bool ReadbackRing::submit(uint64_t tex, const ReadbackTag& tag) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (!backend_) return false;
+  ReadbackKey key;
+  if (!backend_->describe(tex, key)) {
+    ++st_.failed;
+    return false;
+  }
+  drop_idle_other_layouts(key);
+  size_t idx = slots_.size(), dead = slots_.size();
+  int n = 0;
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    const Slot& s = slots_[i];
+    if (!s.staging) {
+      if (!s.busy && dead == slots_.size()) dead = i;
+      continue;
+    }
+    if (s.key != key) continue;
+    ++n;
+    if (!s.busy && idx == slots_.size()) idx = i;
+  }
+  if (idx == slots_.size()) {
+    if (n >= depth_) {   // the GPU (or the map side) is behind by a whole ring
+      ++st_.no_slot;
+      return false;
+    }
+    Slot s;
+    s.key = key;
+    if (!backend_->create_staging(key, s.staging)) {
+      ++st_.failed;
+      return false;
+    }
+    ++st_.staging_created;
+    if (dead < slots_.size()) {
+      slots_[dead] = s;
+      idx = dead;
+    } else {
+      slots_.push_back(s);
+      idx = slots_.size() - 1;
+    }
+  }
+  if (!backend_->copy(tex, slots_[idx].staging)) {
+    ++st_.failed;
+    return false;
+  }
+  Flight f;
+  f.slot = idx;
+  f.tag = tag;
+  f.frame = frame_;
+  f.fence_value = fence_value_ + 1;   // signalled by the next commit()
+  uncommitted_ = true;
+  slots_[idx].busy = true;
+  flight_.push_back(f);
+  ++st_.submitted;
+  return true;
+}
+
+void ReadbackRing::commit() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  commit_locked();
+}
+
+void ReadbackRing::commit_locked() {
+  if (!backend_ || !uncommitted_) return;
+  uncommitted_ = false;
+  backend_->flush_copies();
+  if (!fenced_) return;
+  ++fence_value_;
+  ++st_.signals;
+  // no signal: the fence can no longer vouch for these copies, rely on the map waiting instead
+  if (!backend_->signal(fence_value_)) fenced_ = false;
+}
+
+size_t ReadbackRing::take(const Flight& f, const Callback& fn, std::unique_lock<std::mutex>& lk) {
+  // the slot stays busy, so submit() leaves it alone while it is mapped without the lock
+  const uint64_t staging = slots_[f.slot].staging;
+  const ReadbackKey key = slots_[f.slot].key;
+  LatencyHistogram* const map_lat = map_lat_;
+  lk.unlock();
+  const uint64_t t0 = map_lat ? LatencyHistogram::now() : 0;
+  ReadbackMapped m;
+  const bool ok = backend_->map(staging, m) && m.data;
+  if (ok) {
+    if (fn) fn(f.tag, key, m);
+    backend_->unmap(staging);
+  } else if (fn) {
+    fn(f.tag, key, ReadbackMapped());   // the owner still learns the frame is over
+  }
+  if (map_lat) map_lat->record_since(t0);
+  lk.lock();
+  Slot& s = slots_[f.slot];
+  if (ok) {
+    ++st_.completed;
+    const uint64_t lat = frame_ - f.frame;
+    latency_sum_ += lat;
+    st_.latency_max_frames = std::max(st_.latency_max_frames, (uint32_t)lat);
+  } else {
+    ++st_.failed;
+  }
+  s.busy = false;
+  return ok ? 1 : 0;
+}
+
+void ReadbackRing::next_frame() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  commit_locked();
+  ++frame_;
+}
+
+size_t ReadbackRing::poll(const Callback& fn) {
+  std::unique_lock<std::mutex> lk(mtx_);
+  commit_locked();
+  ++frame_;
+  size_t n = 0;
+  // in submit order: a copy that is not done holds back the ones behind it
+  while (backend_ && !flight_.empty()) {
+    const Flight& f = flight_.front();
+    if (frame_ - f.frame < (uint64_t)latency_) break;
+    if (fenced_ && backend_->completed() < f.fence_value) {
+      ++st_.late;
+      break;
+    }
+    const Flight g = f;
+    flight_.pop_front();
+    n += take(g, fn, lk);
+  }
+  return n;
+}
+
+int ReadbackRing::take_frame(uint64_t frame_idx, const Callback& fn, bool wait) {
+  std::unique_lock<std::mutex> lk(mtx_);
+  if (!backend_) return 0;
+  if (!wait) {
+    // all of the frame's copies (and any older ones) or none
+    for (const Flight& f : flight_) {
+      if (f.tag.frame_idx > frame_idx) break;
+      if (frame_ - f.frame < (uint64_t)latency_ || (fenced_ && f.fence_value > fence_value_)) return -1;
+      if (fenced_ && backend_->completed() < f.fence_value) {
+        ++st_.late;
+        return -1;
+      }
+    }
+  }
+  int n = 0;
+  while (!flight_.empty() && flight_.front().tag.frame_idx <= frame_idx) {
+    const Flight g = flight_.front();
+    flight_.pop_front();
+    n += (int)take_waiting(g, fn, lk);
+  }
+  return n;
+}
+
+size_t ReadbackRing::take_waiting(const Flight& g, const Callback& fn, std::unique_lock<std::mutex>& lk) {
+  if (fenced_ && g.fence_value <= fence_value_ && backend_->completed() < g.fence_value) {
+    ++st_.waits;
+    const uint64_t v = g.fence_value;
+    LatencyHistogram* const wait_lat = wait_lat_;
+    lk.unlock();
+    {
+      LatencyScope timed(wait_lat);
+      (void)backend_->wait(v, 2000);
+    }
+    lk.lock();
+  } else if (wait_lat_) {
+    wait_lat_->record_ns(0);   // already done: the distribution shows how often it is not
+  }
+  return take(g, fn, lk);
+}
+
+size_t ReadbackRing::flush(const Callback& fn) {
+  std::unique_lock<std::mutex> lk(mtx_);
+  return flush_locked(fn, lk);
+}
+
+size_t ReadbackRing::flush_locked(const Callback& fn, std::unique_lock<std::mutex>& lk) {
+  commit_locked();
+  size_t n = 0;
+  while (backend_ && !flight_.empty()) {
+    const Flight g = flight_.front();
+    flight_.pop_front();
+    n += take_waiting(g, fn, lk);
+  }
+  return n;
+}
+
+void ReadbackRing::release() {
+  std::unique_lock<std::mutex> lk(mtx_);
+  if (!backend_) return;
+  flush_locked(Callback(), lk);
+  for (Slot& s : slots_) {
+    if (!s.staging) continue;
+    backend_->destroy_staging(s.staging);
+    ++st_.staging_destroyed;
+  }
+  slots_.clear();
+  if (fenced_) backend_->destroy_fence();
+  fenced_ = false;
+  uncommitted_ = false;
+  backend_.reset();
+}
+
+void ReadbackRing::set_latency(LatencyHistogram* wait, LatencyHistogram* map) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  wait_lat_ = wait;
+  map_lat_ = map;
+}
+
+bool ReadbackRing::maps_off_thread() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return backend_ && backend_->maps_off_thread();
+}
+
+size_t ReadbackRing::in_flight() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return flight_.size();
+}
+
+ReadbackRingStats ReadbackRing::stats() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  ReadbackRingStats s = st_;
+  s.in_flight = (uint32_t)flight_.size();
+  s.staging = 0;
+  for (const Slot& sl : slots_) s.staging += sl.staging ? 1 : 0;
+  s.latency_mean_frames = s.completed ? (double)latency_sum_ / (double)s.completed : 0.0;
+  s.fenced = fenced_;
+  return s;
+}
+
+//=================================================================================================
+
+void ReadbackBatch::add(const std::string& name, uint64_t tex, Converter fn) {
+  Entry e;
+  e.name = name;
+  e.tex = tex;
+  e.fn = std::move(fn);
+  entries_.push_back(std::move(e));
+}
+
+size_t ReadbackBatch::run(uint64_t timeout_ms) {
+  using clock = std::chrono::steady_clock;
+  auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+  timing_ = ReadbackBatchTiming();
+  timing_.entries.resize(entries_.size());
+  if (!backend_) return 0;
+
+  const clock::time_point t0 = clock::now();
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    Entry& e = entries_[i];
+    e.ok = false;
+    e.staging = 0;
+    e.data = ReadbackMapped();
+    timing_.entries[i].name = e.name;
+    if (!backend_->describe(e.tex, e.key)) continue;
+    timing_.entries[i].width = e.key.width;
+    timing_.entries[i].height = e.key.height;
+    if (!backend_->create_staging(e.key, e.staging)) {
+      e.staging = 0;
+      continue;
+    }
+    if (!backend_->copy(e.tex, e.staging)) {
+      backend_->destroy_staging(e.staging);
+      e.staging = 0;
+    }
+  }
+  backend_->flush_copies();
+  const bool fence = backend_->create_fence();
+  timing_.fenced = fence && backend_->signal(1);
+  const clock::time_point t1 = clock::now();
+  if (timing_.fenced) (void)backend_->wait(1, timeout_ms);
+  const clock::time_point t2 = clock::now();
+  for (Entry& e : entries_) {
+    if (e.staging && !(backend_->map(e.staging, e.data) && e.data.data)) e.data = ReadbackMapped();
+  }
+  const clock::time_point t3 = clock::now();
+
+  auto convert = [this, &ms](size_t i) {
+    const clock::time_point a = clock::now();
+    entries_[i].ok = entries_[i].fn && entries_[i].fn(entries_[i].key, entries_[i].data);
+    timing_.entries[i].convert_ms = ms(a, clock::now());
+  };
+  std::vector<std::thread> threads;
+  size_t last = entries_.size();
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (!entries_[i].data.data) continue;
+    if (last < entries_.size()) threads.emplace_back(convert, last);
+    last = i;
+  }
+  if (last < entries_.size()) convert(last);
+  for (std::thread& t : threads) t.join();
+  const clock::time_point t4 = clock::now();
+
+  size_t n = 0;
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    Entry& e = entries_[i];
+    if (e.data.data) backend_->unmap(e.staging);
+    if (e.staging) backend_->destroy_staging(e.staging);
+    e.staging = 0;
+    e.data = ReadbackMapped();
+    timing_.entries[i].ok = e.ok;
+    n += e.ok ? 1 : 0;
+  }
+  if (fence) backend_->destroy_fence();
+  timing_.record_ms = ms(t0, t1);
+  timing_.wait_ms = ms(t1, t2);
+  timing_.map_ms = ms(t2, t3);
+  timing_.convert_ms = ms(t3, t4);
+  timing_.total_ms = ms(t0, clock::now());
+  return n;
+}
+
+std::string ReadbackBatchTiming::summary() const {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "readback of %zu textures: record %.2f ms, wait %.2f ms%s, map %.2f ms, convert %.2f ms, total %.2f ms;",
+           entries.size(), record_ms, wait_ms, fenced ? "" : " (no fence)", map_ms, convert_ms, total_ms);
+  std::string s = buf;
+  for (const Entry& e : entries) {
+    snprintf(buf, sizeof(buf), " %s %ux%u %s %.2f ms", e.name.c_str(), e.width, e.height, e.ok ? "ok" : "FAILED", e.convert_ms);
+    s += buf;
+  }
+  return s;
+}
+
+//=================================================================================================
+
+ReadbackKey MockReadbackBackend::key_of(uint64_t tex) {
+  ReadbackKey k;
+  k.format = 1 + (uint32_t)((tex >> 32) & 0xFF);
+  k.width = 8u << ((tex >> 24) & 3);
+  k.height = 4;
+  return k;
+}
+
+static uint8_t mock_texel(uint64_t tex, size_t i) {
+  return (uint8_t)((tex * 131u) + i * 7u);
+}
+
+uint8_t MockReadbackBackend::texel_of(uint64_t tex, size_t i) {
+  return mock_texel(tex, i);
+}
+
+bool MockReadbackBackend::describe(uint64_t tex, ReadbackKey& key) {
+  if (!tex) return false;
+  key = key_of(tex);
+  return true;
+}
+
+bool MockReadbackBackend::create_staging(const ReadbackKey& key, uint64_t& staging) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  Staging s;
+  s.key = key;
+  s.bytes.assign((size_t)key.width * key.height * 4, 0);
+  s.live = true;
+  staging_.push_back(s);
+  staging = staging_.size();   // handle: index + 1
+  ++live_;
+  return true;
+}
+
+void MockReadbackBackend::destroy_staging(uint64_t staging) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (staging == 0 || staging > staging_.size() || !staging_[staging - 1].live) return;
+  staging_[staging - 1].live = false;
+  --live_;
+}
+
+bool MockReadbackBackend::copy(uint64_t tex, uint64_t staging) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (fail_copy || staging == 0 || staging > staging_.size() || !staging_[staging - 1].live) return false;
+  Staging& s = staging_[staging - 1];
+  s.tex = tex;
+  s.seq = ++copies_;
+  return true;
+}
+
+bool MockReadbackBackend::signal(uint64_t value) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  ++signals;
+  pending_.emplace_back(value, copies_);
+  return true;
+}
+
+uint64_t MockReadbackBackend::completed() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return done_;
+}
+
+void MockReadbackBackend::tick() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  tick_locked();
+}
+
+void MockReadbackBackend::tick_locked() {
+  if (fences_) {
+    if (pending_.empty()) return;
+    done_ = pending_.front().first;
+    landed_ = std::max(landed_, pending_.front().second);
+    pending_.pop_front();
+  } else {
+    landed_ = std::max(landed_, copies_at_tick_);   // the GPU is a frame behind
+    copies_at_tick_ = copies_;
+  }
+}
+
+bool MockReadbackBackend::wait(uint64_t value, uint64_t timeout_ms) {
+  (void)timeout_ms;
+  std::lock_guard<std::mutex> lk(mtx_);
+  ++waits;
+  while (done_ < value && !pending_.empty()) tick_locked();
+  return done_ >= value;
+}
+
+bool MockReadbackBackend::map(uint64_t staging, ReadbackMapped& out) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (staging == 0 || staging > staging_.size() || !staging_[staging - 1].live) return false;
+  Staging& s = staging_[staging - 1];
+  if (s.seq > landed_ && !fences_) {   // like a D3D11 Map: blocks until the copy is done
+    ++waits;
+    landed_ = s.seq;
+  }
+  if (s.seq <= landed_ && s.filled != s.seq) {   // the copy has landed: its bytes are there
+    for (size_t i = 0; i < s.bytes.size(); ++i) s.bytes[i] = mock_texel(s.tex, i);
+    s.filled = s.seq;
+  }
+  out.data = s.bytes.data();
+  out.row_pitch = s.key.width * 4;
+  ++mapped_;
+  return true;
+}
+
+void MockReadbackBackend::unmap(uint64_t staging) {
+  (void)staging;
+  std::lock_guard<std::mutex> lk(mtx_);
+  --mapped_;
+}
+
+int MockReadbackBackend::live_staging() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return live_;
+}
+
+int MockReadbackBackend::mapped() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return mapped_;
+}
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+// Runs 'frames' frames of poll + submit (one texture per frame from tex_of) with the GPU finishing
+// one fence value every gpu_every frames; checks order, data and tags of what comes back.
+static std::string run_ring(ReadbackRing& ring, MockReadbackBackend* mock, int frames, int gpu_every,
+                            const std::function<uint64_t(int)>& tex_of, std::vector<uint64_t>& got, uint64_t& refused) {
+  std::string err;
+  uint64_t expect_next = 0;
+  std::vector<uint64_t> submitted_tex;
+  auto check = [&](const ReadbackTag& tag, const ReadbackKey& key, const ReadbackMapped& m) {
+    if (!err.empty()) return;
+    if (!m.data) { err = "map failed"; return; }
+    if (tag.frame_idx >= submitted_tex.size()) { err = "tag of a frame never submitted"; return; }
+    if (tag.frame_idx < expect_next) { err = "readbacks out of order"; return; }
+    expect_next = tag.frame_idx + 1;
+    const uint64_t tex = submitted_tex[(size_t)tag.frame_idx];
+    if (key != MockReadbackBackend::key_of(tex) || tag.time_us != (int64_t)tag.frame_idx * 1000) { err = "tag/layout mix-up"; return; }
+    for (size_t i = 0; i < (size_t)key.width * key.height * 4; ++i)
+      if (m.data[i] != mock_texel(tex, i)) { err = "frame " + std::to_string(tag.frame_idx) + " read before its copy finished"; return; }
+    got.push_back(tag.frame_idx);
+  };
+  for (int i = 0; i < frames; ++i) {
+    ring.poll(check);
+    ReadbackTag tag;
+    tag.frame_idx = (uint64_t)i;
+    tag.time_us = (int64_t)i * 1000;
+    submitted_tex.push_back(tex_of(i));
+    if (!ring.submit(submitted_tex.back(), tag)) ++refused;
+    ring.commit();
+    if (gpu_every > 0 && (i % gpu_every) == 0) mock->tick();
+    if (!err.empty()) return err;
+  }
+  ring.flush(check);
+  return err;
+}
+
+std::string run_readback_ring_tests() {
+  {
+    // GPU keeps up: every frame comes back exactly 'latency' frames later; the spare texture is never needed
+    ReadbackRing ring;
+    ring.configure(2, 3);
+    auto* mock = new MockReadbackBackend();
+    ring.set_backend(std::unique_ptr<ReadbackBackend>(mock));
+    std::vector<uint64_t> got;
+    uint64_t refused = 0;
+    const std::string err = run_ring(ring, mock, 50, 1, [](int i) { return (uint64_t)(0x1234 + i); }, got, refused);
+    if (!err.empty()) RETURNFAILST("readback ring: " + err);
+    const ReadbackRingStats st = ring.stats();
+    if (got.size() != 50 || refused != 0) RETURNFAILST("readback ring: got " + std::to_string(got.size()) + " of 50");
+    if (!st.fenced || st.latency_max_frames != 2 || st.staging_created != 2 || st.late != 0 || mock->waits != 0)
+      RETURNFAILST("readback ring: latency " + std::to_string(st.latency_max_frames) + ", staging " + std::to_string(st.staging_created) +
+                   ", late " + std::to_string(st.late));
+    if (mock->mapped() != 0) RETURNFAILST("readback ring: left a texture mapped");
+    ring.release();   // also drops the backend
+    if (ring.has_backend() || ring.stats().staging != 0 || ring.stats().staging_destroyed != st.staging_created)
+      RETURNFAILST("readback ring: staging textures leaked");
+  }
+  {
+    // slow GPU: copies wait for their fence, a full ring refuses frames instead of blocking
+    ReadbackRing ring;
+    ring.configure(1, 2);
+    auto* mock = new MockReadbackBackend();
+    ring.set_backend(std::unique_ptr<ReadbackBackend>(mock));
+    std::vector<uint64_t> got;
+    uint64_t refused = 0;
+    const std::string err = run_ring(ring, mock, 60, 3, [](int i) { return (uint64_t)(0x700 + i); }, got, refused);
+    if (!err.empty()) RETURNFAILST("readback ring (slow gpu): " + err);
+    const ReadbackRingStats st = ring.stats();
+    if (refused == 0 || st.no_slot != refused || st.late == 0 || got.size() + refused != 60 || st.staging_created != 2)
+      RETURNFAILST("readback ring (slow gpu): refused " + std::to_string(refused) + ", late " + std::to_string(st.late));
+  }
+  {
+    // resolution change: the old layout's textures go away once they are idle
+    ReadbackRing ring;
+    ring.configure(2, 3);
+    auto* mock = new MockReadbackBackend();
+    ring.set_backend(std::unique_ptr<ReadbackBackend>(mock));
+    std::vector<uint64_t> got;
+    uint64_t refused = 0;
+    const std::string err = run_ring(ring, mock, 40, 1, [](int i) { return i < 20 ? (uint64_t)0x10 : (uint64_t)0x01000010; }, got, refused);
+    if (!err.empty()) RETURNFAILST("readback ring (resize): " + err);
+    if (got.size() != 40 || mock->live_staging() > 3) RETURNFAILST("readback ring (resize): " + std::to_string(mock->live_staging()) + " staging textures alive");
+  }
+  {
+    // no fences: taken after 'latency' frames, the map waits for a copy that is not done
+    ReadbackRing ring;
+    ring.configure(1, 2);
+    auto* mock = new MockReadbackBackend(/*fences=*/false);
+    ring.set_backend(std::unique_ptr<ReadbackBackend>(mock));
+    std::vector<uint64_t> got;
+    uint64_t refused = 0;
+    const std::string err = run_ring(ring, mock, 30, 2, [](int i) { return (uint64_t)(0x300 + i); }, got, refused);
+    if (!err.empty()) RETURNFAILST("readback ring (no fence): " + err);
+    if (ring.stats().fenced || got.size() != 30 || mock->waits == 0) RETURNFAILST("readback ring (no fence): got " + std::to_string(got.size()));
+  }
+  {
+    // a failed copy neither queues anything nor keeps its staging texture busy
+    ReadbackRing ring;
+    ring.configure(1, 2);
+    auto* mock = new MockReadbackBackend();
+    ring.set_backend(std::unique_ptr<ReadbackBackend>(mock));
+    ReadbackTag tag;
+    mock->fail_copy = true;
+    for (int i = 0; i < 5; ++i) if (ring.submit(0x55, tag)) RETURNFAILST("readback ring: failed copy was queued");
+    mock->fail_copy = false;
+    if (!ring.submit(0x55, tag) || ring.stats().failed != 5 || ring.in_flight() != 1) RETURNFAILST("readback ring: failed copies left the ring stuck");
+    if (ring.flush(ReadbackRing::Callback()) != 1) RETURNFAILST("readback ring: flush");
+  }
+  {
+    // two textures a frame (color + depth) share the frame's one fence signal
+    ReadbackRing ring;
+    ring.configure(2, 3);
+    auto* mock = new MockReadbackBackend();
+    ring.set_backend(std::unique_ptr<ReadbackBackend>(mock));
+    std::string err;
+    size_t got = 0;
+    auto check = [&](const ReadbackTag& tag, const ReadbackKey&, const ReadbackMapped& m) {
+      const uint64_t tex = tag.aux ? 0x0100000200ull + tag.frame_idx : 0x20 + tag.frame_idx;
+      if (!m.data || m.data[5] != mock_texel(tex, 5)) err = "frame " + std::to_string(tag.frame_idx) + " stream " + std::to_string(tag.aux);
+      ++got;
+    };
+    for (int i = 0; i < 20; ++i) {
+      ring.poll(check);
+      ReadbackTag tag;
+      tag.frame_idx = (uint64_t)i;
+      ring.submit(0x20 + (uint64_t)i, tag);
+      tag.aux = 1;
+      ring.submit(0x0100000200ull + (uint64_t)i, tag);
+      ring.commit();
+      mock->tick();
+    }
+    ring.flush(check);
+    if (!err.empty()) RETURNFAILST("readback ring (two per frame): " + err);
+    if (got != 40 || mock->signals != 20 || ring.stats().signals != 20 || ring.stats().no_slot != 0)
+      RETURNFAILST("readback ring (two per frame): " + std::to_string(got) + " read, " + std::to_string(mock->signals) + " fence signals");
+  }
+  for (int fences = 1; fences >= 0; --fences) {
+    // batch: one signal and one wait for all textures, converters see their own data, a bad texture fails alone
+    MockReadbackBackend mock(fences != 0);
+    ReadbackBatch batch(&mock);
+    const uint64_t texs[4] = { 0x41, 0x0300000042ull, 0, 0x43 };
+    for (int i = 0; i < 4; ++i) {
+      const uint64_t tex = texs[i];
+      batch.add("tex" + std::to_string(i), tex, [tex](const ReadbackKey& key, const ReadbackMapped& m) {
+        if (key != MockReadbackBackend::key_of(tex)) return false;
+        for (size_t k = 0; k < (size_t)key.width * key.height * 4; ++k)
+          if (m.data[k] != mock_texel(tex, k)) return false;
+        return true;
+      });
+    }
+    const std::string what = fences ? "readback batch: " : "readback batch (no fence): ";
+    if (batch.run() != 3 || !batch.ok(0) || !batch.ok(1) || batch.ok(2) || !batch.ok(3)) RETURNFAILST(what + batch.timing().summary());
+    if (fences && (mock.signals != 1 || mock.waits != 1)) RETURNFAILST(what + std::to_string(mock.waits) + " waits");
+    if (mock.live_staging() != 0 || mock.mapped() != 0) RETURNFAILST(what + "staging textures left behind");
+    if (batch.timing().entries.size() != 4 || batch.timing().fenced != (fences != 0)) RETURNFAILST(what + "timings");
+  }
+  return std::string("ok");
+}
@@ -0,0 +1,268 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include "latency_histogram.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Asynchronous GPU -> CPU texture readback. copy_texture_image_needing_resource_barrier_into_packedbuf
+// creates a staging texture, copies, waits for the whole queue to go idle, maps and destroys it,
+// every time. The ring keeps its staging textures (up to 'depth' per format and size) for the whole
+// recording: submit() records the copy, commit() submits the frame's copies behind one fence signal,
+// and poll() maps a copy 'latency' frames later, once the fence says the GPU is done with it, so the
+// render thread never waits for the GPU. Readbacks come out in submit order, each with the tag it
+// went in with. take_frame() hands them out per frame instead, to the readback stage of
+// capture_pipeline.h, which may run on its own thread.
+//
+// ReadbackBatch is the synchronous counterpart for snapshots: all textures copied together, one
+// wait, converted side by side.
+//
+// The device is reached through a ReadbackBackend: readback_ring_reshade.cpp over a ReShade
+// command queue, MockReadbackBackend for the self-test.
+
+struct ReadbackKey {
+  uint32_t format = 0;   // backend specific (reshade::api::format)
+  uint32_t width = 0, height = 0;
+  bool operator==(const ReadbackKey& o) const { return format == o.format && width == o.width && height == o.height; }
+  bool operator!=(const ReadbackKey& o) const { return !(*this == o); }
+};
+
+struct ReadbackMapped {
+  const uint8_t* data = nullptr;
+  uint32_t row_pitch = 0;
+};
+
+// What a readback belongs to; comes back with its data
+struct ReadbackTag {
+  uint64_t frame_idx = 0;
+  int64_t time_us = 0;
+  uint32_t stream = 0;   // caller's stream id (CaptureStream)
+  uint32_t aux = 0;      // caller's extra (e.g. how to interpret the texture)
+};
+
+class ReadbackBackend {
+public:
+  virtual ~ReadbackBackend() {}
+  // Layout of a texture the ring is asked to copy; false if it cannot be copied
+  virtual bool describe(uint64_t tex, ReadbackKey& key) = 0;
+  virtual bool create_staging(const ReadbackKey& key, uint64_t& staging) = 0;
+  virtual void destroy_staging(uint64_t staging) = 0;
+  // Records tex -> staging; flush_copies() hands what was recorded to the GPU
+  virtual bool copy(uint64_t tex, uint64_t staging) = 0;
+  virtual void flush_copies() {}
+  // false: no fences on this device; a copy is then taken as done after 'latency' frames (map waits if not)
+  virtual bool create_fence() = 0;
+  virtual void destroy_fence() = 0;
+  virtual bool signal(uint64_t value) = 0;        // GPU side, after the copies submitted so far
+  virtual uint64_t completed() const = 0;
+  virtual bool wait(uint64_t value, uint64_t timeout_ms) = 0;
+  virtual bool map(uint64_t staging, ReadbackMapped& out) = 0;
+  virtual void unmap(uint64_t staging) = 0;
+  // true: completed/wait/map/unmap may run on another thread than the copies (D3D12, Vulkan)
+  virtual bool maps_off_thread() const { return true; }
+};
+
+struct ReadbackRingStats {
+  uint64_t submitted = 0;
+  uint64_t completed = 0;      // mapped and handed to the callback
+  uint64_t failed = 0;         // copy or map failed
+  uint64_t no_slot = 0;        // submit refused: every staging texture of that layout still in flight
+  uint64_t late = 0;           // polls where the oldest copy was due but its fence was not done yet
+  uint64_t waits = 0;          // flushes that had to block on the fence
+  uint64_t signals = 0;        // fence signals: one per commit() with copies
+  uint64_t staging_created = 0, staging_destroyed = 0;
+  uint32_t in_flight = 0;
+  uint32_t staging = 0;        // staging textures alive
+  double latency_mean_frames = 0.0;   // submit -> callback, in poll() calls
+  uint32_t latency_max_frames = 0;
+  bool fenced = false;
+};
+
+class ReadbackRing {
+public:
+  using Callback = std::function<void(const ReadbackTag& tag, const ReadbackKey& key, const ReadbackMapped& data)>;
+
+  ReadbackRing() = default;
+  ~ReadbackRing();
+  ReadbackRing(const ReadbackRing&) = delete;
+  ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+  // latency: frames (poll calls) between a copy and its map, at least 1.
+  // depth: staging textures per layout, at least latency (poll frees one before the frame's submit);
+  // more leave room for a GPU that is late.
+  void configure(int latency, int depth);
+  int latency() const { return latency_; }
+  int depth() const { return depth_; }
+  // Takes the backend for the textures submitted from now on; the previous one is released first
+  void set_backend(std::unique_ptr<ReadbackBackend> backend);
+  bool has_backend() const { return (bool)backend_; }
+  // whether take_frame(wait=true) may run on a worker thread (ReadbackBackend::maps_off_thread)
+  bool maps_off_thread() const;
+  // Where the time blocked on fences (per readback taken by flush/take_frame(wait)) and spent
+  // mapping goes; null: not timed
+  void set_latency(LatencyHistogram* wait, LatencyHistogram* map);
+
+  // Render thread: copies tex into a free staging texture of its layout. False (nothing queued)
+  // if all of them are still in flight or the copy failed.
+  bool submit(uint64_t tex, const ReadbackTag& tag);
+  // Render thread, after the frame's submits: flushes their copies and signals the fence once for
+  // all of them (poll and flush do it too if it was not called)
+  void commit();
+  // Render thread, once per frame: maps every readback that is 'latency' frames old and done, in
+  // submit order, and calls fn with it (the data is only valid during the call; data.data is null
+  // if the map failed). Returns how many were mapped.
+  size_t poll(const Callback& fn);
+  // Once per frame when the readbacks are taken with take_frame() instead of poll(): commits and
+  // counts the frame for 'latency'
+  void next_frame();
+  // The readbacks of frame frame_idx (and any older ones left), in submit order. wait: blocks on the
+  // fence (a worker thread, after the frame was committed); otherwise takes nothing and returns -1
+  // unless all of them are 'latency' frames old and done. The ring may be submitted to meanwhile.
+  int take_frame(uint64_t frame_idx, const Callback& fn, bool wait);
+  // Waits for everything in flight and hands it to fn (end of a recording)
+  size_t flush(const Callback& fn);
+  // Flushes without a callback and destroys the staging textures and the fence
+  void release();
+
+  size_t in_flight() const;
+  ReadbackRingStats stats() const;
+
+private:
+  struct Slot {
+    ReadbackKey key;
+    uint64_t staging = 0;
+    bool busy = false;
+  };
+  struct Flight {
+    size_t slot = 0;
+    ReadbackTag tag;
+    uint64_t fence_value = 0;
+    uint64_t frame = 0;          // poll count at submit
+  };
+  // called with lk held; lk is released while the staging texture is mapped or waited for
+  size_t take(const Flight& f, const Callback& fn, std::unique_lock<std::mutex>& lk);
+  size_t take_waiting(const Flight& f, const Callback& fn, std::unique_lock<std::mutex>& lk);
+  size_t flush_locked(const Callback& fn, std::unique_lock<std::mutex>& lk);
+  void commit_locked();
+  void drop_idle_other_layouts(const ReadbackKey& key);
+
+  mutable std::mutex mtx_;   // submitting thread vs the one taking readbacks
+
+  std::unique_ptr<ReadbackBackend> backend_;
+  int latency_ = 2, depth_ = 3;
+  bool fenced_ = false;
+  bool uncommitted_ = false;
+  uint64_t fence_value_ = 0;
+  uint64_t frame_ = 0;
+  std::vector<Slot> slots_;
+  std::deque<Flight> flight_;
+  ReadbackRingStats st_;
+  uint64_t latency_sum_ = 0;
+  LatencyHistogram* wait_lat_ = nullptr;
+  LatencyHistogram* map_lat_ = nullptr;
+};
+
+// Backend without a GPU: "textures" are byte patterns derived from their handle and a copy's bytes
+// only show up once tick() has finished it; optionally without fence support. Safe to use from a
+// submitting and a mapping thread at once.
+class MockReadbackBackend : public ReadbackBackend {
+public:
+  explicit MockReadbackBackend(bool fences = true) : fences_(fences) {}
+  bool describe(uint64_t tex, ReadbackKey& key) override;
+  bool create_staging(const ReadbackKey& key, uint64_t& staging) override;
+  void destroy_staging(uint64_t staging) override;
+  bool copy(uint64_t tex, uint64_t staging) override;
+  bool create_fence() override { return fences_; }
+  void destroy_fence() override {}
+  bool signal(uint64_t value) override;
+  uint64_t completed() const override;
+  bool wait(uint64_t value, uint64_t timeout_ms) override;
+  bool map(uint64_t staging, ReadbackMapped& out) override;
+  void unmap(uint64_t staging) override;
+  bool maps_off_thread() const override { return off_thread; }
+
+  // the "GPU" finishes the copies up to the oldest signalled fence value (without fences: the
+  // copies submitted before the previous tick)
+  void tick();
+  // texture handle -> layout: format from bits 32..39, width 8 << bits 24..25, height 4
+  static ReadbackKey key_of(uint64_t tex);
+  // byte i of texture tex once it has been copied
+  static uint8_t texel_of(uint64_t tex, size_t i);
+  int live_staging() const;
+  int mapped() const;
+  uint64_t waits = 0;
+  uint64_t signals = 0;
+  bool fail_copy = false;
+  bool off_thread = true;
+
+private:
+  struct Staging {
+    ReadbackKey key;
+    uint64_t tex = 0;
+    uint64_t seq = 0, filled = 0;   // copy number; the one whose bytes are in 'bytes'
+    std::vector<uint8_t> bytes;
+    bool live = false;
+  };
+  void tick_locked();
+  bool fences_;
+  mutable std::mutex mtx_;
+  std::vector<Staging> staging_;
+  std::deque<std::pair<uint64_t, uint64_t>> pending_;   // fence value, copies made before it
+  uint64_t done_ = 0;
+  uint64_t copies_ = 0, landed_ = 0, copies_at_tick_ = 0;
+  int live_ = 0, mapped_ = 0;
+};
+
+struct ReadbackBatchTiming {
+  struct Entry {
+    std::string name;
+    uint32_t width = 0, height = 0;
+    bool ok = false;
+    double convert_ms = 0.0;
+  };
+  std::vector<Entry> entries;
+  double record_ms = 0.0;    // staging textures created, copies recorded and flushed
+  double wait_ms = 0.0;      // the one fence wait
+  double map_ms = 0.0;       // without a fence this is where the wait happens
+  double convert_ms = 0.0;   // all converters, side by side
+  double total_ms = 0.0;
+  bool fenced = false;
+  std::string summary() const;   // one log line
+};
+
+// One-shot readback of several textures: every copy is recorded before a single fence signal and
+// wait, then all are mapped at once and their converters run in parallel (one thread each, the
+// last on the caller's). Staging textures live for the run only.
+class ReadbackBatch {
+public:
+  // data is only valid during the call; true if the texture was converted
+  using Converter = std::function<bool(const ReadbackKey& key, const ReadbackMapped& data)>;
+
+  explicit ReadbackBatch(ReadbackBackend* backend) : backend_(backend) {}
+  void add(const std::string& name, uint64_t tex, Converter fn);
+  size_t size() const { return entries_.size(); }
+  // Returns how many textures were converted
+  size_t run(uint64_t timeout_ms = 2000);
+  bool ok(size_t i) const { return i < entries_.size() && entries_[i].ok; }
+  const ReadbackBatchTiming& timing() const { return timing_; }
+
+private:
+  struct Entry {
+    std::string name;
+    uint64_t tex = 0, staging = 0;
+    Converter fn;
+    ReadbackKey key;
+    ReadbackMapped data;
+    bool ok = false;
+  };
+  ReadbackBackend* backend_;
+  std::vector<Entry> entries_;
+  ReadbackBatchTiming timing_;
+};
+
+// Ring and batch self-test against MockReadbackBackend; "ok" or what failed (like run_utils_tests)
+std::string run_readback_ring_tests();
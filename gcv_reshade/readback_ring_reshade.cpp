@@ -0,0 +1,106 @@
+// ReadbackBackend over a ReShade command queue (readback_ring.h)
+#include <reshade.hpp>
+#include "copy_texture_into_packedbuf.h"
+
+using namespace reshade::api;
+
+namespace {
+class ReshadeReadbackBackend : public ReadbackBackend {
+public:
+  explicit ReshadeReadbackBackend(command_queue* queue) : queue_(queue), device_(queue->get_device()) {}
+
+  bool describe(uint64_t tex, ReadbackKey& key) override {
+    const resource_desc desc = device_->get_resource_desc(resource{ tex });
+    // same rule as copy_texture_image_needing_resource_barrier_into_packedbuf: Vulkan/OpenGL swapchain
+    // images can be copied without an explicit copy_source usage
+    const device_api api = device_->get_api();
+    if (api != device_api::vulkan && api != device_api::opengl &&
+        (desc.usage & resource_usage::copy_source) != resource_usage::copy_source) {
+      return false;
+    }
+    key.format = (uint32_t)format_to_default_typed(desc.texture.format);
+    key.width = desc.texture.width;
+    key.height = desc.texture.height;
+    return key.width > 0 && key.height > 0;
+  }
+
+  bool create_staging(const ReadbackKey& key, uint64_t& staging) override {
+    resource res = { 0 };
+    if (!device_->create_resource(resource_desc(key.width, key.height, 1, 1, (format)key.format, 1, memory_heap::gpu_to_cpu, resource_usage::copy_dest),
+                                  nullptr, resource_usage::copy_dest, &res)) {
+      reshade::log_message(reshade::log_level::error, "readback ring: failed to create a staging texture");
+      return false;
+    }
+    staging = res.handle;
+    return true;
+  }
+
+  void destroy_staging(uint64_t staging) override {
+    device_->destroy_resource(resource{ staging });
+  }
+
+  bool copy(uint64_t tex, uint64_t staging) override {
+    command_list* const cmd_list = queue_->get_immediate_command_list();
+    if (!cmd_list) return false;
+    cmd_list->barrier(resource{ tex }, resource_usage::render_target, resource_usage::copy_source);
+    cmd_list->copy_texture_region(resource{ tex }, 0, nullptr, resource{ staging }, 0, nullptr);
+    cmd_list->barrier(resource{ tex }, resource_usage::copy_source, resource_usage::render_target);
+    return true;
+  }
+  // the fence signal has to come after the copies on the queue
+  void flush_copies() override { queue_->flush_immediate_command_list(); }
+
+  bool create_fence() override {
+    // D3D11 before 11.3 and some OpenGL drivers have none
+    return device_->create_fence(0, fence_flags::none, &fence_);
+  }
+  void destroy_fence() override {
+    if (fence_.handle) device_->destroy_fence(fence_);
+    fence_ = { 0 };
+  }
+  bool signal(uint64_t value) override { return queue_->signal(fence_, value); }
+  uint64_t completed() const override { return device_->get_completed_fence_value(fence_); }
+  bool wait(uint64_t value, uint64_t timeout_ms) override { return device_->wait(fence_, value, timeout_ms * 1000000ull); }
+
+  bool map(uint64_t staging, ReadbackMapped& out) override {
+    subresource_data data = {};
+    if (!device_->map_texture_region(resource{ staging }, 0, nullptr, map_access::read_only, &data) || !data.data) return false;
+    out.data = static_cast<const uint8_t*>(data.data);
+    out.row_pitch = data.row_pitch;
+    return true;
+  }
+  void unmap(uint64_t staging) override { device_->unmap_texture_region(resource{ staging }, 0); }
+  // D3D11 maps through the immediate context and OpenGL through the game's GL context, both owned
+  // by the render thread
+  bool maps_off_thread() const override {
+    const device_api api = device_->get_api();
+    return api == device_api::d3d12 || api == device_api::vulkan;
+  }
+
+private:
+  command_queue* queue_;
+  device* device_;
+  fence fence_ = { 0 };
+};
+} // namespace
+
+std::unique_ptr<ReadbackBackend> make_reshade_readback_backend(command_queue* queue) {
+  if (!queue) return nullptr;
+  return std::make_unique<ReshadeReadbackBackend>(queue);
+}
+
+uint32_t readback_row_bytes(const ReadbackKey& key) {
+  return format_row_pitch((format)key.format, key.width);
+}
+
+bool copy_readback_into_packedbuf(GameInterface* gamehandle, simple_packed_buf& dstBuf,
+                                  const ReadbackKey& key, const ReadbackMapped& mapped,
+                                  TextureInterpretation tex_interp, const depth_tex_settings& depth_settings) {
+  if (!mapped.data) return false;
+  const resource_desc desc(key.width, key.height, 1, 1, (format)key.format, 1, memory_heap::gpu_to_cpu, resource_usage::copy_dest);
+  subresource_data data = {};
+  data.data = const_cast<uint8_t*>(mapped.data);
+  data.row_pitch = mapped.row_pitch;
+  data.slice_pitch = mapped.row_pitch * key.height;
+  return copy_texture_image_given_ready_resource_into_packedbuf(gamehandle, dstBuf, desc, data, tex_interp, depth_settings);
+}
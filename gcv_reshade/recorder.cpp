@@ -1,11 +1,14 @@
 #include "recorder.h"
+#include "gcv_utils/camera_data_struct.h"
+#include "gcv_utils/yuv_convert.h"
 #include <reshade.hpp>
+#include <algorithm>
 #include <cstring>
+#include <functional>
 #include <ShlObj.h>
 #include <nlohmann/json.hpp>
 #include <mutex>
 #include <sstream> 
-// #include "H5Cpp.h"
 #include <filesystem>     
 #include <Windows.h>  
 #include <dxgi1_6.h>    
@@ -98,32 +101,17 @@ namespace {
     return utf16_to_utf8(fname);
   }
 
-  static uint64_t get_dir_size_bytes(const std::string &dir_utf8) {
-    namespace fs = std::filesystem;
-    uint64_t total = 0;
+  // one stat per encoder output; everything else is counted as it is written
+  static uint64_t file_size_or_zero(const std::string &path_utf8) {
+    if (path_utf8.empty()) return 0;
     std::error_code ec;
-    fs::path root = fs::u8path(dir_utf8);
-    if (!fs::exists(root, ec)) return 0;
-    for (auto it = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied, ec);
-         it != fs::recursive_directory_iterator(); ++it) {
-      if (ec) continue;
-      if (it->is_regular_file(ec)) {
-        total += (uint64_t)fs::file_size(it->path(), ec);
-      }
-    }
-    return total;
+    const uintmax_t sz = std::filesystem::file_size(std::filesystem::u8path(path_utf8), ec);
+    return ec ? 0 : (uint64_t)sz;
   }
 } // namespace
 // ===== Meta helpers end =====
 
 
-const int SHIFT_BIT   = 0;
-const int CTRL_BIT    = 1;
-const int ALT_BIT     = 2;
-const int SPACE_BIT   = 3;
-const int ENTER_BIT   = 4;
-const int ESCAPE_BIT  = 5;
-const int TAB_BIT     = 6;
 static inline std::string join_path_slash(std::string s) {
   if (!s.empty() && s.back()!='/' && s.back()!='\\') s.push_back('/');
   return s;
@@ -136,26 +124,141 @@ static inline void ensure_dir_existsA(const std::string& dir) {
   SHCreateDirectoryExA(nullptr, d.c_str(), nullptr);  
 }
 
+// the three queues, the two last_* references, current + previous frame per writer thread
+// and one being grabbed; slots allocate lazily so unused ones cost nothing
+static size_t frame_pool_slots(size_t queue_capacity) {
+    return 3 * queue_capacity + 2 + 6 + 1;
+}
+
+// depth.gcvd frames per chunk; with delta coding every chunk starts with a keyframe
+static constexpr uint32_t kDepthChunkFrames = 8;
+
+// video frame k of depth16.mkv must be the k-th frame pushed, so duplicates are not an option there
+static QueuePolicy depth16_policy(QueuePolicy p) {
+    return p == QueuePolicy::DuplicateLast ? QueuePolicy::DropNewest : p;
+}
+
+// A segment lane must queue or reject each frame on the spot so it can count frames into
+// segments; DropOldest would evict a frame that was already counted.
+static QueuePolicy segment_policy(QueuePolicy p) {
+    return p == QueuePolicy::Block ? QueuePolicy::Block : QueuePolicy::DropNewest;
+}
+
+// Frames queued in front of a segment lane. A lane's next segment starts (N-1)*K frames after its
+// last one, so the queue only has to ride out ffmpeg starting at the head of a segment, not hold
+// a segment: 8 encoders x 240-frame segments would otherwise pin ~2000 pool slots (~24 GB at 4K).
+static constexpr size_t kSegmentLaneQueue = 8;
+
+static size_t segment_lane_capacity(const RecorderConfig& cfg) {
+    return std::min(kSegmentLaneQueue, (size_t)std::max(1, cfg.segment_frames));
+}
+
+// every lane's queue plus the frame it is writing
+static size_t segment_pool_slots(const RecorderConfig& cfg) {
+    if (cfg.segment_encoders <= 1) return 0;
+    return (size_t)cfg.segment_encoders * (segment_lane_capacity(cfg) + 1);
+}
+
+static std::string segment_file_name(uint64_t seg) {
+    char name[64];
+    _snprintf_s(name, _TRUNCATE, "capture_seg_%06llu.mp4", (unsigned long long)seg);
+    return name;
+}
+
+static const char* color_pix_fmt_name(FrameFormat f) {
+    return f == FrameFormat::BGRA ? "bgra" : (f == FrameFormat::NV12 ? "nv12" : "yuv420p");
+}
+
+// frame indices as inclusive [first, last] runs
+static void append_frame_run(std::vector<std::pair<uint64_t, uint64_t>>& runs, uint64_t idx) {
+    if (!runs.empty() && runs.back().second + 1 == idx) runs.back().second = idx;
+    else runs.emplace_back(idx, idx);
+}
+
+static Json frame_runs_json(const std::vector<std::pair<uint64_t, uint64_t>>& runs) {
+    Json a = Json::array();
+    for (const auto& r : runs) a.push_back(Json::array({ r.first, r.second }));
+    return a;
+}
+
+static bool write_frame_to_pipe(FfmpegPipe& pipe, const FrameRef& f) {
+  if (!f || !f.size() || !pipe.alive()) return true;  // nothing to do
+  return pipe.write_frame(f.data(), f.size(), f.timestamp_us());
+}
+
+namespace {
+// FrameQueue's clock for pushed_us
+int64_t steady_now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// An encoder fed from a bus topic. Spawning ffmpeg takes over 100 ms, so it happens on the sink's
+// thread for the first frame while the next ones wait in its queue. The pipe itself stays the
+// Recorder's (pipe stats and output path for meta.json, the warm encoder hand-over).
+class PipeSink : public FrameSink {
+public:
+  PipeSink(const char* name, FfmpegPipe& pipe, std::function<bool(const FrameRef&)> start, std::atomic<uint64_t>* written)
+    : name_(name), pipe_(pipe), start_(std::move(start)), written_(written) {}
+  const char* name() const override { return name_; }
+  // a timestamped encoder holds a frame until the next one's time; a repeat would only clash with it
+  bool repeats() const override { return !pipe_.timestamped(); }
+  bool open(const FrameRef& first) override {
+    if (start_(first)) return true;
+    char buf[128];
+    _snprintf_s(buf, _TRUNCATE, "[CV Capture] ffmpeg start (%s) failed; frames for it are dropped", name_);
+    reshade::log_message(reshade::log_level::error, buf);
+    return false;
+  }
+  bool consume(const FrameRef& f) override {
+    if (write_frame_to_pipe(pipe_, f)) {
+      if (written_) written_->fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    char buf[128];
+    _snprintf_s(buf, _TRUNCATE, "[CV Capture] Write %s frame failed", name_);
+    reshade::log_message(reshade::log_level::error, buf);
+    return false;
+  }
+
+private:
+  const char* name_;
+  FfmpegPipe& pipe_;
+  std::function<bool(const FrameRef&)> start_;
+  std::atomic<uint64_t>* written_;
+};
+} // namespace
+
 Recorder::Recorder(const RecorderConfig& cfg)
-    : cfg_(cfg), group_counter_(0)
+    : cfg_(cfg), pool_(frame_pool_slots(cfg.queue_capacity) + segment_pool_slots(cfg))
 {
-    InitializeCriticalSection(&depth_cs_);
-    ring_c_.resize(cap_c_);
-    ring_d_.resize(cap_d_);
-
-    // 启动 HDF5 写入线程
-    // h5_thread_ = std::thread(&Recorder::h5_write_thread, this);
+    cfg_.segment_frames = std::max(1, cfg_.segment_frames);
+    pipe_c_.set_timing(cfg_.video_timing);
+    pipe_d_.set_timing(cfg_.video_timing);
+    if (cfg_.dedup_frames && !dedup_color()) {
+        reshade::log_message(reshade::log_level::info, "[CV Capture] color repeats are stored: skipping them needs timestamped video (vfr/cfr, not segmented)");
+    }
+    bus_.set_latency(&latency_[LatencyStage::QueueWait], &latency_[LatencyStage::EncodeWrite]);
+    log_.set_write_latency(&latency_[LatencyStage::DiskWrite]);
+    depth_seq_.set_write_latency(&latency_[LatencyStage::DiskWrite]);
+    // each grabbed frame is published once; every sink of its topic gets a reference to the slot
+    if (cfg_.write_video && !segmented()) {
+        color_sink_ = bus_.add_sink(BusTopic::Color, std::make_unique<PipeSink>("color_video", pipe_c_,
+            [this](const FrameRef& f) { return open_color_pipe(f.w(), f.h(), f.format()); }, &written_),
+            cfg_.queue_capacity, cfg_.queue_policy);
+    }
+    if (cfg_.write_video) {
+        depth_sink_ = bus_.add_sink(BusTopic::Depth, std::make_unique<PipeSink>("depth_video", pipe_d_,
+            [this](const FrameRef& f) { return pipe_d_.start_gray(f.w(), f.h(), depth_fps(), cfg_.out_dir); }, nullptr),
+            cfg_.queue_capacity, cfg_.queue_policy);
+    }
+    if (cfg_.write_depth16) {
+        depth16_sink_ = bus_.add_sink(BusTopic::Depth16, std::make_unique<PipeSink>("depth16_video", pipe_d16_,
+            [this](const FrameRef& f) { return pipe_d16_.start_gray16(f.w(), f.h(), depth_fps(), cfg_.out_dir); }, nullptr),
+            cfg_.queue_capacity, depth16_policy(cfg_.queue_policy));
+    }
 }
 
 Recorder::~Recorder() {
-    // 停止 HDF5 线程
-    // h5_thread_run_ = false;
-    // h5_cv_.notify_one();
-    // if (h5_thread_.joinable()) {
-    //     h5_thread_.join();
-    // }
-
-    DeleteCriticalSection(&depth_cs_);
     stop();
 }
 
@@ -168,37 +271,18 @@ bool Recorder::start(){
   const std::string out_dir_norm = join_path_slash(cfg_.out_dir);
   ensure_dir_existsA(out_dir_norm);
 
-  // open csv
-  if (cfg_.write_csv) {
-    const std::string csv_path = out_dir_norm + "actions.csv";
-    csv_ = _fsopen(csv_path.c_str(), "w", _SH_DENYNO);
-    if (csv_) {
-      setvbuf(csv_, nullptr, _IONBF, 0);
-      // std::fprintf(csv_, "frame_idx,time_us,w,a,s,d,shift,space\n");
-      std::fprintf(csv_, "frame_idx,time_us,");
-      for (char c = 'A'; c <= 'Z'; ++c) {
-        std::fprintf(csv_, "%c,", c);
-      }
-      std::fprintf(csv_, "shift,ctrl,alt,space,enter,escape,tab\n");
-    } else {
-      // error log
-      int e = errno;
-      DWORD we = GetLastError();
-      char buf[512];
-      _snprintf_s(buf, _TRUNCATE,
-        "[CV Capture] open actions.csv failed: path=%s errno=%d winerr=%lu",
-        csv_path.c_str(), e, (unsigned long)we);
-      reshade::log_message(reshade::log_level::error, buf);
-    }
-  }
-  try {
-    cam_jsonl_.open(out_dir_norm + "cam.jsonl", std::ios::out | std::ios::trunc);
-      if (!cam_jsonl_.is_open()) {
-        reshade::log_message(reshade::log_level::error, "[CV Capture] open cam.jsonl failed");
-      }
-  } catch (...) {
-      reshade::log_message(reshade::log_level::error, "[CV Capture] exception opening cam.jsonl");
+  // actions.csv + cam.jsonl (+ trigger.csv, input.csv): formatted and flushed on the log's own thread
+  const bool log_ok = log_.open(cfg_.write_csv ? out_dir_norm + "actions.csv" : std::string(),
+                                out_dir_norm + "cam.jsonl", out_dir_norm,
+                                cfg_.write_trigger_log ? out_dir_norm + "trigger.csv" : std::string(),
+                                cfg_.write_input_log ? out_dir_norm + "input.csv" : std::string());
+  if (!log_ok) {
+    char buf[512];
+    _snprintf_s(buf, _TRUNCATE, "[CV Capture] open actions.csv/cam.jsonl failed: dir=%s errno=%d",
+      out_dir_norm.c_str(), errno);
+    reshade::log_message(reshade::log_level::error, buf);
   }
+  (void)sidecar_.open(out_dir_norm + "frames.bin", cfg_.fps);
   return true;
 }
 
@@ -206,235 +290,194 @@ void Recorder::stop(){
   if (!running_) return;
   running_ = false;
 
-  // stop thread
-  if (th_run_c_.exchange(false)) { if (th_c_.joinable()) th_c_.join(); }
-  if (th_run_d_.exchange(false)) { if (th_d_.joinable()) th_d_.join(); }
+  // stop thread: closing the queues wakes the sinks and lanes, which drain what is left and exit
+  bus_.close();
+  for (auto& l : lanes_) l->q.close();
+  for (auto& l : lanes_) if (l->th.joinable()) l->th.join();   // each lane waits for its last segment
+  if (!segments_.empty()) write_segment_index();
+
+  // stop pipe; waits for the encoders to finish their files (stop() runs on the session controller)
+  pipe_c_.stop(true);
+  pipe_d_.stop(true);
+  pipe_d16_.stop(true);
+  if (warm_c_) {   // no color frame ever came, or segmented encoding: drop its empty capture.mp4
+    const std::string warm_out = warm_c_->output_path();
+    warm_c_->stop(true);
+    warm_c_.reset();
+    std::error_code ec;
+    std::filesystem::remove(std::filesystem::u8path(warm_out), ec);
+  }
 
-  // stop pipe
-  pipe_c_.stop();
-  pipe_d_.stop();
+  // hand the slots back to the pool
+  last_color_.reset();
+  last_depth_.reset();
 
-  if (!depth_cache_.empty()) {
-      reshade::log_message(reshade::log_level::info,
-          "[CV Capture] Saving last partial depth group");
-      // save_depth_group_to_h5();  // 即使不满 5 帧也保存
-  }
-  if (csv_) { fclose(csv_); csv_ = nullptr; }
-  if (cam_jsonl_.is_open()) { cam_jsonl_.close(); }
+  // seals the last partial chunk and writes the frame index
+  depth_seq_.close();
+  live_.close();
+  log_.close();   // writes out whatever is still pending
+  sidecar_.close();
   char s[128];
   _snprintf_s(s, _TRUNCATE, "[CV Capture] frames enqueued=%llu, written=%llu",
               (unsigned long long)enqueued_.load(), (unsigned long long)written_.load());
   reshade::log_message(reshade::log_level::info, s);
 }
 
-bool Recorder::q_push(std::vector<RawFrame>& Q, std::atomic<uint32_t>& P, std::atomic<uint32_t>& C, RawFrame&& f, size_t cap){
-  uint32_t p = P.load(std::memory_order_relaxed);
-  uint32_t c = C.load(std::memory_order_acquire);
-  if ((p - c) >= cap) return false;
-  Q[p % cap] = std::move(f);
-  P.store(p+1, std::memory_order_release);
-  enqueued_.fetch_add(1, std::memory_order_relaxed);
-  return true;
+void Recorder::set_warm_color_encoder(std::unique_ptr<FfmpegPipe> pipe, int w, int h, FrameFormat fmt){
+  if (running_ || !pipe) return;
+  warm_c_ = std::move(pipe);
+  warm_w_ = w;
+  warm_h_ = h;
+  warm_fmt_ = fmt;
+  warm_offered_ = true;
 }
 
-bool Recorder::q_pop(std::vector<RawFrame>& Q, std::atomic<uint32_t>& P, std::atomic<uint32_t>& C, RawFrame& out, size_t cap){
-  uint32_t c = C.load(std::memory_order_relaxed);
-  uint32_t p = P.load(std::memory_order_acquire);
-  if (c == p) return false;
-  out = std::move(Q[c % cap]);
-  C.store(c+1, std::memory_order_release);
-  return true;
+bool Recorder::open_color_pipe(int w,int h,FrameFormat fmt){
+  if (warm_c_) {
+    if (warm_c_->alive() && warm_w_ == w && warm_h_ == h && warm_fmt_ == fmt && warm_c_->timing() == cfg_.video_timing) {
+      pipe_c_.take_over(*warm_c_);
+      warm_c_.reset();
+      warm_used_ = true;
+      return true;
+    }
+    // it writes the same capture.mp4: let it exit before the replacement opens the file
+    warm_c_->stop(true);
+    warm_c_.reset();
+  }
+  return (fmt == FrameFormat::BGRA)
+    ? pipe_c_.start_bgra(w, h, cfg_.fps, cfg_.out_dir)
+    : pipe_c_.start_yuv420(w, h, cfg_.fps, cfg_.out_dir, fmt == FrameFormat::NV12);
 }
 
-void Recorder::ensure_color_started(int w,int h){
-  if (!cfg_.write_video) return;
-  if (pipe_c_.alive()) return;
-  if (!pipe_c_.start_bgra(w, h, cfg_.fps, cfg_.out_dir)) {
-    reshade::log_message(reshade::log_level::error, "ffmpeg start failed; stop color stream");
-    return;
+bool Recorder::push_color(FrameRef&& f){
+  if (!running_) return false;
+  const uint64_t seq = color_frame_seq_.fetch_add(1, std::memory_order_relaxed);
+  bool ok = false;
+  if (f && f.w()>0 && f.h()>0) {
+    if (segmented()) ensure_segments_started(f.w(), f.h(), f.format());
+    else if (!bus_.started(color_sink_)) pipe_c_format_ = f.format();   // the encoder starts for the first frame's layout
   }
-  if (!th_run_c_.load()) {
-    th_run_c_ = true;
-    th_c_ = std::thread(&Recorder::color_loop, this);
+  if (f && !cfg_.live_stream.empty()) {
+    // before dedup: live readers get every frame, repeats included
+    live_color_bytes_ = std::max(live_color_bytes_, f.size());
+    live_.put_color(f.frame_idx(), f.data(), f.size(), f.w(), f.h(), f.stride(), (uint32_t)f.format());
   }
-}
-void Recorder::ensure_depth_started(int w,int h){
-  if (!cfg_.write_video) return;
-  if (pipe_d_.alive()) return;
-  if (!pipe_d_.start_gray(w, h, cfg_.fps, cfg_.out_dir)) {
-    reshade::log_message(reshade::log_level::error, "ffmpeg start (depth) failed");
-    return;
-  }
-  if (!th_run_d_.load()) {
-    th_run_d_ = true;
-    th_d_ = std::thread(&Recorder::depth_loop, this);
+  // the pipe's input format is fixed when ffmpeg starts; a frame in another layout would corrupt the stream
+  const ColorDropCause cause = !f ? DropNoFrame : (f.format() != pipe_c_format_ || f.w()<=0 || f.h()<=0) ? DropLayout : DropQueueFull;
+  if (cause == DropQueueFull) {
+    if (dedup_color() && color_dedup_.check(f.data(), f.size(), f.w(), f.h(), (uint32_t)f.format())) {
+      return true;   // same picture as the last stored frame; frames.bin marks the repeat
+    }
+    last_color_ = f;
+    if (segmented()) {
+      ok = push_segmented(std::move(f));
+    } else {
+      // a sink whose ffmpeg failed to start has closed its queue, so even Block does not wait
+      ok = color_sink_ >= 0 && bus_.publish(BusTopic::Color, f);
+    }
+    if (ok) enqueued_.fetch_add(1, std::memory_order_relaxed);
   }
+  color_dedup_.stored(ok);
+  if (!ok) count_color_drop(seq, cause);
+  return ok;
+}
+
+void Recorder::refuse_color(){
+  if (!running_) return;
+  count_color_drop(color_frame_seq_.fetch_add(1, std::memory_order_relaxed), DropRefused);
+}
+
+// one warning per second at most, with what was dropped since the previous one
+void Recorder::count_color_drop(uint64_t seq, ColorDropCause cause) {
+  vecDroppedColor_.push_back(seq);
+  color_dropped_.fetch_add(1, std::memory_order_relaxed);
+  ++color_drops_[cause];
+  const auto now = std::chrono::steady_clock::now();
+  if (now - color_drop_log_time_ < std::chrono::seconds(1)) return;
+  color_drop_log_time_ = now;
+  char buf[256];
+  _snprintf_s(buf, _TRUNCATE, "[CV Capture] color frames dropped up to #%llu: %llu encoder queue full or closed (%s), %llu not grabbed (no pool slot or readback), %llu in another layout than the encoder's, %llu refused by the full capture pipeline",
+    (unsigned long long)seq, (unsigned long long)(color_drops_[DropQueueFull] - color_drops_logged_[DropQueueFull]), queue_policy_name(cfg_.queue_policy),
+    (unsigned long long)(color_drops_[DropNoFrame] - color_drops_logged_[DropNoFrame]),
+    (unsigned long long)(color_drops_[DropLayout] - color_drops_logged_[DropLayout]),
+    (unsigned long long)(color_drops_[DropRefused] - color_drops_logged_[DropRefused]));
+  reshade::log_message(reshade::log_level::warning, buf);
+  color_drops_logged_ = color_drops_;
+}
+
+void Recorder::push_depth(FrameRef&& f){
+  if (!running_ || !f || f.w()<=0 || f.h()<=0) return;
+  // not deduplicated: frames.bin only marks raw depth repeats, so depth.mp4 keeps every frame pushed
+  last_depth_ = f;
+  if (depth_sink_ >= 0) (void)bus_.publish(BusTopic::Depth, f);
 }
 
 void Recorder::push_color(const uint8_t* bgra,int w,int h){
   if (!running_ || !bgra || w<=0 || h<=0) return;
-  ensure_color_started(w,h);
-
-  RawFrame f; f.w=w; f.h=h; f.stride=(size_t)w*4; f.size=f.stride*(size_t)h;
-  f.data.reset(new uint8_t[f.size]);
-  std::memcpy(f.data.get(), bgra, f.size);
-  /*(void)q_push(ring_c_, prod_c_, cons_c_, std::move(f), cap_c_);*/
-  bool ok = q_push(ring_c_, prod_c_, cons_c_, std::move(f), cap_c_);
-  uint64_t seq = color_frame_seq_.fetch_add(1, std::memory_order_relaxed);
-  if (!ok)
-  {
-      vecDroppedColor_.push_back(seq);
-      reshade::log_message(reshade::log_level::warning, ("color queue full, dropped frame #" + std::to_string(seq)).c_str());
+  const size_t stride = (size_t)w*4;
+  const FrameFormat fmt = cfg_.color_format;
+  if (fmt == FrameFormat::I420 || fmt == FrameFormat::NV12) {
+    FrameRef f = pool_.acquire(yuv420_frame_bytes(w, h));
+    if (f) {
+      f.set_geometry(w, h, (size_t)w, fmt);
+      rgb_to_yuv420(bgra, stride, YuvSrcOrder::BGRA, w, h,
+                    fmt == FrameFormat::NV12 ? YuvLayout::NV12 : YuvLayout::I420, f.data());
+    }
+    push_color(std::move(f));
+    return;
   }
-
-  last_bgra_.assign(bgra, bgra + (size_t)w*h*4);
-  lw_=w; lh_=h;
+  FrameRef f = pool_.acquire(stride*(size_t)h);
+  if (f) {
+    f.set_geometry(w, h, stride);
+    std::memcpy(f.data(), bgra, f.size());
+  }
+  push_color(std::move(f));
 }
 
 void Recorder::push_depth(const uint8_t* gray,int w,int h){
   if (!running_ || !gray || w<=0 || h<=0) return;
-  ensure_depth_started(w,h);
-
-  RawFrame f; f.w=w; f.h=h; f.stride=(size_t)w; f.size=f.stride*(size_t)h;
-  f.data.reset(new uint8_t[f.size]);
-  std::memcpy(f.data.get(), gray, f.size);
-  (void)q_push(ring_d_, prod_d_, cons_d_, std::move(f), cap_d_);
-
-  last_gray_.assign(gray, gray + (size_t)w*h);
-  dw_=w; dh_=h;
+  FrameRef f = pool_.acquire((size_t)w*(size_t)h);
+  if (!f) return;
+  f.set_geometry(w, h, (size_t)w, FrameFormat::Gray8);
+  std::memcpy(f.data(), gray, f.size());
+  push_depth(std::move(f));
 }
 
 void Recorder::push_raw_depth(const float* data, int width, int height, uint64_t frame_idx, int64_t timestamp_us){
     if (!running_ || !data || width <= 0 || height <= 0) return;
+    if (!cfg_.live_stream.empty()) {
+        live_depth_bytes_ = std::max(live_depth_bytes_, (size_t)width * (size_t)height * sizeof(float));
+        live_.put_depth(frame_idx, data, width, height);
+    }
 
-    const size_t num_pixels = (size_t)width * height;
-    std::vector<float> copy(data, data + num_pixels);
-
-    EnterCriticalSection(&depth_cs_);
-    depth_cache_.push_back({
-        std::move(copy),
-        width, height,
-        frame_idx,
-        timestamp_us
-    });
-
-    bool should_save = (depth_cache_.size() >= group_size_);
-    LeaveCriticalSection(&depth_cs_);
-
-    if (should_save) {
-        // save_depth_group_to_h5();  // 现在是异步的！
+    if (!depth_seq_.is_open()) {
+        if (!depth_seq_failed_ && !depth_seq_.open(join_path_slash(cfg_.out_dir) + "depth.gcvd", depth_fps(), kDepthChunkFrames, 2, cfg_.depth_delta))
+            depth_seq_failed_ = true;
+        if (depth_seq_failed_) {
+            raw_depth_dedup_.stored(false);   // nothing stored: no repeat run for this frame or the next
+            return;
+        }
     }
+    const size_t bytes = (size_t)width * (size_t)height * sizeof(float);
+    // a repeat is neither chunked nor quantized: depth.gcvd and depth16.mkv just skip this frame_idx
+    if (cfg_.dedup_frames && raw_depth_dedup_.check(data, bytes, width, height, 0)) return;
+    // copied into the open chunk; compression and disk I/O happen on the writer's own thread
+    raw_depth_dedup_.stored(depth_seq_.push(data, width, height, frame_idx, timestamp_us));
+    if (cfg_.write_depth16) push_depth16(data, width, height, frame_idx, timestamp_us);
 }
 
-
-// void Recorder::save_depth_group_to_h5() {
-//     if (depth_cache_.empty()) return;
-
-//     EnterCriticalSection(&depth_cs_);
-
-//     DepthGroup group;
-//     group.T = depth_cache_.size();
-//     group.H = depth_cache_[0].height;
-//     group.W = depth_cache_[0].width;
-//     group.frame_start = depth_cache_.front().frame_idx;
-//     group.frame_end = depth_cache_.back().frame_idx;
-//     group.ts_start = depth_cache_.front().timestamp_us;
-//     group.ts_end = depth_cache_.back().timestamp_us;
-//     group.group_id = group_counter_++;
-//     group.out_dir = cfg_.out_dir;
-//     group.fps = cfg_.fps;
-
-//     group.all_data.reserve(group.T * group.H * group.W);
-//     for (const auto& frame : depth_cache_) {
-//         group.all_data.insert(group.all_data.end(), frame.data.begin(), frame.data.end());
-//     }
-
-//     depth_cache_.clear();
-//     LeaveCriticalSection(&depth_cs_);
-
-//     // 放入异步队列
-//     {
-//         std::lock_guard<std::mutex> lk(h5_mutex_);
-//         h5_queue_.push(std::move(group));
-//     }
-//     h5_cv_.notify_one();
-// }
-
-
-// void Recorder::h5_write_thread() {
-//     while (h5_thread_run_.load()) {
-//         std::unique_lock<std::mutex> lk(h5_mutex_);
-//         h5_cv_.wait(lk, [this] {
-//             return !h5_queue_.empty() || !h5_thread_run_;
-//         });
-
-//         if (!h5_thread_run_ && h5_queue_.empty()) break;
-
-//         DepthGroup group = std::move(h5_queue_.front());
-//         h5_queue_.pop();
-//         lk.unlock();
-
-//         try {
-//             std::stringstream ss;
-//             ss << group.out_dir << "/depth_group_"
-//                << std::setfill('0') << std::setw(6) << group.group_id << ".h5";
-
-//             H5::H5File file(ss.str().c_str(), H5F_ACC_TRUNC);
-//             hsize_t dims[3] = {(hsize_t)group.T, (hsize_t)group.H, (hsize_t)group.W};
-//             H5::DataSpace space(3, dims);
-
-//             H5::DSetCreatPropList plist;
-            
-//             // 每帧一个 chunk，提升压缩率，服了没啥用
-//             // hsize_t chunk_dims[3] = {1, (hsize_t)group.H, (hsize_t)group.W};
-//             plist.setChunk(3, dims);
-//             plist.setDeflate(6);
-
-//             H5::DataSet dataset = file.createDataSet("/depth", H5::PredType::NATIVE_FLOAT, space, plist);
-//             dataset.write(group.all_data.data(), H5::PredType::NATIVE_FLOAT);
-
-//             auto write_attr = [&](const char* name, uint64_t value) {
-//                 H5::DataSpace attr_space(H5S_SCALAR);
-//                 H5::Attribute attr = dataset.createAttribute(name, H5::PredType::NATIVE_UINT64, attr_space);
-//                 attr.write(H5::PredType::NATIVE_UINT64, &value);
-//             };
-
-//             write_attr("frame_start_idx", group.frame_start);
-//             write_attr("frame_end_idx", group.frame_end);
-//             write_attr("timestamp_start_us", group.ts_start);
-//             write_attr("timestamp_end_us", group.ts_end);
-//             write_attr("num_frames", group.T);
-//             write_attr("fps", group.fps);
-
-//             file.close();
-
-//             char logbuf[256];
-//             _snprintf_s(logbuf, _TRUNCATE,
-//                 "[CV Capture] Saved %d depth frames to %s", group.T, ss.str().c_str());
-//             reshade::log_message(reshade::log_level::info, logbuf);
-
-//         } catch (...) {
-//             reshade::log_message(reshade::log_level::error, "[HDF5] Write failed in thread");
-//         }
-//     }
-// }
-
-
-
 void Recorder::duplicate(int n){
   if (n<=0) return;
+  const bool timed = cfg_.video_timing != VideoTiming::WallClock;
   for (int i=0;i<n;++i){
-    if (pipe_c_.alive() && lw_>0 && lh_>0){
-      RawFrame f; f.w=lw_; f.h=lh_; f.stride=(size_t)lw_*4; f.size=f.stride*(size_t)lh_;
-      f.data.reset(new uint8_t[f.size]);
-      std::memcpy(f.data.get(), last_bgra_.data(), f.size);
-      (void)q_push(ring_c_, prod_c_, cons_c_, std::move(f), cap_c_);
+    // each duplicate is one more reference to the last slot, not a copy
+    if (segmented() && last_color_){
+      if (push_segmented(FrameRef(last_color_))) enqueued_.fetch_add(1, std::memory_order_relaxed);
+    } else if (!timed && bus_.started(color_sink_) && last_color_){
+      if (bus_.publish(BusTopic::Color, last_color_)) enqueued_.fetch_add(1, std::memory_order_relaxed);
     }
-    if (pipe_d_.alive() && dw_>0 && dh_>0){
-      RawFrame f; f.w=dw_; f.h=dh_; f.stride=(size_t)dw_; f.size=f.stride*(size_t)dh_;
-      f.data.reset(new uint8_t[f.size]);
-      std::memcpy(f.data.get(), last_gray_.data(), f.size);
-      (void)q_push(ring_d_, prod_d_, cons_d_, std::move(f), cap_d_);
+    if (!timed && bus_.started(depth_sink_) && last_depth_){
+      (void)bus_.publish(BusTopic::Depth, last_depth_);
     }
   }
 }
@@ -442,108 +485,228 @@ void Recorder::duplicate(int n){
 void Recorder::log_action(uint64_t idx, int64_t t_us,
                           uint32_t letters_mask, uint32_t modifiers_mask)
 {
-    if (!csv_) return;
-
-    // 写入 CSV 头部信息（仅一次）
-    // static bool header_written = false;
-    // if (!header_written) {
-    //     fprintf(csv_, "frame_idx,time_us,");
-    //     for (char c = 'A'; c <= 'Z'; ++c) {
-    //         fprintf(csv_, "%c,", c);
-    //     }
-    //     fprintf(csv_, "shift,ctrl,alt,space,enter,escape,tab\n");
-    //     header_written = true;
-    // }
-
-    // 输出 frame_idx 和 time_us
-    std::fprintf(csv_, "%llu,%lld,", (unsigned long long)idx, (long long)t_us);
-
-    // 输出 A-Z 状态
-    for (int i = 0; i < 26; ++i) {
-        std::fprintf(csv_, "%d,", ((letters_mask >> i) & 1) ? 1 : 0);
-    }
-
-    // 输出修饰键
-    auto b = [&](unsigned bit) { return (modifiers_mask & (1u << bit)) ? 1 : 0; };
-    std::fprintf(csv_, "%d,%d,%d,%d,%d,%d,%d\n",
-        b(SHIFT_BIT),  b(CTRL_BIT),   b(ALT_BIT),
-        b(SPACE_BIT),  b(ENTER_BIT),  b(ESCAPE_BIT), b(TAB_BIT));
-
-    fflush(csv_); // 确保实时写入
-}
-
-void Recorder::color_loop(){
-  RawFrame f;
-  while (th_run_c_.load(std::memory_order_acquire) || prod_c_.load(std::memory_order_acquire) != cons_c_.load(std::memory_order_acquire)){
-    if (!q_pop(ring_c_, prod_c_, cons_c_, f, cap_c_)) { Sleep(1); continue; }
-    if (f.data && f.size && pipe_c_.alive() && pipe_c_.hWrite()){
-      if (!pipe_c_.write(f.data.get(), f.size)) {
-        reshade::log_message(reshade::log_level::error, "[CV Capture] Write color frame failed");
-        th_run_c_.store(false, std::memory_order_release); break;
-      } else {
-        written_.fetch_add(1, std::memory_order_relaxed);
-      }
+    if (!running_) return;
+    ActionRecord r;
+    r.frame_idx = idx;
+    r.time_us = t_us;
+    r.letters_mask = letters_mask;
+    r.modifiers_mask = modifiers_mask;
+    log_.log_action(r);
+}
+
+void Recorder::ensure_segments_started(int w,int h,FrameFormat fmt){
+  if (!cfg_.write_video || !lanes_.empty()) return;
+  pipe_c_format_ = fmt;
+  const QueuePolicy policy = segment_policy(cfg_.queue_policy);
+  for (int i = 0; i < cfg_.segment_encoders; ++i) {
+    lanes_.push_back(std::make_unique<SegmentLane>(segment_lane_capacity(cfg_), policy));
+  }
+  for (size_t i = 0; i < lanes_.size(); ++i) {
+    lanes_[i]->th = std::thread(&Recorder::segment_lane_loop, this, i, w, h, fmt);
+  }
+}
+
+// Render thread. Video frame v goes to segment v / K; a frame the lane cannot take is dropped
+// before it is counted, so every segment but the last has exactly K frames.
+bool Recorder::push_segmented(FrameRef&& f){
+  if (lanes_.empty()) return false;
+  const uint64_t K = (uint64_t)cfg_.segment_frames;
+  const uint64_t seg = seg_video_frames_ / K;
+  const size_t lane = (size_t)(seg % lanes_.size());
+  const uint64_t idx = f.frame_idx();
+  if (!lanes_[lane]->q.push(std::move(f))) return false;
+  if (segments_.empty() || segments_.back().index != seg) {
+    SegmentInfo s;
+    s.index = seg;
+    s.lane = (uint32_t)lane;
+    segments_.push_back(std::move(s));
+  }
+  SegmentInfo& s = segments_.back();
+  ++s.frames;
+  append_frame_run(s.frame_ranges, idx);
+  ++seg_video_frames_;
+  return true;
+}
+
+// Lane i receives segments i, i+N, i+2N, ... back to back, K frames each. One ffmpeg per segment;
+// it is waited for before the next one starts, so at most N encoders run at once.
+void Recorder::segment_lane_loop(size_t lane, int w, int h, FrameFormat fmt){
+  SegmentLane& L = *lanes_[lane];
+  const uint64_t K = (uint64_t)cfg_.segment_frames;
+  const uint64_t N = (uint64_t)lanes_.size();
+  const char* pix_fmt = color_pix_fmt_name(fmt);
+  uint64_t received = 0, seg = 0;
+  bool ok = false;
+  FrameRef f;
+  uint32_t repeat = 0;   // always 0: lanes never use DuplicateLast
+  int64_t pushed_us = 0;
+  auto fail = [this, &seg, &ok, &L](const char* what) {
+    if (!ok) return;
+    ok = false;
+    L.pipe.stop();
+    char buf[128];
+    _snprintf_s(buf, _TRUNCATE, "[CV Capture] segment %llu: %s", (unsigned long long)seg, what);
+    reshade::log_message(reshade::log_level::error, buf);
+    std::lock_guard<std::mutex> lk(seg_failed_mtx_);
+    seg_failed_.push_back(seg);
+  };
+  while (L.q.pop(f, repeat, &pushed_us)) {
+    latency_[LatencyStage::QueueWait].record_ns((uint64_t)std::max<int64_t>(0, steady_now_us() - pushed_us) * 1000);
+    if (received % K == 0) {
+      seg = (received / K) * N + lane;
+      ok = L.pipe.start_segment(w, h, cfg_.fps, cfg_.out_dir, segment_file_name(seg), pix_fmt, (int)K);
+      if (!ok) { ok = true; fail("ffmpeg start failed"); }
     }
-    f = {};
+    // a failed segment still consumes its frames, the following ones stay aligned
+    if (ok) {
+      LatencyScope timed(&latency_[LatencyStage::EncodeWrite]);
+      if (write_frame_to_pipe(L.pipe, f)) written_.fetch_add(1, std::memory_order_relaxed);
+      else fail("write failed");
+    }
+    f.reset();
+    if (++received % K == 0 && ok) L.pipe.stop(true);
   }
+  L.pipe.stop(true);   // last, partial segment
 }
 
-void Recorder::depth_loop(){
-  RawFrame f;
-  while (th_run_d_.load(std::memory_order_acquire)|| prod_d_.load(std::memory_order_acquire) != cons_d_.load(std::memory_order_acquire)){
-    if (!q_pop(ring_d_, prod_d_, cons_d_, f, cap_d_)) { Sleep(1); continue; }
-    if (f.data && f.size && pipe_d_.alive() && pipe_d_.hWrite()){
-      if (!pipe_d_.write(f.data.get(), f.size)) {
-        reshade::log_message(reshade::log_level::error, "[CV Capture] Write depth frame failed");
-        th_run_d_.store(false, std::memory_order_release); break;
-      }
+// segments.json: where every recorder frame index ended up; capture_segments.ffconcat: the
+// successful segments in order (ffmpeg -f concat -safe 0 -i capture_segments.ffconcat -c copy capture.mp4)
+void Recorder::write_segment_index(){
+  const std::string out_dir_norm = join_path_slash(cfg_.out_dir);
+  std::vector<uint64_t> failed;
+  {
+    std::lock_guard<std::mutex> lk(seg_failed_mtx_);
+    failed = seg_failed_;
+  }
+  std::sort(failed.begin(), failed.end());
+  Json segs = Json::array();
+  std::string concat = "ffconcat version 1.0\n";
+  uint64_t concat_offset = 0;
+  for (const SegmentInfo& s : segments_) {
+    const bool ok = !std::binary_search(failed.begin(), failed.end(), s.index);
+    Json js;
+    js["index"]              = s.index;
+    js["file"]               = segment_file_name(s.index);
+    js["lane"]               = s.lane;
+    js["frames"]             = s.frames;
+    js["video_frame_offset"] = s.index * (uint64_t)cfg_.segment_frames;
+    js["frame_ranges"]       = frame_runs_json(s.frame_ranges);   // local frame k is the k-th index covered
+    js["ok"]                 = ok;
+    if (ok) {
+      js["concat_frame_offset"] = concat_offset;
+      concat_offset += s.frames;
+      char buf[128];
+      _snprintf_s(buf, _TRUNCATE, "file '%s'\nduration %.6f\n", segment_file_name(s.index).c_str(),
+                  (double)s.frames / (double)std::max(1, cfg_.fps));
+      concat += buf;
     }
-    f = {};
+    segs.push_back(js);
+  }
+  Json j;
+  j["version"]        = 1;
+  j["fps"]            = cfg_.fps;
+  j["segment_frames"] = cfg_.segment_frames;
+  j["encoders"]       = cfg_.segment_encoders;
+  j["input_pix_fmt"]  = color_pix_fmt_name(pipe_c_format_);
+  j["video_frames"]   = seg_video_frames_;
+  j["concat"]         = "capture_segments.ffconcat";
+  j["segments"]       = segs;
+  try {
+    std::ofstream ofs(out_dir_norm + "segments.json", std::ios::binary);
+    if (ofs) ofs << j.dump(2);
+    std::ofstream ofc(out_dir_norm + "capture_segments.ffconcat", std::ios::binary);
+    if (ofc) ofc << concat;
+    if (!ofs || !ofc) reshade::log_message(reshade::log_level::error, "[CV Capture] write segments.json / capture_segments.ffconcat failed");
+  } catch (...) {
+    reshade::log_message(reshade::log_level::error, "[CV Capture] write segment index exception");
   }
 }
 
-// write to cam.jsonl
-void Recorder::log_camera_json(uint64_t idx, long long t_us,
-                               const Json& cam_json,
-                               int img_w, int img_h)
+// write to cam.jsonl (and, in F9 mode, frame_XXXXXX_camera.json)
+void Recorder::log_camera(uint64_t idx, int64_t t_us, const CamMatrixData* cam, const std::string& cam_err,
+                          int img_w, int img_h)
 {
   if (!running_) return;
 
-  try {
-    Json j = cam_json;       
-    j["frame_idx"] = idx;
-    j["time_us"]   = t_us;
-    j["img_w"]     = img_w;
-    j["img_h"]     = img_h;
+  CameraRecord r{};
+  r.frame_idx = idx;
+  r.time_us = t_us;
+  r.img_w = img_w;
+  r.img_h = img_h;
+  if (cam) {
+    r.status = (cam->extrinsic_status == CamMatrix_AllGood) ? CameraRecord::Good : CameraRecord::WIP;
+    const std::array<ftype, 12> m = cam_matrix_to_flattened_row_major_array(cam->extrinsic_cam2world);
+    for (int i = 0; i < 12; ++i) r.extrinsic[i] = (double)m[i];
+    r.has_fov_v = cam->fov_v_degrees > ftype(0.0);
+    r.has_fov_h = cam->fov_h_degrees > ftype(0.0);
+    r.fov_v = (double)cam->fov_v_degrees;
+    r.fov_h = (double)cam->fov_h_degrees;
+  } else {
+    r.status = CameraRecord::Uninitialized;
+    _snprintf_s(r.err, _TRUNCATE, "%s", cam_err.c_str());
+  }
+  log_.log_camera(r, /*per_frame_file=*/cfg_.write_camera_json_files);
+}
 
-    if (cam_jsonl_.is_open()) {
-      cam_jsonl_ << j.dump() << '\n';
-      cam_jsonl_.flush();
-    }
+void Recorder::log_trigger(const TriggerRecord& r)
+{
+  if (!running_) return;
+  log_.log_trigger(r);
+}
 
-    // 每帧写一份 camera.json
-    if (meta_mode_ == 1)
-    {
-        const std::string out_dir_norm = join_path_slash(cfg_.out_dir);
-        char namebuf[128];
-        _snprintf_s(namebuf, _TRUNCATE, "frame_%06llu_camera.json",
-            (unsigned long long)idx);
-        const std::string per_frame_path = out_dir_norm + namebuf;
-
-        std::ofstream jf(per_frame_path, std::ios::out | std::ios::trunc);
-        if (jf.is_open() && jf.good()) {
-            jf << j.dump() << std::endl;
-            jf.close();
-        }
-        else {
-            reshade::log_message(reshade::log_level::warning,
-                "[CV Capture] failed to write per-frame camera.json");
-        }
-    }
-  } catch (...) {
-    reshade::log_message(reshade::log_level::error,
-      "[CV Capture] exception writing camera json");
+void Recorder::log_input(const InputRecord& r)
+{
+  if (!running_) return;
+  log_.log_input(r);
+}
+
+void Recorder::log_frame(const GcvFrameRecord& r)
+{
+  if (!running_) return;
+  (void)sidecar_.append(r);
+  if (cfg_.live_stream.empty() || live_failed_) return;
+  if (!live_.is_open()) {
+    // the first frame only sizes the slots; readers see the stream from the next one on
+    live_failed_ = !live_.open(cfg_.live_stream, cfg_.live_stream_slots, live_color_bytes_, live_depth_bytes_, cfg_.fps);
+    return;
   }
+  live_.commit(r);
+}
+
+void Recorder::attach_image_counter(const SinkCounter* c) {
+  images_ = c;
+  images_bytes0_ = c ? c->bytes.load(std::memory_order_relaxed) : 0;
+  images_files0_ = c ? c->files.load(std::memory_order_relaxed) : 0;
+}
+
+std::array<Recorder::VideoSink, 3> Recorder::video_sinks() const {
+  // the writer threads set output_path(); it is only read here once they are gone
+  auto started = [this](int sink, const FfmpegPipe& p) { return bus_.started(sink) || !p.output_path().empty(); };
+  return {{ { "color_video", &pipe_c_, started(color_sink_, pipe_c_) },
+            { "depth_video", &pipe_d_, started(depth_sink_, pipe_d_) },
+            { "depth16_video", &pipe_d16_, started(depth16_sink_, pipe_d16_) } }};
+}
+
+std::vector<SinkStats> Recorder::sink_stats() const {
+  std::vector<SinkStats> out;
+  for (const VideoSink& v : video_sinks()) {
+    if (v.started) out.push_back({ v.name, v.pipe->stats().bytes, 1 });
+  }
+  if (!lanes_.empty()) {
+    uint64_t b = 0;
+    for (const auto& l : lanes_) b += l->pipe.stats().bytes;   // pipe counters run across segments
+    out.push_back({ "color_segments", b, (seg_video_frames_ + cfg_.segment_frames - 1) / cfg_.segment_frames });
+  }
+  const uint64_t gcvd = depth_seq_.stats().file_bytes;
+  if (gcvd) out.push_back({ "depth_gcvd", gcvd, 1 });
+  const SessionLogStats ls = log_.stats();
+  out.push_back({ "session_log", ls.bytes, ls.files });
+  if (sidecar_.file_bytes()) out.push_back({ "frames_bin", sidecar_.file_bytes(), 1 });
+  if (images_) {
+    out.push_back({ "images", images_->bytes.load(std::memory_order_relaxed) - images_bytes0_,
+                    images_->files.load(std::memory_order_relaxed) - images_files0_ });
+  }
+  return out;
 }
 
 void Recorder::init_session_meta(const std::string& game_name, int recording_mode, const Json& game_settings) {
@@ -562,6 +725,23 @@ void Recorder::init_session_meta(const std::string& game_name, int recording_mod
     meta_gpu_ = get_gpu_name_dxgi();
 }
 
+void Recorder::push_depth16(const float* data, int w, int h, uint64_t frame_idx, int64_t timestamp_us){
+    if (!cfg_.depth16.valid()) return;
+    ++depth16_pushed_;
+    bool ok = false;
+    if (depth16_sink_ >= 0 && !bus_.failed(depth16_sink_)) {
+        FrameRef f = pool_.acquire((size_t)w * (size_t)h * sizeof(uint16_t));
+        if (f) {
+            f.set_geometry(w, h, (size_t)w * sizeof(uint16_t), FrameFormat::Gray16);
+            f.set_stamp(frame_idx, timestamp_us);
+            quantize_depth16(data, (size_t)w * (size_t)h, cfg_.depth16, reinterpret_cast<uint16_t*>(f.data()));
+            ok = bus_.publish(BusTopic::Depth16, f);
+        }
+    }
+    if (!ok) { ++depth16_dropped_; return; }
+    append_frame_run(depth16_ranges_, frame_idx);
+}
+
 void Recorder::finalize_and_write_meta_json(std::vector<uint64_t>& vecDroppedcamJson_) {
     if (!meta_initialized_) {
         reshade::log_message(reshade::log_level::warning, "[CV Capture] meta not initialized, skip writing meta.json");
@@ -571,7 +751,33 @@ void Recorder::finalize_and_write_meta_json(std::vector<uint64_t>& vecDroppedcam
     const auto t1 = std::chrono::steady_clock::now();
     const double duration_sec = std::chrono::duration<double>(t1 - meta_t0_).count();
     const std::string out_dir_norm = join_path_slash(cfg_.out_dir);
-    const uint64_t size_bytes = get_dir_size_bytes(out_dir_norm);
+    // sum of the sink counters instead of a directory walk; only the encoders' compressed output
+    // needs the file system (one stat per video)
+    uint64_t size_bytes = 0;
+    Json sinks = Json::object();
+    for (const SinkStats& s : sink_stats()) {
+        Json js;
+        js["bytes"] = s.bytes;
+        js["files"] = s.files;
+        sinks[s.name] = js;
+        size_bytes += s.bytes;
+    }
+    for (const VideoSink& v : video_sinks()) {
+        if (!sinks.contains(v.name)) continue;
+        const uint64_t pipe_bytes = sinks[v.name]["bytes"].get<uint64_t>();
+        const uint64_t on_disk = file_size_or_zero(v.pipe->output_path());
+        sinks[v.name]["pipe_bytes"] = pipe_bytes;
+        sinks[v.name]["bytes"] = on_disk;
+        size_bytes = size_bytes - pipe_bytes + on_disk;
+    }
+    if (sinks.contains("color_segments")) {
+        const uint64_t pipe_bytes = sinks["color_segments"]["bytes"].get<uint64_t>();
+        uint64_t on_disk = 0;
+        for (const SegmentInfo& s : segments_) on_disk += file_size_or_zero(out_dir_norm + segment_file_name(s.index));
+        sinks["color_segments"]["pipe_bytes"] = pipe_bytes;
+        sinks["color_segments"]["bytes"] = on_disk;
+        size_bytes = size_bytes - pipe_bytes + on_disk;
+    }
     const double bitrate_bps = (duration_sec > 0.0) ? (double(size_bytes) * 8.0 / duration_sec) : 0.0;
 
     Json j;
@@ -587,13 +793,40 @@ void Recorder::finalize_and_write_meta_json(std::vector<uint64_t>& vecDroppedcam
     if (!meta_game_settings_.is_null()) j["game_settings"] = meta_game_settings_;
 
     Json rec;
-    rec["mode"]          = (meta_mode_ == 1 ? "F9" : (meta_mode_ == 2 ? "F7" : ""));
+    rec["mode"]          = !cfg_.profile_name.empty() ? cfg_.profile_name : (meta_mode_ == 1 ? "F9" : (meta_mode_ == 2 ? "F7" : ""));
     rec["fps"]           = meta_fps_;
     rec["duration_sec"]  = duration_sec;
     rec["size_bytes"]    = size_bytes;
     rec["bitrate_bps"]   = bitrate_bps;
     rec["dir"]           = out_dir_norm;
     j["recording"] = rec;
+    j["sinks"] = sinks;
+
+    Json js;
+    js["start_latency_ms"]       = timing_.start_latency_ms;
+    js["start_render_thread_ms"] = timing_.start_render_thread_ms;
+    js["stop_latency_ms"]        = timing_.stop_latency_ms;
+    js["stop_render_thread_ms"]  = timing_.stop_render_thread_ms;
+    js["warm_encoder_offered"]   = warm_offered_;
+    js["warm_encoder_used"]      = warm_used_;
+    j["session"] = js;
+
+    if (!cfg_.profile.is_null()) {
+        Json jp = cfg_.profile;
+        if (!schedule_stats_.is_null()) jp["schedule"] = schedule_stats_;
+        j["capture_profile"] = jp;
+    }
+
+    if (!cfg_.live_stream.empty()) {
+        const LiveStreamStats ls = live_.stats();
+        Json jl;
+        jl["name"]      = cfg_.live_stream;
+        jl["slots"]     = cfg_.live_stream_slots;
+        jl["published"] = ls.published;
+        jl["oversize"]  = ls.oversize;
+        jl["failed"]    = live_failed_;
+        j["live_stream"] = jl;
+    }
 
     Json droppedcolor;
     if (!vecDroppedColor_.empty())
@@ -606,9 +839,161 @@ void Recorder::finalize_and_write_meta_json(std::vector<uint64_t>& vecDroppedcam
         }
         droppedcolor["color_size"] = vecDroppedColor_.size();
         droppedcolor["color_idx"] = vecColor;
+        droppedcolor["queue_full"] = color_drops_[DropQueueFull];
+        droppedcolor["not_grabbed"] = color_drops_[DropNoFrame];
+        droppedcolor["other_layout"] = color_drops_[DropLayout];
+        droppedcolor["refused"] = color_drops_[DropRefused];
         j["droppedcolor"] = droppedcolor;
     }
 
+    auto stats_json = [](const FrameQueueStats& st, size_t capacity, QueuePolicy policy, const FfmpegPipe& pipe) {
+        Json jq;
+        jq["capacity"]       = capacity;
+        jq["policy"]         = queue_policy_name(policy);
+        jq["pushed"]         = st.pushed;
+        jq["popped"]         = st.popped;
+        jq["dropped"]        = st.dropped;
+        jq["duplicated"]     = st.duplicated;
+        jq["producer_waits"] = st.producer_waits;
+        jq["consumer_waits"] = st.consumer_waits;
+        jq["max_depth"]      = st.max_depth;
+        jq["wait_mean_ms"]   = st.popped ? (double)st.wait_us_sum / (double)st.popped / 1000.0 : 0.0;
+        jq["wait_max_ms"]    = (double)st.wait_us_max / 1000.0;
+        const PipeWriteStats ps = pipe.stats();
+        jq["pipe_bytes"]     = ps.bytes;
+        jq["pipe_stalls"]    = ps.stalls;
+        jq["pipe_stall_us"]  = ps.stall_us;
+        if (pipe.timestamped() || ps.last_pts_us >= 0) {
+            jq["pts_fixups"]  = ps.pts_fixups;
+            jq["pts_last_ms"] = (double)ps.last_pts_us / 1000.0;   // time of the last frame in the video
+        }
+        return jq;
+    };
+    auto queue_json = [&](const FrameQueue& q, const FfmpegPipe& pipe) {
+        return stats_json(q.stats(), q.capacity(), q.policy(), pipe);
+    };
+    // a frame bus sink: its queue, plus frames written and publish -> written lag
+    auto sink_json = [&](int sink, const FfmpegPipe& pipe) {
+        const FrameBusSinkStats bs = bus_.stats(sink);
+        Json jq = stats_json(bs.queue, bs.capacity, bs.policy, pipe);
+        jq["consumed"]    = bs.consumed;
+        jq["lag_mean_ms"] = bs.lag_mean_ms;
+        jq["lag_max_ms"]  = bs.lag_max_ms;
+        if (bs.failed) jq["failed"] = true;
+        return jq;
+    };
+    Json queues;
+    if (color_sink_ >= 0) queues["color"] = sink_json(color_sink_, pipe_c_);
+    queues["color"]["input_pix_fmt"] = color_pix_fmt_name(pipe_c_format_);
+    if (pipe_c_format_ != FrameFormat::BGRA) queues["color"]["yuv_kernel"] = yuv_simd_name(yuv_simd_detect());
+    if (depth_sink_ >= 0) queues["depth"] = sink_json(depth_sink_, pipe_d_);
+    if (depth16_pushed_ > 0 && depth16_sink_ >= 0) queues["depth16"] = sink_json(depth16_sink_, pipe_d16_);
+    // vfr: video frame k is the k-th frame written, at its capture time less the first one's (frames.bin);
+    // cfr: resampled to fps by ffmpeg; wallclock: frame k at k / fps
+    queues["video_timing"] = video_timing_name(cfg_.video_timing);
+    queues["pool_slots"] = pool_.num_slots();
+    queues["pool_exhausted"] = pool_.exhausted_count();
+    j["queues"] = queues;
+
+    // where a frame's time goes, per stage over the whole recording
+    Json jlat;
+    for (int i = 0; i < kLatencyStages; ++i) {
+        const LatencySummary ls = latency_.stage[i].summary();
+        if (ls.count == 0) continue;
+        Json jst;
+        jst["count"]   = ls.count;
+        jst["mean_ms"] = ls.mean_ms;
+        jst["p50_ms"]  = ls.p50_ms;
+        jst["p95_ms"]  = ls.p95_ms;
+        jst["p99_ms"]  = ls.p99_ms;
+        jst["max_ms"]  = ls.max_ms;
+        jlat[latency_stage_name((LatencyStage)i)] = jst;
+    }
+    if (!jlat.is_null()) j["latency"] = jlat;
+
+    const DepthChunkWriterStats ds = depth_seq_.stats();
+    if (ds.frames_written || ds.frames_dropped) {
+        Json jd;
+        jd["file"]           = "depth.gcvd";
+        jd["fps"]            = depth_fps();
+        jd["codec"]          = depth_seq_.delta() ? "key+delta, shuffle, lz4" : "lz4";
+        jd["chunk_frames"]   = kDepthChunkFrames;   // also the keyframe interval
+        jd["frames_written"] = ds.frames_written;
+        jd["frames_dropped"] = ds.frames_dropped;
+        jd["chunks"]         = ds.chunks_written;
+        jd["raw_bytes"]      = ds.raw_bytes;
+        jd["stored_bytes"]   = ds.stored_bytes;
+        j["depth_seq"] = jd;
+    }
+
+    const SessionLogStats ls = log_.stats();
+    Json jl;
+    jl["records"]     = ls.records;
+    jl["dropped"]     = ls.dropped;
+    jl["bytes"]       = ls.bytes;
+    jl["flushes"]     = ls.flushes;
+    jl["max_pending"] = ls.max_pending;
+    j["session_log"] = jl;
+
+    if (sidecar_.num_records() > 0) {
+        // python_threedee/gcv_frames.py loads it and converts back to cam.jsonl / actions.csv
+        Json jf;
+        jf["file"]         = "frames.bin";
+        jf["version"]      = 1;
+        jf["record_bytes"] = sizeof(GcvFrameRecord);
+        jf["records"]      = sidecar_.num_records();
+        j["frames_sidecar"] = jf;
+    }
+
+    if (cfg_.dedup_frames) {
+        // repeated frames are flagged per frame in frames.bin (GCVF_COLOR_REPEAT / GCVF_DEPTH_REPEAT)
+        Json jr;
+        jr["hash"]                = "xxh3_64";
+        jr["color_repeats"]       = color_dedup_.repeats();
+        jr["color_longest_run"]   = color_dedup_.longest_run();
+        jr["depth_repeats"]       = raw_depth_dedup_.repeats();
+        jr["depth_longest_run"]   = raw_depth_dedup_.longest_run();
+        j["dedup"] = jr;
+    }
+
+    if (!lanes_.empty()) {
+        // per-segment frame ranges are in segments.json; python_threedee/gcv_segments.py reads it
+        size_t failed = 0;
+        {
+            std::lock_guard<std::mutex> lk(seg_failed_mtx_);
+            failed = seg_failed_.size();
+        }
+        Json jsg;
+        jsg["index"]          = "segments.json";
+        jsg["concat"]         = "capture_segments.ffconcat";
+        jsg["encoders"]       = cfg_.segment_encoders;
+        jsg["segment_frames"] = cfg_.segment_frames;
+        jsg["segments"]       = segments_.size();
+        jsg["failed"]         = failed;
+        jsg["video_frames"]   = seg_video_frames_;
+        Json lanes = Json::array();
+        for (const auto& l : lanes_) lanes.push_back(queue_json(l->q, l->pipe));
+        jsg["lanes"] = lanes;
+        j["segments"] = jsg;
+    }
+
+    if (depth16_pushed_ > 0) {
+        // decoding: python_threedee/gcv_depth16.py
+        Json jd;
+        jd["file"]            = "depth16.mkv";
+        jd["fps"]             = depth_fps();
+        jd["codec"]           = "ffv1";
+        jd["pix_fmt"]         = "gray16le";
+        jd["curve"]           = depth_curve_name(cfg_.depth16.curve);
+        jd["near"]            = cfg_.depth16.near_z;
+        jd["far"]             = cfg_.depth16.far_z;
+        jd["code_max"]        = kDepth16CodeMax;
+        jd["frames_pushed"]   = depth16_pushed_;
+        jd["frames_dropped"]  = depth16_dropped_;
+        jd["frame_ranges"]    = frame_runs_json(depth16_ranges_);   // video frame k is the k-th index covered by these runs
+        j["depth16"] = jd;
+    }
+
     Json droppedcamJson;
     if (!vecDroppedcamJson_.empty()) {
         std::string vecJson = std::to_string(vecDroppedcamJson_[0]);
@@ -5,12 +5,25 @@
 #include <thread>
 #include <atomic>
 #include <vector>
+#include <array>
 #include <memory> 
 #include <string>
 #include <mutex>
 #include <queue>              
 #include <condition_variable> 
-#include "ffmpeg_pipe_win.h"
+#include "ffmpeg_pipe.h"
+#include "frame_pool.h"
+#include "frame_queue.h"
+#include "frame_bus.h"
+#include "depth_chunk_writer.h"
+#include "depth_quant.h"
+#include "session_log.h"
+#include "frame_sidecar.h"
+#include "sink_counter.h"
+#include "frame_dedup.h"
+#include "live_stream.h"
+#include "latency_histogram.h"
+#include "capture_stages.h"
 #include <fstream>
 // #include <nlohmann/json_fwd.hpp>
 #include <nlohmann/json.hpp>
@@ -19,15 +32,12 @@
 using Json = nlohmann::json_abi_v3_12_0::json;
 
 // 前向声明
-struct DepthFrame;
 class Recorder;
+struct CamMatrixData;
 
 // 数据结构
-struct RawFrame {
-    std::unique_ptr<uint8_t[]> data;
-    size_t size = 0, stride = 0;
-    int w = 0, h = 0;
-};
+// queued frames are references into the recorder's FramePool (see frame_pool.h)
+using RawFrame = FrameRef;
 using RawFrameGray = RawFrame;
 
 struct RecorderConfig {
@@ -35,27 +45,35 @@ struct RecorderConfig {
     std::string out_dir;      
     bool write_video = true;  
     bool write_csv = true;    
+    size_t queue_capacity = 8;                           // frames buffered per stream before the policy applies
+    QueuePolicy queue_policy = QueuePolicy::DropNewest;
+    FrameFormat color_format = FrameFormat::I420;        // what the color pipe takes: BGRA, I420 or NV12
+    bool write_depth16 = true;                           // raw depth also goes to depth16.mkv (FFV1 gray16le)
+    Depth16Params depth16;                               // quantization curve for depth16.mkv
+    bool write_camera_json_files = false;                // frame_XXXXXX_camera.json too (frames.bin has the same data)
+    int segment_encoders = 1;                            // >1: color goes to GOP-aligned segments rotated over this many ffmpeg processes
+    int segment_frames = 48;                             // frames per segment (one GOP each)
+    bool depth_delta = true;                             // depth.gcvd: keyframe + delta coding per chunk instead of plain LZ4
+    bool dedup_frames = false;                           // identical consecutive color/raw depth frames are not stored again (frames.bin keeps the runs)
+    std::string live_stream;                             // non-empty: every frame is also published to shared memory gcv_live_<name> (live_stream.h)
+    int live_stream_slots = 4;                           // frames a slow reader can lag behind before it misses some
+    int depth_fps = 0;                                   // rate of the depth streams (depth.gcvd, depth16.mkv, depth.mp4); 0: fps
+    std::string profile_name;                            // capture profile (capture_profile.h), saved in meta.json
+    Json profile;
+    bool write_trigger_log = false;                      // trigger.csv: the motion trigger's captures and their reasons
+    bool write_input_log = false;                        // input.csv: mouse and gamepad state per frame (input sampler)
+    VideoTiming video_timing = VideoTiming::Vfr;         // capture.mp4/depth.mp4: frames carry their capture times (not segments, depth16.mkv)
 };
 
-struct DepthFrame {  
-    std::vector<float> data;
-    int width, height;
-    uint64_t frame_idx;
-    int64_t timestamp_us;
-};
-
-// 异步写入的数据块
-struct DepthGroup {
-    std::vector<float> all_data;
-    int T, H, W;
-    uint64_t group_id;
-    uint64_t frame_start, frame_end;
-    int64_t ts_start, ts_end;
-    std::string out_dir;
-    int fps;
+// Filled in by the session controller (session_controller.h), saved under "session" in meta.json
+struct SessionTiming {
+    double start_latency_ms = 0.0;         // start key -> recorder ready (files open, meta collected)
+    double start_render_thread_ms = 0.0;   // part of that spent on the render thread
+    double stop_latency_ms = 0.0;          // stop key -> writers drained, encoders and files closed
+    double stop_render_thread_ms = 0.0;
 };
 
-class Recorder {
+class Recorder : public CaptureOutput {
 public:
     explicit Recorder(const RecorderConfig& cfg);
     ~Recorder();
@@ -64,70 +82,143 @@ public:
     void stop();
     bool running() const { return running_; }
 
-    void push_color(const uint8_t* bgra, int w, int h);
+    // Grabbers convert straight into slots of this pool; pass the result to push_color/push_depth.
+    FramePool& frame_pool() override { return pool_; }
+    // Layout the color grab should produce (fixed for the whole recording)
+    FrameFormat color_format() const { return cfg_.color_format; }
+
+    bool push_color(FrameRef&& frame) override;   // false if dropped; an empty frame (pool exhausted) counts as dropped
+    void refuse_color() override;                  // counted apart from encoder drops (meta.json droppedcolor.refused)
+    // cfg.dedup_frames: repeats of the last stored frame in a row, ending with the last push (0: it was stored)
+    uint32_t color_repeat_run() const override { return color_dedup_.run(); }
+    uint32_t depth_repeat_run() const override { return raw_depth_dedup_.run(); }
+    void push_depth(FrameRef&& frame) override;
+    void push_color(const uint8_t* bgra, int w, int h);   // copies (or converts, for YUV color_format) once into a pool slot
     void push_depth(const uint8_t* gray, int w, int h);
-    void push_raw_depth(const float* data, int w, int h, uint64_t frame_idx, int64_t timestamp_us);
+    void push_raw_depth(const float* data, int w, int h, uint64_t frame_idx, int64_t timestamp_us) override;
+    // n more copies of the last color/depth frame; nothing to do for timestamped video (a frame lasts until the next)
     void duplicate(int n_dup);
 
     void log_action(uint64_t idx, int64_t timestamp_us,
                 uint32_t letters_mask,      // A-Z
                 uint32_t modifiers_mask);   // Ctrl/Shift/etc.
-    void log_camera_json(uint64_t idx, long long t_us, const Json& cam_json, int img_w, int img_h);
+    // cam == nullptr: camera not available (cam_err says why). Only copies a record on this thread.
+    void log_camera(uint64_t idx, int64_t t_us, const CamMatrixData* cam, const std::string& cam_err, int img_w, int img_h) override;
+    // one frames.bin record per recorded frame (memcpy into the mapped file)
+    void log_frame(const GcvFrameRecord& r) override;
+    void log_trigger(const TriggerRecord& r);
+    void log_input(const InputRecord& r);
+    // Before start(): an encoder already running for this out_dir. Used by the color stream if its
+    // first frame has this size/layout (at cfg.fps), otherwise stopped and replaced.
+    void set_warm_color_encoder(std::unique_ptr<FfmpegPipe> pipe, int w, int h, FrameFormat fmt);
+    void set_session_timing(const SessionTiming& t) { timing_ = t; }
+    // per-stream scheduler counters of the capture profile, saved with it in meta.json
+    void set_schedule_stats(const Json& j) { schedule_stats_ = j; }
+    const SessionTiming& session_timing() const { return timing_; }
+    // F9 depth images go through the shared image writer pool; only what it writes from now on is counted
+    void attach_image_counter(const SinkCounter* c);
+    // bytes/files written so far per sink (cheap: running counters, no file system access)
+    std::vector<SinkStats> sink_stats() const;
+    // queue depth, drops and lag of each frame bus sink (the encoders)
+    std::vector<FrameBusSinkStats> bus_stats() const { return bus_.stats(); }
+    // color frames dropped so far (vecDroppedColor_), readable from any thread
+    uint64_t color_dropped() const { return color_dropped_.load(std::memory_order_relaxed); }
+    DepthChunkWriterStats depth_seq_stats() const { return depth_seq_.stats(); }
+    // capture governor: depth.gcvd chunks written from now on without delta coding
+    void set_fast_depth_compression(bool fast) { depth_seq_.set_fast(fast); }
+    // per-stage latency histograms of this recording; queue wait, encode and disk writes are timed
+    // here, the capture side records its own stages into it (any thread); summarized in meta.json
+    CaptureLatency& latency() override { return latency_; }
     void init_session_meta(const std::string& game_name, int recording_mode, const Json& game_settings);
     void finalize_and_write_meta_json(std::vector<uint64_t> &vecDroppedcamJson_);
 
 private:
-    bool q_push(std::vector<RawFrame>& Q, std::atomic<uint32_t>& P, std::atomic<uint32_t>& C, RawFrame&& f, size_t cap);
-    bool q_pop (std::vector<RawFrame>& Q, std::atomic<uint32_t>& P, std::atomic<uint32_t>& C, RawFrame& out, size_t cap);
-
-    void color_loop();
-    void depth_loop();
-    void ensure_color_started(int w, int h);
-    void ensure_depth_started(int w, int h);
-
-    // void save_depth_group_to_h5();  // ✅ 声明函数
-    // void h5_write_thread();         // ✅ 声明线程函数
+    bool open_color_pipe(int w, int h, FrameFormat fmt);   // color sink thread
+    void push_depth16(const float* data, int w, int h, uint64_t frame_idx, int64_t timestamp_us);
+    struct VideoSink { const char* name; const FfmpegPipe* pipe; bool started; };
+    std::array<VideoSink, 3> video_sinks() const;
+
+    // segmented color encoding (cfg.segment_encoders > 1): segment s holds video frames
+    // [s*K, (s+1)*K) and is encoded by lane s % N, one ffmpeg process per segment
+    struct SegmentLane {
+        SegmentLane(size_t capacity, QueuePolicy policy) : q(capacity, policy) {}
+        FrameQueue q;
+        FfmpegPipe pipe;
+        std::thread th;
+    };
+    struct SegmentInfo {
+        uint64_t index = 0;
+        uint32_t lane = 0;
+        uint64_t frames = 0;
+        std::vector<std::pair<uint64_t, uint64_t>> frame_ranges;   // recorder frame indices, inclusive runs
+    };
+    bool segmented() const { return cfg_.segment_encoders > 1; }
+    // a skipped color repeat has to keep its time in capture.mp4: only a timestamped feed does that
+    // (at a fixed frame rate every later frame would move up by one frame time)
+    bool dedup_color() const { return cfg_.dedup_frames && !segmented() && cfg_.video_timing != VideoTiming::WallClock; }
+    int depth_fps() const { return cfg_.depth_fps > 0 ? cfg_.depth_fps : cfg_.fps; }
+    void ensure_segments_started(int w, int h, FrameFormat fmt);
+    bool push_segmented(FrameRef&& f);
+    void segment_lane_loop(size_t lane, int w, int h, FrameFormat fmt);
+    void write_segment_index();
 
 private:
     RecorderConfig cfg_;
     std::atomic<bool> running_{false};
 
-    // 队列
-    std::vector<RawFrame> ring_c_;
-    std::vector<RawFrame> ring_d_;
-    const size_t cap_c_ = 8, cap_d_ = 8;
-    std::atomic<uint32_t> prod_c_{0}, cons_c_{0};
-    std::atomic<uint32_t> prod_d_{0}, cons_d_{0};
+    // declared before the queues and last_* so it is destroyed after every FrameRef is gone
+    FramePool pool_;
+    // outlives every thread that records into it (bus, lanes, log and depth writers)
+    CaptureLatency latency_;
 
     std::atomic<uint64_t> color_frame_seq_{ 0 };    //color帧计数器
     std::vector<uint64_t> vecDroppedColor_;
-
-    // 线程与管道
-    std::atomic<bool> th_run_c_{false}, th_run_d_{false};
-    std::thread th_c_, th_d_;
-    FfmpegPipe pipe_c_, pipe_d_;
-
-    // 最近帧缓存
-    std::vector<uint8_t> last_bgra_, last_gray_;
-    int lw_ = 0, lh_ = 0, dw_ = 0, dh_ = 0;
+    std::atomic<uint64_t> color_dropped_{0};
+    // why color frames were dropped (meta.json "droppedcolor"); render thread
+    enum ColorDropCause { DropQueueFull, DropNoFrame, DropLayout, DropRefused, kColorDropCauses };   // queue full or closed, empty frame, other layout, pipeline full
+    std::array<uint64_t, kColorDropCauses> color_drops_{}, color_drops_logged_{};
+    std::chrono::steady_clock::time_point color_drop_log_time_{};
+    void count_color_drop(uint64_t seq, ColorDropCause cause);
+
+    // 管道 (started by the sinks for their first frame)
+    FfmpegPipe pipe_c_, pipe_d_, pipe_d16_;
+    FrameFormat pipe_c_format_ = FrameFormat::BGRA;   // input format the color pipe was started with
+    std::unique_ptr<FfmpegPipe> warm_c_;              // handed over by the session controller
+    int warm_w_ = 0, warm_h_ = 0;
+    FrameFormat warm_fmt_ = FrameFormat::I420;
+    bool warm_offered_ = false, warm_used_ = false;
+    SessionTiming timing_;
+    Json schedule_stats_;
+
+    std::vector<std::unique_ptr<SegmentLane>> lanes_;
+    std::vector<SegmentInfo> segments_;      // render thread (read by stop() after the lanes are joined)
+    uint64_t seg_video_frames_ = 0;          // frames accepted into segments so far
+    std::mutex seg_failed_mtx_;
+    std::vector<uint64_t> seg_failed_;       // segments whose encoder failed (lane threads)
+
+    RepeatDetector color_dedup_, raw_depth_dedup_;   // render thread
+
+    // cfg.live_stream: opened at the first log_frame, sized by the color/depth seen until then
+    LiveStreamWriter live_;
+    size_t live_color_bytes_ = 0, live_depth_bytes_ = 0;
+    bool live_failed_ = false;
+
+    // 最近帧缓存 (extra reference to the slot, used by duplicate())
+    FrameRef last_color_, last_depth_;
 
     // CSV & JSONL
-    FILE* csv_{nullptr};
+    SessionLog log_;
+    FrameSidecarWriter sidecar_;
+    const SinkCounter* images_ = nullptr;
+    uint64_t images_bytes0_ = 0, images_files0_ = 0;
     std::atomic<uint64_t> enqueued_{0}, written_{0};
-    std::ofstream cam_jsonl_;
 
-    // HDF5 异步相关
-    std::vector<DepthFrame> depth_cache_;      // 临时缓存
-    mutable CRITICAL_SECTION depth_cs_;        // 保护 depth_cache_
-    uint64_t group_counter_ = 0;              // 文件编号
-    static const int group_size_ = 30;         // 每组 30 帧
-
-    // 异步写入队列
-    // std::queue<DepthGroup> h5_queue_;
-    // std::mutex h5_mutex_;
-    // std::condition_variable h5_cv_;
-    // std::atomic<bool> h5_thread_run_{true};
-    // std::thread h5_thread_;
+    // raw float depth (mode 2) -> depth.gcvd, opened on the first push_raw_depth
+    DepthChunkWriter depth_seq_;
+    bool depth_seq_failed_ = false;
+    // quantized raw depth -> depth16.mkv; frame indices in the video as inclusive [first, last] runs
+    std::vector<std::pair<uint64_t, uint64_t>> depth16_ranges_;
+    uint64_t depth16_pushed_ = 0, depth16_dropped_ = 0;
 
     std::string meta_game_name_;
     int meta_mode_ = 0;
@@ -140,4 +231,9 @@ private:
     std::string meta_gpu_;
     std::chrono::steady_clock::time_point meta_t0_{};
     bool meta_initialized_ = false;
+
+    // render thread -> encoder sinks (color, gray8 depth, depth16), each with its own queue and thread.
+    // Declared last: destroyed (threads joined) before the pipes and counters its sinks use.
+    FrameBus bus_;
+    int color_sink_ = -1, depth_sink_ = -1, depth16_sink_ = -1;
 };
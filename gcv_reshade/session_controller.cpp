@@ -0,0 +1,189 @@
+#include "session_controller.h"
+
+#include <filesystem>
+#include <reshade.hpp>
+
+static double ms_since(SessionController::Clock::time_point t0) {
+  return std::chrono::duration<double, std::milli>(SessionController::Clock::now() - t0).count();
+}
+
+SessionController::~SessionController() {
+  shutdown();
+}
+
+void SessionController::post(std::function<void()> fn) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (!th_.joinable()) {
+    stop_ = false;
+    th_ = std::thread(&SessionController::loop, this);
+  }
+  pending_.fetch_add(1, std::memory_order_acq_rel);
+  cmds_.push_back(std::move(fn));
+  cv_.notify_one();
+}
+
+void SessionController::loop() {
+  for (;;) {
+    std::function<void()> fn;
+    {
+      std::unique_lock<std::mutex> lk(mtx_);
+      cv_.wait(lk, [this] { return stop_ || !cmds_.empty(); });
+      if (cmds_.empty()) break;   // stop_ and drained
+      fn = std::move(cmds_.front());
+      cmds_.pop_front();
+    }
+    fn();
+    pending_.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
+
+uint64_t SessionController::start(Recorder* rec, int recording_mode, const Json& game_settings,
+                                  Clock::time_point requested, bool use_warm) {
+  if (!rec) return 0;
+  const uint64_t id = ++next_id_;
+  const double render_ms = ms_since(requested);
+  post([this, rec, recording_mode, game_settings, requested, use_warm, id, render_ms]() {
+    if (use_warm) {
+      WarmEncoderParams p;
+      {
+        std::lock_guard<std::mutex> lk(warm_mtx_);
+        p = warm_params_;
+        warm_claimed_ = false;
+      }
+      if (warm_) {
+        rec->set_warm_color_encoder(std::move(warm_), p.w, p.h, p.fmt);
+        warm_state_.store(WarmState::None, std::memory_order_release);
+      }
+    }
+    rec->start();
+    rec->init_session_meta(/*game_name*/"", recording_mode, game_settings);
+    SessionTiming t;
+    t.start_latency_ms = ms_since(requested);
+    t.start_render_thread_ms = render_ms;
+    rec->set_session_timing(t);
+    ready_id_.store(id, std::memory_order_release);
+
+    char buf[160];
+    _snprintf_s(buf, _TRUNCATE, "[CV Capture] session %llu ready after %.1f ms (render thread %.2f ms)%s",
+                (unsigned long long)id, t.start_latency_ms, render_ms, use_warm ? ", warm encoder" : "");
+    reshade::log_message(reshade::log_level::info, buf);
+  });
+  return id;
+}
+
+void SessionController::stop(std::unique_ptr<Recorder> rec, std::vector<uint64_t> dropped_cam_json,
+                             Clock::time_point requested, bool write_meta) {
+  if (!rec) return;
+  const double render_ms = ms_since(requested);
+  // std::function needs a copyable callable: hand the recorder over as a shared_ptr
+  std::shared_ptr<Recorder> r(std::move(rec));
+  auto dropped = std::make_shared<std::vector<uint64_t>>(std::move(dropped_cam_json));
+  post([this, r, dropped, requested, write_meta, render_ms]() {
+    ready_id_.store(0, std::memory_order_release);
+    r->stop();
+    SessionTiming t = r->session_timing();
+    t.stop_latency_ms = ms_since(requested);
+    t.stop_render_thread_ms = render_ms;
+    r->set_session_timing(t);
+    if (write_meta) r->finalize_and_write_meta_json(*dropped);
+
+    char buf[128];
+    _snprintf_s(buf, _TRUNCATE, "[CV Capture] session stopped after %.1f ms (render thread %.2f ms)",
+                t.stop_latency_ms, render_ms);
+    reshade::log_message(reshade::log_level::info, buf);
+  });
+}
+
+void SessionController::prewarm(const WarmEncoderParams& p) {
+  if (p.out_dir.empty() || p.w <= 0 || p.h <= 0 || p.fps <= 0) return;
+  warm_state_.store(WarmState::Spawning, std::memory_order_release);
+  post([this, p]() {
+    {
+      std::lock_guard<std::mutex> lk(warm_mtx_);
+      if (warm_claimed_) {   // already promised to a session that is about to start
+        warm_state_.store(warm_ ? WarmState::Ready : WarmState::None, std::memory_order_release);
+        return;
+      }
+    }
+    if (warm_ && warm_->alive()) {
+      std::lock_guard<std::mutex> lk(warm_mtx_);
+      const WarmEncoderParams& w = warm_params_;
+      if (w.w == p.w && w.h == p.h && w.fps == p.fps && w.fmt == p.fmt && w.timing == p.timing) {   // the one running will do
+        warm_state_.store(WarmState::Ready, std::memory_order_release);
+        return;
+      }
+    }
+    discard_warm();
+    auto pipe = std::make_unique<FfmpegPipe>();
+    pipe->set_timing(p.timing);
+    const bool ok = (p.fmt == FrameFormat::BGRA)
+      ? pipe->start_bgra(p.w, p.h, p.fps, p.out_dir)
+      : pipe->start_yuv420(p.w, p.h, p.fps, p.out_dir, p.fmt == FrameFormat::NV12);
+    if (!ok) {
+      reshade::log_message(reshade::log_level::warning, "[CV Capture] could not pre-spawn an encoder; recordings start it themselves");
+      std::error_code ec;
+      std::filesystem::remove(std::filesystem::u8path(p.out_dir), ec);   // only if still empty
+      warm_state_.store(WarmState::Failed, std::memory_order_release);
+      return;
+    }
+    warm_ = std::move(pipe);
+    {
+      std::lock_guard<std::mutex> lk(warm_mtx_);
+      warm_params_ = p;
+    }
+    warm_state_.store(WarmState::Ready, std::memory_order_release);
+  });
+}
+
+bool SessionController::claim_warm(int fps, FrameFormat fmt, VideoTiming timing, std::string& out_dir) {
+  if (warm_state() != WarmState::Ready) return false;
+  std::lock_guard<std::mutex> lk(warm_mtx_);
+  if (warm_claimed_ || warm_params_.fps != fps || warm_params_.fmt != fmt || warm_params_.timing != timing) return false;
+  warm_claimed_ = true;
+  out_dir = warm_params_.out_dir;
+  return true;
+}
+
+void SessionController::release_warm() {
+  post([this]() {
+    {
+      std::lock_guard<std::mutex> lk(warm_mtx_);
+      if (warm_claimed_) return;
+    }
+    discard_warm();
+  });
+}
+
+void SessionController::discard_warm() {
+  if (!warm_) return;
+  const std::string out_path = warm_->output_path();
+  warm_->stop(true);
+  warm_.reset();
+  // the encoder never got a frame: remove its empty output and the directory made for it
+  std::error_code ec;
+  const std::filesystem::path f = std::filesystem::u8path(out_path);
+  std::filesystem::remove(f, ec);
+  std::filesystem::remove(f.parent_path(), ec);   // fails (harmlessly) unless empty
+  warm_state_.store(WarmState::None, std::memory_order_release);
+}
+
+void SessionController::shutdown() {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!th_.joinable()) return;
+  }
+  post([this]() {
+    {
+      std::lock_guard<std::mutex> lk(warm_mtx_);
+      warm_claimed_ = false;
+    }
+    discard_warm();
+  });
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_ = true;
+    cv_.notify_one();
+  }
+  th_.join();
+  ready_id_.store(0, std::memory_order_release);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "recorder.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Encoder spawned ahead of time for the next recording
+struct WarmEncoderParams {
+  std::string out_dir;    // the next session's directory; ffmpeg already has capture.mp4 open there
+  int w = 0, h = 0, fps = 0;
+  FrameFormat fmt = FrameFormat::I420;
+  VideoTiming timing = VideoTiming::Vfr;
+};
+
+// Starts and stops recordings on its own thread, so the render thread never waits for ffmpeg to
+// spawn, for the registry/DXGI queries behind meta.json, or for the writers to drain.
+// Commands run in the order they are posted; the thread is started on first use.
+class SessionController {
+public:
+  using Clock = std::chrono::steady_clock;
+  enum class WarmState { None, Spawning, Ready, Failed };
+
+  SessionController() = default;
+  ~SessionController();
+  SessionController(const SessionController&) = delete;
+  SessionController& operator=(const SessionController&) = delete;
+
+  // Render thread. rec must stay alive until it is passed to stop(). The recorder is started here
+  // and frames may be pushed once ready(id) is true. requested: when the start key was seen.
+  // use_warm: out_dir came from claim_warm(), hand the warm encoder to this recorder.
+  uint64_t start(Recorder* rec, int recording_mode, const Json& game_settings, Clock::time_point requested,
+                 bool use_warm);
+  bool ready(uint64_t session_id) const { return session_id && ready_id_.load(std::memory_order_acquire) == session_id; }
+
+  // Render thread: stops the recorder, writes meta.json (write_meta) and destroys it, off-thread.
+  void stop(std::unique_ptr<Recorder> rec, std::vector<uint64_t> dropped_cam_json, Clock::time_point requested,
+            bool write_meta = true);
+
+  // Spawns a color encoder for the next session (replacing a warm one with other parameters).
+  void prewarm(const WarmEncoderParams& p);
+  // Render thread, before start(): true if the warm encoder fits fps/fmt/timing; out_dir is its directory
+  // and must be the next recorder's out_dir. The frame size is checked on the first frame.
+  bool claim_warm(int fps, FrameFormat fmt, VideoTiming timing, std::string& out_dir);
+  void release_warm();   // stops an unclaimed warm encoder
+  WarmState warm_state() const { return warm_state_.load(std::memory_order_acquire); }
+
+  bool idle() const { return pending_.load(std::memory_order_acquire) == 0; }
+  // Runs what is queued, stops the warm encoder (removing its unused directory) and joins the thread.
+  void shutdown();
+
+private:
+  void post(std::function<void()> fn);
+  void loop();
+  void discard_warm();   // controller thread
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> cmds_;
+  bool stop_ = false;
+  std::thread th_;
+  std::atomic<int> pending_{0};
+
+  std::atomic<uint64_t> ready_id_{0};
+  uint64_t next_id_ = 0;   // render thread
+
+  // warm encoder: the pipe is touched on the controller thread only, the rest under warm_mtx_
+  std::unique_ptr<FfmpegPipe> warm_;
+  std::mutex warm_mtx_;
+  WarmEncoderParams warm_params_;
+  bool warm_claimed_ = false;
+  std::atomic<WarmState> warm_state_{WarmState::None};
+};
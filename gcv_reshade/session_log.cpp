@@ -0,0 +1,405 @@
+#include "session_log.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <reshade.hpp>
+#ifdef _WIN32
+#include <share.h>
+#endif
+
+namespace {
+
+FILE* open_log_file(const std::string& path) {
+#ifdef _WIN32
+  // readable by other processes while recording, like the old actions.csv
+  return _fsopen(path.c_str(), "w", _SH_DENYNO);
+#else
+  return std::fopen(path.c_str(), "w");
+#endif
+}
+
+template <typename T>
+void append_int(std::string& out, T v) {
+  char buf[24];
+  const auto r = std::to_chars(buf, buf + sizeof(buf), v);
+  out.append(buf, r.ptr);
+}
+
+// shortest round-trip text, as a JSON number: integral values keep a ".0" (like nlohmann's dump),
+// non-finite values become null
+void append_json_double(std::string& out, double v) {
+  if (!std::isfinite(v)) { out += "null"; return; }
+  char buf[32];
+  const auto r = std::to_chars(buf, buf + sizeof(buf), v);
+  out.append(buf, r.ptr);
+  if (std::find_if(buf, r.ptr, [](char c) { return c == '.' || c == 'e'; }) == r.ptr) out += ".0";
+}
+
+void append_json_string(std::string& out, const char* s) {
+  static const char* hex = "0123456789abcdef";
+  out.push_back('"');
+  for (; *s; ++s) {
+    const unsigned char c = (unsigned char)*s;
+    switch (c) {
+      case '"':  out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (c < 0x20) { out += "\\u00"; out.push_back(hex[c >> 4]); out.push_back(hex[c & 15]); }
+        else out.push_back((char)c);
+    }
+  }
+  out.push_back('"');
+}
+
+} // namespace
+
+const char* SessionLog::csv_header() {
+  return "frame_idx,time_us,A,B,C,D,E,F,G,H,I,J,K,L,M,N,O,P,Q,R,S,T,U,V,W,X,Y,Z,"
+         "shift,ctrl,alt,space,enter,escape,tab\n";
+}
+
+void SessionLog::format_action(const ActionRecord& r, std::string& out) {
+  append_int(out, r.frame_idx);
+  out.push_back(',');
+  append_int(out, r.time_us);
+  out.push_back(',');
+  for (int i = 0; i < 26; ++i) {
+    out.push_back(((r.letters_mask >> i) & 1) ? '1' : '0');
+    out.push_back(',');
+  }
+  for (int i = 0; i < 7; ++i) {
+    out.push_back(((r.modifiers_mask >> i) & 1) ? '1' : '0');
+    out.push_back(i < 6 ? ',' : '\n');
+  }
+}
+
+const char* SessionLog::trigger_csv_header() {
+  return "frame_idx,time_us,fired,reason,since_us,translation,rotation_deg,fov_deg,governor_skipped\n";
+}
+
+void SessionLog::format_trigger(const TriggerRecord& r, std::string& out) {
+  append_int(out, r.frame_idx);
+  out.push_back(',');
+  append_int(out, r.time_us);
+  out += r.fired ? ",1," : ",0,";
+  out.append(r.reason, strnlen(r.reason, sizeof(r.reason)));
+  out.push_back(',');
+  append_int(out, r.since_us);
+  out.push_back(',');
+  append_json_double(out, r.translation);
+  out.push_back(',');
+  append_json_double(out, r.rotation_deg);
+  out.push_back(',');
+  append_json_double(out, r.fov_deg);
+  out += r.governor_skipped ? ",1\n" : ",0\n";
+}
+
+const char* SessionLog::input_csv_header() {
+  return "frame_idx,time_us,sample_time_us,samples,mouse_dx,mouse_dy,mouse_buttons,pad,pad_buttons,lt,rt,lx,ly,rx,ry\n";
+}
+
+void SessionLog::format_input(const InputRecord& r, std::string& out) {
+  const int64_t cols[] = { (int64_t)r.frame_idx, r.time_us, r.sample_time_us, (int64_t)r.samples, r.mouse_dx, r.mouse_dy,
+                           r.mouse_buttons, r.pad_connected, r.pad_buttons, r.pad_lt, r.pad_rt, r.pad_lx, r.pad_ly, r.pad_rx, r.pad_ry };
+  const size_t n = sizeof(cols) / sizeof(cols[0]);
+  for (size_t i = 0; i < n; ++i) {
+    append_int(out, cols[i]);
+    out.push_back(i + 1 < n ? ',' : '\n');
+  }
+}
+
+// same keys, order (sorted) and values as CamMatrixData::into_json + the fields Recorder added
+void SessionLog::format_camera(const CameraRecord& r, std::string& out) {
+  out.push_back('{');
+  if (r.status == CameraRecord::Uninitialized) {
+    out += "\"cam_status\":\"uninitialized\",";
+    if (r.err[0]) { out += "\"err\":"; append_json_string(out, r.err); out.push_back(','); }
+  } else {
+    out += (r.status == CameraRecord::Good) ? "\"extrinsic_cam2world\":[" : "\"extrinsic_WIP\":[";
+    for (int i = 0; i < 12; ++i) {
+      if (i) out.push_back(',');
+      append_json_double(out, r.extrinsic[i]);
+    }
+    out += "],";
+    if (r.has_fov_h) { out += "\"fov_h_degrees\":"; append_json_double(out, r.fov_h); out.push_back(','); }
+    if (r.has_fov_v) { out += "\"fov_v_degrees\":"; append_json_double(out, r.fov_v); out.push_back(','); }
+  }
+  out += "\"frame_idx\":";  append_int(out, r.frame_idx);
+  out += ",\"img_h\":";     append_int(out, r.img_h);
+  out += ",\"img_w\":";     append_int(out, r.img_w);
+  out += ",\"time_us\":";   append_int(out, r.time_us);
+  out += "}\n";
+}
+
+SessionLog::~SessionLog() {
+  close();
+}
+
+bool SessionLog::open(const std::string& csv_path, const std::string& jsonl_path, const std::string& camera_file_dir,
+                      const std::string& trigger_csv_path, const std::string& input_csv_path, size_t flush_bytes, int flush_ms, size_t max_pending) {
+  close();
+  camera_file_dir_ = camera_file_dir;
+  flush_bytes_ = flush_bytes ? flush_bytes : 1;
+  flush_ms_ = flush_ms > 0 ? flush_ms : 1;
+  max_pending_ = max_pending ? max_pending : 1;
+  bool ok = true;
+  if (!csv_path.empty()) {
+    csv_ = open_log_file(csv_path);
+    if (csv_ && std::fputs(csv_header(), csv_) >= 0) bytes_.fetch_add(std::strlen(csv_header()), std::memory_order_relaxed);
+    else ok = false;
+  }
+  if (!jsonl_path.empty()) {
+    jsonl_ = open_log_file(jsonl_path);
+    if (!jsonl_) ok = false;
+  }
+  if (!trigger_csv_path.empty()) {
+    trigger_ = open_log_file(trigger_csv_path);
+    if (trigger_ && std::fputs(trigger_csv_header(), trigger_) >= 0) bytes_.fetch_add(std::strlen(trigger_csv_header()), std::memory_order_relaxed);
+    else ok = false;
+  }
+  if (!input_csv_path.empty()) {
+    input_ = open_log_file(input_csv_path);
+    if (input_ && std::fputs(input_csv_header(), input_) >= 0) bytes_.fetch_add(std::strlen(input_csv_header()), std::memory_order_relaxed);
+    else ok = false;
+  }
+  files_.fetch_add((csv_ ? 1 : 0) + (jsonl_ ? 1 : 0) + (trigger_ ? 1 : 0) + (input_ ? 1 : 0), std::memory_order_relaxed);
+  if (!csv_ && !jsonl_ && !trigger_ && !input_) return false;
+  pending_.reserve(256);
+  stop_ = false;
+  th_ = std::thread(&SessionLog::writer_loop, this);
+  return ok;
+}
+
+void SessionLog::close() {
+  if (th_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    th_.join();
+  }
+  if (csv_) { std::fclose(csv_); csv_ = nullptr; }
+  if (jsonl_) { std::fclose(jsonl_); jsonl_ = nullptr; }
+  if (trigger_) { std::fclose(trigger_); trigger_ = nullptr; }
+  if (input_) { std::fclose(input_); input_ = nullptr; }
+}
+
+void SessionLog::push(const Entry& e) {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (stop_ || pending_.size() >= max_pending_) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    pending_.push_back(e);
+  }
+  records_.fetch_add(1, std::memory_order_relaxed);
+  // no notify: the writer wakes on its own every flush_ms, which is all the latency we promise
+}
+
+void SessionLog::log_action(const ActionRecord& r) {
+  if (!csv_) return;
+  Entry e;
+  e.kind = Action;
+  e.action = r;
+  push(e);
+}
+
+void SessionLog::log_camera(const CameraRecord& r, bool per_frame_file) {
+  if (!jsonl_ && !per_frame_file) return;
+  Entry e;
+  e.kind = (per_frame_file && !camera_file_dir_.empty()) ? CameraWithFile : Camera;
+  e.camera = r;
+  push(e);
+}
+
+void SessionLog::log_trigger(const TriggerRecord& r) {
+  if (!trigger_) return;
+  Entry e;
+  e.kind = Trigger;
+  e.trigger = r;
+  push(e);
+}
+
+void SessionLog::log_input(const InputRecord& r) {
+  if (!input_) return;
+  Entry e;
+  e.kind = Input;
+  e.input = r;
+  push(e);
+}
+
+void SessionLog::write_out(FILE* f, std::string& buf) {
+  if (!f || buf.empty()) return;
+  size_t n = 0;
+  {
+    LatencyScope timed(write_lat_);
+    n = std::fwrite(buf.data(), 1, buf.size(), f);
+    std::fflush(f);
+  }
+  bytes_.fetch_add(n, std::memory_order_relaxed);
+  if (n != buf.size()) {
+    reshade::log_message(reshade::log_level::error, "[CV Capture] session log write failed");
+  }
+  buf.clear();
+}
+
+void SessionLog::write_camera_file(const CameraRecord& r, std::string& scratch) {
+  char name[64];
+  std::snprintf(name, sizeof(name), "frame_%06llu_camera.json", (unsigned long long)r.frame_idx);
+  scratch.clear();
+  format_camera(r, scratch);
+  LatencyScope timed(write_lat_);
+  FILE* f = open_log_file(camera_file_dir_ + name);
+  if (!f || std::fwrite(scratch.data(), 1, scratch.size(), f) != scratch.size()) {
+    reshade::log_message(reshade::log_level::warning, "[CV Capture] failed to write per-frame camera.json");
+  } else {
+    bytes_.fetch_add(scratch.size(), std::memory_order_relaxed);
+    files_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (f) std::fclose(f);
+}
+
+void SessionLog::writer_loop() {
+  std::vector<Entry> batch;
+  batch.reserve(256);
+  std::string csv_buf, jsonl_buf, trigger_buf, input_buf, file_buf;
+  csv_buf.reserve(flush_bytes_ + 4096);
+  jsonl_buf.reserve(flush_bytes_ + 4096);
+  auto last_flush = std::chrono::steady_clock::now();
+  const auto period = std::chrono::milliseconds(flush_ms_);
+
+  for (;;) {
+    bool stopping;
+    {
+      std::unique_lock<std::mutex> lk(mtx_);
+      // wake at least twice per period so nothing waits much longer than flush_ms
+      cv_.wait_for(lk, period / 2, [this] { return stop_; });
+      stopping = stop_;
+      batch.swap(pending_);
+    }
+    if (batch.size() > max_backlog_.load(std::memory_order_relaxed))
+      max_backlog_.store(batch.size(), std::memory_order_relaxed);
+
+    for (const Entry& e : batch) {
+      if (e.kind == Action) { format_action(e.action, csv_buf); continue; }
+      if (e.kind == Trigger) { format_trigger(e.trigger, trigger_buf); continue; }
+      if (e.kind == Input) { format_input(e.input, input_buf); continue; }
+      if (jsonl_) format_camera(e.camera, jsonl_buf);
+      if (e.kind == CameraWithFile) write_camera_file(e.camera, file_buf);
+    }
+    batch.clear();
+
+    const auto now = std::chrono::steady_clock::now();
+    const bool due = stopping || now - last_flush >= period;
+    bool flushed = false;
+    if (due || csv_buf.size() >= flush_bytes_) { flushed |= !csv_buf.empty(); write_out(csv_, csv_buf); }
+    if (due || jsonl_buf.size() >= flush_bytes_) { flushed |= !jsonl_buf.empty(); write_out(jsonl_, jsonl_buf); }
+    if (due || trigger_buf.size() >= flush_bytes_) { flushed |= !trigger_buf.empty(); write_out(trigger_, trigger_buf); }
+    if (due || input_buf.size() >= flush_bytes_) { flushed |= !input_buf.empty(); write_out(input_, input_buf); }
+    if (flushed) flushes_.fetch_add(1, std::memory_order_relaxed);
+    if (due) last_flush = now;
+    if (stopping) break;
+  }
+}
+
+SessionLogStats SessionLog::stats() const {
+  SessionLogStats s;
+  s.records     = records_.load(std::memory_order_relaxed);
+  s.dropped     = dropped_.load(std::memory_order_relaxed);
+  s.bytes       = bytes_.load(std::memory_order_relaxed);
+  s.files       = files_.load(std::memory_order_relaxed);
+  s.flushes     = flushes_.load(std::memory_order_relaxed);
+  s.max_pending = max_backlog_.load(std::memory_order_relaxed);
+  return s;
+}
+
+//=================================================================================================
+
+SessionLogBenchResult bench_session_log(const std::string& dir, int frames) {
+  namespace fs = std::filesystem;
+  using clock = std::chrono::steady_clock;
+  SessionLogBenchResult res;
+  res.frames = frames > 0 ? frames : 1;
+  std::error_code ec;
+  fs::create_directories(fs::u8path(dir), ec);
+  const std::string base = (fs::u8path(dir) / "session_log_bench_").u8string();
+
+  auto action_at = [](int i) {
+    ActionRecord a{};
+    a.frame_idx = (uint64_t)i;
+    a.time_us = 1000000 + (int64_t)i * 33333;
+    a.letters_mask = (uint32_t)(i * 2654435761u) & 0x3FFFFFFu;
+    a.modifiers_mask = (uint32_t)i & 0x7Fu;
+    return a;
+  };
+  auto camera_at = [](int i) {
+    CameraRecord c{};
+    c.frame_idx = (uint64_t)i;
+    c.time_us = 1000000 + (int64_t)i * 33333;
+    c.img_w = 1920; c.img_h = 1080;
+    c.status = CameraRecord::Good;
+    for (int k = 0; k < 12; ++k) c.extrinsic[k] = std::sin(0.01 * i + k) * (k % 4 == 3 ? 250.0 : 1.0);
+    c.has_fov_v = true; c.fov_v = 59.0 + 0.001 * i;
+    return c;
+  };
+
+  // the old path: per-column fprintf + fflush, nlohmann json per line + flush, on the calling thread
+  {
+    FILE* csv = open_log_file(base + "legacy.csv");
+    std::ofstream jsonl(base + "legacy.jsonl", std::ios::out | std::ios::trunc);
+    if (csv) setvbuf(csv, nullptr, _IONBF, 0);
+    const auto t0 = clock::now();
+    for (int i = 0; i < res.frames; ++i) {
+      const ActionRecord a = action_at(i);
+      if (csv) {
+        std::fprintf(csv, "%llu,%lld,", (unsigned long long)a.frame_idx, (long long)a.time_us);
+        for (int k = 0; k < 26; ++k) std::fprintf(csv, "%d,", ((a.letters_mask >> k) & 1) ? 1 : 0);
+        auto b = [&](unsigned bit) { return (a.modifiers_mask & (1u << bit)) ? 1 : 0; };
+        std::fprintf(csv, "%d,%d,%d,%d,%d,%d,%d\n", b(0), b(1), b(2), b(3), b(4), b(5), b(6));
+        std::fflush(csv);
+      }
+      const CameraRecord c = camera_at(i);
+      nlohmann::json j;
+      j["extrinsic_cam2world"] = std::vector<double>(c.extrinsic, c.extrinsic + 12);
+      j["fov_v_degrees"] = c.fov_v;
+      j["frame_idx"] = c.frame_idx;
+      j["time_us"] = c.time_us;
+      j["img_w"] = c.img_w;
+      j["img_h"] = c.img_h;
+      jsonl << j.dump() << '\n';
+      jsonl.flush();
+    }
+    res.legacy_us_per_frame = std::chrono::duration<double, std::micro>(clock::now() - t0).count() / res.frames;
+    if (csv) std::fclose(csv);
+  }
+
+  // SessionLog: only the enqueue happens on the calling thread
+  {
+    SessionLog log;
+    log.open(base + "async.csv", base + "async.jsonl", std::string());
+    const auto t0 = clock::now();
+    for (int i = 0; i < res.frames; ++i) {
+      log.log_action(action_at(i));
+      log.log_camera(camera_at(i));
+    }
+    const auto t1 = clock::now();
+    log.close();
+    res.async_us_per_frame = std::chrono::duration<double, std::micro>(t1 - t0).count() / res.frames;
+    res.async_close_ms = std::chrono::duration<double, std::milli>(clock::now() - t1).count();
+  }
+
+  for (const char* suffix : { "legacy.csv", "legacy.jsonl", "async.csv", "async.jsonl" })
+    fs::remove(fs::u8path(base + suffix), ec);
+  return res;
+}
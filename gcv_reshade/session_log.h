@@ -0,0 +1,146 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_histogram.h"
+
+// Append-only per-session text logs (actions.csv, cam.jsonl, optional frame_XXXXXX_camera.json,
+// trigger.csv and input.csv)
+// written off the render thread.
+// The render thread only copies a fixed-size record into a buffer under a short lock; a background
+// thread formats the records (std::to_chars, no iostreams or nlohmann) and writes them out.
+// Durability: anything logged more than flush_ms ago has been handed to the OS (fflush), so a
+// crash of the game process loses at most the last flush_ms of records.
+
+struct ActionRecord {
+  uint64_t frame_idx;
+  int64_t time_us;
+  uint32_t letters_mask;     // A-Z
+  uint32_t modifiers_mask;   // bit 0..6: shift, ctrl, alt, space, enter, escape, tab
+};
+
+struct CameraRecord {
+  enum Status : uint8_t { Uninitialized, WIP, Good };
+  uint64_t frame_idx;
+  int64_t time_us;
+  int32_t img_w, img_h;
+  Status status;
+  bool has_fov_v, has_fov_h;
+  double extrinsic[12];      // cam2world, row-major 3x4 (Status WIP or Good)
+  double fov_v, fov_h;
+  char err[96];              // Uninitialized only; truncated
+};
+
+// a decision of the motion trigger (motion_trigger.h): a capture, or a capture held back by min_interval
+struct TriggerRecord {
+  uint64_t frame_idx;        // the captured frame (Held, governor_skipped: the last one captured)
+  int64_t time_us;
+  int64_t since_us;          // since the previous capture
+  double translation, rotation_deg, fov_deg;
+  uint8_t fired;
+  uint8_t governor_skipped;  // fired, but the governor's rate step left the frame out: nothing was captured
+  char reason[14];
+};
+
+// mouse and gamepad at a recorded frame: the input sampler's (input_sampler.h) state nearest the frame
+struct InputRecord {
+  uint64_t frame_idx;
+  int64_t time_us;
+  int64_t sample_time_us;    // when that state was sampled
+  uint32_t samples;          // samples taken since the previous frame's
+  int32_t mouse_dx, mouse_dy;   // cursor movement since the previous frame
+  uint8_t mouse_buttons;     // bit 0..4: left, right, middle, x1, x2
+  uint8_t pad_connected;
+  uint16_t pad_buttons;      // XINPUT_GAMEPAD_* bits
+  uint8_t pad_lt, pad_rt;
+  int16_t pad_lx, pad_ly, pad_rx, pad_ry;
+};
+
+struct SessionLogStats {
+  uint64_t records = 0;       // accepted from the render thread
+  uint64_t dropped = 0;       // backlog over max_pending (writer stuck on I/O)
+  uint64_t bytes = 0;         // written to the files (per-frame camera json included)
+  uint64_t files = 0;         // files created (actions.csv, cam.jsonl, per-frame camera json)
+  uint64_t flushes = 0;
+  uint64_t max_pending = 0;   // largest backlog seen by the writer
+};
+
+class SessionLog {
+public:
+  SessionLog() = default;
+  ~SessionLog();
+  SessionLog(const SessionLog&) = delete;
+  SessionLog& operator=(const SessionLog&) = delete;
+
+  // Any path may be empty to skip that file. camera_file_dir (with trailing slash) is where
+  // log_camera(r, true) puts the per-frame json files. flush_bytes: write once this much text is
+  // formatted; flush_ms: upper bound on how long a record waits before it reaches the OS.
+  bool open(const std::string& csv_path, const std::string& jsonl_path, const std::string& camera_file_dir,
+            const std::string& trigger_csv_path = std::string(), const std::string& input_csv_path = std::string(), size_t flush_bytes = 64 << 10, int flush_ms = 100, size_t max_pending = 1 << 16);
+  void close();   // formats and flushes everything still pending
+  bool is_open() const { return th_.joinable(); }
+
+  // Render thread: copy into the pending buffer, never touches the files
+  void log_action(const ActionRecord& r);
+  void log_camera(const CameraRecord& r, bool per_frame_file = false);
+  void log_trigger(const TriggerRecord& r);
+  void log_input(const InputRecord& r);
+
+  SessionLogStats stats() const;
+  // Before open(): each write to the files (fwrite + fflush) is timed into h
+  void set_write_latency(LatencyHistogram* h) { write_lat_ = h; }
+
+  // text for one record, as written to the files (also used by the benchmark)
+  static void format_action(const ActionRecord& r, std::string& out);
+  static void format_camera(const CameraRecord& r, std::string& out);
+  static void format_trigger(const TriggerRecord& r, std::string& out);
+  static void format_input(const InputRecord& r, std::string& out);
+  static const char* csv_header();
+  static const char* trigger_csv_header();
+  static const char* input_csv_header();
+
+private:
+  enum EntryKind : uint8_t { Action, Camera, CameraWithFile, Trigger, Input };
+  struct Entry {
+    EntryKind kind;
+    union { ActionRecord action; CameraRecord camera; TriggerRecord trigger; InputRecord input; };
+  };
+  void push(const Entry& e);
+  void writer_loop();
+  void write_out(FILE* f, std::string& buf);
+  void write_camera_file(const CameraRecord& r, std::string& scratch);
+
+  FILE* csv_ = nullptr;
+  FILE* jsonl_ = nullptr;
+  FILE* trigger_ = nullptr;
+  FILE* input_ = nullptr;
+  std::string camera_file_dir_;
+  size_t flush_bytes_ = 64 << 10;
+  int flush_ms_ = 100;
+  size_t max_pending_ = 1 << 16;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<Entry> pending_;   // filled by the render thread, swapped out by the writer
+  bool stop_ = false;
+  std::thread th_;
+
+  std::atomic<uint64_t> records_{0}, dropped_{0}, bytes_{0}, files_{0}, flushes_{0}, max_backlog_{0};
+  LatencyHistogram* write_lat_ = nullptr;
+};
+
+struct SessionLogBenchResult {
+  int frames = 0;
+  double legacy_us_per_frame = 0.0;   // fprintf per column + fflush, nlohmann dump + flush
+  double async_us_per_frame = 0.0;    // SessionLog::log_action + log_camera
+  double async_close_ms = 0.0;        // draining the writer at the end (not on the render thread)
+};
+
+// Times the render-thread cost of logging one action row and one camera line per frame, with the
+// old code path and with SessionLog, writing into scratch files under dir (removed afterwards).
+SessionLogBenchResult bench_session_log(const std::string& dir, int frames);
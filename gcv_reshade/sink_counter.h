@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Running totals of what one output sink has written, bumped by the thread doing the I/O.
+// Summing these replaces walking the recording directory when the session ends.
+struct SinkCounter {
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> files{0};
+
+  void add(uint64_t b, uint64_t f = 0) {
+    bytes.fetch_add(b, std::memory_order_relaxed);
+    if (f) files.fetch_add(f, std::memory_order_relaxed);
+  }
+};
+
+// One row of Recorder::sink_stats()
+struct SinkStats {
+  const char* name;
+  uint64_t bytes;   // bytes handed to the sink so far (video: raw frames into the encoder)
+  uint64_t files;
+};
+
+// MB/s from successive byte totals (overlay); exponentially smoothed over roughly half a second
+class ThroughputMeter {
+public:
+  double update(uint64_t bytes) {
+    const auto now = std::chrono::steady_clock::now();
+    if (!started_ || bytes < last_bytes_) {
+      started_ = true;
+      last_bytes_ = bytes;
+      last_t_ = now;
+      mbps_ = 0.0;
+      return mbps_;
+    }
+    const double dt = std::chrono::duration<double>(now - last_t_).count();
+    if (dt < 0.05) return mbps_;
+    const double inst = double(bytes - last_bytes_) / (1024.0 * 1024.0) / dt;
+    const double a = dt >= 0.5 ? 1.0 : dt / 0.5;
+    mbps_ += a * (inst - mbps_);
+    last_bytes_ = bytes;
+    last_t_ = now;
+    return mbps_;
+  }
+  void reset() { started_ = false; mbps_ = 0.0; }
+
+private:
+  bool started_ = false;
+  uint64_t last_bytes_ = 0;
+  std::chrono::steady_clock::time_point last_t_{};
+  double mbps_ = 0.0;
+};
@@ -0,0 +1,188 @@
+// gcv_depth_writer: writes depth.gcvd files with the addon's DepthChunkWriter (depth_chunk_writer.h)
+// and decodes them back, so the container and its reader can be checked without a game.
+//
+//   gcv_depth_writer DIR         writes DIR/depth_v1.gcvd (LZ4), DIR/depth_v2.gcvd (keyframe + delta) and
+//                                DIR/expected.f32, the frames as pushed, back to back (gcv_depth_reader.py --selftest)
+//   gcv_depth_writer --selftest  writes both versions and decodes them bit-exactly; exit code 1 if one fails
+//
+// The frames cover each codec of a version: smooth depth (LZ4, or a keyframe and deltas), random bits
+// no codec shrinks (stored RAW) and a resolution change in the middle of a chunk.
+#include "depth_chunk_writer.h"
+#include "gcv_utils/depth_delta_codec.h"
+#include "lz4/lz4.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+namespace {
+const uint32_t kFramesPerChunk = 4;
+
+struct TestFrame {
+  int w = 0, h = 0;
+  std::vector<float> data;
+};
+
+// 6 frames at 64x48 (the 5th random), then 3 at 40x30 from the 3rd frame of the second chunk on:
+// chunks of 4, 2 (sealed by the resize) and 3 (sealed by close)
+std::vector<TestFrame> test_frames() {
+  std::vector<TestFrame> frames;
+  uint32_t rng = 0x9e3779b9u;
+  for (int k = 0; k < 9; ++k) {
+    TestFrame f;
+    f.w = k < 6 ? 64 : 40;
+    f.h = k < 6 ? 48 : 30;
+    f.data.resize((size_t)f.w * f.h);
+    for (int y = 0; y < f.h; ++y) {
+      for (int x = 0; x < f.w; ++x) {
+        float& v = f.data[(size_t)y * f.w + x];
+        if (k == 4) {
+          rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+          std::memcpy(&v, &rng, sizeof(v));
+        } else {
+          v = 2.0f + 0.5f * (float)(y / 8) + 0.25f * (float)(x / 16) + 0.125f * (float)k;   // plateaus
+        }
+      }
+    }
+    frames.push_back(std::move(f));
+  }
+  return frames;
+}
+
+bool write_gcvd(const std::string& path, bool delta, const std::vector<TestFrame>& frames) {
+  DepthChunkWriter w;
+  if (!w.open(path, 30, kFramesPerChunk, /*max_pending_chunks=*/16, delta)) return false;
+  for (size_t k = 0; k < frames.size(); ++k) {
+    if (!w.push(frames[k].data.data(), frames[k].w, frames[k].h, 100 + k, (int64_t)k * 33333)) return false;
+  }
+  w.close();
+  const DepthChunkWriterStats st = w.stats();
+  return st.frames_written == frames.size() && st.frames_dropped == 0;
+}
+
+template <typename T>
+bool read_at(FILE* f, uint64_t offset, T* out, size_t count = 1) {
+  return std::fseek(f, (long)offset, SEEK_SET) == 0 && std::fread(out, sizeof(T), count, f) == count;
+}
+
+// Decodes path through its index and compares every frame with the one pushed; codecs_seen gets a
+// bit per GcvdCodec stored
+std::string check_gcvd(const std::string& path, uint32_t version, const std::vector<TestFrame>& frames,
+                       uint32_t& codecs_seen) {
+  FILE* f = std::fopen(path.c_str(), "rb");
+  if (!f) RETURNFAILST("open " + path);
+  std::string err;
+  GcvdFileHeader hdr{};
+  GcvdTrailer tr{};
+  std::fseek(f, 0, SEEK_END);
+  const long size = std::ftell(f);
+  if (!read_at(f, 0, &hdr) || std::memcmp(hdr.magic, "GCVDEPTH", 8) != 0) err = "file header";
+  else if (hdr.version != version || hdr.frames_per_chunk != kFramesPerChunk || hdr.fps != 30) err = "file header fields";
+  else if (!read_at(f, (uint64_t)size - sizeof(tr), &tr) || std::memcmp(tr.magic, "GCVDIDX1", 8) != 0) err = "trailer";
+  else if (tr.num_chunks != 3 || tr.index_offset + tr.num_chunks * sizeof(GcvdIndexEntry) + sizeof(tr) != (uint64_t)size)
+    err = "index size";
+  std::vector<GcvdIndexEntry> index(err.empty() ? tr.num_chunks : 0);
+  if (err.empty() && !read_at(f, tr.index_offset, index.data(), index.size())) err = "index";
+
+  size_t k = 0;
+  std::vector<float> prev, cur;
+  std::vector<uint8_t> payload, scratch;
+  for (size_t c = 0; c < index.size() && err.empty(); ++c) {
+    GcvdChunkHeader ch{};
+    if (!read_at(f, index[c].offset, &ch) || std::memcmp(ch.magic, "GCVC", 4) != 0 || ch.num_frames != index[c].num_frames) {
+      err = "chunk header " + std::to_string(c);
+      break;
+    }
+    std::vector<GcvdFrameEntry> entries(ch.num_frames);
+    if (!read_at(f, index[c].offset + sizeof(ch), entries.data(), entries.size())) { err = "frame table"; break; }
+    uint64_t pos = index[c].offset + sizeof(ch) + entries.size() * sizeof(GcvdFrameEntry);
+    const size_t n = (size_t)ch.width * ch.height;
+    for (const GcvdFrameEntry& e : entries) {
+      const std::string at = "frame " + std::to_string(k);
+      if (k >= frames.size() || frames[k].w != (int)ch.width || frames[k].h != (int)ch.height) { err = at + ": size"; break; }
+      if (e.frame_idx != 100 + k || e.timestamp_us != (int64_t)k * 33333) { err = at + ": index or timestamp"; break; }
+      payload.resize((size_t)e.stored_bytes);
+      if (!read_at(f, pos, payload.data(), payload.size())) { err = at + ": payload"; break; }
+      pos += e.stored_bytes;
+      cur.resize(n);
+      bool ok = false;
+      if (e.codec == GCVD_CODEC_RAW) {
+        ok = payload.size() == n * sizeof(float);
+        if (ok) std::memcpy(cur.data(), payload.data(), payload.size());
+      } else if (e.codec == GCVD_CODEC_LZ4) {
+        ok = LZ4_decompress_safe(reinterpret_cast<const char*>(payload.data()), reinterpret_cast<char*>(cur.data()),
+                                 (int)payload.size(), (int)(n * sizeof(float))) == (int)(n * sizeof(float));
+      } else if (e.codec == GCVD_CODEC_KEY || e.codec == GCVD_CODEC_DELTA) {
+        const bool has_prev = e.codec == GCVD_CODEC_DELTA && prev.size() == n && &e != &entries.front();
+        ok = (e.codec == GCVD_CODEC_KEY || has_prev) &&
+             depth_codec_decode(payload.data(), payload.size(), has_prev ? prev.data() : nullptr, (int)ch.width,
+                                (int)ch.height, cur.data(), scratch);
+      }
+      if (!ok) { err = at + ": codec " + std::to_string(e.codec) + " does not decode"; break; }
+      if (std::memcmp(cur.data(), frames[k].data.data(), n * sizeof(float)) != 0) { err = at + ": differs"; break; }
+      codecs_seen |= 1u << e.codec;
+      prev.swap(cur);
+      ++k;
+    }
+  }
+  std::fclose(f);
+  if (err.empty() && k != frames.size()) err = std::to_string(k) + " frames decoded";
+  if (!err.empty()) RETURNFAILST(path + ": " + err);
+  return "ok";
+}
+
+std::string run_depth_chunk_writer_tests(const std::string& dir) {
+  const std::vector<TestFrame> frames = test_frames();
+  const struct { const char* name; bool delta; uint32_t version, codecs; } cases[] = {
+    { "depth_v1.gcvd", false, 1, (1u << GCVD_CODEC_LZ4) | (1u << GCVD_CODEC_RAW) },
+    { "depth_v2.gcvd", true, 2, (1u << GCVD_CODEC_KEY) | (1u << GCVD_CODEC_DELTA) | (1u << GCVD_CODEC_RAW) },
+  };
+  for (const auto& tc : cases) {
+    const std::string path = dir + "/" + tc.name;
+    if (!write_gcvd(path, tc.delta, frames)) RETURNFAILST(std::string("write ") + tc.name);
+    uint32_t seen = 0;
+    const std::string res = check_gcvd(path, tc.version, frames, seen);
+    if (res != "ok") return res;
+    if (seen != tc.codecs) RETURNFAILST(std::string(tc.name) + ": codecs used " + std::to_string(seen));
+  }
+  return "ok";
+}
+
+bool write_expected(const std::string& path, const std::vector<TestFrame>& frames) {
+  FILE* f = std::fopen(path.c_str(), "wb");
+  if (!f) return false;
+  bool ok = true;
+  for (const TestFrame& fr : frames) ok &= std::fwrite(fr.data.data(), sizeof(float), fr.data.size(), f) == fr.data.size();
+  return std::fclose(f) == 0 && ok;
+}
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2 || argv[1][0] == '\0') {
+    std::fprintf(stderr, "usage: gcv_depth_writer DIR\n       gcv_depth_writer --selftest\n");
+    return 2;
+  }
+  std::error_code ec;
+  if (std::strcmp(argv[1], "--selftest") == 0) {
+    const std::filesystem::path tmp = std::filesystem::temp_directory_path() / ("gcv_depth_writer_" + std::to_string(getpid()));
+    std::filesystem::create_directories(tmp, ec);
+    const std::string res = run_depth_chunk_writer_tests(tmp.string());
+    std::filesystem::remove_all(tmp, ec);
+    std::printf("depth chunk writer: %s\n", res.c_str());
+    return res == "ok" ? 0 : 1;
+  }
+  const std::string dir = argv[1];
+  std::filesystem::create_directories(dir, ec);
+  const std::vector<TestFrame> frames = test_frames();
+  if (!write_gcvd(dir + "/depth_v1.gcvd", false, frames) || !write_gcvd(dir + "/depth_v2.gcvd", true, frames) ||
+      !write_expected(dir + "/expected.f32", frames)) {
+    std::fprintf(stderr, "gcv_depth_writer: writing into %s failed\n", dir.c_str());
+    return 1;
+  }
+  return 0;
+}
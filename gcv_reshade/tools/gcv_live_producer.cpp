@@ -0,0 +1,67 @@
+// gcv_live_producer: publishes a synthetic live stream through the addon's LiveStreamWriter
+// (live_stream.h), so that consumers can be tested against the real writer without a game.
+// Frame k carries value k+1: cam2world filled with it, every color byte value & 0xFF, every depth
+// sample value (the pattern gcv_live.py --selftest checks).
+//
+//   gcv_live_producer NAME FRAMES [FPS]   4 slots, 640x360 BGRA color and float depth; FPS 120
+//   gcv_live_producer --selftest          run_live_stream_tests; exit code 1 if it fails
+#include "live_stream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int usage() {
+  std::fprintf(stderr,
+    "usage: gcv_live_producer NAME FRAMES [FPS]\n"
+    "       gcv_live_producer --selftest\n");
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 2 && std::strcmp(argv[1], "--selftest") == 0) {
+    const std::string res = run_live_stream_tests();
+    std::printf("live stream: %s\n", res.c_str());
+    return res == "ok" ? 0 : 1;
+  }
+  if (argc < 3 || argv[1][0] == '-') return usage();
+  const std::string name = argv[1];
+  const int frames = std::atoi(argv[2]);
+  const int fps = argc > 3 ? std::max(1, std::atoi(argv[3])) : 120;
+
+  const int w = 640, h = 360;
+  std::vector<uint8_t> color((size_t)w * h * 4);
+  std::vector<float> depth((size_t)w * h);
+  LiveStreamWriter writer;
+  if (!writer.open(name, 4, color.size(), depth.size() * sizeof(float), fps)) return 1;
+
+  using clock = std::chrono::steady_clock;
+  const clock::time_point t0 = clock::now();
+  double worst_ms = 0.0;
+  for (int k = 0; k < frames; ++k) {
+    const uint64_t value = (uint64_t)k + 1;
+    std::fill(color.begin(), color.end(), (uint8_t)(value & 0xFF));
+    std::fill(depth.begin(), depth.end(), (float)value);
+    GcvFrameRecord r{};
+    r.frame_idx = (uint64_t)k;
+    r.time_us = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - t0).count();
+    r.cam_time_us = r.time_us;
+    for (double& v : r.cam2world) v = (double)value;
+    r.flags = GCVF_CAM_VALID;
+
+    const clock::time_point t = clock::now();
+    writer.put_color(r.frame_idx, color.data(), color.size(), w, h, (size_t)w * 4, /*BGRA*/0);
+    writer.put_depth(r.frame_idx, depth.data(), w, h);
+    writer.commit(r);
+    worst_ms = std::max(worst_ms, std::chrono::duration<double, std::milli>(clock::now() - t).count());
+    std::this_thread::sleep_until(t0 + std::chrono::microseconds((int64_t)(k + 1) * 1000000 / fps));
+  }
+  writer.close();
+  std::printf("producer: %d frames, slowest publish %.2f ms\n", frames, worst_ms);
+  return 0;
+}
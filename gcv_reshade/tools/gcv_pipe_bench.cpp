@@ -0,0 +1,220 @@
+// gcv_pipe_bench: drives FfmpegPipe (ffmpeg_pipe.h) the way the recorder does, against a real
+// ffmpeg or against this program as a stub consumer, and prints the pipe's throughput and stalls.
+//
+//   gcv_pipe_bench [--frames 300] [--size 1920x1080] [--format bgra|gray] [--timing wallclock|vfr]
+//                  [--ffmpeg EXE] [--stub-us-per-mb 0] [--out DIR]
+//       without --ffmpeg the stub consumer copies stdin to the output file (stub-us-per-mb slows it down)
+//   gcv_pipe_bench --selftest   round trips through the stub consumer; exit code 1 if one fails
+//
+// The stub consumer is this executable started by FfmpegPipe with ffmpeg's command line and
+// GCV_PIPE_STUB in its environment: it writes what arrives on stdin to the last argument (the
+// output file), optionally exiting early after GCV_PIPE_STUB_EXIT_AFTER bytes.
+#include "ffmpeg_pipe.h"
+#include "mkv_feed.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+static std::string g_self;   // this executable, the stub consumer
+
+static int stub_main(int argc, char** argv) {
+  const char* exit_after = std::getenv("GCV_PIPE_STUB_EXIT_AFTER");
+  const char* us_per_mb = std::getenv("GCV_PIPE_STUB_US_PER_MB");
+  const uint64_t limit = exit_after ? std::strtoull(exit_after, nullptr, 10) : UINT64_MAX;
+  const long delay = us_per_mb ? std::atol(us_per_mb) : 0;
+  FILE* out = std::fopen(argv[argc - 1], "wb");
+  if (!out) return 1;
+  std::vector<char> buf(1 << 20);
+  uint64_t total = 0;
+  for (;;) {
+    const ssize_t got = read(STDIN_FILENO, buf.data(), (size_t)std::min<uint64_t>(buf.size(), limit - total));
+    if (got <= 0) break;
+    std::fwrite(buf.data(), 1, (size_t)got, out);
+    total += (uint64_t)got;
+    if (total >= limit) break;
+    if (delay > 0) std::this_thread::sleep_for(std::chrono::microseconds(delay * got / (1 << 20)));
+  }
+  std::fclose(out);
+  return 0;
+}
+
+// stub consumer settings for the pipes started until the next call
+static void set_stub(bool on, uint64_t exit_after = 0, long us_per_mb = 0) {
+  if (!on) {
+    unsetenv("GCV_PIPE_STUB");
+    unsetenv("GCV_PIPE_STUB_EXIT_AFTER");
+    unsetenv("GCV_PIPE_STUB_US_PER_MB");
+    return;
+  }
+  setenv("GCV_PIPE_STUB", "1", 1);
+  if (exit_after) setenv("GCV_PIPE_STUB_EXIT_AFTER", std::to_string(exit_after).c_str(), 1);
+  else unsetenv("GCV_PIPE_STUB_EXIT_AFTER");
+  setenv("GCV_PIPE_STUB_US_PER_MB", std::to_string(us_per_mb).c_str(), 1);
+}
+
+static std::string read_file(const std::string& path) {
+  std::ifstream f(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+static std::vector<uint8_t> test_frame(size_t bytes, int k) {
+  std::vector<uint8_t> f(bytes);
+  for (size_t i = 0; i < bytes; ++i) f[i] = (uint8_t)(k * 31 + i * 7 + (i >> 9));
+  return f;
+}
+
+static std::string run_pipe_tests(const std::string& dir) {
+  const int w = 96, h = 40, frames = 6;
+  {  // wall clock, BGRA: capture.mp4 is exactly the raw frames, in order
+    set_stub(true);
+    FfmpegPipe p;
+    p.set_executable(g_self);
+    if (!p.start_bgra(w, h, 30, dir)) RETURNFAILST("pipe: start_bgra with the stub consumer");
+    if (!p.alive() || p.timestamped()) RETURNFAILST("pipe: wall clock pipe state");
+    std::string expect;
+    for (int k = 0; k < frames; ++k) {
+      const std::vector<uint8_t> f = test_frame((size_t)w * h * 4, k);
+      if (!p.write(f.data(), f.size())) RETURNFAILST("pipe: write frame " + std::to_string(k));
+      expect.append((const char*)f.data(), f.size());
+    }
+    const PipeWriteStats st = p.stats();
+    p.stop(true);
+    if (st.writes != (uint64_t)frames || st.bytes != expect.size()) RETURNFAILST("pipe: write stats");
+    if (read_file(p.output_path()) != expect) RETURNFAILST("pipe: capture.mp4 differs from the frames written");
+  }
+  {  // Vfr, gray: Matroska header, then each frame behind its header with its time since the first
+    set_stub(true);
+    FfmpegPipe p;
+    p.set_executable(g_self);
+    p.set_timing(VideoTiming::Vfr);
+    if (!p.start_gray(w, h, 30, dir) || !p.timestamped()) RETURNFAILST("pipe: start_gray (vfr) with the stub consumer");
+    std::string expect = mkv_stream_header(w, h, mkv_fourcc_for_pix_fmt("gray"));
+    const int64_t t0 = 5000000, times[frames] = { 0, 33333, 66667, 66667, 120000, 150000 };   // a repeated stamp
+    int64_t last = -1;
+    for (int k = 0; k < frames; ++k) {
+      const std::vector<uint8_t> f = test_frame((size_t)w * h, k);
+      if (!p.write_frame(f.data(), f.size(), t0 + times[k])) RETURNFAILST("pipe: write_frame " + std::to_string(k));
+      const int64_t pts = std::max(times[k], last + 1);
+      last = pts;
+      uint8_t hdr[kMkvMaxFrameHeader];
+      expect.append((const char*)hdr, mkv_frame_header(hdr, pts, f.size()));
+      expect.append((const char*)f.data(), f.size());
+    }
+    const PipeWriteStats st = p.stats();
+    p.stop(true);
+    if (st.pts_fixups != 1 || st.last_pts_us != 150000) RETURNFAILST("pipe: timestamp fixups");
+    if (read_file(p.output_path()) != expect) RETURNFAILST("pipe: depth.mp4 differs from the Matroska feed");
+  }
+  {  // a consumer that exits: writes fail and alive() notices without a write
+    set_stub(true, /*exit_after=*/4096);
+    FfmpegPipe p;
+    p.set_executable(g_self);
+    if (!p.start_bgra(w, h, 30, dir)) RETURNFAILST("pipe: start_bgra (early exit)");
+    const std::vector<uint8_t> f = test_frame((size_t)1 << 20, 0);
+    bool failed = false;
+    for (int k = 0; k < 64 && !failed; ++k) failed = !p.write(f.data(), f.size());
+    if (!failed) RETURNFAILST("pipe: writes into an exited consumer succeed");
+    bool gone = false;
+    for (int i = 0; i < 200 && !gone; ++i) {
+      gone = !p.alive();
+      if (!gone) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    if (!gone) RETURNFAILST("pipe: alive() after the consumer exited");
+    p.stop(true);
+  }
+  {  // a missing executable fails to start
+    set_stub(false);
+    FfmpegPipe p;
+    p.set_executable(dir + "/no_such_encoder");
+    if (p.start_bgra(w, h, 30, dir) || p.alive()) RETURNFAILST("pipe: a missing executable starts");
+  }
+  set_stub(false);
+  return "ok";
+}
+
+static int usage() {
+  std::fprintf(stderr,
+    "usage: gcv_pipe_bench [--frames N] [--size WxH] [--format bgra|gray] [--timing wallclock|vfr]\n"
+    "                      [--ffmpeg EXE] [--stub-us-per-mb N] [--out DIR]\n"
+    "       gcv_pipe_bench --selftest\n");
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  if (std::getenv("GCV_PIPE_STUB")) return stub_main(argc, argv);
+  g_self = std::filesystem::absolute(argv[0]).string();
+  const std::filesystem::path tmp = std::filesystem::temp_directory_path() / ("gcv_pipe_bench_" + std::to_string(getpid()));
+
+  if (argc == 2 && std::strcmp(argv[1], "--selftest") == 0) {
+    const std::string res = run_pipe_tests(tmp.string());
+    std::error_code ec;
+    std::filesystem::remove_all(tmp, ec);
+    std::printf("ffmpeg pipe: %s\n", res.c_str());
+    return res == "ok" ? 0 : 1;
+  }
+
+  int frames = 300, w = 1920, h = 1080;
+  long stub_us = 0;
+  bool gray = false;
+  VideoTiming timing = VideoTiming::WallClock;
+  std::string ffmpeg, out = tmp.string();
+  for (int i = 1; i < argc; ++i) {
+    const std::string opt = argv[i];
+    if (i + 1 >= argc) return usage();
+    const char* val = argv[++i];
+    if (opt == "--frames") frames = std::max(1, std::atoi(val));
+    else if (opt == "--size") { if (std::sscanf(val, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) return usage(); }
+    else if (opt == "--format") { gray = std::strcmp(val, "gray") == 0; if (!gray && std::strcmp(val, "bgra") != 0) return usage(); }
+    else if (opt == "--timing") { timing = std::strcmp(val, "vfr") == 0 ? VideoTiming::Vfr : VideoTiming::WallClock; }
+    else if (opt == "--ffmpeg") ffmpeg = val;
+    else if (opt == "--stub-us-per-mb") stub_us = std::atol(val);
+    else if (opt == "--out") out = val;
+    else return usage();
+  }
+
+  set_stub(ffmpeg.empty(), 0, stub_us);
+  FfmpegPipe p;
+  p.set_executable(ffmpeg.empty() ? g_self : ffmpeg);
+  p.set_timing(timing);
+  const bool started = gray ? p.start_gray(w, h, 60, out) : p.start_bgra(w, h, 60, out);
+  if (!started) {
+    std::fprintf(stderr, "gcv_pipe_bench: %s did not start\n", ffmpeg.empty() ? "the stub consumer" : ffmpeg.c_str());
+    return 1;
+  }
+  const size_t bytes = (size_t)w * h * (gray ? 1 : 4);
+  std::vector<std::vector<uint8_t>> src;
+  for (int k = 0; k < 4; ++k) src.push_back(test_frame(bytes, k));
+  const auto t0 = std::chrono::steady_clock::now();
+  int written = 0;
+  for (; written < frames; ++written) {
+    const std::vector<uint8_t>& f = src[written % src.size()];
+    if (!p.write_frame(f.data(), f.size(), (int64_t)written * 1000000 / 60)) break;
+  }
+  const double write_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  const PipeWriteStats st = p.stats();
+  p.stop(true);
+  const double total_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  set_stub(false);
+  if (ffmpeg.empty()) {
+    std::error_code ec;
+    std::filesystem::remove_all(tmp, ec);
+  }
+  std::printf("%d/%d frames of %dx%d %s (%s): %.1f frames/s, %.1f MB/s written; %llu stalls, %.1f ms stalled; "
+              "%llu pieces; %.1f s until the consumer exited\n",
+              written, frames, w, h, gray ? "gray" : "bgra", video_timing_name(timing), written / write_s,
+              st.bytes / write_s / (1 << 20), (unsigned long long)st.stalls, st.stall_us / 1000.0,
+              (unsigned long long)st.pieces, total_s);
+  return written == frames ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+// gcv_replay: replays a capture trace (capture.gcvt, written by the addon with "Trace the next
+// recording") through the capture path on any machine, without a game or a GPU, and prints the
+// result as JSON (CaptureReplayResult::to_json, capture_replay.h).
+//
+//   gcv_replay capture.gcvt [--speed 1] [--loops 1] [--gpu-us 2000] [--encoder-us 0]
+//                           [--encoder-capacity 8] [--format i420|nv12|bgra] [--pool-slots 24]
+//   gcv_replay --selftest   the self-tests of the capture path's units; exit code 1 if one fails
+//
+// Textures are unpacked by unpack_traced_readback: 8-bit RGBA/BGRA color and float depth.
+#include "capture_governor.h"
+#include "capture_pipeline.h"
+#include "capture_profile.h"
+#include "capture_replay.h"
+#include "frame_bus.h"
+#include "latency_histogram.h"
+#include "motion_trigger.h"
+#include "readback_ring.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static int usage() {
+  std::fprintf(stderr,
+    "usage: gcv_replay TRACE.gcvt [--speed X] [--loops N] [--gpu-us N] [--encoder-us N]\n"
+    "                  [--encoder-capacity N] [--format i420|nv12|bgra] [--pool-slots N]\n"
+    "       gcv_replay --selftest\n");
+  return 2;
+}
+
+static int selftest() {
+  const std::pair<const char*, std::string (*)()> tests[] = {
+    { "capture scheduler", run_capture_scheduler_tests },
+    { "motion trigger", run_motion_trigger_tests },
+    { "readback ring", run_readback_ring_tests },
+    { "capture pipeline", run_capture_pipeline_tests },
+    { "latency histogram", run_latency_histogram_tests },
+    { "frame bus", run_frame_bus_tests },
+    { "capture governor", run_capture_governor_tests },
+    { "capture replay", run_capture_replay_tests },
+  };
+  int failed = 0;
+  for (const auto& t : tests) {
+    const std::string res = t.second();
+    std::printf("%s: %s\n", t.first, res.c_str());
+    if (res != "ok") ++failed;
+  }
+  return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 2 && std::strcmp(argv[1], "--selftest") == 0) return selftest();
+  if (argc < 2 || argv[1][0] == '-') return usage();
+
+  const std::string path = argv[1];
+  CaptureReplayConfig cfg;
+  for (int i = 2; i < argc; ++i) {
+    const std::string opt = argv[i];
+    if (i + 1 >= argc) return usage();
+    const char* val = argv[++i];
+    if (opt == "--speed") cfg.speed = std::atof(val);
+    else if (opt == "--loops") cfg.loops = std::atoi(val);
+    else if (opt == "--gpu-us") cfg.gpu_us = std::atoi(val);
+    else if (opt == "--encoder-us") cfg.encoder_us = std::atoi(val);
+    else if (opt == "--encoder-capacity") cfg.encoder_capacity = (size_t)std::max(1, std::atoi(val));
+    else if (opt == "--pool-slots") cfg.pool_slots = (size_t)std::max(2, std::atoi(val));
+    else if (opt == "--format") {
+      const std::string f = val;
+      if (f == "i420") cfg.color_format = FrameFormat::I420;
+      else if (f == "nv12") cfg.color_format = FrameFormat::NV12;
+      else if (f == "bgra") cfg.color_format = FrameFormat::BGRA;
+      else return usage();
+    } else {
+      return usage();
+    }
+  }
+
+  CaptureTrace trace;
+  std::string err;
+  if (!load_capture_trace(path, trace, err)) {
+    std::fprintf(stderr, "gcv_replay: %s\n", err.c_str());
+    return 1;
+  }
+  const CaptureReplayResult r = replay_capture_trace(trace, cfg);
+  std::printf("%s\n", r.to_json().dump(2).c_str());
+  std::fprintf(stderr, "%s\n", r.summary().c_str());
+  return r.err.empty() ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+#pragma once
+// The tools are built without ReShade. The sources they share with the addon only use its log, so
+// this header stands in for the SDK's: log lines go to stderr.
+#include <cstdio>
+
+namespace reshade {
+enum class log_level { error = 1, warning = 2, info = 3, debug = 4 };
+
+inline void log_message(log_level level, const char* message) {
+  static const char* const names[] = { "", "error", "warning", "info", "debug" };
+  std::fprintf(stderr, "%s: %s\n", names[(int)level], message);
+}
+}
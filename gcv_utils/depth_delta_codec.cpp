@@ -0,0 +1,226 @@
+// Copyright (C) 2022 Jason Bunk
+#include "gcv_utils/depth_delta_codec.h"
+#include "lz4/lz4.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+size_t depth_codec_bound(int width, int height) {
+	if (width <= 0 || height <= 0) return 0;
+	const size_t bytes = (size_t)width * (size_t)height * sizeof(float);
+	if (bytes > (size_t)LZ4_MAX_INPUT_SIZE) return 0;
+	return (size_t)LZ4_compressBound((int)bytes);
+}
+
+static inline uint32_t zigzag(uint32_t d) { return (d << 1) ^ (uint32_t)((int32_t)d >> 31); }
+static inline uint32_t unzigzag(uint32_t z) { return (z >> 1) ^ (0u - (z & 1u)); }
+
+static inline void put_planes(uint8_t* planes, size_t n, size_t i, uint32_t z) {
+	planes[i] = (uint8_t)z;
+	planes[n + i] = (uint8_t)(z >> 8);
+	planes[2 * n + i] = (uint8_t)(z >> 16);
+	planes[3 * n + i] = (uint8_t)(z >> 24);
+}
+static inline uint32_t get_planes(const uint8_t* planes, size_t n, size_t i) {
+	return (uint32_t)planes[i] | ((uint32_t)planes[n + i] << 8) | ((uint32_t)planes[2 * n + i] << 16) | ((uint32_t)planes[3 * n + i] << 24);
+}
+
+// residuals of the prediction, zigzag coded, into four byte planes
+static void predict_shuffle(const uint32_t* c, const uint32_t* p, int w, int h, uint8_t* planes) {
+	const size_t n = (size_t)w * (size_t)h;
+	for (int y = 0; y < h; ++y) {
+		const size_t row = (size_t)y * (size_t)w;
+		if (p) {
+			put_planes(planes, n, row, zigzag(c[row] - p[row]));
+			for (size_t i = row + 1; i < row + (size_t)w; ++i) {
+				put_planes(planes, n, i, zigzag((c[i] - p[i]) - (c[i - 1] - p[i - 1])));
+			}
+		} else {
+			put_planes(planes, n, row, zigzag(c[row] - (y ? c[row - (size_t)w] : 0u)));
+			for (size_t i = row + 1; i < row + (size_t)w; ++i) {
+				put_planes(planes, n, i, zigzag(c[i] - c[i - 1]));
+			}
+		}
+	}
+}
+
+static void unshuffle_predict(const uint8_t* planes, const uint32_t* p, int w, int h, uint32_t* o) {
+	const size_t n = (size_t)w * (size_t)h;
+	for (int y = 0; y < h; ++y) {
+		const size_t row = (size_t)y * (size_t)w;
+		if (p) {
+			o[row] = p[row] + unzigzag(get_planes(planes, n, row));
+			for (size_t i = row + 1; i < row + (size_t)w; ++i) {
+				o[i] = p[i] + (o[i - 1] - p[i - 1]) + unzigzag(get_planes(planes, n, i));
+			}
+		} else {
+			o[row] = (y ? o[row - (size_t)w] : 0u) + unzigzag(get_planes(planes, n, row));
+			for (size_t i = row + 1; i < row + (size_t)w; ++i) {
+				o[i] = o[i - 1] + unzigzag(get_planes(planes, n, i));
+			}
+		}
+	}
+}
+
+size_t depth_codec_encode(const float* cur, const float* prev, int width, int height,
+	uint8_t* dst, size_t dst_cap, std::vector<uint8_t>& scratch)
+{
+	if (!cur || !dst || depth_codec_bound(width, height) == 0) return 0;
+	const size_t bytes = (size_t)width * (size_t)height * sizeof(float);
+	if (scratch.size() < bytes) scratch.resize(bytes);
+	predict_shuffle(reinterpret_cast<const uint32_t*>(cur), reinterpret_cast<const uint32_t*>(prev), width, height, scratch.data());
+	const int cap = (int)std::min(dst_cap, (size_t)INT32_MAX);
+	const int n = LZ4_compress_default(reinterpret_cast<const char*>(scratch.data()), reinterpret_cast<char*>(dst), (int)bytes, cap);
+	return n > 0 ? (size_t)n : 0;
+}
+
+bool depth_codec_decode(const uint8_t* src, size_t src_bytes, const float* prev, int width, int height,
+	float* out, std::vector<uint8_t>& scratch)
+{
+	if (!src || !out || depth_codec_bound(width, height) == 0 || src_bytes > (size_t)INT32_MAX) return false;
+	const size_t bytes = (size_t)width * (size_t)height * sizeof(float);
+	if (scratch.size() < bytes) scratch.resize(bytes);
+	const int n = LZ4_decompress_safe(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(scratch.data()), (int)src_bytes, (int)bytes);
+	if (n != (int)bytes) return false;
+	unshuffle_predict(scratch.data(), reinterpret_cast<const uint32_t*>(prev), width, height, reinterpret_cast<uint32_t*>(out));
+	return true;
+}
+
+bool save_depth_gcvz(const std::string &filepath, const float* data, int width, int height, std::string &errstr) {
+	if (!data || width <= 0 || height <= 0) {
+		errstr += "gcvz: empty frame " + filepath;
+		return false;
+	}
+	const size_t count = (size_t)width * (size_t)height;
+	std::vector<uint8_t> comp(depth_codec_bound(width, height));
+	std::vector<uint8_t> scratch;
+	GcvzHeader hdr{};
+	std::memcpy(hdr.magic, "GCVZ", 4);
+	hdr.version = 1;
+	hdr.width = (uint32_t)width;
+	hdr.height = (uint32_t)height;
+	const size_t n = comp.empty() ? 0 : depth_codec_encode(data, nullptr, width, height, comp.data(), comp.size(), scratch);
+	const bool packed = n > 0 && n < count * sizeof(float);
+	hdr.codec = packed ? GCVZ_CODEC_KEY : GCVZ_CODEC_RAW;
+	hdr.stored_bytes = packed ? n : count * sizeof(float);
+
+	FILE* f = fopen(filepath.c_str(), "wb");
+	if (!f) {
+		errstr += "gcvz: failed to open file " + filepath;
+		return false;
+	}
+	const void* payload = packed ? (const void*)comp.data() : (const void*)data;
+	const bool ok = fwrite(&hdr, 1, sizeof(hdr), f) == sizeof(hdr)
+		&& fwrite(payload, 1, (size_t)hdr.stored_bytes, f) == (size_t)hdr.stored_bytes;
+	if (fclose(f) != 0 || !ok) {
+		errstr += "gcvz: failed to write " + filepath;
+		return false;
+	}
+	return true;
+}
+
+namespace {
+	using bench_clock = std::chrono::steady_clock;
+	double seconds_since(bench_clock::time_point t0) {
+		return std::chrono::duration<double>(bench_clock::now() - t0).count();
+	}
+}
+
+DepthCodecBenchResult bench_depth_codec(const std::vector<std::vector<float>> &frames, int width, int height,
+	int keyframe_interval)
+{
+	DepthCodecBenchResult res;
+	res.frames = (int)frames.size();
+	res.width = width;
+	res.height = height;
+	static const char* names[3] = { "lz4", "keyframes only", "keyframe+delta" };
+	const size_t count = (size_t)std::max(0, width) * (size_t)std::max(0, height);
+	const size_t bound = depth_codec_bound(width, height);
+	const int interval = std::max(1, keyframe_interval);
+	for (int m = 0; m < 3; ++m) res.rows[m] = { names[m], 0.0, 0.0, 0.0 };
+	if (frames.empty() || count == 0 || bound == 0) return res;
+
+	std::vector<std::vector<uint8_t>> enc(frames.size(), std::vector<uint8_t>(bound));
+	std::vector<size_t> sizes(frames.size());
+	std::vector<uint8_t> scratch;
+	std::vector<float> dec(count), dec_prev(count);
+	const double raw_mb = (double)frames.size() * (double)count * sizeof(float) / (1024.0 * 1024.0);
+	for (int m = 0; m < 3; ++m) {
+		uint64_t stored = 0;
+		auto t0 = bench_clock::now();
+		for (size_t i = 0; i < frames.size(); ++i) {
+			if (frames[i].size() != count) return res;
+			if (m == 0) {
+				const int n = LZ4_compress_default(reinterpret_cast<const char*>(frames[i].data()),
+					reinterpret_cast<char*>(enc[i].data()), (int)(count * sizeof(float)), (int)bound);
+				sizes[i] = n > 0 ? (size_t)n : 0;
+			} else {
+				const float* prev = (m == 2 && i % interval != 0) ? frames[i - 1].data() : nullptr;
+				sizes[i] = depth_codec_encode(frames[i].data(), prev, width, height, enc[i].data(), bound, scratch);
+			}
+			stored += sizes[i];
+		}
+		const double enc_s = seconds_since(t0);
+
+		bool ok = true;
+		t0 = bench_clock::now();
+		for (size_t i = 0; i < frames.size(); ++i) {
+			if (m == 0) {
+				ok &= LZ4_decompress_safe(reinterpret_cast<const char*>(enc[i].data()), reinterpret_cast<char*>(dec.data()),
+					(int)sizes[i], (int)(count * sizeof(float))) == (int)(count * sizeof(float));
+			} else {
+				const float* prev = (m == 2 && i % interval != 0) ? dec_prev.data() : nullptr;
+				ok &= depth_codec_decode(enc[i].data(), sizes[i], prev, width, height, dec.data(), scratch);
+			}
+			dec.swap(dec_prev);
+		}
+		const double dec_s = seconds_since(t0);
+		// lossless: the last decoded frame must match bit for bit
+		ok &= std::memcmp(dec_prev.data(), frames.back().data(), count * sizeof(float)) == 0;
+
+		DepthCodecBenchRow& r = res.rows[m];
+		r.ratio = (ok && stored) ? raw_mb * 1024.0 * 1024.0 / (double)stored : 0.0;
+		r.encode_mb_s = enc_s > 0.0 ? raw_mb / enc_s : 0.0;
+		r.decode_mb_s = dec_s > 0.0 ? raw_mb / dec_s : 0.0;
+	}
+	return res;
+}
+
+std::vector<std::vector<float>> make_synthetic_depth_sequence(int width, int height, int count) {
+	std::vector<std::vector<float>> out;
+	if (width <= 0 || height <= 0 || count <= 0) return out;
+	const double f = 0.5 * width;            // ~90 degree horizontal fov
+	const double cx = 0.5 * width, cy = 0.5 * height;
+	const double cam_h = 1.7;                // eye height above the floor
+	out.resize((size_t)count);
+	for (int k = 0; k < count; ++k) {
+		std::vector<float>& d = out[(size_t)k];
+		d.resize((size_t)width * (size_t)height);
+		const double travel = 0.05 * k;      // walking forward, slowly turning
+		const double yaw = 0.002 * k;
+		const double wall = 40.0 - travel;   // back wall distance
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				const double rx = (x + 0.5 - cx) / f + yaw;
+				const double ry = (y + 0.5 - cy) / f + 0.08 * rx;              // slightly rolled camera
+				double z = wall;
+				if (ry > 1e-6) {                                                // gently rolling floor
+					const double zf = cam_h / ry;
+					z = std::min(z, zf * (1.0 + 0.01 * std::sin(0.7 * (zf + travel)) * std::cos(3.0 * rx)));
+				}
+				const double side = std::fabs(rx) > 1e-6 ? 4.0 / std::fabs(rx) : 1e9;
+				z = std::min(z, side);                                          // corridor walls at +-4 m
+				// two boxes ahead, 1 m tall
+				for (int b = 0; b < 2; ++b) {
+					const double bz = (b ? 18.0 : 9.0) - travel;
+					const double bx = b ? 1.5 : -1.0;
+					if (bz > 0.5 && std::fabs(rx * bz - bx) < 0.6 && ry * bz > cam_h - 1.0) z = std::min(z, bz);
+				}
+				d[(size_t)y * width + x] = (float)z;
+			}
+		}
+	}
+	return out;
+}
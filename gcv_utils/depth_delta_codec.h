@@ -0,0 +1,66 @@
+#pragma once
+// Copyright (C) 2022 Jason Bunk
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Lossless codec for float32 depth frames. Each pixel's 32-bit pattern is predicted, the
+// prediction error is zigzag coded (small errors of either sign -> small unsigned words), the
+// words are split into four byte planes (low bytes, ..., high bytes) so the near-zero high planes
+// form long runs, and the result is LZ4 compressed. Integer arithmetic on the bit patterns keeps
+// it lossless; for positive floats a small change in depth is a small change in the pattern.
+//   keyframe (prev == nullptr): predicted by the left neighbour (first column: the pixel above)
+//   delta frame: by the same pixel of the previous frame, corrected by how much the left
+//                neighbour changed since then; a static camera or a static region gives zeros
+// Decoding a delta frame needs the decoded previous frame, so a sequence is cut into groups that
+// each start with a keyframe. Used by depth.gcvd (gcv_reshade/depth_chunk_writer.h) and the .gcvz
+// image writer; python decoder: python_threedee/gcv_depth_reader.py
+
+// Worst-case encoded size of a width x height frame (0 if too large for LZ4)
+size_t depth_codec_bound(int width, int height);
+
+// prev: previous frame of the group (same size), nullptr for a keyframe.
+// Returns the encoded size, 0 if it did not fit into dst_cap. scratch is reused between calls.
+size_t depth_codec_encode(const float* cur, const float* prev, int width, int height,
+	uint8_t* dst, size_t dst_cap, std::vector<uint8_t>& scratch);
+
+// prev: the decoded previous frame for a delta frame, nullptr for a keyframe
+bool depth_codec_decode(const uint8_t* src, size_t src_bytes, const float* prev, int width, int height,
+	float* out, std::vector<uint8_t>& scratch);
+
+// Single keyframe file (frame_XXXXXX_depth.gcvz): GcvzHeader, then stored_bytes of payload
+enum GcvzCodec : uint32_t {
+	GCVZ_CODEC_RAW = 0,            // float32, row-major
+	GCVZ_CODEC_KEY = 2,            // depth_codec_encode keyframe (same id as in depth.gcvd)
+};
+#pragma pack(push, 1)
+struct GcvzHeader {
+	char magic[4];            // "GCVZ"
+	uint32_t version;         // 1
+	uint32_t width, height;
+	uint32_t codec;           // GcvzCodec
+	uint32_t reserved;
+	uint64_t stored_bytes;
+};
+#pragma pack(pop)
+static_assert(sizeof(GcvzHeader) == 32, "gcvz header layout");
+
+bool save_depth_gcvz(const std::string &filepath, const float* data, int width, int height, std::string &errstr);
+
+// Compression ratio and single-thread throughput of plain LZ4, keyframes only and keyframe +
+// delta frames (a keyframe every keyframe_interval frames) over a sequence of frames
+struct DepthCodecBenchRow {
+	const char* name;
+	double ratio;             // raw bytes / stored bytes
+	double encode_mb_s;       // raw MB per second
+	double decode_mb_s;
+};
+struct DepthCodecBenchResult {
+	int frames = 0, width = 0, height = 0;
+	DepthCodecBenchRow rows[3];
+};
+DepthCodecBenchResult bench_depth_codec(const std::vector<std::vector<float>> &frames, int width, int height,
+	int keyframe_interval);
+// Smooth synthetic depth (a tilted floor, walls and a few boxes) seen from a slowly moving camera
+std::vector<std::vector<float>> make_synthetic_depth_sequence(int width, int height, int count);
@@ -1,5 +1,6 @@
 // Copyright (C) 2022 Jason Bunk
 #include "gcv_utils/image_queue_entry.h" 
+#include "gcv_utils/depth_delta_codec.h"
 #include <cnpy.h>
 #include <fpzip/fpzip.h>
 #include <fstream>
@@ -10,6 +11,7 @@
 #include <cmath>
 #include <algorithm>
 #include <queue>
+#include <filesystem>
 
 #define RobustNth 50
 
@@ -141,11 +143,21 @@ bool save_packedbuf_to_epr(const std::string& filepath,
 }
 
 
-bool queue_item_image2write::write_to_disk(std::string &errstr) const {
+static void count_written_file(const std::string &path, uint64_t *files_written, uint64_t *bytes_written) {
+	if (!files_written && !bytes_written) return;
+	std::error_code ec;
+	const uintmax_t sz = std::filesystem::file_size(std::filesystem::u8path(path), ec);
+	if (ec) return;
+	if (files_written) *files_written += 1;
+	if (bytes_written) *bytes_written += static_cast<uint64_t>(sz);
+}
+
+bool queue_item_image2write::write_to_disk(std::string &errstr, uint64_t *files_written, uint64_t *bytes_written) const {
 	if (writers == ImageWriter_none || writers >= ImageWriter_end) return false;
 	bool allgood = true;
 	if (writers & ImageWriter_STB_png) {
 		allgood &= save_packedbuf_as_8bit_png_image(filepath_noexten + std::string(".png"), mybuf, errstr);
+		count_written_file(filepath_noexten + std::string(".png"), files_written, bytes_written);
 	}
 	if (writers & ImageWriter_numpy) {
 		switch (mybuf.pixfmt) {
@@ -166,14 +178,27 @@ bool queue_item_image2write::write_to_disk(std::string &errstr) const {
 		}
 		default: allgood = false;
 		}
+		count_written_file(filepath_noexten + std::string(".npy"), files_written, bytes_written);
 	}
 	if (writers & ImageWriter_fpzip) {
 		allgood &= save_packedbuf_f32_using_fpzip(filepath_noexten + std::string(".fpzip"),
 			mybuf, errstr);
+		count_written_file(filepath_noexten + std::string(".fpzip"), files_written, bytes_written);
 	}
 	 if (writers & ImageWriter_epr) {
         allgood &= save_packedbuf_to_epr(filepath_noexten + std::string(".epr"),
             mybuf, errstr);
+        count_written_file(filepath_noexten + std::string(".epr"), files_written, bytes_written);
     }
+	if (writers & ImageWriter_gcvz) {
+		if (mybuf.pixfmt != BUF_PIX_FMT_GRAYF32) {
+			errstr += "gcvz: only writes f32 depth data; refusing " + filepath_noexten;
+			allgood = false;
+		} else {
+			allgood &= save_depth_gcvz(filepath_noexten + std::string(".gcvz"), mybuf.cdata<float>(),
+				static_cast<int>(mybuf.width), static_cast<int>(mybuf.height), errstr);
+			count_written_file(filepath_noexten + std::string(".gcvz"), files_written, bytes_written);
+		}
+	}
 	return allgood;
 }
@@ -1,6 +1,7 @@
 #pragma once
 // Copyright (C) 2022 Jason Bunk
 #include "gcv_utils/simple_packed_buf.h" 
+#include <cstdint>
 #include <string>
 
 enum ImageWriterType {
@@ -9,7 +10,8 @@ enum ImageWriterType {
 	ImageWriter_numpy   = (1 << 1),
 	ImageWriter_fpzip   = (1 << 2),
 	ImageWriter_epr     = (1 << 3),
-	ImageWriter_end     = (1 << 4),
+	ImageWriter_gcvz    = (1 << 4),   // f32 depth, lossless keyframe of gcv_utils/depth_delta_codec.h
+	ImageWriter_end     = (1 << 5),
 };
 
 struct queue_item_image2write {
@@ -21,5 +23,6 @@ struct queue_item_image2write {
 		const std::string &filepath_noextension)
 		: writers(image_writers), filepath_noexten(filepath_noextension) {}
 
-	bool write_to_disk(std::string &errstr) const;
+	// files_written/bytes_written (optional) are incremented for every file that was saved
+	bool write_to_disk(std::string &errstr, uint64_t *files_written = nullptr, uint64_t *bytes_written = nullptr) const;
 };
@@ -1,6 +1,7 @@
 // Copyright (C) 2022 Jason Bunk
 #include "gcv_utils/miscutils.h" 
 #include "gcv_utils/geometry.h"
+#include "gcv_utils/yuv_convert.h"
 #include <locale>
 #include <codecvt>
 #include <algorithm>
@@ -108,5 +109,6 @@ std::string run_utils_tests() {
 		const Vec3 testlookdir = Vec3(-0.441620, -0.853757, 0.275811); CamMatrix testlookcam = build_cam_matrix_from_pos_and_lookdir(testcampos, testlookdir);
 		CHECKVECNEAR("lookcam4_col0", testlookcam.col(0), -0.888209, 0.459441, 0.0) CHECKVECNEAR("lookcam4_col1", testlookcam.col(1), testlookdir(0), testlookdir(1), testlookdir(2)) CHECKVECNEAR("lookcam4_col2", testlookcam.col(2), 0.126719, 0.244978, 0.961212) CHECKVECNEAR("lookcam4_col3", testlookcam.col(3), 5.0, 2.0, 3.0)
 	}
+	{const std::string yuvres = run_yuv_convert_tests(); if (yuvres.compare("ok")) return yuvres;}
 	return std::string("ok");
 }
@@ -7,6 +7,7 @@ size_t simple_packed_buf::bytes_per_pixel() const {
 	case BUF_PIX_FMT_RGBA: return 4;
 	case BUF_PIX_FMT_GRAYU32: return 4;
 	case BUF_PIX_FMT_GRAYF32: return sizeof(float);
+	case BUF_PIX_FMT_NONE: break;
 	}
 	// TODO: raise error!
 	return 0;
@@ -0,0 +1,404 @@
+// Copyright (C) 2022 Jason Bunk
+#include "gcv_utils/yuv_convert.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define GCV_YUV_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC lets any function use any intrinsic; the dispatcher makes sure the CPU has it
+#define GCV_TARGET_SSE41
+#define GCV_TARGET_AVX2
+#else
+#define GCV_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define GCV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Fixed-point BT.601 limited range:
+//   Y = ((66 R + 129 G + 25 B + 128) >> 8) + 16
+//   U = ((-38 sR - 74 sG + 112 sB + 512) >> 10) + 128     (sR, sG, sB: sums over the 2x2 block)
+//   V = ((112 sR - 94 sG - 18 sB + 512) >> 10) + 128
+// Y stays within [16,235] and U,V within [16,240] for any input, so no clamping is needed.
+enum { YR = 66, YG = 129, YB = 25, UR = -38, UG = -74, UB = 112, VR = 112, VG = -94, VB = -18 };
+
+namespace {
+
+struct RowPair {
+	const uint8_t* r0;   // top source row
+	const uint8_t* r1;   // bottom source row (== r0 for the last row of an odd height)
+	uint8_t* y0;
+	uint8_t* y1;         // nullptr if r1 is a replicated row
+	uint8_t* u;          // I420: U row, NV12: UV row
+	uint8_t* v;          // I420: V row, NV12: UV row + 1
+	int uvstep;          // 1 for I420, 2 for NV12
+};
+
+struct SrcFormat {
+	int bpp, ro, go, bo;   // bytes per pixel and channel offsets
+};
+
+SrcFormat src_format(YuvSrcOrder order) {
+	switch (order) {
+	case YuvSrcOrder::RGBA:  return { 4, 0, 1, 2 };
+	case YuvSrcOrder::RGB24: return { 3, 0, 1, 2 };
+	default:                 return { 4, 2, 1, 0 };
+	}
+}
+
+inline uint8_t luma(int r, int g, int b) {
+	return (uint8_t)(((YR * r + YG * g + YB * b + 128) >> 8) + 16);
+}
+
+// columns [x0, w) of one row pair; x0 must be even
+void rows_scalar(const RowPair& rp, const SrcFormat& f, int x0, int w) {
+	for (int x = x0; x < w; x += 2) {
+		const int xb = (x + 1 < w) ? x + 1 : x;
+		const uint8_t* a0 = rp.r0 + (size_t)x * f.bpp;
+		const uint8_t* b0 = rp.r0 + (size_t)xb * f.bpp;
+		const uint8_t* a1 = rp.r1 + (size_t)x * f.bpp;
+		const uint8_t* b1 = rp.r1 + (size_t)xb * f.bpp;
+		rp.y0[x] = luma(a0[f.ro], a0[f.go], a0[f.bo]);
+		if (xb != x) rp.y0[xb] = luma(b0[f.ro], b0[f.go], b0[f.bo]);
+		if (rp.y1) {
+			rp.y1[x] = luma(a1[f.ro], a1[f.go], a1[f.bo]);
+			if (xb != x) rp.y1[xb] = luma(b1[f.ro], b1[f.go], b1[f.bo]);
+		}
+		const int sr = a0[f.ro] + b0[f.ro] + a1[f.ro] + b1[f.ro];
+		const int sg = a0[f.go] + b0[f.go] + a1[f.go] + b1[f.go];
+		const int sb = a0[f.bo] + b0[f.bo] + a1[f.bo] + b1[f.bo];
+		const size_t c = (size_t)(x / 2) * rp.uvstep;
+		rp.u[c] = (uint8_t)(((UR * sr + UG * sg + UB * sb + 512) >> 10) + 128);
+		rp.v[c] = (uint8_t)(((VR * sr + VG * sg + VB * sb + 512) >> 10) + 128);
+	}
+}
+
+#ifdef GCV_YUV_X86
+
+// per-channel int16 weights in the source's memory order (alpha weight 0), for pmaddwd
+struct Coefs4 { short c[4]; };
+Coefs4 coefs4(const SrcFormat& f, int kr, int kg, int kb) {
+	Coefs4 k = { { 0, 0, 0, 0 } };
+	k.c[f.ro] = (short)kr; k.c[f.go] = (short)kg; k.c[f.bo] = (short)kb;
+	return k;
+}
+
+// 16 pixels per step. Pixels are widened to int16, pmaddwd + phaddd give one int32 per pixel;
+// the chroma terms are taken on the vertical sums and a second phaddd adds horizontal pairs.
+GCV_TARGET_SSE41 int rows_sse41(const RowPair& rp, const SrcFormat& f, int w) {
+	const Coefs4 ky = coefs4(f, YR, YG, YB), ku = coefs4(f, UR, UG, UB), kv = coefs4(f, VR, VG, VB);
+	const __m128i cy = _mm_setr_epi16(ky.c[0], ky.c[1], ky.c[2], ky.c[3], ky.c[0], ky.c[1], ky.c[2], ky.c[3]);
+	const __m128i cu = _mm_setr_epi16(ku.c[0], ku.c[1], ku.c[2], ku.c[3], ku.c[0], ku.c[1], ku.c[2], ku.c[3]);
+	const __m128i cv = _mm_setr_epi16(kv.c[0], kv.c[1], kv.c[2], kv.c[3], kv.c[0], kv.c[1], kv.c[2], kv.c[3]);
+	const __m128i z = _mm_setzero_si128();
+	const __m128i yrnd = _mm_set1_epi32(128), yoff = _mm_set1_epi32(16);
+	const __m128i crnd = _mm_set1_epi32(512), coff = _mm_set1_epi32(128);
+
+	int x = 0;
+	for (; x + 16 <= w; x += 16) {
+		__m128i ya[4], yb[4], up[4], vp[4];
+		for (int k = 0; k < 4; ++k) {
+			const __m128i a = _mm_loadu_si128((const __m128i*)(rp.r0 + 4 * (size_t)(x + 4 * k)));
+			const __m128i b = _mm_loadu_si128((const __m128i*)(rp.r1 + 4 * (size_t)(x + 4 * k)));
+			const __m128i alo = _mm_unpacklo_epi8(a, z), ahi = _mm_unpackhi_epi8(a, z);
+			const __m128i blo = _mm_unpacklo_epi8(b, z), bhi = _mm_unpackhi_epi8(b, z);
+			ya[k] = _mm_hadd_epi32(_mm_madd_epi16(alo, cy), _mm_madd_epi16(ahi, cy));
+			yb[k] = _mm_hadd_epi32(_mm_madd_epi16(blo, cy), _mm_madd_epi16(bhi, cy));
+			const __m128i slo = _mm_add_epi16(alo, blo), shi = _mm_add_epi16(ahi, bhi);
+			up[k] = _mm_hadd_epi32(_mm_madd_epi16(slo, cu), _mm_madd_epi16(shi, cu));
+			vp[k] = _mm_hadd_epi32(_mm_madd_epi16(slo, cv), _mm_madd_epi16(shi, cv));
+		}
+		for (int k = 0; k < 4; ++k) {
+			ya[k] = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(ya[k], yrnd), 8), yoff);
+			yb[k] = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(yb[k], yrnd), 8), yoff);
+		}
+		_mm_storeu_si128((__m128i*)(rp.y0 + x), _mm_packus_epi16(_mm_packs_epi32(ya[0], ya[1]), _mm_packs_epi32(ya[2], ya[3])));
+		if (rp.y1) _mm_storeu_si128((__m128i*)(rp.y1 + x), _mm_packus_epi16(_mm_packs_epi32(yb[0], yb[1]), _mm_packs_epi32(yb[2], yb[3])));
+
+		__m128i u0 = _mm_hadd_epi32(up[0], up[1]), u1 = _mm_hadd_epi32(up[2], up[3]);
+		__m128i v0 = _mm_hadd_epi32(vp[0], vp[1]), v1 = _mm_hadd_epi32(vp[2], vp[3]);
+		u0 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(u0, crnd), 10), coff);
+		u1 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(u1, crnd), 10), coff);
+		v0 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(v0, crnd), 10), coff);
+		v1 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(v1, crnd), 10), coff);
+		const __m128i u8 = _mm_packus_epi16(_mm_packs_epi32(u0, u1), z);   // 8 bytes
+		const __m128i v8 = _mm_packus_epi16(_mm_packs_epi32(v0, v1), z);
+		if (rp.uvstep == 1) {
+			_mm_storel_epi64((__m128i*)(rp.u + x / 2), u8);
+			_mm_storel_epi64((__m128i*)(rp.v + x / 2), v8);
+		} else {
+			_mm_storeu_si128((__m128i*)(rp.u + x), _mm_unpacklo_epi8(u8, v8));
+		}
+	}
+	return x;
+}
+
+// 32 pixels per step, same arithmetic as rows_sse41. The in-lane unpack/hadd leave the results
+// in 128-bit-lane order; one vpermd per output restores pixel order.
+GCV_TARGET_AVX2 int rows_avx2(const RowPair& rp, const SrcFormat& f, int w) {
+	const Coefs4 ky = coefs4(f, YR, YG, YB), ku = coefs4(f, UR, UG, UB), kv = coefs4(f, VR, VG, VB);
+	const __m256i cy = _mm256_setr_epi16(ky.c[0], ky.c[1], ky.c[2], ky.c[3], ky.c[0], ky.c[1], ky.c[2], ky.c[3],
+	                                     ky.c[0], ky.c[1], ky.c[2], ky.c[3], ky.c[0], ky.c[1], ky.c[2], ky.c[3]);
+	const __m256i cu = _mm256_setr_epi16(ku.c[0], ku.c[1], ku.c[2], ku.c[3], ku.c[0], ku.c[1], ku.c[2], ku.c[3],
+	                                     ku.c[0], ku.c[1], ku.c[2], ku.c[3], ku.c[0], ku.c[1], ku.c[2], ku.c[3]);
+	const __m256i cv = _mm256_setr_epi16(kv.c[0], kv.c[1], kv.c[2], kv.c[3], kv.c[0], kv.c[1], kv.c[2], kv.c[3],
+	                                     kv.c[0], kv.c[1], kv.c[2], kv.c[3], kv.c[0], kv.c[1], kv.c[2], kv.c[3]);
+	const __m256i z = _mm256_setzero_si256();
+	const __m256i yrnd = _mm256_set1_epi32(128), yoff = _mm256_set1_epi32(16);
+	const __m256i crnd = _mm256_set1_epi32(512), coff = _mm256_set1_epi32(128);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	int x = 0;
+	for (; x + 32 <= w; x += 32) {
+		__m256i ya[4], yb[4], up[4], vp[4];
+		for (int k = 0; k < 4; ++k) {
+			const __m256i a = _mm256_loadu_si256((const __m256i*)(rp.r0 + 4 * (size_t)(x + 8 * k)));
+			const __m256i b = _mm256_loadu_si256((const __m256i*)(rp.r1 + 4 * (size_t)(x + 8 * k)));
+			const __m256i alo = _mm256_unpacklo_epi8(a, z), ahi = _mm256_unpackhi_epi8(a, z);
+			const __m256i blo = _mm256_unpacklo_epi8(b, z), bhi = _mm256_unpackhi_epi8(b, z);
+			ya[k] = _mm256_hadd_epi32(_mm256_madd_epi16(alo, cy), _mm256_madd_epi16(ahi, cy));
+			yb[k] = _mm256_hadd_epi32(_mm256_madd_epi16(blo, cy), _mm256_madd_epi16(bhi, cy));
+			const __m256i slo = _mm256_add_epi16(alo, blo), shi = _mm256_add_epi16(ahi, bhi);
+			up[k] = _mm256_hadd_epi32(_mm256_madd_epi16(slo, cu), _mm256_madd_epi16(shi, cu));
+			vp[k] = _mm256_hadd_epi32(_mm256_madd_epi16(slo, cv), _mm256_madd_epi16(shi, cv));
+		}
+		for (int k = 0; k < 4; ++k) {
+			ya[k] = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(ya[k], yrnd), 8), yoff);
+			yb[k] = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(yb[k], yrnd), 8), yoff);
+		}
+		const __m256i y0 = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(
+			_mm256_packs_epi32(ya[0], ya[1]), _mm256_packs_epi32(ya[2], ya[3])), order);
+		_mm256_storeu_si256((__m256i*)(rp.y0 + x), y0);
+		if (rp.y1) {
+			const __m256i y1 = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(
+				_mm256_packs_epi32(yb[0], yb[1]), _mm256_packs_epi32(yb[2], yb[3])), order);
+			_mm256_storeu_si256((__m256i*)(rp.y1 + x), y1);
+		}
+
+		__m256i u0 = _mm256_hadd_epi32(up[0], up[1]), u1 = _mm256_hadd_epi32(up[2], up[3]);
+		__m256i v0 = _mm256_hadd_epi32(vp[0], vp[1]), v1 = _mm256_hadd_epi32(vp[2], vp[3]);
+		u0 = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(u0, crnd), 10), coff);
+		u1 = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(u1, crnd), 10), coff);
+		v0 = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(v0, crnd), 10), coff);
+		v1 = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(v1, crnd), 10), coff);
+		const __m256i u16 = _mm256_permutevar8x32_epi32(_mm256_packs_epi32(u0, u1), order);
+		const __m256i v16 = _mm256_permutevar8x32_epi32(_mm256_packs_epi32(v0, v1), order);
+		const __m128i u8 = _mm_packus_epi16(_mm256_castsi256_si128(u16), _mm256_extracti128_si256(u16, 1));
+		const __m128i v8 = _mm_packus_epi16(_mm256_castsi256_si128(v16), _mm256_extracti128_si256(v16, 1));
+		if (rp.uvstep == 1) {
+			_mm_storeu_si128((__m128i*)(rp.u + x / 2), u8);
+			_mm_storeu_si128((__m128i*)(rp.v + x / 2), v8);
+		} else {
+			_mm_storeu_si128((__m128i*)(rp.u + x), _mm_unpacklo_epi8(u8, v8));
+			_mm_storeu_si128((__m128i*)(rp.u + x + 16), _mm_unpackhi_epi8(u8, v8));
+		}
+	}
+	return x;
+}
+
+YuvSimd detect_cpu() {
+#if defined(_MSC_VER)
+	int info[4] = { 0, 0, 0, 0 };
+	__cpuid(info, 0);
+	const int max_leaf = info[0];
+	__cpuid(info, 1);
+	const bool sse41 = (info[2] & (1 << 19)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false;
+	if (osxsave && avx && max_leaf >= 7 && (_xgetbv(0) & 6) == 6) {   // OS saves the YMM state
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	const bool sse41 = __builtin_cpu_supports("sse4.1") != 0;
+	const bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+	if (avx2) return YuvSimd::AVX2;
+	if (sse41) return YuvSimd::SSE41;
+	return YuvSimd::Scalar;
+}
+
+#endif // GCV_YUV_X86
+
+} // namespace
+
+size_t yuv420_frame_bytes(int w, int h) {
+	if (w <= 0 || h <= 0) return 0;
+	const size_t cw = (size_t)(w + 1) / 2, ch = (size_t)(h + 1) / 2;
+	return (size_t)w * (size_t)h + 2 * cw * ch;
+}
+
+YuvSimd yuv_simd_detect() {
+#ifdef GCV_YUV_X86
+	static const YuvSimd best = detect_cpu();
+	return best;
+#else
+	return YuvSimd::Scalar;
+#endif
+}
+
+const char* yuv_simd_name(YuvSimd s) {
+	switch (s) {
+	case YuvSimd::Auto:   return "auto";
+	case YuvSimd::Scalar: return "scalar";
+	case YuvSimd::SSE41:  return "sse4.1";
+	case YuvSimd::AVX2:   return "avx2";
+	}
+	return "?";
+}
+
+void rgb_to_yuv420(const uint8_t* src, size_t src_stride, YuvSrcOrder order,
+	int w, int h, YuvLayout layout, uint8_t* dst, YuvSimd simd) {
+	if (!src || !dst || w <= 0 || h <= 0) return;
+	const YuvSimd best = yuv_simd_detect();
+	if (simd == YuvSimd::Auto || (int)simd > (int)best) simd = best;
+	if (order == YuvSrcOrder::RGB24) simd = YuvSimd::Scalar;
+	const SrcFormat f = src_format(order);
+
+	const size_t cw = (size_t)(w + 1) / 2, ch = (size_t)(h + 1) / 2;
+	uint8_t* yplane = dst;
+	uint8_t* uplane = dst + (size_t)w * (size_t)h;
+	uint8_t* vplane = uplane + cw * ch;
+
+	for (int y = 0; y < h; y += 2) {
+		RowPair rp;
+		rp.r0 = src + (size_t)y * src_stride;
+		rp.r1 = (y + 1 < h) ? rp.r0 + src_stride : rp.r0;
+		rp.y0 = yplane + (size_t)y * (size_t)w;
+		rp.y1 = (y + 1 < h) ? rp.y0 + w : nullptr;
+		if (layout == YuvLayout::NV12) {
+			rp.u = uplane + (size_t)(y / 2) * cw * 2;
+			rp.v = rp.u + 1;
+			rp.uvstep = 2;
+		} else {
+			rp.u = uplane + (size_t)(y / 2) * cw;
+			rp.v = vplane + (size_t)(y / 2) * cw;
+			rp.uvstep = 1;
+		}
+		int done = 0;
+#ifdef GCV_YUV_X86
+		if (simd == YuvSimd::AVX2) done = rows_avx2(rp, f, w);
+		if (simd >= YuvSimd::SSE41) {
+			RowPair rest = rp;   // SSE picks up what is left over after the 32-wide steps
+			rest.r0 += 4 * (size_t)done; rest.r1 += 4 * (size_t)done;
+			rest.y0 += done; if (rest.y1) rest.y1 += done;
+			rest.u += (size_t)(done / 2) * rp.uvstep; rest.v += (size_t)(done / 2) * rp.uvstep;
+			done += rows_sse41(rest, f, w - done);
+		}
+#endif
+		rows_scalar(rp, f, done, w);
+	}
+}
+
+//=================================================================================================
+// self test, run from run_utils_tests()
+
+#define RETURNFAILST(xx) return std::string("failed: ")+xx
+
+namespace {
+
+// deterministic test image: smooth gradients plus noise, random padding past each row
+std::vector<uint8_t> make_test_image(int w, int h, int bpp, size_t stride, uint32_t seed) {
+	std::vector<uint8_t> img(stride * (size_t)h);
+	uint32_t s = seed;
+	for (size_t i = 0; i < img.size(); ++i) {
+		s = s * 1664525u + 1013904223u;
+		img[i] = (uint8_t)(s >> 24);
+	}
+	for (int y = 0; y < h; ++y) {
+		for (int x = 0; x < w; ++x) {
+			uint8_t* p = &img[(size_t)y * stride + (size_t)x * bpp];
+			for (int c = 0; c < 3; ++c) {
+				const double base = 127.5 + 100.0 * std::sin(0.07 * x * (c + 1) + 0.05 * y * (3 - c));
+				const int v = (int)base + ((int)(p[c] % 17) - 8);
+				p[c] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+			}
+		}
+	}
+	return img;
+}
+
+double psnr(const std::vector<double>& ref, const uint8_t* got, size_t n) {
+	double se = 0.0;
+	for (size_t i = 0; i < n; ++i) { const double d = ref[i] - (double)got[i]; se += d * d; }
+	if (se <= 0.0) return 1e9;
+	return 10.0 * std::log10(255.0 * 255.0 / (se / (double)n));
+}
+
+} // namespace
+
+std::string run_yuv_convert_tests() {
+	const int sizes[][2] = { { 64, 4 }, { 96, 6 }, { 33, 7 }, { 1, 1 }, { 31, 2 }, { 2, 3 }, { 130, 17 } };
+	const YuvSrcOrder orders[] = { YuvSrcOrder::BGRA, YuvSrcOrder::RGBA, YuvSrcOrder::RGB24 };
+	const YuvLayout layouts[] = { YuvLayout::I420, YuvLayout::NV12 };
+	const YuvSimd best = yuv_simd_detect();
+
+	for (const auto& sz : sizes) {
+		const int w = sz[0], h = sz[1];
+		for (YuvSrcOrder order : orders) {
+			const int bpp = src_format(order).bpp;
+			const size_t stride = (size_t)w * bpp + 12;
+			const std::vector<uint8_t> img = make_test_image(w, h, bpp, stride, (uint32_t)(w * 131 + h));
+			for (YuvLayout layout : layouts) {
+				std::vector<uint8_t> ref(yuv420_frame_bytes(w, h)), got(ref.size());
+				rgb_to_yuv420(img.data(), stride, order, w, h, layout, ref.data(), YuvSimd::Scalar);
+				for (int s = (int)YuvSimd::SSE41; s <= (int)best; ++s) {
+					std::memset(got.data(), 0xCD, got.size());
+					rgb_to_yuv420(img.data(), stride, order, w, h, layout, got.data(), (YuvSimd)s);
+					if (got != ref) RETURNFAILST(std::string("yuv420 ") + yuv_simd_name((YuvSimd)s) + " != scalar at "
+						+ std::to_string(w) + "x" + std::to_string(h));
+				}
+			}
+		}
+	}
+
+	// extremes hit the nominal range exactly
+	{
+		const uint8_t px[2][8] = { { 255, 255, 255, 255, 255, 255, 255, 255 }, { 0, 0, 0, 255, 0, 0, 0, 255 } };
+		const uint8_t want_y[2] = { 235, 16 };
+		for (int i = 0; i < 2; ++i) {
+			uint8_t out[6];
+			rgb_to_yuv420(px[i], 8, YuvSrcOrder::BGRA, 2, 1, YuvLayout::I420, out);
+			if (out[0] != want_y[i] || out[1] != want_y[i] || out[2] != 128 || out[3] != 128)
+				RETURNFAILST("yuv420 black/white levels");
+		}
+	}
+
+	// quality vs floating-point BT.601 (chroma from the 2x2 mean): only rounding error should remain
+	{
+		const int w = 200, h = 120;
+		const size_t stride = (size_t)w * 4;
+		const std::vector<uint8_t> img = make_test_image(w, h, 4, stride, 7u);
+		std::vector<uint8_t> out(yuv420_frame_bytes(w, h));
+		rgb_to_yuv420(img.data(), stride, YuvSrcOrder::BGRA, w, h, YuvLayout::I420, out.data());
+		const int cw = w / 2, ch = h / 2;
+		std::vector<double> ry((size_t)w * h), ru((size_t)cw * ch), rv((size_t)cw * ch);
+		auto px = [&](int x, int y, int c) { return (double)img[(size_t)y * stride + (size_t)x * 4 + c]; };
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+				ry[(size_t)y * w + x] = 16.0 + (65.481 * px(x, y, 2) + 128.553 * px(x, y, 1) + 24.966 * px(x, y, 0)) / 255.0;
+		for (int y = 0; y < ch; ++y) {
+			for (int x = 0; x < cw; ++x) {
+				double r = 0, g = 0, b = 0;
+				for (int dy = 0; dy < 2; ++dy)
+					for (int dx = 0; dx < 2; ++dx) {
+						r += px(2 * x + dx, 2 * y + dy, 2); g += px(2 * x + dx, 2 * y + dy, 1); b += px(2 * x + dx, 2 * y + dy, 0);
+					}
+				r /= 4.0; g /= 4.0; b /= 4.0;
+				ru[(size_t)y * cw + x] = 128.0 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255.0;
+				rv[(size_t)y * cw + x] = 128.0 + (112.0 * r - 93.786 * g - 18.214 * b) / 255.0;
+			}
+		}
+		const uint8_t* yp = out.data();
+		const uint8_t* up = yp + (size_t)w * h;
+		const uint8_t* vp = up + (size_t)cw * ch;
+		if (psnr(ry, yp, ry.size()) < 48.0) RETURNFAILST("yuv420 luma PSNR");
+		if (psnr(ru, up, ru.size()) < 45.0) RETURNFAILST("yuv420 U PSNR");
+		if (psnr(rv, vp, rv.size()) < 45.0) RETURNFAILST("yuv420 V PSNR");
+	}
+	return std::string("ok");
+}
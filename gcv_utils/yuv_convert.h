@@ -0,0 +1,44 @@
+#pragma once
+// Copyright (C) 2022 Jason Bunk
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 8-bit RGB -> YUV 4:2:0 (BT.601, limited range), the layout ffmpeg's rawvideo "yuv420p"/"nv12" expect.
+// Each 2x2 block shares one chroma sample computed from the sum of its four pixels; for odd
+// widths/heights the last column/row is replicated. All code paths use the same fixed-point
+// arithmetic, so the SIMD kernels are bit-exact with the scalar reference.
+
+enum class YuvLayout {
+	I420,   // Y plane, then U plane, then V plane (ffmpeg yuv420p)
+	NV12,   // Y plane, then interleaved UV plane
+};
+
+enum class YuvSrcOrder {
+	BGRA,
+	RGBA,
+	RGB24,  // 3 bytes per pixel, scalar path only
+};
+
+enum class YuvSimd {
+	Auto,   // best available on this CPU
+	Scalar,
+	SSE41,
+	AVX2,
+};
+
+// Y plane w*h bytes, then two chroma planes of ceil(w/2)*ceil(h/2) bytes (or one interleaved)
+size_t yuv420_frame_bytes(int w, int h);
+
+// Best kernel this CPU supports (never returns Auto)
+YuvSimd yuv_simd_detect();
+const char* yuv_simd_name(YuvSimd s);
+
+// src rows are src_stride bytes apart; dst receives the tightly packed planes (yuv420_frame_bytes).
+// A request for a kernel the CPU lacks falls back to the best available one.
+void rgb_to_yuv420(const uint8_t* src, size_t src_stride, YuvSrcOrder order,
+	int w, int h, YuvLayout layout, uint8_t* dst, YuvSimd simd = YuvSimd::Auto);
+
+// return error string if test failed; "ok" otherwise
+// (SIMD kernels vs scalar reference bit-exact, scalar vs floating-point BT.601 by PSNR)
+std::string run_yuv_convert_tests();
@@ -0,0 +1,150 @@
+"""
+Decoder for depth16.mkv, the lossless 16-bit depth video written during F7 recordings.
+The quantization (curve, near, far) is stored under "depth16" in the recording's meta.json;
+the mapping mirrors gcv_reshade/depth_quant.cpp.
+
+    from gcv_depth16 import Depth16Video
+    v = Depth16Video("actions_xxx")                # directory with meta.json and depth16.mkv
+    for frame_idx, depth in v:                     # depth: (H, W) float32 in the raw depth's units
+        ...
+
+Decoding runs ffmpeg (must be on PATH). Run as a script to measure the round-trip error against
+depth.gcvd from the same recording:
+
+    python gcv_depth16.py actions_xxx [--max-frames N]
+"""
+import json
+import os
+import subprocess
+
+import numpy as np
+
+CODE_MAX = 65535
+
+
+def codes_to_depth(codes, curve, near, far):
+    """uint16 codes -> float32 depth (inverse of depth_to_codes)."""
+    t = np.asarray(codes, dtype=np.float64) / CODE_MAX
+    near, far = float(near), float(far)
+    if curve == "linear":
+        d = near + t * (far - near)
+    elif curve == "log":
+        d = near * np.power(far / near, t)
+    elif curve == "inverse":
+        inear = 1.0 / near
+        d = 1.0 / (inear - t * (inear - 1.0 / far))
+    else:
+        raise ValueError(f"unknown depth16 curve {curve!r}")
+    return d.astype(np.float32)
+
+
+def depth_to_codes(depth, curve, near, far):
+    """float depth -> uint16 codes like quantize_depth16 (NaN -> far, clamped to [near, far]).
+    The log curve can differ by one code where libm and numpy round log() differently."""
+    d = np.asarray(depth, dtype=np.float32)
+    near, far = np.float32(near), np.float32(far)
+    with np.errstate(divide="ignore", invalid="ignore"):
+        if curve == "linear":
+            t = (d - near) * (np.float32(1) / (far - near))
+        elif curve == "log":
+            t = (np.log(d) - np.log(near)) * (np.float32(1) / (np.log(far) - np.log(near)))
+        elif curve == "inverse":
+            inear = np.float32(1) / near
+            t = (inear - np.float32(1) / d) * (np.float32(1) / (inear - np.float32(1) / far))
+        else:
+            raise ValueError(f"unknown depth16 curve {curve!r}")
+        if curve != "linear":
+            t = np.where(d > 0, t, np.float32(0))
+    t = np.where(np.isnan(d), np.float32(1), t)
+    t = np.clip(np.nan_to_num(t, nan=0.0, posinf=1.0, neginf=0.0), 0.0, 1.0)
+    return (t * np.float32(CODE_MAX) + np.float32(0.5)).astype(np.uint16)
+
+
+def expand_frame_ranges(ranges):
+    """meta.json "frame_ranges" ([[first, last], ...] inclusive) -> list of recorder frame indices."""
+    out = []
+    for first, last in ranges:
+        out.extend(range(int(first), int(last) + 1))
+    return out
+
+
+def _probe_size(path):
+    r = subprocess.run(
+        ["ffprobe", "-v", "error", "-select_streams", "v:0", "-show_entries", "stream=width,height",
+         "-of", "csv=p=0", path], capture_output=True, text=True, check=True)
+    w, h = r.stdout.strip().split(",")[:2]
+    return int(w), int(h)
+
+
+class Depth16Video:
+    def __init__(self, rec_dir, meta=None):
+        if meta is None:
+            with open(os.path.join(rec_dir, "meta.json"), "r", encoding="utf-8") as f:
+                meta = json.load(f)
+        if "depth16" not in meta:
+            raise ValueError("meta.json has no depth16 section (recording made without the 16-bit depth stream)")
+        self.params = meta["depth16"]
+        self.curve = self.params["curve"]
+        self.near = float(self.params["near"])
+        self.far = float(self.params["far"])
+        self.path = os.path.join(rec_dir, self.params.get("file", "depth16.mkv"))
+        self.frame_indices = expand_frame_ranges(self.params.get("frame_ranges", []))
+        self.width, self.height = _probe_size(self.path)
+
+    def codes(self):
+        """Yields the raw (H, W) uint16 code images in video order."""
+        cmd = ["ffmpeg", "-v", "error", "-i", self.path, "-f", "rawvideo", "-pix_fmt", "gray16le", "pipe:1"]
+        nbytes = self.width * self.height * 2
+        with subprocess.Popen(cmd, stdout=subprocess.PIPE) as p:
+            try:
+                while True:
+                    buf = p.stdout.read(nbytes)
+                    if len(buf) < nbytes:
+                        break
+                    yield np.frombuffer(buf, dtype="<u2").reshape(self.height, self.width)
+            finally:
+                p.stdout.close()
+                p.kill()
+
+    def __iter__(self):
+        """Yields (frame_idx, depth float32) with frame_idx from meta.json (None past its end)."""
+        for k, c in enumerate(self.codes()):
+            idx = self.frame_indices[k] if k < len(self.frame_indices) else None
+            yield idx, codes_to_depth(c, self.curve, self.near, self.far)
+
+
+def roundtrip_error(rec_dir, max_frames=None):
+    """Compares depth16.mkv against depth.gcvd frame by frame; returns a dict of error statistics."""
+    from gcv_depth_reader import GcvDepthReader
+    v = Depth16Video(rec_dir)
+    abs_err, rel_err, n = [], [], 0
+    with GcvDepthReader(os.path.join(rec_dir, "depth.gcvd")) as r:
+        for idx, dec in v:
+            if max_frames is not None and n >= max_frames:
+                break
+            i = r.find(idx) if idx is not None else None
+            if i is None:
+                continue
+            ref = r.read(i)
+            ok = np.isfinite(ref) & (ref >= v.near) & (ref <= v.far)
+            if not ok.any():
+                continue
+            e = np.abs(dec[ok].astype(np.float64) - ref[ok])
+            abs_err.append(e.max())
+            rel_err.append((e / np.maximum(np.abs(ref[ok]), 1e-12)).max())
+            n += 1
+    return {
+        "frames_compared": n,
+        "max_abs_err": float(max(abs_err)) if abs_err else None,
+        "max_rel_err": float(max(rel_err)) if rel_err else None,
+        "curve": v.curve, "near": v.near, "far": v.far,
+    }
+
+
+if __name__ == "__main__":
+    import argparse
+    ap = argparse.ArgumentParser(description="round-trip error of depth16.mkv against depth.gcvd")
+    ap.add_argument("rec_dir")
+    ap.add_argument("--max-frames", type=int, default=None)
+    args = ap.parse_args()
+    print(json.dumps(roundtrip_error(args.rec_dir, args.max_frames), indent=2))
@@ -0,0 +1,330 @@
+"""
+Reader for depth.gcvd, the chunked depth container written by the recorder (F7 mode).
+Layout is documented in gcv_reshade/depth_chunk_writer.h.
+
+    from gcv_depth_reader import GcvDepthReader
+    with GcvDepthReader("actions_xxx/depth.gcvd") as r:
+        print(len(r), r.frame_indices[:5])
+        d = r.read(0)                       # (H, W) float32
+        for frame_idx, t_us, depth in r:    # sequential
+            ...
+
+Version 2 files code all but the first frame of a chunk against the frame before it
+(gcv_utils/depth_delta_codec.h); read(i) then decodes from the chunk's keyframe, sequential reads
+reuse the previous frame. load_gcvz() reads the single-frame .gcvz files of F9 recordings.
+
+Uses the `lz4` package when installed (pip install lz4), otherwise a slow pure-python decoder.
+
+    python gcv_depth_reader.py actions_xxx/depth.gcvd [--bench]   # --bench: ratio of each codec on these frames
+    python gcv_depth_reader.py --selftest --writer EXE            # decodes the files of gcv_depth_writer
+                                                                   # (gcv_reshade/tools) bit-exactly
+"""
+import os
+import struct
+
+try:
+    import lz4.block as _lz4block
+except ImportError:
+    _lz4block = None
+
+FILE_HEADER = struct.Struct("<8sIIIIII")     # magic, version, header_bytes, fps, frames_per_chunk, dtype, reserved
+CHUNK_HEADER = struct.Struct("<4sIII")       # magic, num_frames, width, height
+FRAME_ENTRY = struct.Struct("<QqQII")        # frame_idx, timestamp_us, stored_bytes, codec, reserved
+INDEX_ENTRY = struct.Struct("<QQQII")        # offset, first_frame_idx, last_frame_idx, num_frames, reserved
+TRAILER = struct.Struct("<QQ8s")             # index_offset, num_chunks, magic
+
+CODEC_RAW = 0
+CODEC_LZ4 = 1
+CODEC_KEY = 2      # predicted from the left neighbour, zigzag, byte planes, lz4
+CODEC_DELTA = 3    # predicted from the previous frame (+ left neighbour's change)
+
+GCVZ_HEADER = struct.Struct("<4sIIIIIQ")    # magic, version, width, height, codec, reserved, stored_bytes
+
+
+def lz4_block_decompress_py(src, raw_size):
+    """Plain LZ4 block format decoder, used when the lz4 package is missing."""
+    dst = bytearray()
+    i, n = 0, len(src)
+    while i < n:
+        token = src[i]
+        i += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                b = src[i]
+                i += 1
+                lit += b
+                if b != 255:
+                    break
+        dst += src[i:i + lit]
+        i += lit
+        if i >= n:
+            break
+        off = src[i] | (src[i + 1] << 8)
+        i += 2
+        ml = token & 15
+        if ml == 15:
+            while True:
+                b = src[i]
+                i += 1
+                ml += b
+                if b != 255:
+                    break
+        ml += 4
+        start = len(dst) - off
+        if off >= ml:
+            dst += dst[start:start + ml]
+        else:
+            for k in range(ml):
+                dst.append(dst[start + k])
+    if len(dst) != raw_size:
+        raise ValueError(f"lz4: decoded {len(dst)} bytes, expected {raw_size}")
+    return bytes(dst)
+
+
+def _lz4_decompress(payload, raw_size):
+    if _lz4block is not None:
+        return _lz4block.decompress(payload, uncompressed_size=raw_size)
+    return lz4_block_decompress_py(payload, raw_size)
+
+
+def _unpredict(planes, w, h, prev_bits=None):
+    """depth_codec_decode after LZ4: byte planes -> zigzag residuals -> float32 bit patterns (uint32)."""
+    import numpy as np
+    z = np.frombuffer(planes, dtype=np.uint8).reshape(4, h * w).T.copy().view("<u4").reshape(h, w)
+    d = (z >> np.uint32(1)) ^ (np.uint32(0) - (z & np.uint32(1)))
+    with np.errstate(over="ignore"):
+        if prev_bits is None:
+            d[:, 0] = np.cumsum(d[:, 0], dtype=np.uint32)        # first column: from the pixel above
+            return np.cumsum(d, axis=1, dtype=np.uint32)          # then along the row
+        return prev_bits + np.cumsum(d, axis=1, dtype=np.uint32)
+
+
+def _predict(bits, prev_bits=None):
+    """Inverse of _unpredict (used by the benchmark): uint32 (h, w) -> byte planes."""
+    import numpy as np
+    with np.errstate(over="ignore"):
+        if prev_bits is None:
+            d = bits.copy()
+            d[:, 1:] -= bits[:, :-1]
+            d[1:, 0] -= bits[:-1, 0]
+        else:
+            t = bits - prev_bits
+            d = t.copy()
+            d[:, 1:] -= t[:, :-1]
+    z = (d << np.uint32(1)) ^ (d.view("<i4") >> 31).view("<u4")
+    return np.ascontiguousarray(z.reshape(-1).view(np.uint8).reshape(-1, 4).T).tobytes()
+
+
+def _decompress(codec, payload, raw_size, w=0, h=0, prev=None):
+    if codec == CODEC_RAW:
+        return payload
+    if codec == CODEC_LZ4:
+        return _lz4_decompress(payload, raw_size)
+    if codec in (CODEC_KEY, CODEC_DELTA):
+        import numpy as np
+        prev_bits = None
+        if codec == CODEC_DELTA:
+            if prev is None:
+                raise ValueError("delta frame without its previous frame")
+            prev_bits = np.frombuffer(prev, dtype="<u4").reshape(h, w)
+        return _unpredict(_lz4_decompress(payload, raw_size), w, h, prev_bits).tobytes()
+    raise ValueError(f"unknown depth codec {codec}")
+
+
+def load_gcvz(path):
+    """frame_XXXXXX_depth.gcvz -> (H, W) float32"""
+    import numpy as np
+    with open(path, "rb") as f:
+        magic, _, w, h, codec, _, stored = GCVZ_HEADER.unpack(f.read(GCVZ_HEADER.size))
+        if magic != b"GCVZ":
+            raise ValueError(f"{path}: not a .gcvz file")
+        raw = _decompress(codec, f.read(stored), w * h * 4, w, h)
+    return np.frombuffer(raw, dtype="<f4").reshape(h, w)
+
+
+class GcvDepthReader:
+    def __init__(self, path):
+        self.path = path
+        self._f = open(path, "rb")
+        hdr = self._f.read(FILE_HEADER.size)
+        magic, self.version, header_bytes, self.fps, self.frames_per_chunk, self.dtype, _ = FILE_HEADER.unpack(hdr)
+        if magic != b"GCVDEPTH":
+            raise ValueError(f"{path}: not a depth.gcvd file")
+        self._data_start = header_bytes
+        self._file_size = os.fstat(self._f.fileno()).st_size
+
+        # per frame: (frame_idx, timestamp_us, offset, stored_bytes, codec, width, height, chunk's first position)
+        self._frames = []
+        self._last = (None, None)   # (position, decoded bytes) of the last frame read
+        self.complete = self._load_index()
+        if not self.complete:
+            self._scan_chunks()   # recording was cut short: walk the chunk headers instead
+
+    def _load_index(self):
+        if self._file_size < self._data_start + TRAILER.size:
+            return False
+        self._f.seek(self._file_size - TRAILER.size)
+        index_offset, num_chunks, magic = TRAILER.unpack(self._f.read(TRAILER.size))
+        if magic != b"GCVDIDX1" or index_offset + num_chunks * INDEX_ENTRY.size + TRAILER.size != self._file_size:
+            return False
+        self._f.seek(index_offset)
+        raw = self._f.read(num_chunks * INDEX_ENTRY.size)
+        for k in range(num_chunks):
+            offset = INDEX_ENTRY.unpack_from(raw, k * INDEX_ENTRY.size)[0]
+            self._read_chunk_table(offset)
+        return True
+
+    def _scan_chunks(self):
+        self._frames = []
+        offset = self._data_start
+        while offset + CHUNK_HEADER.size <= self._file_size:
+            end = self._read_chunk_table(offset)
+            if end is None or end > self._file_size:
+                break
+            offset = end
+
+    def _read_chunk_table(self, offset):
+        """Appends the chunk's frames to self._frames, returns the offset just past the chunk."""
+        self._f.seek(offset)
+        buf = self._f.read(CHUNK_HEADER.size)
+        if len(buf) < CHUNK_HEADER.size:
+            return None
+        magic, nf, w, h = CHUNK_HEADER.unpack(buf)
+        if magic != b"GCVC":
+            return None
+        table = self._f.read(nf * FRAME_ENTRY.size)
+        if len(table) < nf * FRAME_ENTRY.size:
+            return None
+        pos = offset + CHUNK_HEADER.size + nf * FRAME_ENTRY.size
+        first = len(self._frames)
+        frames = []
+        for k in range(nf):
+            frame_idx, t_us, stored, codec, _ = FRAME_ENTRY.unpack_from(table, k * FRAME_ENTRY.size)
+            frames.append((frame_idx, t_us, pos, stored, codec, w, h, first))
+            pos += stored
+        if pos > self._file_size:
+            return None   # truncated chunk
+        self._frames.extend(frames)
+        return pos
+
+    def __len__(self):
+        return len(self._frames)
+
+    @property
+    def frame_indices(self):
+        return [fr[0] for fr in self._frames]
+
+    @property
+    def timestamps_us(self):
+        return [fr[1] for fr in self._frames]
+
+    def shape(self, i):
+        return self._frames[i][6], self._frames[i][5]
+
+    def read_bytes(self, i):
+        """Decompressed float32 bytes of the i-th stored frame (row-major, height x width)."""
+        fr = self._frames[i]
+        start, prev = i, None
+        if fr[4] == CODEC_DELTA:
+            # decode forward from the chunk's keyframe, or from the frame read last if it is on the way
+            last_i, last_bytes = self._last
+            if last_i is not None and fr[7] <= last_i < i:
+                start, prev = last_i + 1, last_bytes
+            else:
+                start = fr[7]
+        for k in range(start, i + 1):
+            _, _, offset, stored, codec, w, h, _ = self._frames[k]
+            self._f.seek(offset)
+            prev = _decompress(codec, self._f.read(stored), w * h * 4, w, h, prev)
+            self._last = (k, prev)
+        return prev
+
+    def read(self, i):
+        import numpy as np
+        h, w = self.shape(i)
+        return np.frombuffer(self.read_bytes(i), dtype="<f4").reshape(h, w)
+
+    def find(self, frame_idx):
+        """Position of the recorder frame index frame_idx, or None."""
+        for i, fr in enumerate(self._frames):
+            if fr[0] == frame_idx:
+                return i
+        return None
+
+    def __iter__(self):
+        for i, fr in enumerate(self._frames):
+            yield fr[0], fr[1], self.read(i)
+
+    def close(self):
+        self._f.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+def bench_codecs(reader, max_frames=96, keyframe_interval=8):
+    """Compression ratio of plain lz4, keyframes only and keyframe + delta on recorded frames
+    (needs the lz4 package). Throughput is measured by the C++ benchmark in the overlay."""
+    import numpy as np
+    if _lz4block is None:
+        raise RuntimeError("bench needs the lz4 package (pip install lz4)")
+    n = min(len(reader), max_frames)
+    raw, sizes, prev = 0, [0, 0, 0], None
+    for i in range(n):
+        d = reader.read(i)
+        if prev is not None and prev.shape != d.shape:
+            prev = None
+        bits = np.ascontiguousarray(d).view("<u4")
+        raw += bits.nbytes
+        sizes[0] += len(_lz4block.compress(bits.tobytes(), store_size=False))
+        sizes[1] += len(_lz4block.compress(_predict(bits), store_size=False))
+        delta_prev = prev if (prev is not None and i % keyframe_interval != 0) else None
+        sizes[2] += len(_lz4block.compress(_predict(bits, delta_prev), store_size=False))
+        prev = bits
+    return {name: raw / max(1, s) for name, s in zip(["lz4", "keyframes only", "keyframe+delta"], sizes)}
+
+
+def _selftest(writer):
+    """Decodes the depth_v1.gcvd / depth_v2.gcvd of writer (a gcv_depth_writer executable, the C++
+    DepthChunkWriter) and compares every frame with expected.f32, the frames it pushed."""
+    import subprocess
+    import tempfile
+    ok = True
+    with tempfile.TemporaryDirectory() as tmp:
+        subprocess.run([writer, tmp], check=True)
+        with open(os.path.join(tmp, "expected.f32"), "rb") as f:
+            expected = f.read()
+        for name, version, codecs in (("depth_v1.gcvd", 1, {CODEC_RAW, CODEC_LZ4}),
+                                      ("depth_v2.gcvd", 2, {CODEC_RAW, CODEC_KEY, CODEC_DELTA})):
+            with GcvDepthReader(os.path.join(tmp, name)) as r:
+                got = b"".join(r.read_bytes(i) for i in range(len(r)))
+                used = {fr[4] for fr in r._frames}
+                shapes = {r.shape(i) for i in range(len(r))}
+                good = (r.complete and r.version == version and used == codecs and got == expected
+                        and shapes == {(48, 64), (30, 40)})
+                # a frame read out of order decodes from its chunk's keyframe
+                good = good and r.read_bytes(len(r) - 1) == expected[-40 * 30 * 4:] and \
+                    r.read_bytes(1) == expected[64 * 48 * 4:2 * 64 * 48 * 4]
+            print(f"{name}: {len(r)} frames, codecs {sorted(used)}", "ok" if good else "FAILED")
+            ok = ok and good
+    print("selftest", "passed" if ok else "FAILED")
+    return ok
+
+
+if __name__ == "__main__":
+    import sys
+    if len(sys.argv) >= 2 and sys.argv[1] == "--selftest":
+        if len(sys.argv) < 4 or sys.argv[2] != "--writer":
+            sys.exit("usage: gcv_depth_reader.py --selftest --writer EXE")
+        sys.exit(0 if _selftest(sys.argv[3]) else 1)
+    with GcvDepthReader(sys.argv[1]) as r:
+        print(f"{r.path}: {len(r)} frames, fps={r.fps}, version {r.version}, index={'ok' if r.complete else 'missing (scanned)'}")
+        if len(r):
+            print(f"  frame_idx {r.frame_indices[0]} .. {r.frame_indices[-1]}, shape {r.shape(0)}")
+        if "--bench" in sys.argv[2:] and len(r):
+            for name, ratio in bench_codecs(r).items():
+                print(f"  {name:16s} ratio {ratio:6.2f}")
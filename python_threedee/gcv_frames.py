@@ -0,0 +1,210 @@
+"""
+Reader for frames.bin, the per-frame binary sidecar of a recording (pose, fov, keys, timestamps,
+drop flags; one fixed-size record per recorded frame). Layout: gcv_reshade/frame_sidecar.h.
+
+    from gcv_frames import load_frames
+    fr = load_frames("actions_xxx/frames.bin")    # numpy memmap, no copy
+    fr["cam2world"]                               # (N, 3, 4) float64
+    fr["time_us"][fr["flags"] & CAM_GOOD != 0]
+
+The converters rebuild the text layouts the recorder writes (cam.jsonl, actions.csv,
+frame_XXXXXX_camera.json), so existing tools keep working on recordings that only have frames.bin:
+
+    python gcv_frames.py actions_xxx [--cam-jsonl] [--actions-csv] [--camera-json] [--out DIR]
+"""
+import json
+import os
+
+import numpy as np
+
+MAGIC = b"GCVFRAME"
+VERSION = 1
+
+# GcvFrameFlags
+CAM_VALID = 1 << 0
+CAM_GOOD = 1 << 1
+FOV_V = 1 << 2
+FOV_H = 1 << 3
+KEYS = 1 << 4
+COLOR_DROPPED = 1 << 5
+CONTROL_LATE = 1 << 6
+DEPTH_LATE = 1 << 7
+COLOR_REPEAT = 1 << 8
+DEPTH_REPEAT = 1 << 9
+NO_COLOR = 1 << 10          # capture profiles: streams not due at this frame
+NO_DEPTH = 1 << 11
+NO_POSE = 1 << 12
+SEGMENTATION = 1 << 13      # a segmentation snapshot was taken at this frame
+GOV_RATE = 1 << 14          # capture governor: color/depth below their rate (divisor: governor_divisor)
+GOV_DEPTH_BITS = 1 << 15    # raw depth mantissa cut to the governor's min_depth_bits (meta.json)
+GOV_DEPTH_FAST = 1 << 16    # depth.gcvd without delta coding (lossless)
+DEPTH_DROPPED = 1 << 17     # depth was due but not read back (capture pipeline full)
+GOV_LEVEL_SHIFT = 20        # 4 bits: governor steps in effect, 0 = full quality
+GOV_DIVISOR_SHIFT = 24      # 4 bits: every n-th due color/depth frame captured (0 = 1)
+
+HEADER_DTYPE = np.dtype([
+    ("magic", "S8"),
+    ("version", "<u4"),
+    ("header_bytes", "<u4"),
+    ("record_bytes", "<u4"),
+    ("fps", "<u4"),
+    ("num_records", "<u8"),
+    ("reserved", "V32"),
+])
+
+RECORD_DTYPE = np.dtype([
+    ("frame_idx", "<u8"),
+    ("time_us", "<i8"),
+    ("cam_time_us", "<i8"),
+    ("cam2world", "<f8", (3, 4)),
+    ("fov_v_degrees", "<f8"),
+    ("fov_h_degrees", "<f8"),
+    ("letters_mask", "<u4"),
+    ("modifiers_mask", "<u4"),
+    ("flags", "<u4"),
+    ("img_w", "<u4"),
+    ("img_h", "<u4"),
+    ("color_run", "<u2"),
+    ("depth_run", "<u2"),
+])
+
+assert HEADER_DTYPE.itemsize == 64 and RECORD_DTYPE.itemsize == 160
+
+MODIFIERS = ["shift", "ctrl", "alt", "space", "enter", "escape", "tab"]
+CSV_HEADER = ",".join(["frame_idx", "time_us"] + [chr(ord("A") + i) for i in range(26)] + MODIFIERS)
+
+
+def read_header(path):
+    hdr = np.fromfile(path, dtype=HEADER_DTYPE, count=1)
+    if hdr.size != 1 or hdr["magic"][0] != MAGIC:
+        raise ValueError(f"{path}: not a frames.bin file")
+    hdr = hdr[0]
+    if int(hdr["version"]) != VERSION:
+        raise ValueError(f"{path}: unsupported frames.bin version {int(hdr['version'])}")
+    if int(hdr["record_bytes"]) != RECORD_DTYPE.itemsize:
+        raise ValueError(f"{path}: record size {int(hdr['record_bytes'])}, expected {RECORD_DTYPE.itemsize}")
+    return hdr
+
+
+def load_frames(path):
+    """Memory-maps the records of frames.bin (read-only). Only the num_records committed in the
+    header are exposed, so a file still being written, or left behind by a crash, loads fine."""
+    if os.path.isdir(path):
+        path = os.path.join(path, "frames.bin")
+    hdr = read_header(path)
+    n = int(hdr["num_records"])
+    if n == 0:
+        return np.zeros(0, dtype=RECORD_DTYPE)
+    return np.memmap(path, dtype=RECORD_DTYPE, mode="r", offset=int(hdr["header_bytes"]), shape=(n,))
+
+
+def key_matrix(frames):
+    """(N, 33) uint8, the A..Z + modifier columns of actions.csv."""
+    letters = (frames["letters_mask"][:, None] >> np.arange(26, dtype=np.uint32)) & 1
+    mods = (frames["modifiers_mask"][:, None] >> np.arange(7, dtype=np.uint32)) & 1
+    return np.concatenate([letters, mods], axis=1).astype(np.uint8)
+
+
+def governor_level(frames):
+    """Capture governor steps in effect at each record (0: full quality; GOV_* flags say which)."""
+    return ((frames["flags"] >> GOV_LEVEL_SHIFT) & 0xF).astype(np.uint8)
+
+
+def governor_divisor(frames):
+    """Rate divisor of the governor at each record: 1, or n for every n-th due color/depth frame."""
+    return np.maximum((frames["flags"] >> GOV_DIVISOR_SHIFT) & 0xF, 1).astype(np.uint8)
+
+
+def source_frame_idx(frames, repeat_flag=COLOR_REPEAT):
+    """frame_idx whose stored picture each record shows: itself, or for a repeat (recordings with
+    "Skip identical consecutive frames") the last stored frame before it. -1 where there is none."""
+    idx = frames["frame_idx"].astype(np.int64)
+    stored = (frames["flags"] & repeat_flag) == 0
+    src = np.where(stored, idx, -1)
+    # forward-fill the last stored index over each run of repeats
+    pos = np.maximum.accumulate(np.where(stored, np.arange(len(src)), -1))
+    return np.where(pos >= 0, src[np.maximum(pos, 0)], -1)
+
+
+def camera_dict(rec):
+    """One record -> the dict the recorder writes to cam.jsonl / frame_XXXXXX_camera.json."""
+    flags = int(rec["flags"])
+    d = {}
+    if flags & CAM_VALID:
+        key = "extrinsic_cam2world" if flags & CAM_GOOD else "extrinsic_WIP"
+        d[key] = [float(v) for v in np.asarray(rec["cam2world"]).reshape(-1)]
+        if flags & FOV_H:
+            d["fov_h_degrees"] = float(rec["fov_h_degrees"])
+        if flags & FOV_V:
+            d["fov_v_degrees"] = float(rec["fov_v_degrees"])
+    else:
+        d["cam_status"] = "uninitialized"
+    d["frame_idx"] = int(rec["frame_idx"])
+    d["img_h"] = int(rec["img_h"])
+    d["img_w"] = int(rec["img_w"])
+    d["time_us"] = int(rec["time_us"])
+    return d
+
+
+def _dump(d):
+    return json.dumps(d, sort_keys=True, separators=(",", ":"))
+
+
+def to_cam_jsonl(frames, out_path):
+    """cam.jsonl: one line per frame whose camera and depth sampling were on time."""
+    late = CONTROL_LATE | DEPTH_LATE | NO_POSE
+    with open(out_path, "w", encoding="utf-8", newline="\n") as f:
+        for rec in frames:
+            if int(rec["flags"]) & late:
+                continue
+            f.write(_dump(camera_dict(rec)) + "\n")
+
+
+def to_actions_csv(frames, out_path):
+    """actions.csv: one row per frame with sampled keys (F7 recordings)."""
+    sel = frames[(frames["flags"] & KEYS) != 0]
+    keys = key_matrix(sel)
+    with open(out_path, "w", encoding="utf-8", newline="\n") as f:
+        f.write(CSV_HEADER + "\n")
+        for rec, k in zip(sel, keys):
+            f.write(f"{int(rec['frame_idx'])},{int(rec['time_us'])}," + ",".join(map(str, k.tolist())) + "\n")
+
+
+def to_camera_json_files(frames, out_dir):
+    """frame_XXXXXX_camera.json for every frame with a pose."""
+    os.makedirs(out_dir, exist_ok=True)
+    for rec in frames:
+        if not int(rec["flags"]) & CAM_VALID:
+            continue
+        name = f"frame_{int(rec['frame_idx']):06d}_camera.json"
+        with open(os.path.join(out_dir, name), "w", encoding="utf-8") as f:
+            f.write(_dump(camera_dict(rec)) + "\n")
+
+
+if __name__ == "__main__":
+    import argparse
+    ap = argparse.ArgumentParser(description="convert frames.bin back to cam.jsonl / actions.csv / per-frame camera json")
+    ap.add_argument("rec_dir", help="recording directory (or the frames.bin file)")
+    ap.add_argument("--out", default=None, help="output directory (default: next to frames.bin)")
+    ap.add_argument("--cam-jsonl", action="store_true")
+    ap.add_argument("--actions-csv", action="store_true")
+    ap.add_argument("--camera-json", action="store_true")
+    args = ap.parse_args()
+
+    src = args.rec_dir if os.path.isfile(args.rec_dir) else os.path.join(args.rec_dir, "frames.bin")
+    out = args.out or os.path.dirname(os.path.abspath(src))
+    os.makedirs(out, exist_ok=True)
+    fr = load_frames(src)
+    hdr = read_header(src)
+    print(f"{src}: {len(fr)} records, fps {int(hdr['fps'])}, "
+          f"{int(np.count_nonzero(fr['flags'] & CAM_GOOD))} good poses, "
+          f"{int(np.count_nonzero(fr['flags'] & COLOR_DROPPED))} color drops, "
+          f"{int(np.count_nonzero(fr['flags'] & DEPTH_DROPPED))} depth drops, "
+          f"{int(np.count_nonzero(fr['flags'] & COLOR_REPEAT))} color repeats, "
+          f"{int(np.count_nonzero(governor_level(fr)))} degraded by the governor")
+    if args.cam_jsonl:
+        to_cam_jsonl(fr, os.path.join(out, "cam.jsonl"))
+    if args.actions_csv:
+        to_actions_csv(fr, os.path.join(out, "actions.csv"))
+    if args.camera_json:
+        to_camera_json_files(fr, out)
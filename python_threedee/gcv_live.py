@@ -0,0 +1,401 @@
+"""
+Consumer for the live frame stream the recorder publishes in shared memory while recording
+("Live stream" in the overlay): pose, keys, color and raw depth of every frame, without disk or
+ffmpeg. Layout and protocol: gcv_reshade/live_stream.h.
+
+    from gcv_live import LiveStream
+    with LiveStream("default") as s:
+        for fr in s.frames():                  # newest frames as they arrive (skips what it missed)
+            depth = fr.depth                   # (H, W) float32 view into shared memory, no copy
+            rgb = fr.rgb()                     # (H, W, 3) uint8 copy
+            if fr.valid():                     # still the same frame (producer did not lap us)?
+                use(fr.frame_idx, fr.cam2world, depth, rgb)
+
+The producer never waits for readers. Views stay valid until the producer comes back around to
+the slot (slot_count frames later); check fr.valid() after using them, or take fr.copy().
+
+    python gcv_live.py [NAME]                       # print what arrives
+    python gcv_live.py --selftest                   # producer and consumer in separate processes
+    python gcv_live.py --selftest --producer EXE    # ... against the addon's writer (gcv_live_producer,
+                                                    #     built by gcv_reshade/tools/CMakeLists.txt)
+"""
+import mmap
+import os
+import struct
+import sys
+import time
+
+import numpy as np
+
+MAGIC = b"GCVLIVE1"
+STATE_OPEN = 1
+STATE_CLOSED = 2
+
+# FrameFormat (gcv_reshade/frame_pool.h)
+FMT_BGRA, FMT_GRAY8, FMT_I420, FMT_NV12, FMT_GRAY16 = 0, 1, 2, 3, 4
+
+HEADER_DTYPE = np.dtype([
+    ("magic", "S8"),
+    ("version", "<u4"),
+    ("header_bytes", "<u4"),
+    ("slot_count", "<u4"),
+    ("slot_header_bytes", "<u4"),
+    ("slot_stride", "<u8"),
+    ("color_capacity", "<u8"),
+    ("depth_capacity", "<u8"),
+    ("fps", "<u4"),
+    ("producer_pid", "<u4"),
+    ("stream_id", "<u8"),
+    ("published", "<u8"),
+    ("state", "<u4"),
+    ("reserved", "V52"),
+])
+
+SLOT_DTYPE = np.dtype([
+    ("seq", "<u8"),
+    ("frame_idx", "<u8"),
+    ("time_us", "<i8"),
+    ("cam_time_us", "<i8"),
+    ("cam2world", "<f8", (3, 4)),
+    ("fov_v_degrees", "<f8"),
+    ("fov_h_degrees", "<f8"),
+    ("flags", "<u4"),
+    ("letters_mask", "<u4"),
+    ("modifiers_mask", "<u4"),
+    ("color_format", "<u4"),
+    ("color_w", "<u4"),
+    ("color_h", "<u4"),
+    ("color_stride", "<u4"),
+    ("depth_w", "<u4"),
+    ("depth_h", "<u4"),
+    ("reserved0", "<u4"),
+    ("color_bytes", "<u8"),
+    ("depth_bytes", "<u8"),
+    ("reserved", "V56"),
+])
+
+assert HEADER_DTYPE.itemsize == 128 and SLOT_DTYPE.itemsize == 256
+
+_PUBLISHED = HEADER_DTYPE.fields["published"][1]
+_STATE = HEADER_DTYPE.fields["state"][1]
+
+
+def _align(n, a):
+    return (n + a - 1) // a * a
+
+
+def _map(name, size=None, write=False):
+    """Maps the stream's shared memory (the whole object if size is None, POSIX only)."""
+    if os.name == "nt":
+        access = mmap.ACCESS_WRITE if write else mmap.ACCESS_READ
+        return mmap.mmap(-1, size or HEADER_DTYPE.itemsize, tagname=f"Local\\gcv_live_{name}", access=access)
+    path = f"/dev/shm/gcv_live_{name}"
+    fd = os.open(path, os.O_RDWR if write else os.O_RDONLY)
+    try:
+        size = size or os.fstat(fd).st_size
+        prot = mmap.PROT_READ | (mmap.PROT_WRITE if write else 0)
+        return mmap.mmap(fd, size, flags=mmap.MAP_SHARED, prot=prot)
+    finally:
+        os.close(fd)
+
+
+class LiveFrame:
+    """Frame n of the stream, as numpy views into its slot."""
+
+    def __init__(self, stream, n, seq, meta, color, depth):
+        self._stream, self.n, self._seq = stream, n, seq
+        self.meta = meta                       # SLOT_DTYPE record (view)
+        self.frame_idx = int(meta["frame_idx"])
+        self.time_us = int(meta["time_us"])
+        self.cam2world = meta["cam2world"]     # (3, 4) float64
+        self.flags = int(meta["flags"])
+        self.color_raw = color                 # uint8 bytes as produced (see color_format), or None
+        self.depth = depth                     # (H, W) float32, or None
+
+    def valid(self):
+        """True while the slot still holds this frame (everything read so far is consistent)."""
+        return self._stream._slot_seq(self.n) == self._seq
+
+    @property
+    def color_format(self):
+        return int(self.meta["color_format"])
+
+    def color_planes(self):
+        """Views of the color buffer: (H, W, 4) BGRA, or (Y, U, V) for I420, or (Y, UV) for NV12."""
+        if self.color_raw is None:
+            return None
+        w, h, s = int(self.meta["color_w"]), int(self.meta["color_h"]), int(self.meta["color_stride"])
+        fmt = self.color_format
+        if fmt == FMT_BGRA:
+            return self.color_raw[:h * s].reshape(h, s)[:, :w * 4].reshape(h, w, 4)
+        if fmt in (FMT_I420, FMT_NV12):
+            cw, ch = (w + 1) // 2, (h + 1) // 2
+            y = self.color_raw[:h * s].reshape(h, s)[:, :w]
+            rest = self.color_raw[h * s:]
+            if fmt == FMT_NV12:
+                return y, rest[:ch * cw * 2].reshape(ch, cw, 2)
+            return y, rest[:ch * cw].reshape(ch, cw), rest[ch * cw:2 * ch * cw].reshape(ch, cw)
+        if fmt == FMT_GRAY8:
+            return self.color_raw[:h * s].reshape(h, s)[:, :w]
+        raise ValueError(f"unsupported color format {fmt}")
+
+    def rgb(self):
+        """(H, W, 3) uint8 copy; YUV is converted back with BT.601 limited range (as encoded)."""
+        planes = self.color_planes()
+        if planes is None:
+            return None
+        fmt = self.color_format
+        if fmt == FMT_BGRA:
+            return planes[:, :, 2::-1].copy()
+        if fmt == FMT_GRAY8:
+            return np.repeat(planes[:, :, None], 3, axis=2)
+        y = planes[0].astype(np.float32)
+        if fmt == FMT_NV12:
+            u, v = planes[1][:, :, 0], planes[1][:, :, 1]
+        else:
+            u, v = planes[1], planes[2]
+        h, w = y.shape
+        u = np.repeat(np.repeat(u, 2, 0), 2, 1)[:h, :w].astype(np.float32) - 128.0
+        v = np.repeat(np.repeat(v, 2, 0), 2, 1)[:h, :w].astype(np.float32) - 128.0
+        c = 1.164 * (y - 16.0)
+        out = np.stack([c + 1.596 * v, c - 0.392 * u - 0.813 * v, c + 2.017 * u], axis=2)
+        return np.clip(out + 0.5, 0, 255).astype(np.uint8)
+
+    def copy(self):
+        """dict of copies of the frame's arrays, or None if the producer overwrote the slot meanwhile."""
+        d = {"frame_idx": self.frame_idx, "time_us": self.time_us, "flags": self.flags,
+             "cam2world": np.array(self.cam2world),
+             "color": None if self.color_raw is None else self.color_raw.copy(),
+             "depth": None if self.depth is None else self.depth.copy()}
+        return d if self.valid() else None
+
+
+class LiveStream:
+    def __init__(self, name="default", wait_s=0.0):
+        self.name = name
+        deadline = time.monotonic() + wait_s
+        while True:
+            try:
+                self._open()
+                break
+            except (FileNotFoundError, OSError, ValueError):
+                if time.monotonic() >= deadline:
+                    raise
+                time.sleep(0.05)
+
+    def _open(self):
+        head = _map(self.name)
+        hdr = np.frombuffer(head, dtype=HEADER_DTYPE, count=1)[0]
+        if hdr["magic"] != MAGIC:
+            raise ValueError(f"gcv_live_{self.name}: not (yet) a live stream")
+        self.header = hdr.copy()
+        size = int(hdr["header_bytes"]) + int(hdr["slot_count"]) * int(hdr["slot_stride"])
+        if os.name == "nt":
+            del hdr
+            head.close()
+            head = _map(self.name, size)
+        self._mm = head
+        self.slot_count = int(self.header["slot_count"])
+        self.stream_id = int(self.header["stream_id"])
+        self._slot0 = int(self.header["header_bytes"])
+        self._stride = int(self.header["slot_stride"])
+        self._color_off = int(self.header["slot_header_bytes"])
+        self._depth_off = self._color_off + _align(int(self.header["color_capacity"]), 64)
+
+    def close(self):
+        try:
+            self._mm.close()
+        except BufferError:
+            pass    # frames still reference the mapping; it goes away with them
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    @property
+    def published(self):
+        return struct.unpack_from("<Q", self._mm, _PUBLISHED)[0]
+
+    @property
+    def closed(self):
+        return struct.unpack_from("<I", self._mm, _STATE)[0] == STATE_CLOSED
+
+    def _slot_off(self, n):
+        return self._slot0 + (n % self.slot_count) * self._stride
+
+    def _slot_seq(self, n):
+        return struct.unpack_from("<Q", self._mm, self._slot_off(n))[0]
+
+    def frame(self, n):
+        """Frame n (0-based publish order) if its slot still holds it, else None."""
+        seq = self._slot_seq(n)
+        if seq != 2 * (n + 1):
+            return None
+        off = self._slot_off(n)
+        meta = np.frombuffer(self._mm, dtype=SLOT_DTYPE, count=1, offset=off)[0]
+        cb, db = int(meta["color_bytes"]), int(meta["depth_bytes"])
+        color = np.frombuffer(self._mm, dtype=np.uint8, count=cb, offset=off + self._color_off) if cb else None
+        depth = None
+        if db:
+            depth = np.frombuffer(self._mm, dtype="<f4", count=db // 4, offset=off + self._depth_off)
+            depth = depth.reshape(int(meta["depth_h"]), int(meta["depth_w"]))
+        fr = LiveFrame(self, n, seq, meta, color, depth)
+        return fr if fr.valid() else None
+
+    def latest(self):
+        for _ in range(8):
+            p = self.published
+            if p == 0:
+                return None
+            fr = self.frame(p - 1)
+            if fr is not None:
+                return fr
+        return None
+
+    def frames(self, timeout_s=None, poll_s=0.0005):
+        """Yields the newest frame each time a new one is published; ends when the producer closes
+        the stream or nothing arrives for timeout_s. self.skipped counts frames never yielded."""
+        self.skipped = 0
+        last = None
+        t_last = time.monotonic()
+        while True:
+            p = self.published
+            if last is None or p - 1 > last:
+                fr = self.latest()
+                if fr is not None and (last is None or fr.n > last):
+                    if last is not None:
+                        self.skipped += fr.n - last - 1
+                    last = fr.n
+                    t_last = time.monotonic()
+                    yield fr
+                    continue
+            if self.closed and (last is None or self.published - 1 <= last):
+                return
+            if timeout_s is not None and time.monotonic() - t_last > timeout_s:
+                return
+            time.sleep(poll_s)
+
+
+class _DemoProducer:
+    """Writes the layout the recorder writes, for testing consumers without the game."""
+
+    def __init__(self, name, slots, color_shape, depth_shape):
+        h, w = color_shape
+        dh, dw = depth_shape
+        self.color_cap, self.depth_cap = h * w * 4, dh * dw * 4
+        self.slots = slots
+        self.stride = _align(SLOT_DTYPE.itemsize + _align(self.color_cap, 64) + _align(self.depth_cap, 64), 4096)
+        size = HEADER_DTYPE.itemsize + slots * self.stride
+        if os.name == "nt":
+            self.mm = _map(name, size, write=True)
+        else:
+            path = f"/dev/shm/gcv_live_{name}"
+            if os.path.exists(path):
+                os.unlink(path)
+            with open(path, "wb") as f:
+                f.truncate(size)
+            self.path = path
+            self.mm = _map(name, size, write=True)
+        hdr = np.zeros(1, dtype=HEADER_DTYPE)
+        hdr["version"], hdr["header_bytes"], hdr["slot_count"] = 1, HEADER_DTYPE.itemsize, slots
+        hdr["slot_header_bytes"], hdr["slot_stride"] = SLOT_DTYPE.itemsize, self.stride
+        hdr["color_capacity"], hdr["depth_capacity"], hdr["fps"] = self.color_cap, self.depth_cap, 60
+        hdr["producer_pid"], hdr["stream_id"], hdr["state"] = os.getpid(), time.monotonic_ns(), STATE_OPEN
+        b = hdr.tobytes()
+        self.mm[8:len(b)] = b[8:]
+        self.mm[0:8] = MAGIC
+        self.n = 0
+        self.color_shape, self.depth_shape = color_shape, depth_shape
+
+    def publish(self, frame_idx, value):
+        off = HEADER_DTYPE.itemsize + (self.n % self.slots) * self.stride
+        struct.pack_into("<Q", self.mm, off, 2 * self.n + 1)
+        meta = np.zeros(1, dtype=SLOT_DTYPE)
+        h, w = self.color_shape
+        dh, dw = self.depth_shape
+        meta["frame_idx"], meta["time_us"] = frame_idx, int(time.monotonic() * 1e6)
+        meta["cam2world"] = np.full((3, 4), float(value))
+        meta["color_format"], meta["color_w"], meta["color_h"], meta["color_stride"] = FMT_BGRA, w, h, w * 4
+        meta["depth_w"], meta["depth_h"] = dw, dh
+        meta["color_bytes"], meta["depth_bytes"] = self.color_cap, self.depth_cap
+        self.mm[off + 8:off + SLOT_DTYPE.itemsize] = meta.tobytes()[8:]
+        c = off + SLOT_DTYPE.itemsize
+        self.mm[c:c + self.color_cap] = bytes([value & 0xFF]) * self.color_cap
+        d = c + _align(self.color_cap, 64)
+        self.mm[d:d + self.depth_cap] = np.full(dh * dw, float(value), dtype="<f4").tobytes()
+        self.n += 1
+        struct.pack_into("<Q", self.mm, off, 2 * self.n)
+        struct.pack_into("<Q", self.mm, _PUBLISHED, self.n)
+
+    def close(self):
+        struct.pack_into("<I", self.mm, _STATE, STATE_CLOSED)
+        self.mm.close()
+        if os.name != "nt":
+            os.unlink(self.path)
+
+
+def _demo_producer_main(name, frames, fps):
+    p = _DemoProducer(name, slots=4, color_shape=(360, 640), depth_shape=(360, 640))
+    worst = 0.0
+    t0 = time.monotonic()
+    for k in range(frames):
+        t = time.monotonic()
+        p.publish(k, k + 1)
+        worst = max(worst, time.monotonic() - t)
+        time.sleep(max(0.0, t0 + (k + 1) / fps - time.monotonic()))
+    p.close()
+    print(f"producer: {frames} frames, slowest publish {worst * 1e3:.2f} ms")
+
+
+def _selftest(producer=None):
+    """Producer in a child process, deliberately slow consumer here. Every frame the consumer
+    accepts (valid() after reading) must be internally consistent; torn frames must be rejected.
+    producer: a gcv_live_producer executable (the C++ LiveStreamWriter, same frame pattern) to
+    run instead of _DemoProducer."""
+    import subprocess
+    name = f"selftest_{os.getpid()}"
+    frames = 300
+    if producer:
+        prod = subprocess.Popen([producer, name, str(frames)])
+    else:
+        prod = subprocess.Popen([sys.executable, os.path.abspath(__file__), "--demo-producer", name, str(frames)])
+    accepted = rejected = bad = 0
+    try:
+        with LiveStream(name, wait_s=10.0) as s:
+            for i, fr in enumerate(s.frames(timeout_s=5.0)):
+                value = int(fr.cam2world[0, 0])
+                if i % 3 == 0:
+                    time.sleep(0.03)          # slower than the producer: it laps this slot
+                c = fr.copy()
+                if c is None:
+                    rejected += 1
+                    continue
+                accepted += 1
+                if not (np.all(c["color"] == (value & 0xFF)) and np.all(c["depth"] == value)
+                        and c["frame_idx"] == value - 1):
+                    bad += 1
+            skipped = s.skipped
+    finally:
+        prod.wait(timeout=60)
+    print(f"consumer: {accepted} frames accepted, {rejected} rejected as overwritten, {skipped} skipped, {bad} inconsistent")
+    ok = prod.returncode == 0 and accepted > 0 and bad == 0
+    print("selftest", "passed" if ok else "FAILED")
+    return ok
+
+
+if __name__ == "__main__":
+    if len(sys.argv) >= 4 and sys.argv[1] == "--demo-producer":
+        _demo_producer_main(sys.argv[2], int(sys.argv[3]), fps=120)
+    elif len(sys.argv) >= 2 and sys.argv[1] == "--selftest":
+        producer = sys.argv[3] if len(sys.argv) >= 4 and sys.argv[2] == "--producer" else None
+        sys.exit(0 if _selftest(producer) else 1)
+    else:
+        name = sys.argv[1] if len(sys.argv) > 1 else "default"
+        with LiveStream(name, wait_s=30.0) as s:
+            print(f"gcv_live_{name}: {s.slot_count} slots, producer pid {int(s.header['producer_pid'])}")
+            for fr in s.frames(timeout_s=10.0):
+                d = fr.depth
+                print(f"frame {fr.frame_idx} t={fr.time_us} us, color {None if fr.color_raw is None else fr.color_raw.size} B, "
+                      f"depth {None if d is None else d.shape}, skipped {s.skipped}")
@@ -0,0 +1,85 @@
+"""
+Reader for segments.json, the index of a recording whose color video was encoded in parallel as
+GOP-aligned segments (capture_seg_XXXXXX.mp4, see "Parallel color encoders" in the overlay).
+
+    from gcv_segments import load_segments, locate
+    idx = load_segments("actions_xxx")
+    locate(idx, frame_idx)        # -> ("capture_seg_000003.mp4", local_frame) or None
+
+Every segment lists the recorder frame indices (the frame_idx of cam.jsonl / frames.bin) it holds as
+inclusive runs; local frame k of a segment is the k-th index covered by its runs. To join the
+segments into one capture.mp4 without re-encoding:
+
+    python gcv_segments.py actions_xxx [--concat]
+"""
+import bisect
+import json
+import os
+import subprocess
+
+
+def load_segments(rec_dir):
+    path = rec_dir if os.path.isfile(rec_dir) else os.path.join(rec_dir, "segments.json")
+    with open(path, "r", encoding="utf-8") as f:
+        idx = json.load(f)
+    if int(idx.get("version", 0)) != 1:
+        raise ValueError(f"{path}: unsupported segments.json version {idx.get('version')}")
+    idx["_dir"] = os.path.dirname(os.path.abspath(path))
+    # flat, sorted (first, last, segment, local offset) table for locate()
+    table = []
+    for s in idx["segments"]:
+        local = 0
+        for first, last in s["frame_ranges"]:
+            table.append((int(first), int(last), s, local))
+            local += int(last) - int(first) + 1
+    table.sort(key=lambda t: t[0])
+    idx["_table"] = table
+    idx["_firsts"] = [t[0] for t in table]
+    return idx
+
+
+def locate(idx, frame_idx):
+    """recorder frame index -> (segment file, frame within that file), None if it has no video frame
+    (dropped, or its segment failed to encode)."""
+    i = bisect.bisect_right(idx["_firsts"], frame_idx) - 1
+    if i < 0:
+        return None
+    first, last, seg, local = idx["_table"][i]
+    if frame_idx > last or not seg["ok"]:
+        return None
+    return seg["file"], local + frame_idx - first
+
+
+def concat_frame(idx, frame_idx):
+    """recorder frame index -> frame number in the joined capture.mp4 (None if not in it)."""
+    hit = locate(idx, frame_idx)
+    if hit is None:
+        return None
+    seg = next(s for s in idx["segments"] if s["file"] == hit[0])
+    return int(seg["concat_frame_offset"]) + hit[1]
+
+
+def concat(idx, out_path=None, ffmpeg="ffmpeg"):
+    """Stream-copies the successful segments into one mp4 using capture_segments.ffconcat."""
+    out_path = out_path or os.path.join(idx["_dir"], "capture.mp4")
+    cmd = [ffmpeg, "-hide_banner", "-loglevel", "error", "-y", "-f", "concat", "-safe", "0",
+           "-i", os.path.join(idx["_dir"], idx["concat"]), "-c", "copy", "-movflags", "+faststart", out_path]
+    subprocess.run(cmd, check=True)
+    return out_path
+
+
+if __name__ == "__main__":
+    import argparse
+    ap = argparse.ArgumentParser(description="inspect / join the color segments of a recording")
+    ap.add_argument("rec_dir", help="recording directory (or its segments.json)")
+    ap.add_argument("--concat", action="store_true", help="join the segments into capture.mp4 (needs ffmpeg on PATH)")
+    ap.add_argument("--out", default=None, help="output file for --concat")
+    args = ap.parse_args()
+
+    idx = load_segments(args.rec_dir)
+    segs = idx["segments"]
+    failed = [s["index"] for s in segs if not s["ok"]]
+    print(f"{len(segs)} segments of {idx['segment_frames']} frames on {idx['encoders']} encoders, "
+          f"{idx['video_frames']} video frames, {len(failed)} failed {failed if failed else ''}")
+    if args.concat:
+        print(concat(idx, args.out))
@@ -1,7 +1,7 @@
 #!/usr/bin/env python3
 import os
 import cv2
-import h5py
+from gcv_depth_reader import GcvDepthReader
 import numpy as np
 from PIL import Image
 import argparse
@@ -9,7 +9,7 @@ from tqdm import tqdm
 
 def unpack_data_to_frames(data_dir, output_dir=None):
     """
-    将 Cyberpunk 2077 的 capture.mp4 + depth_group_*.h5 + camera.json
+    将 Cyberpunk 2077 的 capture.mp4 + depth.gcvd + camera.json
     解包为每帧独立的:
         frame_XXXXXX_depth.npy
         frame_XXXXXX_RGB.png
@@ -19,39 +19,30 @@ def unpack_data_to_frames(data_dir, output_dir=None):
         output_dir = data_dir
 
     video_path = os.path.join(data_dir, "capture.mp4")
-    # depth_dir = data_dir
+    depth_dir = data_dir
     cam_dir = data_dir
     rgb_output_dir = output_dir
-    # depth_output_dir = output_dir
+    depth_output_dir = output_dir
 
     os.makedirs(rgb_output_dir, exist_ok=True)
-    # os.makedirs(depth_output_dir, exist_ok=True)
-
-    # print("🔍 扫描 depth_group_*.h5 文件...")
-    # depth_files = sorted(f for f in os.listdir(depth_dir) if f.startswith("depth_group_") and f.endswith(".h5"))
-    # assert len(depth_files) > 0, f"未找到 depth_group_*.h5 文件于 {depth_dir}"
-
-    # # === Step 1: 从 .h5 提取 depth 帧 ===
-    # global_frame_idx = 0
-    # print("📦 解包 depth 数据...")
-    # for h5_file in tqdm(depth_files, desc="Processing depth chunks"):
-    #     h5_path = os.path.join(depth_dir, h5_file)
-    #     with h5py.File(h5_path, 'r') as hf:
-    #         assert 'depth' in hf, f"'depth' dataset not found in {h5_file}"
-    #         depth_stack = hf['depth'][:]  # shape: (N, H, W)
-
-    #         for i in range(depth_stack.shape[0]):
-    #             frame_id = global_frame_idx + i
-    #             depth_data = depth_stack[i]  # (H, W)
-
-    #             # 保存为 .npy
-    #             depth_filename = os.path.join(depth_output_dir, f"frame_{frame_id:06d}_depth.npy")
-    #             np.save(depth_filename, depth_data.astype(np.float32))
-
-    #     global_frame_idx += depth_stack.shape[0]
-
-    # total_frames = global_frame_idx
-    # print(f"✅ 共提取 {total_frames} 帧 depth 数据.")
+    os.makedirs(depth_output_dir, exist_ok=True)
+
+    # === Step 1: 从 depth.gcvd 提取 depth 帧 ===
+    # 文件名沿用录制时的 frame_idx，与 camera.json / actions.csv 对齐
+    total_frames = 0
+    depth_path = os.path.join(depth_dir, "depth.gcvd")
+    if os.path.isfile(depth_path):
+        print("📦 解包 depth 数据...")
+        with GcvDepthReader(depth_path) as r:
+            if not r.complete:
+                print("⚠️ depth.gcvd 没有索引（录制可能被中断），已按顺序扫描")
+            for frame_id, _t_us, depth_data in tqdm(r, total=len(r), desc="Processing depth frames"):
+                depth_filename = os.path.join(depth_output_dir, f"frame_{frame_id:06d}_depth.npy")
+                np.save(depth_filename, depth_data.astype(np.float32))
+            total_frames = len(r)
+        print(f"✅ 共提取 {total_frames} 帧 depth 数据.")
+    else:
+        print("⚠️ 未找到 depth.gcvd，跳过 depth 解包")
 
     # === Step 2: 从视频提取 RGB 图像 ===
     print("🎥 解包 RGB 视频帧...")
@@ -59,8 +50,8 @@ def unpack_data_to_frames(data_dir, output_dir=None):
     assert cap.isOpened(), f"无法打开视频文件: {video_path}"
 
     total_video_frames = int(cap.get(cv2.CAP_PROP_FRAME_COUNT))
-    # assert total_video_frames >= total_frames, \
-    #     f"视频帧数 ({total_video_frames}) 少于 depth 帧数 ({total_frames})"
+    if total_frames and total_video_frames < total_frames:
+        print(f"⚠️ 视频帧数 ({total_video_frames}) 少于 depth 帧数 ({total_frames})")
 
     for frame_idx in tqdm(range(total_video_frames), desc="Extracting RGB frames"):
         ret, bgr = cap.read()
@@ -100,8 +91,8 @@ def unpack_data_to_frames(data_dir, output_dir=None):
 
 
 if __name__ == '__main__':
-    parser = argparse.ArgumentParser(description="将 Cyberpunk 2077 的 h5+mp4 数据解包为每帧独立文件")
-    parser.add_argument("data_dir", help="包含 capture.mp4 和 depth_group_*.h5 的目录")
+    parser = argparse.ArgumentParser(description="将 Cyberpunk 2077 的 depth.gcvd+mp4 数据解包为每帧独立文件")
+    parser.add_argument("data_dir", help="包含 capture.mp4 和 depth.gcvd 的目录")
     parser.add_argument("--output_dir", type=str, default=None, help="输出目录（默认为 data_dir）")
     args = parser.parse_args()
 